@@ -0,0 +1,102 @@
+#pragma once
+
+#include <d3d11.h>
+#include <vector>
+
+#include "D3D11DynamicBuffer.h"
+#include "../Common/DrawBatcher.h"
+#include "../Common/RingVertexAllocator.h"
+#include "../Common/Telemetry.h"
+
+// Issues batched draws on a D3D11 context. Vertices are streamed through
+// the ring allocator; shaders and layouts are looked up by the index they
+// were registered under.
+class D3D11DrawBackend : public DrawBackend
+{
+public:
+    D3D11DrawBackend(ID3D11DeviceContext *devcon, D3D11DynamicBuffer *stream, RingVertexAllocator *ring) :
+        _devcon(devcon),
+        _stream(stream),
+        _ring(ring),
+        _topology(BatchTopology_TriangleList)
+    {
+    }
+
+    unsigned RegisterVertexShader(ID3D11VertexShader *shader)
+    {
+        _vertexShaders.push_back(shader);
+        return (unsigned)_vertexShaders.size() - 1;
+    }
+
+    unsigned RegisterPixelShader(ID3D11PixelShader *shader)
+    {
+        _pixelShaders.push_back(shader);
+        return (unsigned)_pixelShaders.size() - 1;
+    }
+
+    unsigned RegisterInputLayout(ID3D11InputLayout *layout)
+    {
+        _inputLayouts.push_back(layout);
+        return (unsigned)_inputLayouts.size() - 1;
+    }
+
+    void SetState(const DrawStateKey &key)
+    {
+        static const D3D11_PRIMITIVE_TOPOLOGY topologies[] =
+        {
+            D3D11_PRIMITIVE_TOPOLOGY_POINTLIST,         // BatchTopology_PointList
+            D3D11_PRIMITIVE_TOPOLOGY_LINELIST,          // BatchTopology_LineList
+            D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST,      // BatchTopology_TriangleList
+            D3D11_PRIMITIVE_TOPOLOGY_LINESTRIP,         // BatchTopology_LineStrip
+            D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP      // BatchTopology_TriangleStrip
+        };
+
+        ID3D11Buffer *buffer = _stream->Buffer();
+        UINT stride = key.stride;
+        UINT offset = 0;
+        _devcon->IASetVertexBuffers(0, 1, &buffer, &stride, &offset);
+        _devcon->IASetPrimitiveTopology(topologies[key.topology]);
+        _devcon->IASetInputLayout(_inputLayouts[key.inputLayout]);
+        _devcon->VSSetShader(_vertexShaders[key.vertexShader], 0, 0);
+        _devcon->PSSetShader(_pixelShaders[key.pixelShader], 0, 0);
+        _topology = key.topology;
+    }
+
+    bool UploadVertices(const void *data, size_t bytes, unsigned stride, unsigned *firstVertex)
+    {
+        // aligned to the stride so the offset is a whole vertex
+        size_t offset;
+        if (!_ring->Upload(data, bytes, stride, &offset))
+            return false;
+
+        *firstVertex = (unsigned)(offset / stride);
+        Telemetry::Add(Telemetry_UploadBytes, bytes);
+        return true;
+    }
+
+    void Draw(unsigned vertexCount, unsigned firstVertex)
+    {
+        _devcon->Draw(vertexCount, firstVertex);
+
+        unsigned primitives;
+        switch (_topology)
+        {
+        case BatchTopology_PointList:       primitives = vertexCount; break;
+        case BatchTopology_LineList:        primitives = vertexCount / 2; break;
+        case BatchTopology_LineStrip:       primitives = vertexCount > 1 ? vertexCount - 1 : 0; break;
+        case BatchTopology_TriangleStrip:   primitives = vertexCount > 2 ? vertexCount - 2 : 0; break;
+        default:                            primitives = vertexCount / 3; break;
+        }
+        Telemetry::Add(Telemetry_DrawCalls);
+        Telemetry::Add(Telemetry_Primitives, primitives);
+    }
+
+private:
+    ID3D11DeviceContext *_devcon;
+    D3D11DynamicBuffer *_stream;
+    RingVertexAllocator *_ring;
+    std::vector<ID3D11VertexShader*> _vertexShaders;
+    std::vector<ID3D11PixelShader*> _pixelShaders;
+    std::vector<ID3D11InputLayout*> _inputLayouts;
+    unsigned _topology;         // of the last SetState, for counting primitives
+};
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <d3d11.h>
+
+#include "../Common/DynamicBuffer.h"
+
+// Dynamic vertex buffer on a D3D11 device. Frame fences are event queries,
+// one per frame in flight.
+class D3D11DynamicBuffer : public DynamicBufferBackend
+{
+public:
+    static const UINT MaxFramesInFlight = 3;
+
+    D3D11DynamicBuffer() :
+        _dev(NULL),
+        _devcon(NULL),
+        _buffer(NULL),
+        _capacity(0),
+        _completedFrame(0)
+    {
+        ZeroMemory(_fences, sizeof(_fences));
+        ZeroMemory(_fenceFrames, sizeof(_fenceFrames));
+    }
+
+    ~D3D11DynamicBuffer()
+    {
+        Release();
+    }
+
+    HRESULT Create(ID3D11Device *dev, ID3D11DeviceContext *devcon, UINT byteWidth)
+    {
+        _dev = dev;
+        _devcon = devcon;
+        _capacity = byteWidth;
+
+        D3D11_BUFFER_DESC buffer;
+        ZeroMemory(&buffer, sizeof(buffer));
+
+        buffer.Usage = D3D11_USAGE_DYNAMIC;                // write access access by CPU and GPU
+        buffer.ByteWidth = byteWidth;
+        buffer.BindFlags = D3D11_BIND_VERTEX_BUFFER;       // use as a vertex buffer
+        buffer.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;    // allow CPU to write in buffer
+
+        HRESULT hr = dev->CreateBuffer(&buffer, NULL, &_buffer);
+
+        D3D11_QUERY_DESC query;
+        query.Query = D3D11_QUERY_EVENT;
+        query.MiscFlags = 0;
+        for (UINT i = 0; SUCCEEDED(hr) && i < MaxFramesInFlight; i++)
+        {
+            hr = dev->CreateQuery(&query, &_fences[i]);
+        }
+        return hr;
+    }
+
+    void Release()
+    {
+        for (UINT i = 0; i < MaxFramesInFlight; i++)
+        {
+            if (_fences[i])
+            {
+                _fences[i]->Release();
+                _fences[i] = NULL;
+            }
+        }
+        if (_buffer)
+        {
+            _buffer->Release();
+            _buffer = NULL;
+        }
+    }
+
+    ID3D11Buffer *Buffer() const { return _buffer; }
+
+    size_t Capacity() const { return _capacity; }
+
+    // D3D11 renames dynamic buffers on MAP_WRITE_DISCARD
+    bool SupportsDiscard() const { return true; }
+
+    unsigned char* Map(DynamicMapMode mode)
+    {
+        D3D11_MAPPED_SUBRESOURCE ms;
+        D3D11_MAP type = mode == DynamicMap_Discard ? D3D11_MAP_WRITE_DISCARD : D3D11_MAP_WRITE_NO_OVERWRITE;
+        if (FAILED(_devcon->Map(_buffer, 0, type, 0, &ms)))
+        {
+            return NULL;
+        }
+        return (unsigned char*)ms.pData;
+    }
+
+    void Unmap()
+    {
+        _devcon->Unmap(_buffer, 0);
+    }
+
+    void SignalFrame(unsigned long long frame)
+    {
+        UINT slot = (UINT)(frame % MaxFramesInFlight);
+        // Reusing a slot means that frame is as good as done
+        if (_fenceFrames[slot] != 0)
+        {
+            WaitForFrame(_fenceFrames[slot]);
+        }
+        _devcon->End(_fences[slot]);
+        _fenceFrames[slot] = frame;
+    }
+
+    unsigned long long CompletedFrame()
+    {
+        for (UINT i = 0; i < MaxFramesInFlight; i++)
+        {
+            Poll(i, D3D11_ASYNC_GETDATA_DONOTFLUSH);
+        }
+        return _completedFrame;
+    }
+
+    void WaitForFrame(unsigned long long frame)
+    {
+        while (_completedFrame < frame)
+        {
+            UINT slot = (UINT)(frame % MaxFramesInFlight);
+            if (_fenceFrames[slot] != frame)
+            {
+                break;
+            }
+            if (!Poll(slot, 0))
+            {
+                YieldProcessor();
+            }
+        }
+    }
+
+private:
+    ID3D11Device *_dev;
+    ID3D11DeviceContext *_devcon;
+    ID3D11Buffer *_buffer;
+    ID3D11Query *_fences[MaxFramesInFlight];
+    unsigned long long _fenceFrames[MaxFramesInFlight];
+    size_t _capacity;
+    unsigned long long _completedFrame;
+
+    // Returns true once the fence in the slot has passed
+    bool Poll(UINT slot, UINT flags)
+    {
+        if (_fenceFrames[slot] == 0)
+        {
+            return true;
+        }
+        BOOL done = FALSE;
+        if (_devcon->GetData(_fences[slot], &done, sizeof(done), flags) == S_OK && done)
+        {
+            if (_fenceFrames[slot] > _completedFrame)
+            {
+                _completedFrame = _fenceFrames[slot];
+            }
+            _fenceFrames[slot] = 0;
+            return true;
+        }
+        return false;
+    }
+};
@@ -1,14 +1,36 @@
 // include the basic windows header files and the Direct3D header files
 #include <windows.h>
 #include <windowsx.h>
+#include <stdio.h>
 #include <d3d11.h>
 #include <d3dx11.h>
 #include <d3dx10.h>
 
+#include "D3D11DynamicBuffer.h"
+#include "D3D11DrawBackend.h"
+#include "../Common/RingVertexAllocator.h"
+#include "../Common/PackedVertex.h"
+#include "../Common/ShaderCache.h"
+#include "../Common/DrawBatcher.h"
+#include "../Common/SpscQueue.h"
+#include "../Common/Profiler.h"
+#include "../Common/FrameScheduler.h"
+#include "../Common/Telemetry.h"
+#include "../Common/VecMath.h"
+
 // define the screen resolution
 #define SCREEN_WIDTH  800
 #define SCREEN_HEIGHT 600
 
+// size of the streaming vertex buffer, in vertices
+#define MAX_STREAMED_VERTICES 65536
+
+// frames the input thread may queue ahead of the render thread
+#define MAX_FRAMES_IN_FLIGHT 2
+
+// vertices carried by one frame packet
+#define MAX_PACKET_VERTICES 64
+
 // global declarations
 IDXGISwapChain *swapchain;             // the pointer to the swap chain interface
 ID3D11Device *dev;                     // the pointer to our Direct3D device interface
@@ -17,17 +39,50 @@ ID3D11RenderTargetView *backbuffer;    // the pointer to our back buffer
 ID3D11InputLayout *pLayout;            // the pointer to the input layout
 ID3D11VertexShader *pVS;               // the pointer to the vertex shader
 ID3D11PixelShader *pPS;                // the pointer to the pixel shader
-ID3D11Buffer *pVBuffer;                // the pointer to the vertex buffer
+D3D11DynamicBuffer vertexStream;       // the dynamic buffer geometry is streamed through
+RingVertexAllocator *pVertexRing;      // hands out per-frame ranges of vertexStream
+D3D11DrawBackend *pDrawBackend;        // issues the batcher's draws on devcon
+DrawBatcher batcher;                   // merges the frame's draws by pipeline state
+DrawStateKey triangleState;            // pipeline state of the colored triangles
 
 // represent a simple vertex in struct form. 3D coordinate and a color
-struct VERTEX{FLOAT X, Y, Z; D3DXCOLOR Color;};
+// vertices are quantized to PackedVertex (12 bytes) on their way to the GPU
+struct VERTEX{FLOAT X, Y, Z; Float4 Color;};
+static_assert(sizeof(VERTEX) == sizeof(FloatVertex), "VERTEX must match FloatVertex for packing");
+
+// create a triangle using the VERTEX struct
+VERTEX OurVertices[] =
+{
+    {0.0f, 0.5f, 0.0f, Float4(1.0f, 0.0f, 0.0f, 1.0f)},
+    {0.45f, -0.5, 0.0f, Float4(0.0f, 1.0f, 0.0f, 1.0f)},
+    {-0.45f, -0.5f, 0.0f, Float4(0.0f, 0.0f, 1.0f, 1.0f)}
+};
+
+// everything the render thread needs to draw one frame
+struct FramePacket
+{
+    UINT64 frame;
+    BOOL quit;                          // tells the render thread to exit
+    UINT vertexCount;
+    VERTEX vertices[MAX_PACKET_VERTICES];
+};
+
+// frame handoff from the input thread to the render thread
+SpscQueue<FramePacket> frameQueue(MAX_FRAMES_IN_FLIGHT);
+HANDLE frameQueued;                    // signaled when a packet is pushed
+HANDLE frameConsumed;                  // signaled when the render thread finishes a packet
+HANDLE renderThread;
 
 // function prototypes
-void InitD3D(HWND hWnd);    // sets up and initializes Direct3D
-void RenderFrame(void);     // renders a single frame
+HRESULT InitD3D(HWND hWnd); // sets up and initializes Direct3D
+void RenderFrame(const FramePacket &packet); // renders a single frame
+void BuildFrame(FramePacket *packet, UINT64 frame); // fills in the next frame
+void StartRenderThread(void); // starts rendering on its own thread
+void StopRenderThread(void);  // drains the queue and joins the render thread
+DWORD WINAPI RenderThread(LPVOID param);
 void CleanD3D(void);        // closes Direct3D and releases memory
-void InitGraphics(void);    // creates the shape to render
-void InitPipeline(void);    // loads and prepares the shaders
+void InitGraphics(void);    // creates the vertex stream
+HRESULT InitPipeline(void); // loads and prepares the shaders
 
 // the WindowProc function prototype
 LRESULT CALLBACK WindowProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam);
@@ -72,35 +127,185 @@ int WINAPI WinMain(HINSTANCE hInstance,
 
     ShowWindow(hWnd, nCmdShow);
 
+    Profiler::SetThreadName("Input");
+
+    // counters for an outside reader, see TelemetryReader
+    Telemetry::Publish("2DTest");
+
     // set up and initialize Direct3D
-    InitD3D(hWnd);
+    if (FAILED(InitD3D(hWnd)))
+        return 0;
+
+    // from here on devcon belongs to the render thread
+    StartRenderThread();
 
     // enter the main event loop
-	
     MSG msg; // Holder for Windows event messages
+    msg.wParam = 0;
 
-    while(TRUE)
+    FramePacket packet;
+    UINT64 frame = 0;
+    BOOL running = TRUE;
+
+    // the triangle animates, so build a frame every interval instead of as
+    // fast as the queue drains; the timer wakes the loop when one is due
+    FrameScheduler scheduler;
+    scheduler.SetContinuous(true);
+    HANDLE waits[2] = { frameConsumed, CreateWaitableTimer(NULL, TRUE, NULL) };
+
+    while(running)
     {
-		// Use Peek to avoid blocking, just for fun
-        if(PeekMessage(&msg, NULL, 0, 0, PM_REMOVE))
+        // handle everything that is waiting, never blocking the renderer
+        while(PeekMessage(&msg, NULL, 0, 0, PM_REMOVE))
         {
+            if(msg.message == WM_QUIT)
+            {
+                running = FALSE;
+                break;
+            }
+
             TranslateMessage(&msg);
             DispatchMessage(&msg);
+        }
 
-            if(msg.message == WM_QUIT)
-                break;
+        if(!running)
+            break;
+
+        // queue the next frame if it is due and the render thread has room for it
+        UINT64 now = FrameScheduler::Now();
+        UINT64 wait = scheduler.NextWait(now);
+        if(wait == 0 && frameQueue.Size() < frameQueue.Capacity())
+        {
+            scheduler.BeginFrame(now);
+            BuildFrame(&packet, frame);
+            if(frameQueue.TryPush(packet))
+            {
+                // latency here is to the hand-off, the render thread's share
+                // shows up in the profiler
+                scheduler.EndFrame(FrameScheduler::Now());
+                frame++;
+                SetEvent(frameQueued);
+                continue;
+            }
         }
 
-        RenderFrame();
+        // sleep until a frame is rendered, the next one is due or input arrives
+        DWORD count = 1;
+        if(wait != 0 && waits[1])
+        {
+            LARGE_INTEGER due;
+            due.QuadPart = -(LONGLONG)(wait * 10);
+            SetWaitableTimer(waits[1], &due, 0, NULL, NULL, FALSE);
+            count = 2;
+        }
+        MsgWaitForMultipleObjects(count, waits, FALSE, INFINITE, QS_ALLINPUT);
     }
 
+    if(waits[1])
+        CloseHandle(waits[1]);
+
+    StopRenderThread();
+
     // clean up DirectX and COM
     CleanD3D();
 
+    // where the frame time went, open the trace in chrome://tracing
+    Profiler::WriteChromeTrace("2DTest.trace.json");
+    Telemetry::Unpublish();
+    OutputDebugStringA(Profiler::Report().c_str());
+
+    FrameLatencyStats stats = scheduler.Stats();
+    char line[256];
+    snprintf(line, sizeof(line), "%llu frames, latency ms p50 %.2f p95 %.2f p99 %.2f max %.2f\n",
+             stats.frames, stats.p50, stats.p95, stats.p99, stats.max);
+    OutputDebugStringA(line);
+
     return msg.wParam;
 }
 
 
+// wait for an object while still dispatching window messages
+void WaitPumpingMessages(HANDLE handle)
+{
+    while(MsgWaitForMultipleObjects(1, &handle, FALSE, INFINITE, QS_ALLINPUT) != WAIT_OBJECT_0)
+    {
+        MSG msg;
+        while(PeekMessage(&msg, NULL, 0, 0, PM_REMOVE))
+        {
+            TranslateMessage(&msg);
+            DispatchMessage(&msg);
+        }
+    }
+}
+
+
+// start the render thread and the events it is driven by
+void StartRenderThread()
+{
+    frameQueued = CreateEvent(NULL, FALSE, FALSE, NULL);
+    frameConsumed = CreateEvent(NULL, FALSE, FALSE, NULL);
+    renderThread = CreateThread(NULL, 0, RenderThread, NULL, 0, NULL);
+}
+
+
+// ask the render thread to finish and wait for it
+void StopRenderThread()
+{
+    FramePacket quit;
+    quit.frame = 0;
+    quit.quit = TRUE;
+    quit.vertexCount = 0;
+
+    while(!frameQueue.TryPush(quit))
+        WaitPumpingMessages(frameConsumed);
+    SetEvent(frameQueued);
+
+    // Present can need the window thread, so keep pumping while we wait
+    WaitPumpingMessages(renderThread);
+
+    CloseHandle(renderThread);
+    CloseHandle(frameQueued);
+    CloseHandle(frameConsumed);
+}
+
+
+// renders packets as they arrive until it sees a quit packet
+DWORD WINAPI RenderThread(LPVOID param)
+{
+    Profiler::SetThreadName("Render");
+
+    FramePacket packet;
+    while(TRUE)
+    {
+        if(!frameQueue.TryPop(&packet))
+        {
+            // the event stays signaled if a push raced with the pop above
+            WaitForSingleObject(frameQueued, INFINITE);
+            continue;
+        }
+
+        if(packet.quit)
+            break;
+
+        RenderFrame(packet);
+        SetEvent(frameConsumed);
+    }
+    return 0;
+}
+
+
+// fill in the geometry for the next frame
+void BuildFrame(FramePacket *packet, UINT64 frame)
+{
+    PROFILE_ZONE("BuildFrame");
+
+    packet->frame = frame;
+    packet->quit = FALSE;
+    packet->vertexCount = ARRAYSIZE(OurVertices);
+    memcpy(packet->vertices, OurVertices, sizeof(OurVertices));
+}
+
+
 // this is the main message handler for the program
 LRESULT CALLBACK WindowProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 {
@@ -119,8 +324,10 @@ LRESULT CALLBACK WindowProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lPara
 
 
 // initiallize and prepare Direct3D for use
-void InitD3D(HWND hWnd)
+HRESULT InitD3D(HWND hWnd)
 {
+    PROFILE_ZONE("InitD3D");
+
     // create a struct to hold information about the swap chain
     DXGI_SWAP_CHAIN_DESC scd;
 
@@ -167,31 +374,50 @@ void InitD3D(HWND hWnd)
 
     devcon->RSSetViewports(1, &viewport);
 
-    InitPipeline();
+    HRESULT hr = InitPipeline();
+    if (FAILED(hr))
+        return hr;
+
     InitGraphics();
+    return S_OK;
 }
 
 
-// render a single frame
-void RenderFrame(void)
+// render a single frame, called on the render thread
+void RenderFrame(const FramePacket &packet)
 {
+    PROFILE_ZONE("RenderFrame");
+
     // clear the back buffer to a deep blue
-    devcon->ClearRenderTargetView(backbuffer, D3DXCOLOR(0.0f, 0.8f, 0.2f, 1.0f));
+    Float4 clearColor(0.0f, 0.8f, 0.2f, 1.0f);
+    devcon->ClearRenderTargetView(backbuffer, &clearColor.x);
+
+    pVertexRing->BeginFrame();
 
-        // select which vertex buffer to display
-        UINT stride = sizeof(VERTEX);
-        UINT offset = 0;
-        devcon->IASetVertexBuffers(0, 1, &pVBuffer, &stride, &offset);
+    // quantize this frame's vertices straight into the batch
+    {
+        PROFILE_ZONE("PackVertices");
+        PackedVertex *packed = (PackedVertex*)batcher.Allocate(triangleState, packet.vertexCount);
+        if (packed)
+        {
+            PackVertices((const FloatVertex*)packet.vertices, packed, packet.vertexCount);
+            Telemetry::Add(Telemetry_Vertices, packet.vertexCount);
+        }
+    }
 
-        // select which primtive type we are using
-        devcon->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    // sort, merge and draw everything submitted this frame
+    {
+        PROFILE_ZONE("Submit");
+        batcher.Flush(pDrawBackend);
+    }
 
-        // draw the vertex buffer to the back buffer
-        devcon->Draw(3, 0);
+    pVertexRing->EndFrame();
 
     // switch the back buffer and the front buffer
 	// params shouldn't need to be changed for what we're doing
+    PROFILE_ZONE("Present");
     swapchain->Present(0, 0);
+    Telemetry::Add(Telemetry_Frames);
 }
 
 // clean up Direct3D and COM
@@ -203,7 +429,9 @@ void CleanD3D(void)
     pLayout->Release();
     pVS->Release();
     pPS->Release();
-    pVBuffer->Release();
+    delete pDrawBackend;
+    delete pVertexRing;
+    vertexStream.Release();
     swapchain->Release();
     backbuffer->Release();
     dev->Release();
@@ -211,61 +439,123 @@ void CleanD3D(void)
 }
 
 
-// Create the shape we wish to render
+// Create the buffer the shapes are streamed through
 void InitGraphics()
 {
-    // create a triangle using the VERTEX struct
-    VERTEX OurVertices[] =
+    PROFILE_ZONE("InitGraphics");
+
+    // one large dynamic buffer, suballocated every frame by the ring allocator
+    vertexStream.Create(dev, devcon, sizeof(PackedVertex) * MAX_STREAMED_VERTICES);
+    pVertexRing = new RingVertexAllocator(&vertexStream);
+
+    // the batcher refers to pipeline objects by their index in the backend
+    pDrawBackend = new D3D11DrawBackend(devcon, &vertexStream, pVertexRing);
+    triangleState.topology = BatchTopology_TriangleList;
+    triangleState.vertexShader = pDrawBackend->RegisterVertexShader(pVS);
+    triangleState.pixelShader = pDrawBackend->RegisterPixelShader(pPS);
+    triangleState.inputLayout = pDrawBackend->RegisterInputLayout(pLayout);
+    triangleState.stride = sizeof(PackedVertex);
+}
+
+
+// compiles one entry point of a shader for the shader cache
+bool CompileShader(const ShaderSource &source, std::vector<unsigned char> *bytecode, std::string *errors)
+{
+    std::vector<D3D10_SHADER_MACRO> macros;
+    for (size_t i = 0; i < source.defines.size(); i++)
     {
-        {0.0f, 0.5f, 0.0f, D3DXCOLOR(1.0f, 0.0f, 0.0f, 1.0f)},
-        {0.45f, -0.5, 0.0f, D3DXCOLOR(0.0f, 1.0f, 0.0f, 1.0f)},
-        {-0.45f, -0.5f, 0.0f, D3DXCOLOR(0.0f, 0.0f, 1.0f, 1.0f)}
-    };
+        D3D10_SHADER_MACRO macro = {source.defines[i].name.c_str(), source.defines[i].value.c_str()};
+        macros.push_back(macro);
+    }
+    D3D10_SHADER_MACRO terminator = {NULL, NULL};
+    macros.push_back(terminator);
+
+    ID3D10Blob *code = NULL, *messages = NULL;
+    HRESULT hr = D3DX11CompileFromMemory(source.text.c_str(), source.text.size(), source.fileName.c_str(),
+                                         &macros[0], NULL, source.entryPoint.c_str(), source.profile.c_str(),
+                                         source.flags, 0, NULL, &code, &messages, NULL);
+    if (messages)
+    {
+        errors->assign((const char*)messages->GetBufferPointer(), messages->GetBufferSize());
+        messages->Release();
+    }
+    if (FAILED(hr) || !code)
+    {
+        if (errors->empty())
+            errors->assign("failed to compile " + source.fileName + ":" + source.entryPoint);
+        return false;
+    }
 
+    const unsigned char *data = (const unsigned char*)code->GetBufferPointer();
+    bytecode->assign(data, data + code->GetBufferSize());
+    code->Release();
+    return true;
+}
 
-    // create the vertex buffer
-    D3D11_BUFFER_DESC buffer;
-    ZeroMemory(&buffer, sizeof(buffer));
 
-    buffer.Usage = D3D11_USAGE_DYNAMIC;                // write access access by CPU and GPU
-    buffer.ByteWidth = sizeof(VERTEX) * 3;             // size is the VERTEX struct * 3
-    buffer.BindFlags = D3D11_BIND_VERTEX_BUFFER;       // use as a vertex buffer
-    buffer.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;    // allow CPU to write in buffer
+// this function loads and prepares the shaders
+HRESULT InitPipeline()
+{
+    PROFILE_ZONE("InitPipeline");
 
-    dev->CreateBuffer(&buffer, NULL, &pVBuffer);       // create the buffer
+    // shaders are compiled once and then loaded from the cache on later launches
+    ShaderCache cache("ShaderCache", CompileShader);
 
+    // entries compiled by another D3DX build must not be reused
+    char compilerVersion[32];
+    snprintf(compilerVersion, sizeof(compilerVersion), "d3dx11_%d", D3DX11_SDK_VERSION);
+    cache.SetCompilerVersion(compilerVersion);
 
-    // copy the vertices into the buffer
-    D3D11_MAPPED_SUBRESOURCE ms;
-    devcon->Map(pVBuffer, NULL, D3D11_MAP_WRITE_DISCARD, NULL, &ms);    // map the buffer
-    memcpy(ms.pData, OurVertices, sizeof(OurVertices));                 // copy the data
-    devcon->Unmap(pVBuffer, NULL);                                      // unmap the buffer
-}
+    ShaderSource source;
+    source.fileName = "shaders.shader";
+    if (!ReadTextFile(source.fileName, &source.text))
+    {
+        MessageBoxA(NULL, "Could not open shaders.shader", "Shader error", MB_OK | MB_ICONERROR);
+        return E_FAIL;
+    }
 
+    // load the vertex shader and pixel shader
+    std::vector<unsigned char> VS, PS;
+    std::string errors;
+    source.entryPoint = "VShader";
+    source.profile = "vs_4_0";
+    bool loaded = cache.Load(source, &VS, &errors);
+    if (loaded)
+    {
+        source.entryPoint = "PShader";
+        source.profile = "ps_4_0";
+        loaded = cache.Load(source, &PS, &errors);
+    }
+    if (!loaded)
+    {
+        MessageBoxA(NULL, errors.c_str(), "Shader error", MB_OK | MB_ICONERROR);
+        return E_FAIL;
+    }
 
-// this function loads and prepares the shaders
-void InitPipeline()
-{
-    // load and compile the vertex shader and pixel shader
-    ID3D10Blob *VS, *PS;
-    D3DX11CompileFromFile(L"shaders.shader", 0, 0, "VShader", "vs_4_0", 0, 0, 0, &VS, 0, 0);
-    D3DX11CompileFromFile(L"shaders.shader", 0, 0, "PShader", "ps_4_0", 0, 0, 0, &PS, 0, 0);
+    // report cold vs warm startup cost
+    OutputDebugStringA((cache.Report() + "\n").c_str());
 
     // encapsulate both shaders into shader objects
-    dev->CreateVertexShader(VS->GetBufferPointer(), VS->GetBufferSize(), NULL, &pVS);
-    dev->CreatePixelShader(PS->GetBufferPointer(), PS->GetBufferSize(), NULL, &pPS);
+    HRESULT hr = dev->CreateVertexShader(&VS[0], VS.size(), NULL, &pVS);
+    if (SUCCEEDED(hr))
+        hr = dev->CreatePixelShader(&PS[0], PS.size(), NULL, &pPS);
+    if (FAILED(hr))
+        return hr;
 
     // set the shader objects
     devcon->VSSetShader(pVS, 0, 0);
     devcon->PSSetShader(pPS, 0, 0);
 
-    // create the input layout object
+    // create the input layout object, matching PackedVertex
     D3D11_INPUT_ELEMENT_DESC ied[] =
     {
-        {"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0},
-        {"COLOR", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0},
+        {"POSITION", 0, DXGI_FORMAT_R16G16B16A16_SNORM, 0, PACKEDVERTEX_POSITION_OFFSET, D3D11_INPUT_PER_VERTEX_DATA, 0},
+        {"COLOR", 0, DXGI_FORMAT_R8G8B8A8_UNORM, 0, PACKEDVERTEX_COLOR_OFFSET, D3D11_INPUT_PER_VERTEX_DATA, 0},
     };
 
-    dev->CreateInputLayout(ied, 2, VS->GetBufferPointer(), VS->GetBufferSize(), &pLayout);
+    hr = dev->CreateInputLayout(ied, 2, &VS[0], VS.size(), &pLayout);
+    if (FAILED(hr))
+        return hr;
     devcon->IASetInputLayout(pLayout);
+    return S_OK;
 }
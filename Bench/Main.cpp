@@ -0,0 +1,2828 @@
+// Times the CPU paths the apps share, from a few items to millions,
+// checks that the scenes still render the images in golden/ and that the
+// shared code gives the results it promises. Results go to stdout and
+// optionally to a JSON file; given the JSON of an earlier run it fails if
+// anything got slower than allowed.
+//
+//   Bench --json today.json --baseline yesterday.json
+//
+// On Linux: g++ -std=c++11 -O2 -pthread -I../Common Main.cpp ../Common/*.cpp -o Bench -lrt
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../Common/BatchCulling.h"
+#include "../Common/ColorConvert.h"
+#include "../Common/CommandBuffer.h"
+#include "../Common/DrawBatcher.h"
+#include "../Common/DynamicBuffer.h"
+#include "../Common/FrameArena.h"
+#include "../Common/FrameScheduler.h"
+#include "../Common/Histogram.h"
+#include "../Common/InstanceTransforms.h"
+#include "../Common/LineRaster.h"
+#include "../Common/MeshGenerator.h"
+#include "../Common/MeshOptimizer.h"
+#include "../Common/PackedVertex.h"
+#include "../Common/ParallelWaves.h"
+#include "../Common/PointCloudWriter.h"
+#include "../Common/PolylineLoader.h"
+#include "../Common/Profiler.h"
+#include "../Common/RingVertexAllocator.h"
+#include "../Common/Scenes.h"
+#include "../Common/ShaderCache.h"
+#include "../Common/SoftwareRaster.h"
+#include "../Common/SpscQueue.h"
+#include "../Common/TextureStreamer.h"
+#include "../Common/ThreadPool.h"
+#include "../Common/VecMath.h"
+
+struct Options
+{
+    std::string filter;         // only benchmarks whose name contains this
+    size_t maxSize;
+    double minTime;             // seconds per benchmark and size
+    unsigned threads;
+    std::string input;
+    std::string golden;
+    bool updateGolden;
+    unsigned tolerance;         // per channel
+    double maxDiffering;        // fraction of pixels past tolerance
+    std::string json;
+    std::string baseline;
+    double maxSlowdown;         // fraction of the baseline's median
+};
+
+// Nanoseconds per item over the runs of one benchmark at one size
+struct BenchResult
+{
+    std::string name;
+    size_t size;
+    unsigned runs;
+    double best;
+    double median;
+};
+
+struct GoldenResult
+{
+    std::string scene;
+    unsigned maxDifference;     // largest channel difference
+    size_t differing;           // pixels past the tolerance
+    size_t pixels;
+    bool pass;
+};
+
+static const unsigned long long BenchSeed = 1;
+
+// Small, medium, large and huge
+static const size_t Sizes[] = {1 << 10, 1 << 16, 1 << 20, 1 << 22};
+
+static const unsigned MinRuns = 3;
+static const unsigned MaxRuns = 1000;
+
+// Results are stored here so the optimizer can't drop the work. A plain
+// store, compound assignment to a volatile is deprecated in C++20.
+static volatile unsigned s_sink;
+
+static void Sink(unsigned value)
+{
+    s_sink = value;
+}
+
+static void PrintUsage()
+{
+    printf("usage: Bench [options]\n"
+           "  --filter TEXT         only benchmarks whose name contains TEXT\n"
+           "  --max-size N          largest data size (default 4194304)\n"
+           "  --min-time S          seconds to time each benchmark and size (default 0.2)\n"
+           "  --quick               --max-size 65536 --min-time 0.05\n"
+           "  --threads N           total threads for the parallel benchmarks, 0 for one per core\n"
+           "  --input PATH          polyline file (default ../Transform/dino.dat)\n"
+           "  --golden DIR          golden images (default golden)\n"
+           "  --update-golden       write the golden images instead of checking them\n"
+           "  --tolerance N         channel difference still counted as equal (default 2)\n"
+           "  --max-differing F     fraction of pixels allowed past the tolerance (default 0.0005)\n"
+           "  --json PATH           write the results as JSON\n"
+           "  --baseline PATH       JSON of an earlier run to compare with\n"
+           "  --max-slowdown F      fail if a median is more than F slower than the baseline's\n"
+           "                        (default 0.25, i.e. 25%%)\n");
+}
+
+static bool ParseOptions(int argc, char** argv, Options* options)
+{
+    options->maxSize = Sizes[sizeof(Sizes) / sizeof(Sizes[0]) - 1];
+    options->minTime = 0.2;
+    options->threads = 0;
+    options->input = "../Transform/dino.dat";
+    options->golden = "golden";
+    options->updateGolden = false;
+    options->tolerance = 2;
+    options->maxDiffering = 0.0005;
+    options->maxSlowdown = 0.25;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (strcmp(arg, "--quick") == 0)
+        {
+            options->maxSize = 1 << 16;
+            options->minTime = 0.05;
+            continue;
+        }
+        if (strcmp(arg, "--update-golden") == 0)
+        {
+            options->updateGolden = true;
+            continue;
+        }
+        if (strcmp(arg, "--help") == 0 || !value)
+        {
+            return false;
+        }
+
+        i++;
+        if (strcmp(arg, "--filter") == 0)
+        {
+            options->filter = value;
+        }
+        else if (strcmp(arg, "--max-size") == 0)
+        {
+            options->maxSize = (size_t)strtoull(value, NULL, 10);
+        }
+        else if (strcmp(arg, "--min-time") == 0)
+        {
+            options->minTime = atof(value);
+        }
+        else if (strcmp(arg, "--threads") == 0)
+        {
+            options->threads = (unsigned)atoi(value);
+        }
+        else if (strcmp(arg, "--input") == 0)
+        {
+            options->input = value;
+        }
+        else if (strcmp(arg, "--golden") == 0)
+        {
+            options->golden = value;
+        }
+        else if (strcmp(arg, "--tolerance") == 0)
+        {
+            options->tolerance = (unsigned)atoi(value);
+        }
+        else if (strcmp(arg, "--max-differing") == 0)
+        {
+            options->maxDiffering = atof(value);
+        }
+        else if (strcmp(arg, "--json") == 0)
+        {
+            options->json = value;
+        }
+        else if (strcmp(arg, "--baseline") == 0)
+        {
+            options->baseline = value;
+        }
+        else if (strcmp(arg, "--max-slowdown") == 0)
+        {
+            options->maxSlowdown = atof(value);
+        }
+        else
+        {
+            fprintf(stderr, "unknown option %s\n", arg);
+            return false;
+        }
+    }
+    return options->maxSize > 0 && options->minTime >= 0.0;
+}
+
+static float RandomFloat(SceneRandom* random, float low, float high)
+{
+    return low + (high - low) * (float)(random->Next() >> 40) * (1.0f / (1 << 24));
+}
+
+// Runs each benchmark at each size and keeps the results
+class BenchRunner
+{
+public:
+    explicit BenchRunner(const Options& options) : _options(options) {}
+
+    bool Wants(const char* name) const
+    {
+        return _options.filter.empty() || strstr(name, _options.filter.c_str()) != NULL;
+    }
+
+    // The standard sizes up to --max-size, capped at limit
+    std::vector<size_t> SizesUpTo(size_t limit) const
+    {
+        std::vector<size_t> sizes;
+        for (size_t i = 0; i < sizeof(Sizes) / sizeof(Sizes[0]); i++)
+        {
+            if (Sizes[i] <= _options.maxSize && Sizes[i] <= limit)
+            {
+                sizes.push_back(Sizes[i]);
+            }
+        }
+        return sizes;
+    }
+
+    // body does size items of work. One untimed run warms the caches, then
+    // it runs until it has run MinRuns times and for --min-time.
+    void Run(const char* name, size_t size, const std::function<void()>& body)
+    {
+        body();
+
+        std::vector<double> times;
+        double total = 0.0;
+        while (times.size() < MinRuns || (total < _options.minTime && times.size() < MaxRuns))
+        {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            body();
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            times.push_back(seconds);
+            total += seconds;
+        }
+        std::sort(times.begin(), times.end());
+
+        BenchResult result;
+        result.name = name;
+        result.size = size;
+        result.runs = (unsigned)times.size();
+        result.best = times.front() * 1e9 / size;
+        result.median = times[times.size() / 2] * 1e9 / size;
+        _results.push_back(result);
+
+        printf("  %-24s %10llu %8u %12.3f %12.3f %14.0f\n", name, (unsigned long long)size, result.runs,
+               result.best, result.median, 1e9 / result.median);
+        fflush(stdout);
+    }
+
+    const std::vector<BenchResult>& Results() const { return _results; }
+
+private:
+    const Options& _options;
+    std::vector<BenchResult> _results;
+
+    BenchRunner(const BenchRunner&);
+    BenchRunner& operator=(const BenchRunner&);
+};
+
+//
+// Micro benchmarks, one kernel each
+//
+
+static void BenchChaos(BenchRunner* runner, ThreadPool* pool)
+{
+    std::vector<size_t> sizes = runner->SizesUpTo(~(size_t)0);
+    for (size_t i = 0; i < sizes.size(); i++)
+    {
+        SierpinskiParams params;
+        DefaultSierpinski(800, 600, sizes[i], BenchSeed, &params);
+        std::vector<Float2> points(sizes[i]);
+
+        if (runner->Wants("chaos/serial"))
+        {
+            runner->Run("chaos/serial", sizes[i], [&]() {
+                GenerateChaosPoints(params, &points[0], NULL);
+                Sink((unsigned)points.back().x);
+            });
+        }
+        if (runner->Wants("chaos/parallel"))
+        {
+            runner->Run("chaos/parallel", sizes[i], [&]() {
+                GenerateChaosPoints(params, &points[0], pool);
+                Sink((unsigned)points.back().x);
+            });
+        }
+        if (runner->Wants("chaos/density"))
+        {
+            std::vector<unsigned> density(800 * 600);
+            runner->Run("chaos/density", sizes[i], [&]() {
+                AccumulateChaosDensity(params, 0, ChaosChunkCount(params), 800, 600, &density[0]);
+                Sink(density[300 * 800 + 400]);
+            });
+        }
+    }
+}
+
+// Polylines of 64 points in the dino.dat format, count points in all
+static std::string SyntheticPolylines(size_t count)
+{
+    SceneRandom random(BenchSeed);
+    const size_t perLine = 64;
+    size_t lineCount = (count + perLine - 1) / perLine;
+
+    std::string text;
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "%llu\n", (unsigned long long)lineCount);
+    text += buffer;
+    for (size_t line = 0; line < lineCount; line++)
+    {
+        size_t points = count - line * perLine < perLine ? count - line * perLine : perLine;
+        snprintf(buffer, sizeof(buffer), "%llu\n", (unsigned long long)points);
+        text += buffer;
+        for (size_t p = 0; p < points; p++)
+        {
+            snprintf(buffer, sizeof(buffer), "%.1f %.1f\n", RandomFloat(&random, 0.0f, 640.0f),
+                     RandomFloat(&random, 0.0f, 480.0f));
+            text += buffer;
+        }
+    }
+    return text;
+}
+
+static size_t PointCount(const Polylines& lines)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < lines.size(); i++)
+    {
+        count += lines[i].size();
+    }
+    return count;
+}
+
+static void BenchParse(BenchRunner* runner, const std::string& dinoText)
+{
+    if (runner->Wants("parse/dino") && !dinoText.empty())
+    {
+        Polylines lines;
+        std::istringstream in(dinoText);
+        ReadPolylines(in, &lines);
+
+        runner->Run("parse/dino", PointCount(lines), [&]() {
+            std::istringstream in(dinoText);
+            Polylines parsed;
+            Sink(ReadPolylines(in, &parsed) ? (unsigned)parsed.size() : 0);
+        });
+    }
+
+    if (runner->Wants("parse/synthetic"))
+    {
+        std::vector<size_t> sizes = runner->SizesUpTo(1 << 20);
+        for (size_t i = 0; i < sizes.size(); i++)
+        {
+            std::string text = SyntheticPolylines(sizes[i]);
+            runner->Run("parse/synthetic", sizes[i], [&]() {
+                std::istringstream in(text);
+                Polylines parsed;
+                Sink(ReadPolylines(in, &parsed) ? (unsigned)parsed.size() : 0);
+            });
+        }
+    }
+}
+
+// Reads a string in place, where istringstream would copy it every run
+class TextBuffer : public std::streambuf
+{
+public:
+    explicit TextBuffer(const std::string& text)
+    {
+        char* p = const_cast<char*>(text.data());
+        setg(p, p, p + text.size());
+    }
+};
+
+// Reading a file the way Transform does, all of it before drawing, against
+// PolylineLoader handing it over in batches. load/first-batch stops at the
+// first batch, the wait before a window can draw anything; per point it
+// shrinks as the file grows since the first batch doesn't.
+static void BenchLoad(BenchRunner* runner)
+{
+    if (!runner->Wants("load/"))
+    {
+        return;
+    }
+
+    // One worker whatever --threads says, as in Transform
+    ThreadPool loadPool(2);
+    Matrix3x2 flip = {1.0f, 0.0f, 0.0f, -1.0f, 0.0f, 440.0f};
+
+    std::vector<size_t> sizes = runner->SizesUpTo(1 << 22);
+    for (size_t i = 0; i < sizes.size(); i++)
+    {
+        std::string text = SyntheticPolylines(sizes[i]);
+
+        if (runner->Wants("load/blocking"))
+        {
+            runner->Run("load/blocking", sizes[i], [&]() {
+                TextBuffer buffer(text);
+                std::istream in(&buffer);
+                Polylines parsed;
+                ReadPolylines(in, &parsed);
+                for (size_t j = 0; j < parsed.size(); j++)
+                {
+                    for (size_t k = 0; k < parsed[j].size(); k++)
+                    {
+                        parsed[j][k] = flip.TransformPoint(parsed[j][k]);
+                    }
+                }
+                Sink((unsigned)parsed.size());
+            });
+        }
+
+        if (runner->Wants("load/progressive"))
+        {
+            runner->Run("load/progressive", sizes[i], [&]() {
+                TextBuffer buffer(text);
+                std::istream in(&buffer);
+                PolylineLoader loader;
+                std::vector<PolylineBatch> batches;
+                loader.Start(&in, flip, &loadPool, PolylineReadyFunction());
+                loader.Wait();
+                loader.Take(&batches);
+                Sink((unsigned)batches.size());
+            });
+        }
+
+        if (runner->Wants("load/first-batch"))
+        {
+            runner->Run("load/first-batch", sizes[i], [&]() {
+                std::mutex mutex;
+                std::condition_variable ready;
+                bool any = false;
+
+                TextBuffer buffer(text);
+                std::istream in(&buffer);
+                PolylineLoader loader;
+                loader.Start(&in, flip, &loadPool, [&]() {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    any = true;
+                    ready.notify_one();
+                });
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    ready.wait(lock, [&] { return any; });
+                }
+
+                std::vector<PolylineBatch> batches;
+                loader.Take(&batches);
+                loader.Cancel();
+                Sink((unsigned)batches.size());
+            });
+        }
+    }
+}
+
+static void BenchTransform(BenchRunner* runner, const Polylines& dino)
+{
+    // What the Transform app applies for a rotated, scaled frame
+    TransformParams params;
+    params.rotation = 30.0f;
+    params.scale = 0.8f;
+    params.translation = Float2(20.0f, -10.0f);
+    Matrix3x2 m = TransformSceneMatrix(dino, params, 800, 600);
+
+    std::vector<size_t> sizes = runner->SizesUpTo(~(size_t)0);
+    for (size_t i = 0; i < sizes.size(); i++)
+    {
+        size_t count = sizes[i];
+        SceneRandom random(BenchSeed);
+        std::vector<float> x(count), y(count), outX(count), outY(count);
+        for (size_t p = 0; p < count; p++)
+        {
+            x[p] = RandomFloat(&random, 0.0f, 640.0f);
+            y[p] = RandomFloat(&random, 0.0f, 480.0f);
+        }
+
+        if (runner->Wants("transform/scalar"))
+        {
+            runner->Run("transform/scalar", count, [&]() {
+                TransformPoints2Scalar(m, &x[0], &y[0], &outX[0], &outY[0], count);
+                Sink((unsigned)outX.back());
+            });
+        }
+        if (runner->Wants("transform/batch"))
+        {
+            runner->Run("transform/batch", count, [&]() {
+                TransformPoints2(m, &x[0], &y[0], &outX[0], &outY[0], count);
+                Sink((unsigned)outX.back());
+            });
+        }
+    }
+
+    // The app's per-frame work: a line command per segment
+    if (runner->Wants("transform/record") && !dino.empty())
+    {
+        CommandBuffer commands;
+        runner->Run("transform/record", PointCount(dino), [&]() {
+            commands.Reset();
+            RecordPolylines(dino, m, &commands);
+            Sink((unsigned)commands.Bytes());
+        });
+    }
+}
+
+// Triangles cover a few hundred pixels each, more of them only take longer
+static const size_t TriangleLimit = 1 << 16;
+
+static void BenchRaster(BenchRunner* runner)
+{
+    Image image(1024, 1024);
+    std::vector<size_t> sizes = runner->SizesUpTo(1 << 20);
+    for (size_t i = 0; i < sizes.size(); i++)
+    {
+        size_t count = sizes[i];
+        SceneRandom random(BenchSeed);
+
+        // Short lines and small triangles anywhere on the image, partly
+        // off it, like the scenes draw
+        std::vector<Float2> points(count * 3);
+        std::vector<Float4> colors(count * 3);
+        for (size_t p = 0; p < count; p++)
+        {
+            Float2 center(RandomFloat(&random, -16.0f, 1040.0f), RandomFloat(&random, -16.0f, 1040.0f));
+            for (int v = 0; v < 3; v++)
+            {
+                points[p * 3 + v] = center + Float2(RandomFloat(&random, -16.0f, 16.0f), RandomFloat(&random, -16.0f, 16.0f));
+                colors[p * 3 + v] = Float4(RandomFloat(&random, 0.0f, 1.0f), RandomFloat(&random, 0.0f, 1.0f),
+                                           RandomFloat(&random, 0.0f, 1.0f), 1.0f);
+            }
+        }
+
+        if (runner->Wants("raster/lines"))
+        {
+            runner->Run("raster/lines", count, [&]() {
+                for (size_t p = 0; p < count; p++)
+                {
+                    DrawLine(&image, points[p * 3], points[p * 3 + 1], 0xFF008000);
+                }
+                Sink(image.Pixels()[0]);
+            });
+        }
+        if (runner->Wants("raster/crosses"))
+        {
+            runner->Run("raster/crosses", count, [&]() {
+                for (size_t p = 0; p < count; p++)
+                {
+                    DrawCross(&image, points[p * 3], 3, 0xFF000000);
+                }
+                Sink(image.Pixels()[0]);
+            });
+        }
+        if (runner->Wants("raster/triangles") && count <= TriangleLimit)
+        {
+            runner->Run("raster/triangles", count, [&]() {
+                for (size_t p = 0; p < count; p++)
+                {
+                    FillTriangle(&image, &points[p * 3], &colors[p * 3]);
+                }
+                Sink(image.Pixels()[0]);
+            });
+        }
+    }
+}
+
+// Long lines cross the whole image, more of them only take longer
+static const size_t LongLineLimit = 1 << 16;
+
+// Antialiased lines in batches, the way a LinesCommand replays: short
+// ones like the raster benchmarks' and Sierpinski's crosses, and long
+// ones between any two points of the image like Transform's scaled up
+static void BenchAntialiased(BenchRunner* runner, ThreadPool* pool)
+{
+    Image image(1024, 1024);
+    LineRasterizer lines;
+    const Matrix3x2 identity = Matrix3x2::Identity();
+    std::vector<size_t> sizes = runner->SizesUpTo(1 << 20);
+    for (size_t i = 0; i < sizes.size(); i++)
+    {
+        size_t count = sizes[i];
+        SceneRandom random(BenchSeed);
+        std::vector<Float2> shortLines(count * 2), longLines(count * 2);
+        for (size_t p = 0; p < count; p++)
+        {
+            Float2 center(RandomFloat(&random, -16.0f, 1040.0f), RandomFloat(&random, -16.0f, 1040.0f));
+            shortLines[p * 2] = center + Float2(RandomFloat(&random, -8.0f, 8.0f), RandomFloat(&random, -8.0f, 8.0f));
+            shortLines[p * 2 + 1] = center + Float2(RandomFloat(&random, -8.0f, 8.0f), RandomFloat(&random, -8.0f, 8.0f));
+            longLines[p * 2] = Float2(RandomFloat(&random, 0.0f, 1024.0f), RandomFloat(&random, 0.0f, 1024.0f));
+            longLines[p * 2 + 1] = Float2(RandomFloat(&random, 0.0f, 1024.0f), RandomFloat(&random, 0.0f, 1024.0f));
+        }
+
+        if (runner->Wants("aa/short-scalar"))
+        {
+            runner->Run("aa/short-scalar", count, [&]() {
+                DrawAntialiasedLinesScalar(&image, &shortLines[0], (unsigned)count, 0xFF008000);
+                Sink(image.Pixels()[0]);
+            });
+        }
+        if (runner->Wants("aa/short-tiled"))
+        {
+            runner->Run("aa/short-tiled", count, [&]() {
+                lines.DrawLines(&image, &shortLines[0], (unsigned)count, identity, 0xFF008000, NULL);
+                Sink(image.Pixels()[0]);
+            });
+        }
+        if (runner->Wants("aa/short-parallel"))
+        {
+            runner->Run("aa/short-parallel", count, [&]() {
+                lines.DrawLines(&image, &shortLines[0], (unsigned)count, identity, 0xFF008000, pool);
+                Sink(image.Pixels()[0]);
+            });
+        }
+        if (count > LongLineLimit)
+        {
+            continue;
+        }
+        if (runner->Wants("aa/long-scalar"))
+        {
+            runner->Run("aa/long-scalar", count, [&]() {
+                DrawAntialiasedLinesScalar(&image, &longLines[0], (unsigned)count, 0xFF008000);
+                Sink(image.Pixels()[0]);
+            });
+        }
+        if (runner->Wants("aa/long-tiled"))
+        {
+            runner->Run("aa/long-tiled", count, [&]() {
+                lines.DrawLines(&image, &longLines[0], (unsigned)count, identity, 0xFF008000, NULL);
+                Sink(image.Pixels()[0]);
+            });
+        }
+        if (runner->Wants("aa/long-parallel"))
+        {
+            runner->Run("aa/long-parallel", count, [&]() {
+                lines.DrawLines(&image, &longLines[0], (unsigned)count, identity, 0xFF008000, pool);
+                Sink(image.Pixels()[0]);
+            });
+        }
+    }
+}
+
+// Upload sizes of 256 to RingMaxUpload bytes, 64 to a frame, the way
+// 2DTest streams its geometry
+static const size_t RingCapacity = 256 * 1024;
+static const size_t RingUploadsPerFrame = 64;
+static const size_t RingMaxUpload = 4096;
+
+static void RingUploadSizes(size_t count, std::vector<size_t>* sizes)
+{
+    SceneRandom random(BenchSeed);
+    sizes->resize(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        (*sizes)[i] = 256 + (size_t)(random.Next() % (RingMaxUpload - 256 + 1));
+    }
+}
+
+// Uploads through RingVertexAllocator against a GPU 0 to 3 frames behind,
+// renaming the buffer on discard or waiting on fences when it can't
+static void BenchRing(BenchRunner* runner)
+{
+    std::vector<unsigned char> vertices(RingMaxUpload);
+    std::vector<size_t> sizes = runner->SizesUpTo(1 << 20);
+    for (size_t i = 0; i < sizes.size(); i++)
+    {
+        size_t count = sizes[i];
+        std::vector<size_t> uploadSizes;
+        RingUploadSizes(count, &uploadSizes);
+
+        for (int discard = 1; discard >= 0; discard--)
+        {
+            for (unsigned latency = 0; latency <= 3; latency++)
+            {
+                char name[32];
+                snprintf(name, sizeof(name), "ring/%s-%u", discard ? "discard" : "wait", latency);
+                if (!runner->Wants(name))
+                {
+                    continue;
+                }
+
+                runner->Run(name, count, [&]() {
+                    CpuDynamicBuffer buffer(RingCapacity, discard != 0, latency);
+                    RingVertexAllocator ring(&buffer);
+                    size_t offset = 0;
+                    for (size_t u = 0; u < count; u++)
+                    {
+                        if (u % RingUploadsPerFrame == 0)
+                        {
+                            if (u > 0)
+                            {
+                                ring.EndFrame();
+                            }
+                            ring.BeginFrame();
+                        }
+                        ring.Upload(&vertices[0], uploadSizes[u], 16, &offset);
+                    }
+                    ring.EndFrame();
+                    Sink((unsigned)offset);
+                });
+            }
+        }
+    }
+}
+
+// One producer thread and one consumer thread through SpscQueue, each
+// yielding when the queue is full or empty. Throughput with the producer
+// running flat out, then the latency of single items handed over while
+// the queue is otherwise empty, as 2DTest's frames are.
+static const size_t SpscCapacity = 1024;
+
+static void BenchSpsc(BenchRunner* runner)
+{
+    std::vector<size_t> sizes = runner->SizesUpTo(1 << 22);
+    if (runner->Wants("spsc/throughput"))
+    {
+        for (size_t i = 0; i < sizes.size(); i++)
+        {
+            size_t count = sizes[i];
+            SpscQueue<unsigned long long> queue(SpscCapacity);
+            runner->Run("spsc/throughput", count, [&]() {
+                std::thread producer([&]() {
+                    for (unsigned long long item = 0; item < count; item++)
+                    {
+                        while (!queue.TryPush(item))
+                        {
+                            std::this_thread::yield();
+                        }
+                    }
+                });
+
+                unsigned long long item, sum = 0;
+                for (size_t popped = 0; popped < count; popped++)
+                {
+                    while (!queue.TryPop(&item))
+                    {
+                        std::this_thread::yield();
+                    }
+                    sum += item;
+                }
+                producer.join();
+                Sink((unsigned)sum);
+            });
+        }
+    }
+
+    if (runner->Wants("spsc/latency") && !sizes.empty())
+    {
+        typedef std::chrono::steady_clock::time_point Stamp;
+        size_t count = std::min(sizes.back(), (size_t)1 << 16);
+        SpscQueue<Stamp> queue(SpscCapacity);
+        std::thread producer([&]() {
+            for (size_t item = 0; item < count; item++)
+            {
+                queue.TryPush(std::chrono::steady_clock::now());
+                while (queue.Size() != 0)
+                {
+                    std::this_thread::yield();
+                }
+            }
+        });
+
+        std::vector<double> latencies(count);
+        Stamp pushed;
+        for (size_t popped = 0; popped < count; popped++)
+        {
+            while (!queue.TryPop(&pushed))
+            {
+                std::this_thread::yield();
+            }
+            latencies[popped] = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - pushed).count();
+        }
+        producer.join();
+
+        std::sort(latencies.begin(), latencies.end());
+        printf("  %-24s %10llu  p50 %.0f ns, p99 %.0f ns, p99.9 %.0f ns, max %.0f ns\n", "spsc/latency",
+               (unsigned long long)count, latencies[count / 2], latencies[count * 99 / 100],
+               latencies[count * 999 / 1000], latencies.back());
+        fflush(stdout);
+    }
+}
+
+// The book's Waves::Update loop as it is, for Box's waves before
+// ParallelWaves: one array of positions, normals and tangents, the heights
+// copied into the previous solution
+class BookWaves
+{
+public:
+    void Init(unsigned m, unsigned n, float dx, float dt, float speed, float damping)
+    {
+        _rows = m;
+        _cols = n;
+        _dx = dx;
+        float d = damping * dt + 2.0f;
+        float e = (speed * speed) * (dt * dt) / (dx * dx);
+        _k1 = (damping * dt - 2.0f) / d;
+        _k2 = (4.0f - 8.0f * e) / d;
+        _k3 = (2.0f * e) / d;
+        _prev.assign((size_t)m * n, Float3(0.0f, 0.0f, 0.0f));
+        _curr.assign((size_t)m * n, Float3(0.0f, 0.0f, 0.0f));
+        _normals.assign((size_t)m * n, Float3(0.0f, 1.0f, 0.0f));
+        _tangentX.assign((size_t)m * n, Float3(1.0f, 0.0f, 0.0f));
+    }
+
+    void Disturb(unsigned i, unsigned j, float magnitude)
+    {
+        float halfMag = 0.5f * magnitude;
+        _curr[i * _cols + j].y += magnitude;
+        _curr[i * _cols + j + 1].y += halfMag;
+        _curr[i * _cols + j - 1].y += halfMag;
+        _curr[(i + 1) * _cols + j].y += halfMag;
+        _curr[(i - 1) * _cols + j].y += halfMag;
+    }
+
+    void Step()
+    {
+        for (unsigned i = 1; i < _rows - 1; i++)
+        {
+            for (unsigned j = 1; j < _cols - 1; j++)
+            {
+                _prev[i * _cols + j].y = _k1 * _prev[i * _cols + j].y + _k2 * _curr[i * _cols + j].y +
+                                         _k3 * (_curr[(i + 1) * _cols + j].y + _curr[(i - 1) * _cols + j].y +
+                                                _curr[i * _cols + j + 1].y + _curr[i * _cols + j - 1].y);
+            }
+        }
+        std::swap(_prev, _curr);
+
+        for (unsigned i = 1; i < _rows - 1; i++)
+        {
+            for (unsigned j = 1; j < _cols - 1; j++)
+            {
+                float l = _curr[i * _cols + j - 1].y;
+                float r = _curr[i * _cols + j + 1].y;
+                float t = _curr[(i - 1) * _cols + j].y;
+                float b = _curr[(i + 1) * _cols + j].y;
+                _normals[i * _cols + j] = Normalize(Float3(l - r, 2.0f * _dx, b - t));
+                _tangentX[i * _cols + j] = Normalize(Float3(2.0f * _dx, r - l, 0.0f));
+            }
+        }
+    }
+
+    float Height(size_t v) const { return _curr[v].y; }
+    const Float3& Normal(size_t v) const { return _normals[v]; }
+    const Float3& TangentX(size_t v) const { return _tangentX[v]; }
+
+private:
+    unsigned _rows;
+    unsigned _cols;
+    float _dx;
+    float _k1;
+    float _k2;
+    float _k3;
+    std::vector<Float3> _prev;
+    std::vector<Float3> _curr;
+    std::vector<Float3> _normals;
+    std::vector<Float3> _tangentX;
+
+    static Float3 Normalize(const Float3& v)
+    {
+        float inv = 1.0f / sqrtf(v.x * v.x + v.y * v.y + v.z * v.z);
+        return Float3(v.x * inv, v.y * inv, v.z * inv);
+    }
+};
+
+// The constants of the book's waves demo
+static const float WavesDx = 1.0f;
+static const float WavesDt = 0.03f;
+static const float WavesSpeed = 3.25f;
+static const float WavesDamping = 0.4f;
+
+// One step of square grids of size vertices: the book's loop, ParallelWaves
+// on the calling thread and on pools of 1, 2 and 4 threads
+static void BenchWaves(BenchRunner* runner)
+{
+    const unsigned threadCounts[] = {1, 2, 4};
+
+    std::vector<size_t> sizes = runner->SizesUpTo(1 << 22);
+    for (size_t i = 0; i < sizes.size(); i++)
+    {
+        unsigned side = (unsigned)sqrt((double)sizes[i]);
+        size_t count = (size_t)side * side;
+
+        if (runner->Wants("waves/reference"))
+        {
+            BookWaves waves;
+            waves.Init(side, side, WavesDx, WavesDt, WavesSpeed, WavesDamping);
+            waves.Disturb(side / 2, side / 2, 1.0f);
+            runner->Run("waves/reference", count, [&]() {
+                waves.Step();
+                Sink((unsigned)waves.Height(count / 2));
+            });
+        }
+        if (runner->Wants("waves/serial"))
+        {
+            ParallelWaves waves;
+            waves.Init(side, side, WavesDx, WavesDt, WavesSpeed, WavesDamping, NULL);
+            waves.Disturb(side / 2, side / 2, 1.0f);
+            runner->Run("waves/serial", count, [&]() {
+                waves.Step();
+                Sink((unsigned)waves.Heights()[count / 2]);
+            });
+        }
+        for (size_t t = 0; t < sizeof(threadCounts) / sizeof(threadCounts[0]); t++)
+        {
+            char name[32];
+            snprintf(name, sizeof(name), "waves/threads-%u", threadCounts[t]);
+            if (!runner->Wants(name))
+            {
+                continue;
+            }
+
+            ThreadPool pool(threadCounts[t]);
+            ParallelWaves waves;
+            waves.Init(side, side, WavesDx, WavesDt, WavesSpeed, WavesDamping, &pool);
+            waves.Disturb(side / 2, side / 2, 1.0f);
+            runner->Run(name, count, [&]() {
+                waves.Step();
+                Sink((unsigned)waves.Heights()[count / 2]);
+            });
+        }
+    }
+}
+
+// count boxes of 1 to 10 units scattered over a cube 1000 units across,
+// and the frustum of Box's camera turned angle radians around the y axis
+static void CullScene(size_t count, AabbSoA* boxes)
+{
+    SceneRandom random(BenchSeed);
+    boxes->Clear();
+    boxes->Reserve(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        float cx = RandomFloat(&random, -500.0f, 500.0f);
+        float cy = RandomFloat(&random, -500.0f, 500.0f);
+        float cz = RandomFloat(&random, -500.0f, 500.0f);
+        boxes->Add(cx, cy, cz, RandomFloat(&random, 0.5f, 5.0f), RandomFloat(&random, 0.5f, 5.0f),
+                   RandomFloat(&random, 0.5f, 5.0f));
+    }
+}
+
+static CullFrustum CullCamera(float angle)
+{
+    Float3 eye(400.0f * sinf(angle), 200.0f, -400.0f * cosf(angle));
+    Matrix4x4 viewProj = Matrix4x4::LookAtLH(eye, Float3(0.0f, 0.0f, 0.0f), Float3(0.0f, 1.0f, 0.0f)) *
+                         Matrix4x4::PerspectiveFovLH(0.25f * 3.1415926535f, 800.0f / 600.0f, 1.0f, 1000.0f);
+    return FrustumFromMatrix(&viewProj.m[0][0]);
+}
+
+// Boxes tested one per call, as Box does through xnacollision, with the
+// SIMD kernel compiled in, and through the BVH, which is built once
+static void BenchCull(BenchRunner* runner)
+{
+    std::string batchName = std::string("cull/") + CullKernelName();
+    CullFrustum frustum = CullCamera(0.0f);
+
+    std::vector<size_t> sizes = runner->SizesUpTo(1 << 20);
+    for (size_t i = 0; i < sizes.size(); i++)
+    {
+        size_t count = sizes[i];
+        AabbSoA boxes;
+        CullScene(count, &boxes);
+        std::vector<unsigned> visible;
+
+        if (runner->Wants("cull/scalar"))
+        {
+            runner->Run("cull/scalar", count, [&]() {
+                Sink((unsigned)CullAabbsScalar(frustum, boxes, &visible));
+            });
+        }
+        if (runner->Wants(batchName.c_str()))
+        {
+            runner->Run(batchName.c_str(), count, [&]() {
+                Sink((unsigned)CullAabbs(frustum, boxes, &visible));
+            });
+        }
+        if (runner->Wants("cull/bvh"))
+        {
+            CullBvh bvh;
+            bvh.Build(boxes);
+            runner->Run("cull/bvh", count, [&]() {
+                Sink((unsigned)bvh.Cull(frustum, &visible));
+            });
+        }
+    }
+}
+
+// The cost PROFILE_ZONE adds: reading the clock alone, an empty zone on
+// this thread, and Profiler::MeasureZoneOverhead's own figure, which the
+// apps' reports can be read against
+static void BenchProfiler(BenchRunner* runner)
+{
+    std::vector<size_t> sizes = runner->SizesUpTo(1 << 20);
+    for (size_t i = 0; i < sizes.size(); i++)
+    {
+        size_t count = sizes[i];
+        if (runner->Wants("profiler/now"))
+        {
+            runner->Run("profiler/now", count, [&]() {
+                unsigned long long sum = 0;
+                for (size_t z = 0; z < count; z++)
+                {
+                    sum += Profiler::Now();
+                }
+                Sink((unsigned)sum);
+            });
+        }
+        if (runner->Wants("profiler/zone"))
+        {
+            runner->Run("profiler/zone", count, [&]() {
+                for (size_t z = 0; z < count; z++)
+                {
+                    PROFILE_ZONE("BenchZone");
+                }
+            });
+        }
+    }
+
+    if (runner->Wants("profiler/overhead") && !sizes.empty())
+    {
+        unsigned iterations = (unsigned)sizes.back();
+        printf("  %-24s %10u  %.1f ns per zone, from Profiler::MeasureZoneOverhead\n", "profiler/overhead",
+               iterations, Profiler::MeasureZoneOverhead(iterations));
+        fflush(stdout);
+    }
+}
+
+// Stands in for D3DX: the "bytecode" is everything the compiler was
+// given, so a stale cache hit shows up as the wrong bytes
+static bool StubCompile(const ShaderSource& source, std::vector<unsigned char>* bytecode, std::string* errors)
+{
+    if (source.text.empty())
+    {
+        *errors = source.fileName + ": empty";
+        return false;
+    }
+
+    char flags[16];
+    snprintf(flags, sizeof(flags), "|%08x", source.flags);
+    std::string code = "DXBC|" + source.entryPoint + "|" + source.profile + flags;
+    for (size_t i = 0; i < source.defines.size(); i++)
+    {
+        code += "|" + source.defines[i].name + "=" + source.defines[i].value;
+    }
+    code += "|" + source.text;
+    bytecode->assign(code.begin(), code.end());
+    return true;
+}
+
+// 2DTest's shader startup with the cache cold, a compile and a store,
+// against warm, a read and a checksum. The stub compiler costs next to
+// nothing, so cold is what the cache adds on top of D3DX's compile time.
+// Sizes are bytes of source.
+static void BenchShaderCache(BenchRunner* runner)
+{
+    if (!runner->Wants("shader/"))
+    {
+        return;
+    }
+
+    ShaderCache cache(".", StubCompile);
+    std::vector<size_t> sizes = runner->SizesUpTo(1 << 20);
+    for (size_t i = 0; i < sizes.size(); i++)
+    {
+        SceneRandom random(BenchSeed);
+        ShaderSource source;
+        source.fileName = "bench.shader";
+        source.entryPoint = "VShader";
+        source.profile = "vs_4_0";
+        source.text.resize(sizes[i]);
+        for (size_t c = 0; c < sizes[i]; c++)
+        {
+            source.text[c] = (char)('a' + random.Next() % 26);
+        }
+        std::string path = cache.PathFor(cache.Key(source));
+        std::vector<unsigned char> bytecode;
+        std::string errors;
+
+        if (runner->Wants("shader/cold"))
+        {
+            runner->Run("shader/cold", sizes[i], [&]() {
+                remove(path.c_str());
+                Sink(cache.Load(source, &bytecode, &errors) ? (unsigned)bytecode.size() : 0);
+            });
+        }
+        if (runner->Wants("shader/warm"))
+        {
+            runner->Run("shader/warm", sizes[i], [&]() {
+                Sink(cache.Load(source, &bytecode, &errors) ? (unsigned)bytecode.size() : 0);
+            });
+        }
+        remove(path.c_str());
+    }
+}
+
+static void BenchPack(BenchRunner* runner)
+{
+    std::vector<size_t> sizes = runner->SizesUpTo(~(size_t)0);
+    for (size_t i = 0; i < sizes.size(); i++)
+    {
+        size_t count = sizes[i];
+        SceneRandom random(BenchSeed);
+        std::vector<FloatVertex> src(count);
+        std::vector<PackedVertex> dst(count);
+        for (size_t v = 0; v < count; v++)
+        {
+            FloatVertex& vertex = src[v];
+            vertex.x = RandomFloat(&random, -1.0f, 1.0f);
+            vertex.y = RandomFloat(&random, -1.0f, 1.0f);
+            vertex.z = RandomFloat(&random, -1.0f, 1.0f);
+            vertex.r = RandomFloat(&random, 0.0f, 1.0f);
+            vertex.g = RandomFloat(&random, 0.0f, 1.0f);
+            vertex.b = RandomFloat(&random, 0.0f, 1.0f);
+            vertex.a = 1.0f;
+        }
+
+        if (runner->Wants("pack/scalar"))
+        {
+            runner->Run("pack/scalar", count, [&]() {
+                PackVerticesScalar(&src[0], &dst[0], count);
+                Sink((unsigned)dst.back().x);
+            });
+        }
+        if (runner->Wants("pack/batch"))
+        {
+            runner->Run("pack/batch", count, [&]() {
+                PackVertices(&src[0], &dst[0], count);
+                Sink((unsigned)dst.back().x);
+            });
+        }
+
+        std::vector<FloatVertex> unpacked(count);
+        if (runner->Wants("unpack/scalar"))
+        {
+            runner->Run("unpack/scalar", count, [&]() {
+                UnpackVerticesScalar(&dst[0], &unpacked[0], count);
+                Sink((unsigned)unpacked.back().r);
+            });
+        }
+        if (runner->Wants("unpack/batch"))
+        {
+            runner->Run("unpack/batch", count, [&]() {
+                UnpackVertices(&dst[0], &unpacked[0], count);
+                Sink((unsigned)unpacked.back().r);
+            });
+        }
+    }
+}
+
+// Frames 1024 pixels wide, as many rows as the size needs
+static void BenchConvert(BenchRunner* runner)
+{
+    std::vector<size_t> sizes = runner->SizesUpTo(~(size_t)0);
+    for (size_t i = 0; i < sizes.size(); i++)
+    {
+        size_t count = sizes[i];
+        unsigned width = 1024, height = (unsigned)(count / width);
+        SceneRandom random(BenchSeed);
+        std::vector<unsigned> rgba(count);
+        for (size_t p = 0; p < count; p++)
+        {
+            rgba[p] = (unsigned)random.Next();
+        }
+        std::vector<unsigned char> yuv(I420Size(width, height));
+
+        if (runner->Wants("convert/scalar"))
+        {
+            runner->Run("convert/scalar", count, [&]() {
+                RgbaToI420Scalar(&rgba[0], width, height, &yuv[0]);
+                Sink(yuv.back());
+            });
+        }
+        if (runner->Wants("convert/batch"))
+        {
+            runner->Run("convert/batch", count, [&]() {
+                RgbaToI420(&rgba[0], width, height, &yuv[0]);
+                Sink(yuv.back());
+            });
+        }
+    }
+}
+
+// Box's per-object matrices, the way color.fx takes them against the
+// batch colorInstanced.fx reads
+static void BenchBox(BenchRunner* runner, ThreadPool* pool)
+{
+    Matrix4x4 viewProj = Matrix4x4::LookAtLH(Float3(0.0f, 200.0f, -400.0f), Float3(0.0f, 0.0f, 0.0f),
+                                             Float3(0.0f, 1.0f, 0.0f)) *
+                         Matrix4x4::PerspectiveFovLH(0.25f * 3.1415926535f, 800.0f / 600.0f, 1.0f, 1000.0f);
+
+    std::vector<size_t> sizes = runner->SizesUpTo(1 << 20);
+    for (size_t i = 0; i < sizes.size(); i++)
+    {
+        size_t count = sizes[i];
+        std::vector<Matrix4x4> worlds(count), wvp(count), upload(count);
+        GridWorlds(count, 3.0f, 0.0f, &worlds[0], NULL);
+
+        // One multiply and one constant buffer update per object, as
+        // gWorldViewProj->SetMatrix and Apply do before each draw
+        if (runner->Wants("box/per-object"))
+        {
+            Matrix4x4 constants;
+            runner->Run("box/per-object", count, [&]() {
+                for (size_t o = 0; o < count; o++)
+                {
+                    Matrix4x4 m = worlds[o] * viewProj;
+                    memcpy(&constants, &m, sizeof(constants));
+                    Sink((unsigned)constants.m[3][3]);
+                }
+            });
+        }
+        if (runner->Wants("box/batch"))
+        {
+            runner->Run("box/batch", count, [&]() {
+                ComputeWorldViewProj(&worlds[0], viewProj, &wvp[0], count, NULL);
+                Sink((unsigned)wvp.back().m[3][3]);
+            });
+        }
+        if (runner->Wants("box/parallel"))
+        {
+            runner->Run("box/parallel", count, [&]() {
+                ComputeWorldViewProj(&worlds[0], viewProj, &wvp[0], count, pool);
+                Sink((unsigned)wvp.back().m[3][3]);
+            });
+        }
+
+        // The CPU side of a frame: move every box, compute the matrices
+        // and copy them into the mapped instance buffer
+        if (runner->Wants("box/frame"))
+        {
+            float time = 0.0f;
+            runner->Run("box/frame", count, [&]() {
+                time += 0.016f;
+                GridWorlds(count, 3.0f, time, &worlds[0], pool);
+                ComputeWorldViewProj(&worlds[0], viewProj, &wvp[0], count, pool);
+                memcpy(&upload[0], &wvp[0], count * sizeof(Matrix4x4));
+                Sink((unsigned)upload.back().m[3][3]);
+            });
+        }
+    }
+}
+
+// Chaos game samples formatted into PointCloudWriter's buffers, the cost
+// Headless --points adds to generating them, with the disk left out
+static void BenchPointCloud(BenchRunner* runner)
+{
+    const char* names[] = {"pointcloud/blocks", "pointcloud/ply"};
+    const PointCloudFormat formats[] = {PointCloud_Blocks, PointCloud_Ply};
+
+    std::vector<size_t> sizes = runner->SizesUpTo(1 << 22);
+    for (size_t i = 0; i < sizes.size(); i++)
+    {
+        SierpinskiParams params;
+        DefaultSierpinski(800, 600, sizes[i], BenchSeed, &params);
+        std::vector<float> x(sizes[i]), y(sizes[i]);
+        std::vector<unsigned char> corners(sizes[i]);
+        GenerateChaosSamples(params, 0, ChaosChunkCount(params), &x[0], &y[0], &corners[0], NULL);
+
+        for (int f = 0; f < 2; f++)
+        {
+            if (!runner->Wants(names[f]))
+            {
+                continue;
+            }
+
+            PointCloudSettings settings;
+            settings.format = formats[f];
+            settings.bufferBytes = 1 << 20;
+            settings.buffers = 4;
+            settings.direct = false;
+            runner->Run(names[f], sizes[i], [&]() {
+                PointCloudWriter writer;
+                writer.Open(NULL, settings.format, sizes[i], params.corners, settings);
+                writer.Write(&x[0], &y[0], &corners[0], sizes[i]);
+                Sink(writer.Close() ? 1 : 0);
+            });
+        }
+    }
+}
+
+// Four partial histograms of count bins added up, as ChaosCluster merges
+// its workers'
+static void BenchHistogram(BenchRunner* runner, ThreadPool* pool)
+{
+    const size_t partialCount = 4;
+    std::vector<size_t> sizes = runner->SizesUpTo(~(size_t)0);
+    for (size_t i = 0; i < sizes.size(); i++)
+    {
+        size_t count = sizes[i];
+        SceneRandom random(BenchSeed);
+        std::vector<std::vector<unsigned> > partials(partialCount, std::vector<unsigned>(count));
+        const unsigned* partialData[partialCount];
+        for (size_t p = 0; p < partialCount; p++)
+        {
+            for (size_t b = 0; b < count; b++)
+            {
+                partials[p][b] = (unsigned)random.Next() & 0xFFFF;
+            }
+            partialData[p] = &partials[p][0];
+        }
+        std::vector<unsigned> merged(count);
+
+        if (runner->Wants("histogram/scalar"))
+        {
+            runner->Run("histogram/scalar", count, [&]() {
+                memcpy(&merged[0], partialData[0], count * sizeof(unsigned));
+                for (size_t p = 1; p < partialCount; p++)
+                {
+                    AddHistogramScalar(&merged[0], partialData[p], count);
+                }
+                Sink(merged.back());
+            });
+        }
+        if (runner->Wants("histogram/batch"))
+        {
+            runner->Run("histogram/batch", count, [&]() {
+                MergeHistograms(partialData, partialCount, count, &merged[0], NULL);
+                Sink(merged.back());
+            });
+        }
+        if (runner->Wants("histogram/parallel"))
+        {
+            runner->Run("histogram/parallel", count, [&]() {
+                MergeHistograms(partialData, partialCount, count, &merged[0], pool);
+                Sink(merged.back());
+            });
+        }
+    }
+}
+
+//
+// Macro benchmarks, whole frames as Headless renders them
+//
+
+static void BenchScenes(BenchRunner* runner, ThreadPool* pool, const Polylines& dino)
+{
+    Image image(800, 600);
+
+    if (runner->Wants("scene/sierpinski"))
+    {
+        std::vector<size_t> sizes = runner->SizesUpTo(~(size_t)0);
+        for (size_t i = 0; i < sizes.size(); i++)
+        {
+            SierpinskiParams params;
+            DefaultSierpinski(image.Width(), image.Height(), sizes[i], BenchSeed, &params);
+            std::vector<Float2> points;
+            runner->Run("scene/sierpinski", sizes[i], [&]() {
+                GenerateChaosPoints(params, &points, pool);
+                RenderSierpinski(params, points, &image);
+                Sink(image.Pixels()[0]);
+            });
+        }
+    }
+
+    if (runner->Wants("scene/transform") && !dino.empty())
+    {
+        TransformParams params;
+        params.rotation = 30.0f;
+        params.scale = 0.8f;
+        params.translation = Float2(20.0f, -10.0f);
+        runner->Run("scene/transform", PointCount(dino), [&]() {
+            RenderPolylines(dino, TransformSceneMatrix(dino, params, image.Width(), image.Height()), &image);
+            Sink(image.Pixels()[0]);
+        });
+    }
+
+    if (runner->Wants("scene/triangle"))
+    {
+        runner->Run("scene/triangle", (size_t)image.Width() * image.Height(), [&]() {
+            RenderTriangle(&image);
+            Sink(image.Pixels()[0]);
+        });
+    }
+}
+
+//
+// Golden images
+//
+
+static const unsigned GoldenWidth = 320;
+static const unsigned GoldenHeight = 240;
+
+// Every scene at a small fixed size. Sierpinski's points come from the
+// pool, which has to give the same points as one thread; the _aa scenes
+// draw their lines antialiased, the tiles spread over the pool.
+static void RenderGoldenScene(const char* scene, ThreadPool* pool, const Polylines& dino, Image* image)
+{
+    image->Resize(GoldenWidth, GoldenHeight);
+    CommandBuffer commands;
+    LineRasterizer lines;
+    bool antialias = strstr(scene, "_aa") != NULL;
+    if (strncmp(scene, "sierpinski", 10) == 0)
+    {
+        SierpinskiParams params;
+        DefaultSierpinski(GoldenWidth, GoldenHeight, 3 * ChaosChunkSize / 2, BenchSeed, &params);
+        std::vector<Float2> points;
+        GenerateChaosPoints(params, &points, pool);
+        RecordSierpinski(params, &points[0], points.size(), &commands);
+    }
+    else if (strncmp(scene, "transform", 9) == 0)
+    {
+        TransformParams params;
+        params.rotation = 30.0f;
+        params.scale = 0.8f;
+        params.translation = Float2(20.0f, -10.0f);
+        RecordPolylines(dino, TransformSceneMatrix(dino, params, GoldenWidth, GoldenHeight), &commands);
+    }
+    else if (strcmp(scene, "triangle") == 0)
+    {
+        RenderTriangle(image);
+    }
+    else
+    {
+        // The raster benchmarks' primitives, fewer of them
+        SceneRandom random(BenchSeed);
+        image->Clear(PackRgba(255, 255, 255));
+        for (int i = 0; i < 256; i++)
+        {
+            Float2 positions[3];
+            Float4 colors[3];
+            Float2 center(RandomFloat(&random, -16.0f, GoldenWidth + 16.0f),
+                          RandomFloat(&random, -16.0f, GoldenHeight + 16.0f));
+            for (int v = 0; v < 3; v++)
+            {
+                positions[v] = center + Float2(RandomFloat(&random, -16.0f, 16.0f), RandomFloat(&random, -16.0f, 16.0f));
+                colors[v] = Float4(RandomFloat(&random, 0.0f, 1.0f), RandomFloat(&random, 0.0f, 1.0f),
+                                   RandomFloat(&random, 0.0f, 1.0f), 1.0f);
+            }
+            if (i % 2)
+            {
+                FillTriangle(image, positions, colors);
+            }
+            else
+            {
+                DrawLine(image, positions[0], positions[1], PackRgba(0, 128, 0));
+                DrawCross(image, positions[2], 3, PackRgba(0, 0, 0));
+            }
+        }
+    }
+
+    SoftwareCommandBackend backend(image);
+    backend.SetAntialiasing(antialias ? &lines : NULL, pool);
+    commands.Replay(&backend);
+}
+
+static GoldenResult CompareImages(const char* scene, const Image& image, const Image& golden, const Options& options)
+{
+    GoldenResult result;
+    result.scene = scene;
+    result.maxDifference = 0;
+    result.differing = 0;
+    result.pixels = (size_t)image.Width() * image.Height();
+
+    if (image.Width() != golden.Width() || image.Height() != golden.Height())
+    {
+        result.maxDifference = 255;
+        result.differing = result.pixels;
+        result.pass = false;
+        return result;
+    }
+
+    const unsigned* a = image.Pixels();
+    const unsigned* b = golden.Pixels();
+    for (size_t i = 0; i < result.pixels; i++)
+    {
+        // PPMs have no alpha, so only RGB
+        unsigned worst = 0;
+        for (int shift = 0; shift < 24; shift += 8)
+        {
+            int ca = (a[i] >> shift) & 0xFF, cb = (b[i] >> shift) & 0xFF;
+            unsigned difference = (unsigned)(ca > cb ? ca - cb : cb - ca);
+            worst = difference > worst ? difference : worst;
+        }
+        result.maxDifference = worst > result.maxDifference ? worst : result.maxDifference;
+        result.differing += worst > options.tolerance;
+    }
+    result.pass = result.differing <= options.maxDiffering * result.pixels;
+    return result;
+}
+
+static bool CheckGolden(const Options& options, ThreadPool* pool, const Polylines& dino,
+                        std::vector<GoldenResult>* results)
+{
+    static const char* scenes[] = {"sierpinski", "transform", "triangle", "primitives", "sierpinski_aa",
+                                   "transform_aa"};
+
+    bool ok = true;
+    printf("\ngolden images, %s\n", options.golden.c_str());
+    for (size_t i = 0; i < sizeof(scenes) / sizeof(scenes[0]); i++)
+    {
+        if (strncmp(scenes[i], "transform", 9) == 0 && dino.empty())
+        {
+            continue;
+        }
+
+        Image image;
+        RenderGoldenScene(scenes[i], pool, dino, &image);
+        std::string path = options.golden + "/" + scenes[i] + ".ppm";
+
+        if (options.updateGolden)
+        {
+            bool written = image.WritePpm(path.c_str());
+            printf("  %-14s %s %s\n", scenes[i], written ? "wrote" : "failed to write", path.c_str());
+            ok = ok && written;
+            continue;
+        }
+
+        Image golden;
+        if (!golden.ReadPpm(path.c_str()))
+        {
+            printf("  %-14s missing %s, run with --update-golden\n", scenes[i], path.c_str());
+            ok = false;
+            continue;
+        }
+
+        GoldenResult result = CompareImages(scenes[i], image, golden, options);
+        printf("  %-14s %s, %llu of %llu pixels differ, max difference %u\n", scenes[i],
+               result.pass ? "pass" : "FAIL", (unsigned long long)result.differing,
+               (unsigned long long)result.pixels, result.maxDifference);
+        if (!result.pass)
+        {
+            std::string failed = std::string(scenes[i]) + ".failed.ppm";
+            image.WritePpm(failed.c_str());
+            printf("  %-14s wrote what it rendered to %s\n", "", failed.c_str());
+        }
+        ok = ok && result.pass;
+        results->push_back(result);
+    }
+    return ok;
+}
+
+//
+// Checks of what the shared code promises, beyond the images
+//
+
+// One line per check, like the golden images'
+static bool Report(const char* name, bool pass, const char* format, ...)
+{
+    char detail[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(detail, sizeof(detail), format, args);
+    va_end(args);
+
+    printf("  %-24s %s, %s\n", name, pass ? "pass" : "FAIL", detail);
+    return pass;
+}
+
+// A malformed file ends the load as Failed with the polylines before the
+// error delivered, including one whose point count is far more than the
+// file holds, which mustn't be allocated up front
+static bool CheckLoader(ThreadPool* pool)
+{
+    struct Case
+    {
+        const char* name;
+        const char* text;
+        size_t lines;
+    };
+    static const Case cases[] =
+    {
+        { "load/truncated", "3\n2\n0 0 1 1\n2\n2 2 3", 1 },
+        { "load/huge-count", "1\n2000000000\n1 2\n", 0 },
+    };
+
+    Matrix3x2 identity = {1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f};
+    bool ok = true;
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++)
+    {
+        std::string text = cases[c].text;
+        TextBuffer buffer(text);
+        std::istream in(&buffer);
+        PolylineLoader loader;
+        std::vector<PolylineBatch> batches;
+        loader.Start(&in, identity, pool, PolylineReadyFunction());
+        loader.Wait();
+        loader.Take(&batches);
+
+        size_t lines = 0;
+        for (size_t b = 0; b < batches.size(); b++)
+        {
+            lines += batches[b].lines.size();
+        }
+        bool failed = loader.State() == PolylineLoad_Failed;
+        ok = Report(cases[c].name, failed && lines == cases[c].lines, "%s, %llu of %llu lines delivered",
+                    failed ? "failed" : "did not fail", (unsigned long long)lines,
+                    (unsigned long long)cases[c].lines) && ok;
+    }
+    return ok;
+}
+
+// No upload may land on bytes a frame the GPU hasn't finished still reads.
+// A discard hands the old bytes to the driver, so only ranges written
+// since the last one count.
+static bool CheckRing()
+{
+    std::vector<size_t> uploadSizes;
+    RingUploadSizes(1 << 14, &uploadSizes);
+    std::vector<unsigned char> vertices(RingMaxUpload);
+
+    bool ok = true;
+    for (int discard = 1; discard >= 0; discard--)
+    {
+        for (unsigned latency = 0; latency <= 3; latency++)
+        {
+            struct Range
+            {
+                unsigned long long frame;
+                size_t offset;
+                size_t size;
+            };
+            std::vector<Range> written;
+
+            CpuDynamicBuffer buffer(RingCapacity, discard != 0, latency);
+            RingVertexAllocator ring(&buffer);
+            size_t overlaps = 0, failures = 0;
+            for (size_t u = 0; u < uploadSizes.size(); u++)
+            {
+                if (u % RingUploadsPerFrame == 0)
+                {
+                    if (u > 0)
+                    {
+                        ring.EndFrame();
+                    }
+                    ring.BeginFrame();
+                }
+
+                unsigned long long discards = ring.Stats().discardMaps;
+                size_t offset;
+                if (!ring.Upload(&vertices[0], uploadSizes[u], 16, &offset))
+                {
+                    failures++;
+                    continue;
+                }
+                if (ring.Stats().discardMaps != discards)
+                {
+                    written.clear();
+                }
+
+                unsigned long long completed = buffer.CompletedFrame();
+                size_t kept = 0;
+                for (size_t r = 0; r < written.size(); r++)
+                {
+                    if (written[r].frame <= completed)
+                    {
+                        continue;
+                    }
+                    if (offset < written[r].offset + written[r].size && written[r].offset < offset + uploadSizes[u])
+                    {
+                        overlaps++;
+                    }
+                    written[kept++] = written[r];
+                }
+                written.resize(kept);
+
+                Range range = { ring.CurrentFrame(), offset, uploadSizes[u] };
+                written.push_back(range);
+            }
+            ring.EndFrame();
+
+            char name[32];
+            snprintf(name, sizeof(name), "ring/%s-%u", discard ? "discard" : "wait", latency);
+            const RingAllocatorStats& stats = ring.Stats();
+            ok = Report(name, overlaps == 0 && failures == 0,
+                        "%llu uploads, %llu overlaps, %llu failed, %llu discards, %llu stalls",
+                        (unsigned long long)uploadSizes.size(), (unsigned long long)overlaps,
+                        (unsigned long long)failures, stats.discardMaps, stats.stalls) && ok;
+        }
+    }
+    return ok;
+}
+
+// Odd counts, so every backend's tail runs, and each of them in place
+static const size_t BatchCheckCounts[] = { 0, 1, 2, 3, 5, 7, 9, 15, 17, 31, 33, 1001 };
+static const size_t BatchCheckMax = 1001;
+
+// Relative past 1, so large coordinates get the same few ulps as small
+static float BatchError(float a, float b)
+{
+    float scale = fabsf(a) > fabsf(b) ? fabsf(a) : fabsf(b);
+    return fabsf(a - b) / (scale > 1.0f ? scale : 1.0f);
+}
+
+// The compiled-in VecMath backend gives the scalar results on every
+// count, out of place and in place, and writes nothing past the end.
+// The batch paths add in another order and may fuse multiply-adds, so the
+// last bits can differ, hence a tolerance.
+static bool CheckVecMath()
+{
+    static const float Tolerance = 1e-5f;
+    static const float Guard = 12345.0f;
+
+    SceneRandom random(BenchSeed);
+    auto next = [&]() { return (float)((double)(random.Next() >> 11) / (1ULL << 53) * 200.0 - 100.0); };
+
+    Matrix3x2 m2 = {next(), next(), next(), next(), next(), next()};
+    Matrix4x4 m4;
+    for (int r = 0; r < 4; r++)
+    {
+        for (int c = 0; c < 4; c++)
+        {
+            m4.m[r][c] = next() / 100.0f;
+        }
+    }
+
+    std::vector<float> in[3];
+    std::vector<Matrix4x4> matrices(BatchCheckMax);
+    for (int a = 0; a < 3; a++)
+    {
+        in[a].resize(BatchCheckMax);
+        for (size_t i = 0; i < BatchCheckMax; i++)
+        {
+            in[a][i] = next();
+        }
+    }
+    for (size_t i = 0; i < BatchCheckMax; i++)
+    {
+        for (int r = 0; r < 4; r++)
+        {
+            for (int c = 0; c < 4; c++)
+            {
+                matrices[i].m[r][c] = next() / 100.0f;
+            }
+        }
+    }
+
+    // worst[f] and overruns[f] for points2, points3 and matrices
+    float worst[3] = { 0.0f, 0.0f, 0.0f };
+    size_t overruns[3] = { 0, 0, 0 };
+    for (size_t c = 0; c < sizeof(BatchCheckCounts) / sizeof(BatchCheckCounts[0]); c++)
+    {
+        size_t count = BatchCheckCounts[c];
+
+        // One past count is the guard
+        std::vector<float> expected[4], out[4], inPlace[4];
+        for (int a = 0; a < 4; a++)
+        {
+            expected[a].assign(count + 1, Guard);
+            out[a].assign(count + 1, Guard);
+            inPlace[a].assign(count + 1, Guard);
+            if (a < 3)
+            {
+                std::copy(in[a].begin(), in[a].begin() + count, inPlace[a].begin());
+            }
+        }
+
+        TransformPoints2Scalar(m2, &in[0][0], &in[1][0], &expected[0][0], &expected[1][0], count);
+        TransformPoints2(m2, &in[0][0], &in[1][0], &out[0][0], &out[1][0], count);
+        TransformPoints2(m2, &inPlace[0][0], &inPlace[1][0], &inPlace[0][0], &inPlace[1][0], count);
+        for (int a = 0; a < 2; a++)
+        {
+            for (size_t i = 0; i < count; i++)
+            {
+                worst[0] = std::max(worst[0], BatchError(out[a][i], expected[a][i]));
+                worst[0] = std::max(worst[0], BatchError(inPlace[a][i], expected[a][i]));
+            }
+            overruns[0] += (out[a][count] != Guard) + (inPlace[a][count] != Guard);
+        }
+
+        for (int a = 0; a < 3; a++)
+        {
+            std::copy(in[a].begin(), in[a].begin() + count, inPlace[a].begin());
+        }
+        TransformPoints3Scalar(m4, &in[0][0], &in[1][0], &in[2][0], &expected[0][0], &expected[1][0],
+                               &expected[2][0], &expected[3][0], count);
+        TransformPoints3(m4, &in[0][0], &in[1][0], &in[2][0], &out[0][0], &out[1][0], &out[2][0], &out[3][0],
+                         count);
+        TransformPoints3(m4, &inPlace[0][0], &inPlace[1][0], &inPlace[2][0], &inPlace[0][0], &inPlace[1][0],
+                         &inPlace[2][0], NULL, count);
+        for (int a = 0; a < 4; a++)
+        {
+            for (size_t i = 0; i < count; i++)
+            {
+                worst[1] = std::max(worst[1], BatchError(out[a][i], expected[a][i]));
+                if (a < 3)
+                {
+                    worst[1] = std::max(worst[1], BatchError(inPlace[a][i], expected[a][i]));
+                }
+            }
+            overruns[1] += (out[a][count] != Guard) + (inPlace[a][count] != Guard);
+        }
+
+        std::vector<Matrix4x4> products(count + 1), multiplied(count + 1), self(matrices.begin(),
+                                                                               matrices.begin() + count + 1);
+        for (int r = 0; r < 4; r++)
+        {
+            for (int k = 0; k < 4; k++)
+            {
+                multiplied[count].m[r][k] = Guard;
+                self[count].m[r][k] = Guard;
+            }
+        }
+        MultiplyMatricesScalar(&matrices[0], m4, &products[0], count);
+        MultiplyMatrices(&matrices[0], m4, &multiplied[0], count);
+        MultiplyMatrices(&self[0], m4, &self[0], count);
+        for (size_t i = 0; i <= count; i++)
+        {
+            for (int r = 0; r < 4; r++)
+            {
+                for (int k = 0; k < 4; k++)
+                {
+                    if (i == count)
+                    {
+                        overruns[2] += (multiplied[i].m[r][k] != Guard) + (self[i].m[r][k] != Guard);
+                        continue;
+                    }
+                    worst[2] = std::max(worst[2], BatchError(multiplied[i].m[r][k], products[i].m[r][k]));
+                    worst[2] = std::max(worst[2], BatchError(self[i].m[r][k], products[i].m[r][k]));
+                }
+            }
+        }
+    }
+
+    static const char* const names[] = { "vecmath/points2", "vecmath/points3", "vecmath/matrices" };
+    bool ok = true;
+    for (int f = 0; f < 3; f++)
+    {
+        ok = Report(names[f], worst[f] <= Tolerance && overruns[f] == 0, "%s against scalar, worst error %.2g, "
+                    "%llu writes past the end", VecMathBackend(), worst[f], (unsigned long long)overruns[f]) && ok;
+    }
+    return ok;
+}
+
+// The batch kernels give the same bytes as the scalar ones: packing
+// random vertices, some out of range, and unpacking every snorm16 and
+// unorm8 value
+static bool CheckPack()
+{
+    const size_t count = 1 << 16;
+    SceneRandom random(BenchSeed);
+    std::vector<FloatVertex> src(count);
+    for (size_t v = 0; v < count; v++)
+    {
+        FloatVertex& vertex = src[v];
+        vertex.x = RandomFloat(&random, -1.25f, 1.25f);
+        vertex.y = RandomFloat(&random, -1.25f, 1.25f);
+        vertex.z = RandomFloat(&random, -1.25f, 1.25f);
+        vertex.r = RandomFloat(&random, -0.25f, 1.25f);
+        vertex.g = RandomFloat(&random, -0.25f, 1.25f);
+        vertex.b = RandomFloat(&random, -0.25f, 1.25f);
+        vertex.a = RandomFloat(&random, -0.25f, 1.25f);
+    }
+    std::vector<PackedVertex> batch(count), scalar(count);
+    PackVertices(&src[0], &batch[0], count);
+    PackVerticesScalar(&src[0], &scalar[0], count);
+    bool packOk = memcmp(&batch[0], &scalar[0], count * sizeof(PackedVertex)) == 0;
+
+    for (size_t v = 0; v < count; v++)
+    {
+        PackedVertex& vertex = batch[v];
+        vertex.x = (short)(v - 32768);
+        vertex.y = (short)(32767 - v);
+        vertex.z = (short)(v * 7);
+        vertex.r = (unsigned char)v;
+        vertex.g = (unsigned char)(v >> 8);
+        vertex.b = (unsigned char)(255 - v);
+        vertex.a = (unsigned char)(v * 3);
+    }
+    std::vector<FloatVertex> batchFloats(count), scalarFloats(count);
+    UnpackVertices(&batch[0], &batchFloats[0], count);
+    UnpackVerticesScalar(&batch[0], &scalarFloats[0], count);
+    bool unpackOk = memcmp(&batchFloats[0], &scalarFloats[0], count * sizeof(FloatVertex)) == 0;
+
+    bool ok = Report("pack", packOk, "%llu vertices, batch %s scalar", (unsigned long long)count,
+                     packOk ? "matches" : "differs from");
+    return Report("unpack", unpackOk, "%llu vertices, batch %s scalar", (unsigned long long)count,
+                  unpackOk ? "matches" : "differs from") && ok;
+}
+
+// RgbaToI420 gives the scalar bytes on odd and even sizes, whole and in
+// two bands of rows, and writes nothing past the frame
+static bool CheckConvert()
+{
+    static const unsigned sizes[][2] = { {1, 1}, {2, 2}, {3, 3}, {7, 5}, {15, 9}, {16, 16}, {17, 13}, {33, 31},
+                                         {641, 481} };
+    static const size_t Slack = 64;
+
+    SceneRandom random(BenchSeed);
+    size_t differing = 0, overruns = 0;
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        unsigned width = sizes[s][0], height = sizes[s][1];
+        std::vector<unsigned> rgba((size_t)width * height);
+        for (size_t p = 0; p < rgba.size(); p++)
+        {
+            rgba[p] = (unsigned)random.Next();
+        }
+
+        size_t bytes = I420Size(width, height);
+        std::vector<unsigned char> scalar(bytes + Slack, 0xCD), batch(bytes + Slack, 0xCD),
+            banded(bytes + Slack, 0xCD);
+        RgbaToI420Scalar(&rgba[0], width, height, &scalar[0]);
+        RgbaToI420(&rgba[0], width, height, &batch[0]);
+        unsigned split = (height / 2) & ~1u;
+        RgbaToI420Rows(&rgba[0], width, height, 0, split, &banded[0]);
+        RgbaToI420Rows(&rgba[0], width, height, split, height, &banded[0]);
+
+        differing += memcmp(&batch[0], &scalar[0], bytes) != 0;
+        differing += memcmp(&banded[0], &scalar[0], bytes) != 0;
+        for (size_t i = bytes; i < bytes + Slack; i++)
+        {
+            overruns += (scalar[i] != 0xCD) + (batch[i] != 0xCD) + (banded[i] != 0xCD);
+        }
+    }
+
+    size_t frames = sizeof(sizes) / sizeof(sizes[0]);
+#ifdef COLORCONVERT_SSE2
+    const char* kernel = "SSE2";
+#else
+    const char* kernel = "scalar";
+#endif
+    return Report("convert", differing == 0 && overruns == 0, "%llu frames 1x1 to 641x481, %s against scalar, "
+                  "%llu differ, %llu bytes written past the end", (unsigned long long)frames, kernel,
+                  (unsigned long long)differing, (unsigned long long)overruns);
+}
+
+// MergeHistograms sums the partials to what AddHistogramScalar gives, on
+// counts that end inside a tile and inside a SIMD register, with and
+// without the pool and into the first partial. Values near 2^32 check the
+// adds wrap the same way.
+static bool CheckHistogram(ThreadPool* pool)
+{
+    static const size_t counts[] = { 1, 3, 17, HistogramTileSize - 1, HistogramTileSize + 5,
+                                     3 * HistogramTileSize + 7 };
+    static const size_t partialCounts[] = { 0, 1, 2, 5 };
+    static const unsigned Guard = 0xCDCDCDCD;
+
+    SceneRandom random(BenchSeed);
+    size_t differing = 0, overruns = 0, cases = 0;
+    for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++)
+    {
+        size_t count = counts[c];
+        for (size_t n = 0; n < sizeof(partialCounts) / sizeof(partialCounts[0]); n++)
+        {
+            size_t partialCount = partialCounts[n];
+            std::vector<std::vector<unsigned> > partials(partialCount > 0 ? partialCount : 1);
+            std::vector<const unsigned*> pointers;
+            for (size_t p = 0; p < partials.size(); p++)
+            {
+                partials[p].resize(count + 1, Guard);
+                for (size_t i = 0; i < count; i++)
+                {
+                    unsigned value = (unsigned)random.Next();
+                    partials[p][i] = (i & 1) ? value : value >> 20;
+                }
+                pointers.push_back(&partials[p][0]);
+            }
+
+            std::vector<unsigned> expected(count, 0);
+            for (size_t p = 0; p < partialCount; p++)
+            {
+                AddHistogramScalar(&expected[0], &partials[p][0], count);
+            }
+
+            for (int threaded = 0; threaded < 2; threaded++)
+            {
+                std::vector<unsigned> merged(count + 1, Guard);
+                MergeHistograms(&pointers[0], partialCount, count, &merged[0], threaded ? pool : NULL);
+                differing += memcmp(&merged[0], &expected[0], count * sizeof(unsigned)) != 0;
+                overruns += merged[count] != Guard;
+                cases++;
+            }
+
+            if (partialCount > 0)
+            {
+                std::vector<unsigned> first = partials[0];
+                pointers[0] = &first[0];
+                MergeHistograms(&pointers[0], partialCount, count, &first[0], pool);
+                differing += memcmp(&first[0], &expected[0], count * sizeof(unsigned)) != 0;
+                overruns += first[count] != Guard;
+                cases++;
+            }
+        }
+    }
+
+#ifdef HISTOGRAM_SSE2
+    const char* kernel = "SSE2";
+#else
+    const char* kernel = "scalar";
+#endif
+    return Report("histogram", differing == 0 && overruns == 0, "%llu merges, %s against scalar, %llu differ, "
+                  "%llu bins written past the end", (unsigned long long)cases, kernel, (unsigned long long)differing,
+                  (unsigned long long)overruns);
+}
+
+// LineRasterizer draws the same bytes as DrawAntialiasedLinesScalar, by
+// tiles on one thread and on the pool: odd image sizes that end inside a
+// tile, a clip, a transform, a translucent color over a noisy background,
+// and lines that are long, short, empty or off the image
+static bool CheckLineRaster(ThreadPool* pool)
+{
+    struct Case
+    {
+        unsigned width, height;
+        PixelRect clip;
+        float degrees;
+        unsigned color;
+    };
+    const Case cases[] =
+    {
+        { 1, 1, MakePixelRect(0, 0, 1, 1), 0.0f, 0xFF008000 },
+        { 61, 37, MakePixelRect(0, 0, 61, 37), 0.0f, 0xFF008000 },
+        { 333, 197, MakePixelRect(0, 0, 333, 197), 0.0f, 0x80FF2040 },
+        { 333, 197, MakePixelRect(17, 9, 301, 190), 30.0f, 0x80FF2040 },
+        { 640, 480, MakePixelRect(0, 0, 640, 480), -15.0f, 0xC0102030 },
+    };
+    static const unsigned LineCount = 999;
+
+    LineRasterizer lines;
+    SceneRandom random(BenchSeed);
+    size_t differing = 0;
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++)
+    {
+        const Case& test = cases[c];
+        float w = (float)test.width, h = (float)test.height;
+        std::vector<Float2> points(LineCount * 2);
+        for (unsigned i = 0; i < LineCount; i++)
+        {
+            Float2 a(RandomFloat(&random, -0.25f * w, 1.25f * w), RandomFloat(&random, -0.25f * h, 1.25f * h));
+            Float2 b;
+            switch (i % 4)
+            {
+            case 0:         // across the image and past it
+                b = Float2(RandomFloat(&random, -0.25f * w, 1.25f * w), RandomFloat(&random, -0.25f * h, 1.25f * h));
+                break;
+            case 1:         // a few pixels
+                b = a + Float2(RandomFloat(&random, -8.0f, 8.0f), RandomFloat(&random, -8.0f, 8.0f));
+                break;
+            case 2:         // horizontal or vertical
+                b = a + (i & 4 ? Float2(RandomFloat(&random, -64.0f, 64.0f), 0.0f)
+                               : Float2(0.0f, RandomFloat(&random, -64.0f, 64.0f)));
+                break;
+            default:        // empty
+                b = a;
+                break;
+            }
+            points[2 * i] = a;
+            points[2 * i + 1] = b;
+        }
+
+        Matrix3x2 m = Matrix3x2::Rotation(test.degrees, Float2(0.5f * w, 0.5f * h));
+        std::vector<Float2> transformed(points.size());
+        for (size_t p = 0; p < points.size(); p++)
+        {
+            transformed[p] = m.TransformPoint(points[p]);
+        }
+
+        Image background(test.width, test.height);
+        for (unsigned y = 0; y < test.height; y++)
+        {
+            for (unsigned x = 0; x < test.width; x++)
+            {
+                background.Row(y)[x] = (unsigned)random.Next() | 0xFF000000;
+            }
+        }
+
+        Image scalar = background;
+        scalar.SetClip(test.clip);
+        DrawAntialiasedLinesScalar(&scalar, &transformed[0], LineCount, test.color);
+
+        for (int threaded = 0; threaded < 2; threaded++)
+        {
+            Image tiled = background;
+            tiled.SetClip(test.clip);
+            lines.DrawLines(&tiled, &points[0], LineCount, m, test.color, threaded ? pool : NULL);
+            differing += memcmp(tiled.Pixels(), scalar.Pixels(),
+                                (size_t)test.width * test.height * sizeof(unsigned)) != 0;
+        }
+    }
+
+    size_t images = 2 * sizeof(cases) / sizeof(cases[0]);
+    return Report("line-raster", differing == 0, "%llu images 1x1 to 640x480, tiled against scalar, %llu differ",
+                  (unsigned long long)images, (unsigned long long)differing);
+}
+
+// A frame of nine draws over three list states and a strip state, sorted
+// and in submission order. The batch and draw counts are what the states
+// allow, and the recorded draws read the vertices in the order promised.
+static bool CheckBatcher()
+{
+    const DrawStateKey a = {BatchTopology_TriangleList, 0, 0, 0, 4};
+    const DrawStateKey b = {BatchTopology_TriangleList, 0, 1, 0, 4};
+    const DrawStateKey c = {BatchTopology_LineList, 1, 0, 0, 4};
+    const DrawStateKey strip = {BatchTopology_TriangleStrip, 0, 0, 0, 4};
+    const DrawStateKey frame[] = {a, b, a, c, a, b, strip, strip, a};
+    const size_t drawCount = sizeof(frame) / sizeof(frame[0]);
+
+    bool ok = true;
+    for (int preserve = 0; preserve <= 1; preserve++)
+    {
+        DrawBatcher batcher;
+        batcher.SetPreserveOrder(preserve != 0);
+
+        // Each vertex is the index of its draw times 16 plus its own
+        std::vector<size_t> order;
+        for (size_t d = 0; d < drawCount; d++)
+        {
+            unsigned count = frame[d].topology == BatchTopology_TriangleStrip ? 4 : 3;
+            unsigned* vertices = (unsigned*)batcher.Allocate(frame[d], count);
+            for (unsigned v = 0; v < count; v++)
+            {
+                vertices[v] = (unsigned)(d * 16 + v);
+            }
+            order.push_back(d);
+        }
+        if (!preserve)
+        {
+            std::stable_sort(order.begin(), order.end(),
+                             [&](size_t x, size_t y) { return frame[x] < frame[y]; });
+        }
+
+        std::vector<unsigned> expected;
+        for (size_t i = 0; i < order.size(); i++)
+        {
+            unsigned count = frame[order[i]].topology == BatchTopology_TriangleStrip ? 4 : 3;
+            for (unsigned v = 0; v < count; v++)
+            {
+                expected.push_back((unsigned)(order[i] * 16 + v));
+            }
+        }
+
+        RecordingDrawBackend backend;
+        batcher.Flush(&backend);
+
+        std::vector<unsigned> drawn;
+        const std::vector<RecordingDrawBackend::Command>& commands = backend.Commands();
+        for (size_t i = 0; i < commands.size(); i++)
+        {
+            if (commands[i].type == RecordingDrawBackend::Command_Draw)
+            {
+                const unsigned* vertices = (const unsigned*)&backend.Vertices()[0];
+                drawn.insert(drawn.end(), vertices + commands[i].first,
+                             vertices + commands[i].first + commands[i].count);
+            }
+        }
+
+        // Sorted: one batch per state, the list states drawn once each and
+        // the strips once per strip. In order: a batch per run of equal
+        // neighbours, of which the strips are the only one with two draws.
+        const DrawBatchStats& stats = batcher.Stats();
+        unsigned batches = preserve ? 8 : 4;
+        unsigned draws = preserve ? 9 : 5;
+        bool pass = stats.requested == drawCount && stats.stateChanges == batches && stats.uploads == batches &&
+                    stats.submitted == draws && drawn == expected;
+        ok = Report(preserve ? "batcher/ordered" : "batcher/sorted", pass,
+                    "%u draws in %u batches, %u issued, vertices %s", stats.requested, stats.stateChanges,
+                    stats.submitted, drawn == expected ? "in order" : "out of order") && ok;
+    }
+    return ok;
+}
+
+// ParallelWaves against the book's loop on a grid whose width isn't a
+// multiple of four, in strips of 8 rows so the seams between strips are
+// many: heights, normals and tangents within float rounding, and the same
+// bits on one thread as on four
+static bool CheckWaves()
+{
+    const unsigned rows = 67, cols = 131, steps = 200;
+    const unsigned disturbances[][2] = {{2, 2}, {33, 65}, {64, 128}, {10, 100}, {50, 7}};
+
+    ThreadPool pool(4);
+    BookWaves reference;
+    ParallelWaves serial, parallel;
+    reference.Init(rows, cols, WavesDx, WavesDt, WavesSpeed, WavesDamping);
+    serial.Init(rows, cols, WavesDx, WavesDt, WavesSpeed, WavesDamping, NULL);
+    parallel.Init(rows, cols, WavesDx, WavesDt, WavesSpeed, WavesDamping, &pool);
+    parallel.SetBlockRows(8);
+
+    for (unsigned s = 0; s < steps; s++)
+    {
+        if (s % 40 == 0)
+        {
+            const unsigned* at = disturbances[s / 40];
+            reference.Disturb(at[0], at[1], 0.5f);
+            serial.Disturb(at[0], at[1], 0.5f);
+            parallel.Disturb(at[0], at[1], 0.5f);
+        }
+        reference.Step();
+        serial.Step();
+        parallel.Step();
+    }
+
+    float worst = 0.0f;
+    bool same = true;
+    for (size_t v = 0; v < (size_t)rows * cols; v++)
+    {
+        const float values[][2] = {
+            {reference.Height(v), serial.Heights()[v]},
+            {reference.Normal(v).x, serial.NormalX()[v]},
+            {reference.Normal(v).y, serial.NormalY()[v]},
+            {reference.Normal(v).z, serial.NormalZ()[v]},
+            {reference.TangentX(v).x, serial.TangentX()[v]},
+            {reference.TangentX(v).y, serial.TangentY()[v]}};
+        for (size_t k = 0; k < sizeof(values) / sizeof(values[0]); k++)
+        {
+            worst = std::max(worst, fabsf(values[k][0] - values[k][1]));
+        }
+
+        same = same && serial.Heights()[v] == parallel.Heights()[v] && serial.NormalX()[v] == parallel.NormalX()[v] &&
+               serial.NormalY()[v] == parallel.NormalY()[v] && serial.NormalZ()[v] == parallel.NormalZ()[v] &&
+               serial.TangentX()[v] == parallel.TangentX()[v] && serial.TangentY()[v] == parallel.TangentY()[v];
+    }
+
+    return Report("waves", worst <= 1e-4f && same, "%u steps of %ux%u, max error %.2g against the book, "
+                  "4 threads %s 1", steps, rows, cols, worst, same ? "identical to" : "differ from");
+}
+
+// Each triangle as the bytes of its three vertices, turned so the smallest
+// comes first without changing the winding, the list sorted. Equal for two
+// meshes that draw the same triangles, however they are numbered.
+static void TriangleSet(const MeshData& mesh, std::vector<std::string>* triangles)
+{
+    triangles->clear();
+    for (size_t i = 0; i + 3 <= mesh.indices.size(); i += 3)
+    {
+        std::string corners[3];
+        for (int k = 0; k < 3; k++)
+        {
+            const MeshVertex& v = mesh.vertices[mesh.indices[i + k]];
+            corners[k].assign((const char*)&v, sizeof(v));
+        }
+        int first = corners[1] < corners[0] ? 1 : 0;
+        first = corners[2] < corners[first] ? 2 : first;
+        triangles->push_back(corners[first] + corners[(first + 1) % 3] + corners[(first + 2) % 3]);
+    }
+    std::sort(triangles->begin(), triangles->end());
+}
+
+// Box's grid and sphere at the tessellations it uses and at high ones:
+// built the same on a pool as on one thread, then the vertex cache
+// statistics before and after OptimizeMesh, which may only reorder
+static bool CheckMeshes(ThreadPool* pool)
+{
+    struct Shape
+    {
+        const char* name;
+        bool sphere;
+        unsigned a;
+        unsigned b;
+    };
+    static const Shape shapes[] = {{"mesh/grid-160", false, 160, 160}, {"mesh/grid-300", false, 300, 300},
+                                   {"mesh/sphere-20", true, 20, 20}, {"mesh/sphere-160", true, 160, 120}};
+
+    bool ok = true;
+    for (size_t i = 0; i < sizeof(shapes) / sizeof(shapes[0]); i++)
+    {
+        const Shape& shape = shapes[i];
+        MeshData mesh, serial;
+        if (shape.sphere)
+        {
+            MeshGenerator::CreateSphere(0.5f, shape.a, shape.b, mesh, pool);
+            MeshGenerator::CreateSphere(0.5f, shape.a, shape.b, serial, NULL);
+        }
+        else
+        {
+            MeshGenerator::CreateGrid(160.0f, 160.0f, shape.a, shape.b, mesh, pool);
+            MeshGenerator::CreateGrid(160.0f, 160.0f, shape.a, shape.b, serial, NULL);
+        }
+        bool sameBuild = mesh.indices == serial.indices && mesh.vertices.size() == serial.vertices.size() &&
+                         memcmp(&mesh.vertices[0], &serial.vertices[0], mesh.vertices.size() * sizeof(MeshVertex)) == 0;
+
+        std::vector<std::string> before, after;
+        TriangleSet(mesh, &before);
+        MeshOptimizeReport report = OptimizeMesh(mesh.vertices, mesh.indices);
+        TriangleSet(mesh, &after);
+        bool sameTriangles = before == after;
+
+        ok = Report(shape.name, sameBuild && sameTriangles && report.after.acmr <= report.before.acmr,
+                    "%llu triangles, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, %s, triangles %s%s",
+                    (unsigned long long)report.after.triangles, report.before.acmr, report.after.acmr,
+                    report.before.atvr, report.after.atvr, report.index16 ? "16 bit" : "32 bit",
+                    sameTriangles ? "unchanged" : "CHANGED", sameBuild ? "" : ", pool build differs") && ok;
+    }
+    return ok;
+}
+
+// The scalar, SIMD and BVH paths find the same visible boxes from eight
+// directions around the scene
+static bool CheckCulling()
+{
+    AabbSoA boxes;
+    CullScene(100000, &boxes);
+    CullBvh bvh;
+    bvh.Build(boxes);
+
+    bool same = true;
+    size_t visibleMin = boxes.Size(), visibleMax = 0;
+    for (int view = 0; view < 8; view++)
+    {
+        CullFrustum frustum = CullCamera(view * 0.25f * 3.1415926535f);
+        std::vector<unsigned> scalar, batch, tree;
+        CullAabbsScalar(frustum, boxes, &scalar);
+        CullAabbs(frustum, boxes, &batch);
+        bvh.Cull(frustum, &tree);
+        std::sort(tree.begin(), tree.end());
+
+        same = same && batch == scalar && tree == scalar;
+        visibleMin = std::min(visibleMin, scalar.size());
+        visibleMax = std::max(visibleMax, scalar.size());
+    }
+
+    return Report("cull", same, "%llu boxes, %llu to %llu visible, scalar, %s and bvh %s",
+                  (unsigned long long)boxes.Size(), (unsigned long long)visibleMin, (unsigned long long)visibleMax,
+                  CullKernelName(), same ? "agree" : "disagree");
+}
+
+// The shader cache compiles on a miss only: a second load hits, and a
+// change to the source, flags, defines or compiler version misses. A
+// corrupt or truncated entry is rejected and compiled again rather than
+// handed to the device.
+static bool CheckShaderCache()
+{
+    unsigned compiles = 0;
+    ShaderCache cache(".", [&](const ShaderSource& source, std::vector<unsigned char>* bytecode, std::string* errors) {
+        compiles++;
+        return StubCompile(source, bytecode, errors);
+    });
+
+    ShaderSource base;
+    base.fileName = "check.shader";
+    base.text = "float4 VShader(float4 position : POSITION) : SV_POSITION { return position; }";
+    base.entryPoint = "VShader";
+    base.profile = "vs_4_0";
+
+    std::vector<std::string> paths;
+    std::string failed;
+    unsigned rejected = 0;
+
+    // Loads source, expecting a compile or not and StubCompile's bytes
+    auto load = [&](const char* step, const ShaderSource& source, bool compile) {
+        unsigned before = compiles;
+        std::vector<unsigned char> bytecode, expected;
+        std::string errors;
+        bool ok = cache.Load(source, &bytecode, &errors) && StubCompile(source, &expected, &errors) &&
+                  bytecode == expected && (compiles != before) == compile;
+        paths.push_back(cache.PathFor(cache.Key(source)));
+        if (!ok)
+        {
+            failed += failed.empty() ? step : std::string(", ") + step;
+        }
+    };
+
+    // Rewrites the entry of source with its bytes changed by edit
+    auto damage = [&](const ShaderSource& source, const std::function<void(std::vector<unsigned char>*)>& edit) {
+        std::string path = cache.PathFor(cache.Key(source));
+        std::ifstream in(path.c_str(), std::ios::binary);
+        std::vector<unsigned char> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        in.close();
+        edit(&bytes);
+        std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+        out.write((const char*)&bytes[0], bytes.size());
+    };
+
+    load("miss", base, true);
+    load("hit", base, false);
+
+    ShaderSource changed = base;
+    changed.text += " ";
+    load("source", changed, true);
+
+    changed = base;
+    changed.flags = 1;
+    load("flags", changed, true);
+
+    changed = base;
+    ShaderDefine define = { "COLORED", "1" };
+    changed.defines.push_back(define);
+    load("defines", changed, true);
+
+    cache.SetCompilerVersion("2");
+    load("compiler version", base, true);
+    load("hit after version", base, false);
+
+    damage(base, [](std::vector<unsigned char>* bytes) { bytes->back() ^= 1; });
+    load("corrupt", base, true);
+    rejected += cache.Stats().rejected == 1;
+
+    damage(base, [](std::vector<unsigned char>* bytes) { bytes->resize(bytes->size() / 2); });
+    load("truncated", base, true);
+    rejected += cache.Stats().rejected == 2;
+    load("hit after repair", base, false);
+
+    for (size_t i = 0; i < paths.size(); i++)
+    {
+        remove(paths[i].c_str());
+    }
+
+    const ShaderCacheStats& stats = cache.Stats();
+    return Report("shader-cache", failed.empty() && rejected == 2, "%u compiles, %u hits, %u rejected%s%s",
+                  compiles, stats.hits, stats.rejected, failed.empty() ? "" : ", wrong at ", failed.c_str());
+}
+
+// TextureStreamer through CpuTextureBackend on a pool of one thread, so
+// loads finish inline and every frame is the same on every run. Sixteen
+// 64x64 textures under a budget of four: a sliding working set of three
+// stays under budget and resident, a frame that needs six may go over for
+// that frame only, evicted textures are the least recently used, and the
+// backend holds exactly the bytes the streamer counts.
+static bool CheckStreamer()
+{
+    const unsigned textureCount = 16, side = 64;
+    const size_t textureBytes = side * side * 4;
+
+    std::vector<std::string> paths;
+    Image image(side, side);
+    for (unsigned t = 0; t < textureCount; t++)
+    {
+        image.Clear(PackRgba(t * 16, 255 - t * 16, 0));
+        char path[64];
+        snprintf(path, sizeof(path), "streamer_check_%u.ppm", t);
+        paths.push_back(path);
+        if (!image.WritePpm(path))
+        {
+            return Report("streamer", false, "can't write %s", path);
+        }
+    }
+
+    ThreadPool inline1(1);
+    CpuTextureBackend backend;
+    TextureStreamer streamer(&inline1, &backend, DecodePpm, 4 * textureBytes);
+    int placeholder;
+    streamer.SetPlaceholder(&placeholder);
+
+    std::vector<TextureHandle> handles(textureCount, 0);
+    size_t overBudget = 0, notResident = 0, peak = 0;
+    auto frame = [&](const std::vector<unsigned>& used) {
+        for (size_t i = 0; i < used.size(); i++)
+        {
+            TextureHandle& handle = handles[used[i]];
+            if (handle == 0)
+            {
+                handle = streamer.Request(paths[used[i]]);
+            }
+            streamer.Resolve(handle);
+        }
+        streamer.Update();
+
+        for (size_t i = 0; i < used.size(); i++)
+        {
+            notResident += streamer.IsResident(handles[used[i]]) ? 0 : 1;
+        }
+        peak = std::max(peak, streamer.Stats().residentBytes);
+        return streamer.Stats().residentBytes <= streamer.Stats().budgetBytes;
+    };
+
+    std::vector<unsigned> used(3);
+    for (unsigned f = 0; f < 40; f++)
+    {
+        used[0] = f % textureCount;
+        used[1] = (f + 1) % textureCount;
+        used[2] = (f + 2) % textureCount;
+        overBudget += frame(used) ? 0 : 1;
+    }
+
+    // Frame 39 used 7, 8 and 9, frame 38 used 6 to 8: those four fill the
+    // budget and 5, which frame 37 brought in, must be gone
+    bool lru = streamer.IsResident(handles[6]) && streamer.IsResident(handles[9]) && !streamer.IsResident(handles[5]);
+
+    std::vector<unsigned> wide;
+    for (unsigned t = 10; t < 16; t++)
+    {
+        wide.push_back(t);
+    }
+    bool wideOver = !frame(wide);
+    std::vector<unsigned> narrow(1, 0);
+    bool narrowUnder = frame(narrow);
+
+    TextureHandle missing = streamer.Request("streamer_check_missing.ppm");
+    streamer.Update();
+    bool failed = !streamer.IsResident(missing) && streamer.Resolve(missing) == &placeholder &&
+                  streamer.Stats().failures == 1;
+
+    const TextureStreamerStats& stats = streamer.Stats();
+    bool balanced = backend.LiveBytes() == stats.residentBytes &&
+                    backend.Uploads() - backend.Releases() == stats.residentBytes / textureBytes;
+
+    for (unsigned t = 0; t < textureCount; t++)
+    {
+        remove(paths[t].c_str());
+    }
+
+    bool pass = overBudget == 0 && notResident == 0 && lru && wideOver && narrowUnder && failed && balanced;
+    return Report("streamer", pass, "%llu loads, %llu evictions, peak %llu of %llu KB, %s%s%s%s%s%s",
+                  backend.Uploads(), stats.evictions, (unsigned long long)peak / 1024,
+                  (unsigned long long)stats.budgetBytes / 1024, overBudget ? "over budget, " : "",
+                  notResident ? "used texture not resident, " : "", lru ? "" : "not LRU, ",
+                  wideOver && narrowUnder ? "" : "budget not restored, ", failed ? "" : "missing file not failed, ",
+                  balanced ? "backend balanced" : "backend unbalanced");
+}
+
+// FrameScheduler driven by a simulated message loop and clock, in
+// microseconds at 60 Hz. Input every millisecond for a second, each frame
+// taking 2 ms to draw, gets about 60 frames, never two closer than the
+// interval, with every invalidation either drawn or coalesced and no frame
+// more than an interval and a draw behind its input; then the loop idles.
+// Continuous frames whose wakeups come up to 2 ms late still keep 60 a
+// second, as they are paced from when they were due.
+static bool CheckScheduler()
+{
+    const unsigned long long interval = 16667, draw = 2000, second = 1000000;
+    bool ok = true;
+
+    {
+        FrameScheduler scheduler(interval);
+        unsigned long long now = 0, nextInput = 0, lastBegin = 0, closest = FrameScheduler::WaitForever;
+        bool begun = false;
+        while (nextInput < second || scheduler.IsDirty())
+        {
+            unsigned long long wait = scheduler.NextWait(now);
+            unsigned long long frameAt = wait == FrameScheduler::WaitForever ? wait : now + wait;
+            if (nextInput < second && nextInput < frameAt)
+            {
+                now = nextInput;
+                scheduler.Invalidate(now);
+                nextInput += 1000;
+                continue;
+            }
+
+            now = frameAt;
+            scheduler.BeginFrame(now);
+            if (begun)
+            {
+                closest = std::min(closest, now - lastBegin);
+            }
+            lastBegin = now;
+            begun = true;
+
+            // Input that arrives while drawing is queued and seen afterwards
+            now += draw;
+            while (nextInput < second && nextInput <= now)
+            {
+                scheduler.Invalidate(nextInput);
+                nextInput += 1000;
+            }
+            scheduler.EndFrame(now);
+        }
+
+        FrameLatencyStats stats = scheduler.Stats();
+        bool idle = scheduler.NextWait(now + second) == FrameScheduler::WaitForever;
+        bool pass = stats.frames >= 59 && stats.frames <= 62 && closest >= interval &&
+                    stats.invalidations == 1000 && stats.coalesced + stats.frames == stats.invalidations &&
+                    stats.max <= (interval + draw) / 1000.0 && idle;
+        ok = Report("scheduler/input", pass, "%llu invalidations, %llu frames, %llu coalesced, closest %.2f ms, "
+                    "latency p50 %.2f p99 %.2f max %.2f ms, %s", stats.invalidations, stats.frames, stats.coalesced,
+                    closest / 1000.0, stats.p50, stats.p99, stats.max, idle ? "then idle" : "never idles") && ok;
+    }
+
+    {
+        FrameScheduler scheduler(interval);
+        scheduler.SetContinuous(true);
+        SceneRandom random(BenchSeed);
+        unsigned long long now = 0;
+        while (now < second)
+        {
+            unsigned long long wait = scheduler.NextWait(now);
+            now += wait + (random.Next() >> 53);
+            scheduler.BeginFrame(now);
+            now += draw;
+            scheduler.EndFrame(now);
+        }
+
+        FrameLatencyStats stats = scheduler.Stats();
+        bool pass = stats.frames >= 59 && stats.frames <= 62;
+        ok = Report("scheduler/continuous", pass, "%llu frames in a second with late wakeups, latency p50 %.2f "
+                    "max %.2f ms", stats.frames, stats.p50, stats.max) && ok;
+    }
+    return ok;
+}
+
+// Vectors over a FrameArena take their memory from the heap on the first
+// frame only: Reset merges what that frame spilled into one block, and
+// every later frame of the same size fits in it, growth included
+static bool CheckFrameArena()
+{
+    typedef std::vector<Float2, FrameAllocator<Float2> > FramePoints;
+    typedef std::vector<unsigned, FrameAllocator<unsigned> > FrameIndices;
+
+    static const unsigned Frames = 64;
+    static const size_t PointsPerFrame = 5000;
+
+    FrameArena arena(4096);
+    SceneRandom random(BenchSeed);
+    unsigned afterFirst = 0;
+    size_t mismatches = 0;
+    for (unsigned frame = 0; frame < Frames; frame++)
+    {
+        arena.Reset();
+        if (frame == 1)
+        {
+            afterFirst = arena.BlockAllocations();
+        }
+
+        // Points grow one at a time, indices are reserved up front
+        FramePoints points((FrameAllocator<Float2>(&arena)));
+        FrameIndices indices((FrameAllocator<unsigned>(&arena)));
+        std::vector<Float2> expected;
+        indices.reserve(PointsPerFrame);
+        for (size_t i = 0; i < PointsPerFrame; i++)
+        {
+            Float2 p((float)(random.Next() >> 40), (float)i);
+            points.push_back(p);
+            expected.push_back(p);
+            indices.push_back((unsigned)(PointsPerFrame - 1 - i));
+        }
+        for (size_t i = 0; i < PointsPerFrame; i++)
+        {
+            const Float2& p = points[indices[i]];
+            const Float2& e = expected[PointsPerFrame - 1 - i];
+            mismatches += p.x != e.x || p.y != e.y;
+        }
+    }
+
+    unsigned blocks = arena.BlockAllocations();
+    return Report("frame-arena", blocks == afterFirst && mismatches == 0,
+                  "%u blocks after the first frame, %u after %u, %llu bytes a frame, %llu mismatches", afterFirst,
+                  blocks, Frames, (unsigned long long)arena.HighWater(), (unsigned long long)mismatches);
+}
+
+//
+// JSON and the baseline comparison
+//
+
+// One benchmark per line, so ReadBaseline doesn't need a JSON parser
+static bool WriteJson(const char* path, const std::vector<BenchResult>& benchmarks,
+                      const std::vector<GoldenResult>& golden)
+{
+    FILE* file = fopen(path, "w");
+    if (!file)
+    {
+        return false;
+    }
+
+    fprintf(file, "{\n  \"version\": 1,\n  \"seed\": %llu,\n  \"benchmarks\": [\n", BenchSeed);
+    for (size_t i = 0; i < benchmarks.size(); i++)
+    {
+        const BenchResult& r = benchmarks[i];
+        fprintf(file, "    {\"name\": \"%s\", \"size\": %llu, \"runs\": %u, \"best_ns\": %.4f, \"median_ns\": %.4f, "
+                "\"items_per_second\": %.0f}%s\n", r.name.c_str(), (unsigned long long)r.size, r.runs, r.best,
+                r.median, 1e9 / r.median, i + 1 < benchmarks.size() ? "," : "");
+    }
+    fprintf(file, "  ],\n  \"golden\": [\n");
+    for (size_t i = 0; i < golden.size(); i++)
+    {
+        const GoldenResult& g = golden[i];
+        fprintf(file, "    {\"scene\": \"%s\", \"pass\": %s, \"differing_pixels\": %llu, \"max_difference\": %u}%s\n",
+                g.scene.c_str(), g.pass ? "true" : "false", (unsigned long long)g.differing, g.maxDifference,
+                i + 1 < golden.size() ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    return fclose(file) == 0;
+}
+
+// Median nanoseconds per item keyed by "name size"
+static bool ReadBaseline(const char* path, std::map<std::string, double>* medians)
+{
+    std::ifstream in(path);
+    if (!in)
+    {
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(in, line))
+    {
+        char name[128];
+        unsigned long long size;
+        unsigned runs;
+        double best, median;
+        if (sscanf(line.c_str(), " {\"name\": \"%127[^\"]\", \"size\": %llu, \"runs\": %u, \"best_ns\": %lf, \"median_ns\": %lf",
+                   name, &size, &runs, &best, &median) == 5)
+        {
+            char key[160];
+            snprintf(key, sizeof(key), "%s %llu", name, size);
+            (*medians)[key] = median;
+        }
+    }
+    return true;
+}
+
+static bool CompareWithBaseline(const Options& options, const std::vector<BenchResult>& results)
+{
+    std::map<std::string, double> baseline;
+    if (!ReadBaseline(options.baseline.c_str(), &baseline))
+    {
+        fprintf(stderr, "can't read %s\n", options.baseline.c_str());
+        return false;
+    }
+
+    bool ok = true;
+    size_t compared = 0;
+    printf("\nagainst %s, at most %.0f%% slower\n", options.baseline.c_str(), options.maxSlowdown * 100.0);
+    printf("  %-24s %10s %12s %12s %8s\n", "benchmark", "size", "baseline ns", "median ns", "change");
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const BenchResult& r = results[i];
+        char key[160];
+        snprintf(key, sizeof(key), "%s %llu", r.name.c_str(), (unsigned long long)r.size);
+        std::map<std::string, double>::const_iterator found = baseline.find(key);
+        if (found == baseline.end())
+        {
+            continue;
+        }
+
+        double change = r.median / found->second - 1.0;
+        bool slower = change > options.maxSlowdown;
+        printf("  %-24s %10llu %12.3f %12.3f %+7.1f%%%s\n", r.name.c_str(), (unsigned long long)r.size, found->second,
+               r.median, change * 100.0, slower ? "  REGRESSION" : "");
+        ok = ok && !slower;
+        compared++;
+    }
+    printf("  %llu benchmarks compared\n", (unsigned long long)compared);
+    return ok;
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!ParseOptions(argc, argv, &options))
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    std::string dinoText;
+    Polylines dino;
+    {
+        std::ifstream in(options.input.c_str(), std::ios::binary);
+        std::ostringstream text;
+        text << in.rdbuf();
+        dinoText = text.str();
+        std::istringstream parse(dinoText);
+        if (!in || !ReadPolylines(parse, &dino))
+        {
+            fprintf(stderr, "can't read %s, skipping the benchmarks and images that need it\n", options.input.c_str());
+            dinoText.clear();
+            dino.clear();
+        }
+    }
+
+    ThreadPool pool(options.threads);
+    std::vector<GoldenResult> golden;
+    bool goldenOk = CheckGolden(options, &pool, dino, &golden);
+    if (options.updateGolden)
+    {
+        return goldenOk ? 0 : 1;
+    }
+
+    printf("\nchecks\n");
+    bool checksOk = CheckLoader(&pool);
+    checksOk = CheckRing() && checksOk;
+    checksOk = CheckVecMath() && checksOk;
+    checksOk = CheckPack() && checksOk;
+    checksOk = CheckConvert() && checksOk;
+    checksOk = CheckHistogram(&pool) && checksOk;
+    checksOk = CheckLineRaster(&pool) && checksOk;
+    checksOk = CheckBatcher() && checksOk;
+    checksOk = CheckWaves() && checksOk;
+    checksOk = CheckMeshes(&pool) && checksOk;
+    checksOk = CheckCulling() && checksOk;
+    checksOk = CheckShaderCache() && checksOk;
+    checksOk = CheckStreamer() && checksOk;
+    checksOk = CheckScheduler() && checksOk;
+    checksOk = CheckFrameArena() && checksOk;
+
+    printf("\n%u threads, seed %llu\n", pool.ThreadCount(), BenchSeed);
+    printf("  %-24s %10s %8s %12s %12s %14s\n", "benchmark", "size", "runs", "best ns", "median ns", "items/s");
+
+    BenchRunner runner(options);
+    BenchChaos(&runner, &pool);
+    BenchParse(&runner, dinoText);
+    BenchLoad(&runner);
+    BenchTransform(&runner, dino);
+    BenchRaster(&runner);
+    BenchAntialiased(&runner, &pool);
+    BenchRing(&runner);
+    BenchSpsc(&runner);
+    BenchWaves(&runner);
+    BenchCull(&runner);
+    BenchProfiler(&runner);
+    BenchShaderCache(&runner);
+    BenchPack(&runner);
+    BenchConvert(&runner);
+    BenchBox(&runner, &pool);
+    BenchHistogram(&runner, &pool);
+    BenchPointCloud(&runner);
+    BenchScenes(&runner, &pool, dino);
+
+    if (!options.json.empty() && !WriteJson(options.json.c_str(), runner.Results(), golden))
+    {
+        fprintf(stderr, "can't write %s\n", options.json.c_str());
+        return 1;
+    }
+
+    bool fasterThanLimit = options.baseline.empty() || CompareWithBaseline(options, runner.Results());
+    if (!goldenOk)
+    {
+        printf("\ngolden image check failed\n");
+    }
+    if (!checksOk)
+    {
+        printf("\na check failed\n");
+    }
+    if (!fasterThanLimit)
+    {
+        printf("\nslower than the baseline allows\n");
+    }
+    return goldenOk && checksOk && fasterThanLimit ? 0 : 1;
+}
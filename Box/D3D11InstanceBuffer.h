@@ -0,0 +1,136 @@
+#pragma once
+
+#include <d3d11.h>
+#include <string.h>
+
+#include "../Common/Telemetry.h"
+#include "../Common/VecMath.h"
+
+// Per-object matrices for FX/colorInstanced.fx. Instead of setting
+// gWorldViewProj and drawing once per box, the frame computes every
+// matrix with ComputeWorldViewProj, uploads them here in one map and
+// draws all boxes in one call:
+//
+//   GridWorlds(count, 3.0f, time, worlds, pool);
+//   ComputeWorldViewProj(worlds, view * proj, wvp, count, pool);
+//   instances.Upload(context, wvp, count);
+//   mfxInstances->SetResource(instances.View());
+//   tech->GetPassByIndex(0)->Apply(0, context);
+//   context->DrawIndexedInstanced(36, count, 0, 0, 0);
+class D3D11InstanceBuffer
+{
+public:
+    explicit D3D11InstanceBuffer(ID3D11Device* device) :
+        _device(device),
+        _buffer(NULL),
+        _view(NULL),
+        _capacity(0)
+    {
+    }
+
+    ~D3D11InstanceBuffer()
+    {
+        Release();
+    }
+
+    // Copies count matrices with one WRITE_DISCARD map, so the GPU keeps
+    // reading last frame's copy. Grows to the next power of two when count
+    // doesn't fit.
+    HRESULT Upload(ID3D11DeviceContext* context, const Matrix4x4* matrices, UINT count)
+    {
+        if (count == 0)
+        {
+            return S_OK;
+        }
+        if (count > _capacity)
+        {
+            UINT capacity = 64;
+            while (capacity < count)
+            {
+                capacity *= 2;
+            }
+            HRESULT hr = Create(capacity);
+            if (FAILED(hr))
+            {
+                return hr;
+            }
+        }
+
+        D3D11_MAPPED_SUBRESOURCE mapped;
+        HRESULT hr = context->Map(_buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+        memcpy(mapped.pData, matrices, (size_t)count * sizeof(Matrix4x4));
+        context->Unmap(_buffer, 0);
+
+        Telemetry::Add(Telemetry_UploadBytes, (unsigned long long)count * sizeof(Matrix4x4));
+        return S_OK;
+    }
+
+    // Bind as gInstances
+    ID3D11ShaderResourceView* View() const { return _view; }
+
+    UINT Capacity() const { return _capacity; }
+
+    void Release()
+    {
+        if (_view)
+        {
+            _view->Release();
+            _view = NULL;
+        }
+        if (_buffer)
+        {
+            _buffer->Release();
+            _buffer = NULL;
+        }
+        _capacity = 0;
+    }
+
+private:
+    ID3D11Device* _device;
+    ID3D11Buffer* _buffer;
+    ID3D11ShaderResourceView* _view;
+    UINT _capacity;
+
+    HRESULT Create(UINT capacity)
+    {
+        Release();
+
+        D3D11_BUFFER_DESC desc;
+        ZeroMemory(&desc, sizeof(desc));
+        desc.Usage = D3D11_USAGE_DYNAMIC;
+        desc.ByteWidth = capacity * sizeof(Matrix4x4);
+        desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+        desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+        desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+        desc.StructureByteStride = sizeof(Matrix4x4);
+
+        HRESULT hr = _device->CreateBuffer(&desc, NULL, &_buffer);
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+
+        D3D11_SHADER_RESOURCE_VIEW_DESC view;
+        ZeroMemory(&view, sizeof(view));
+        view.Format = DXGI_FORMAT_UNKNOWN;
+        view.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+        view.Buffer.FirstElement = 0;
+        view.Buffer.NumElements = capacity;
+
+        hr = _device->CreateShaderResourceView(_buffer, &view, &_view);
+        if (FAILED(hr))
+        {
+            Release();
+            return hr;
+        }
+        _capacity = capacity;
+        return S_OK;
+    }
+
+    D3D11InstanceBuffer(const D3D11InstanceBuffer&);
+    D3D11InstanceBuffer& operator=(const D3D11InstanceBuffer&);
+};
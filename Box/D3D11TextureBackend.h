@@ -0,0 +1,107 @@
+#pragma once
+
+#include <d3d11.h>
+#include <d3dx11.h>
+
+#include "../Common/TextureStreamer.h"
+
+// Creates shader resource views for TextureStreamer. Encoded files are
+// handed to D3DX as TextureMgr did, decoded pixels become RGBA8 textures.
+class D3D11TextureBackend : public TextureUploadBackend
+{
+public:
+    explicit D3D11TextureBackend(ID3D11Device* device) : _device(device) {}
+
+    void* Upload(const DecodedTexture& texture, size_t* gpuBytes)
+    {
+        *gpuBytes = 0;
+        if (texture.data.empty())
+        {
+            return NULL;
+        }
+
+        ID3D11ShaderResourceView* srv = NULL;
+        if (texture.encoded)
+        {
+            HRESULT hr = D3DX11CreateShaderResourceViewFromMemory(_device, &texture.data[0], texture.data.size(),
+                                                                  NULL, NULL, &srv, NULL);
+            if (FAILED(hr))
+            {
+                return NULL;
+            }
+            *gpuBytes = ResourceBytes(srv);
+            return srv;
+        }
+
+        D3D11_TEXTURE2D_DESC desc;
+        ZeroMemory(&desc, sizeof(desc));
+        desc.Width = texture.width;
+        desc.Height = texture.height;
+        desc.MipLevels = 1;
+        desc.ArraySize = 1;
+        desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+        desc.SampleDesc.Count = 1;
+        desc.Usage = D3D11_USAGE_IMMUTABLE;
+        desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+        D3D11_SUBRESOURCE_DATA init;
+        ZeroMemory(&init, sizeof(init));
+        init.pSysMem = &texture.data[0];
+        init.SysMemPitch = texture.width * 4;
+
+        ID3D11Texture2D* tex = NULL;
+        if (FAILED(_device->CreateTexture2D(&desc, &init, &tex)))
+        {
+            return NULL;
+        }
+
+        HRESULT hr = _device->CreateShaderResourceView(tex, NULL, &srv);
+        tex->Release();
+        if (FAILED(hr))
+        {
+            return NULL;
+        }
+
+        *gpuBytes = texture.data.size();
+        return srv;
+    }
+
+    void Release(void* gpuTexture)
+    {
+        ((ID3D11ShaderResourceView*)gpuTexture)->Release();
+    }
+
+private:
+    ID3D11Device* _device;
+
+    // Size of the top mip level times 4/3 for the chain. Block compressed
+    // formats are counted as 1 byte per texel, close enough for a budget.
+    static size_t ResourceBytes(ID3D11ShaderResourceView* srv)
+    {
+        ID3D11Resource* resource = NULL;
+        srv->GetResource(&resource);
+
+        size_t bytes = 0;
+        D3D11_RESOURCE_DIMENSION dimension;
+        resource->GetType(&dimension);
+        if (dimension == D3D11_RESOURCE_DIMENSION_TEXTURE2D)
+        {
+            D3D11_TEXTURE2D_DESC desc;
+            ((ID3D11Texture2D*)resource)->GetDesc(&desc);
+
+            size_t texel = 4;
+            if (desc.Format >= DXGI_FORMAT_BC1_TYPELESS && desc.Format <= DXGI_FORMAT_BC5_SNORM)
+            {
+                texel = 1;
+            }
+            bytes = (size_t)desc.Width * desc.Height * desc.ArraySize * texel;
+            if (desc.MipLevels != 1)
+            {
+                bytes += bytes / 3;
+            }
+        }
+
+        resource->Release();
+        return bytes;
+    }
+};
@@ -0,0 +1,55 @@
+//***************************************************************************************
+// colorInstanced.fx
+//
+// color.fx for many boxes in one draw. Each instance reads its
+// world-view-projection matrix from gInstances, which D3D11InstanceBuffer
+// fills once per frame, instead of the gWorldViewProj constant.
+//***************************************************************************************
+
+struct InstanceData
+{
+	// ComputeWorldViewProj writes row major matrices for row vectors
+	row_major float4x4 WorldViewProj;
+};
+
+StructuredBuffer<InstanceData> gInstances;
+
+struct VertexIn
+{
+	float3 PosL  : POSITION;
+	float4 Color : COLOR;
+};
+
+struct VertexOut
+{
+	float4 PosH  : SV_POSITION;
+	float4 Color : COLOR;
+};
+
+VertexOut VS(VertexIn vin, uint instanceID : SV_InstanceID)
+{
+	VertexOut vout;
+
+	// Transform to homogeneous clip space.
+	vout.PosH = mul(float4(vin.PosL, 1.0f), gInstances[instanceID].WorldViewProj);
+
+	// Just pass vertex color into the pixel shader.
+	vout.Color = vin.Color;
+
+	return vout;
+}
+
+float4 PS(VertexOut pin) : SV_Target
+{
+	return pin.Color;
+}
+
+technique11 ColorInstancedTech
+{
+	pass P0
+	{
+		SetVertexShader( CompileShader( vs_5_0, VS() ) );
+		SetGeometryShader( NULL );
+		SetPixelShader( CompileShader( ps_5_0, PS() ) );
+	}
+}
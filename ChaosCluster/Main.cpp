@@ -0,0 +1,495 @@
+// Runs one big chaos game over several worker processes on this machine,
+// standing in for a cluster. Every worker walks its own range of chunks,
+// each chunk with its own random stream, into a density histogram in a
+// shared memory segment; this process adds them up tile by tile and
+// checks the sum against the same game run here in one piece.
+//
+//   ChaosCluster --workers 1,2,4,8 --iterations 268435456 --output density.ppm
+//
+// On Linux: g++ -std=c++11 -O2 -pthread -I../Common Main.cpp ../Common/*.cpp -o ChaosCluster -lrt
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+extern char** environ;
+#endif
+
+#include "../Common/Histogram.h"
+#include "../Common/Scenes.h"
+#include "../Common/SharedMemory.h"
+#include "../Common/SoftwareRaster.h"
+#include "../Common/ThreadPool.h"
+
+static const unsigned ClusterMagic = 0x534F4843;      // "CHOS" in memory
+static const unsigned MaxWorkers = 64;                // WaitForMultipleObjects' limit
+
+enum WorkerState
+{
+    Worker_Starting,
+    Worker_Done,
+    Worker_Failed
+};
+
+struct WorkerSlot
+{
+    std::atomic<unsigned> state;
+    double milliseconds;        // accumulating, as the worker measured it
+};
+
+// Start of the segment, the histograms follow at HistogramOffset, one per
+// worker, each on its own cache lines
+struct ClusterHeader
+{
+    unsigned magic;
+    unsigned width;
+    unsigned height;
+    unsigned workers;
+    unsigned long long segmentBytes;
+    SierpinskiParams params;
+    WorkerSlot slots[MaxWorkers];
+};
+
+static size_t AlignUp(size_t bytes)
+{
+    return (bytes + 63) & ~(size_t)63;
+}
+
+static size_t HistogramOffset(const ClusterHeader& header, unsigned worker)
+{
+    size_t histogram = AlignUp((size_t)header.width * header.height * sizeof(unsigned));
+    return AlignUp(sizeof(ClusterHeader)) + worker * histogram;
+}
+
+struct Options
+{
+    std::vector<unsigned> workers;
+    unsigned width;
+    unsigned height;
+    size_t iterations;
+    unsigned long long seed;
+    unsigned threads;
+    std::string output;
+    bool verify;
+
+    // Set on the command lines of the processes this one starts
+    int worker;
+    std::string segment;
+};
+
+static double MillisecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void PrintUsage()
+{
+    printf("usage: ChaosCluster [options]\n"
+           "  --workers N,N,...   worker process counts to run, up to %u (default 1,2,4)\n"
+           "  --width N           histogram width (default 1920)\n"
+           "  --height N          histogram height (default 1080)\n"
+           "  --iterations N      chaos game points (default 134217728)\n"
+           "  --seed N            random seed (default 1)\n"
+           "  --threads N         threads merging the histograms, 0 for one per core (default 0)\n"
+           "  --output PATH       write the merged density of the last run as a PPM\n"
+           "  --no-verify         skip the single process render the merge is checked against\n",
+           MaxWorkers);
+}
+
+static bool ParseOptions(int argc, char** argv, Options* options)
+{
+    options->width = 1920;
+    options->height = 1080;
+    options->iterations = 1 << 27;
+    options->seed = 1;
+    options->threads = 0;
+    options->verify = true;
+    options->worker = -1;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (strcmp(arg, "--no-verify") == 0)
+        {
+            options->verify = false;
+            continue;
+        }
+        if (strcmp(arg, "--help") == 0 || !value)
+        {
+            return false;
+        }
+
+        i++;
+        if (strcmp(arg, "--workers") == 0)
+        {
+            for (const char* p = value; *p; p++)
+            {
+                unsigned count = (unsigned)strtoul(p, (char**)&p, 10);
+                if (count == 0 || count > MaxWorkers || (*p != ',' && *p != '\0'))
+                {
+                    return false;
+                }
+                options->workers.push_back(count);
+                if (*p == '\0')
+                {
+                    break;
+                }
+            }
+        }
+        else if (strcmp(arg, "--width") == 0)
+        {
+            options->width = (unsigned)atoi(value);
+        }
+        else if (strcmp(arg, "--height") == 0)
+        {
+            options->height = (unsigned)atoi(value);
+        }
+        else if (strcmp(arg, "--iterations") == 0)
+        {
+            options->iterations = (size_t)strtoull(value, NULL, 10);
+        }
+        else if (strcmp(arg, "--seed") == 0)
+        {
+            options->seed = strtoull(value, NULL, 10);
+        }
+        else if (strcmp(arg, "--threads") == 0)
+        {
+            options->threads = (unsigned)atoi(value);
+        }
+        else if (strcmp(arg, "--output") == 0)
+        {
+            options->output = value;
+        }
+        else if (strcmp(arg, "--worker") == 0)
+        {
+            options->worker = atoi(value);
+        }
+        else if (strcmp(arg, "--segment") == 0)
+        {
+            options->segment = value;
+        }
+        else
+        {
+            fprintf(stderr, "unknown option %s\n", arg);
+            return false;
+        }
+    }
+
+    if (options->workers.empty())
+    {
+        options->workers.push_back(1);
+        options->workers.push_back(2);
+        options->workers.push_back(4);
+    }
+    return options->width > 0 && options->height > 0;
+}
+
+//
+// Worker side
+//
+
+static int RunWorker(const Options& options)
+{
+    // The header says how big the whole segment is
+    SharedMemory segment;
+    if (!segment.Open(options.segment.c_str(), sizeof(ClusterHeader)))
+    {
+        fprintf(stderr, "worker %d: no segment %s\n", options.worker, options.segment.c_str());
+        return 1;
+    }
+    size_t segmentBytes = (size_t)((const ClusterHeader*)segment.Data())->segmentBytes;
+    if (!segment.Open(options.segment.c_str(), segmentBytes))
+    {
+        fprintf(stderr, "worker %d: can't map %s\n", options.worker, options.segment.c_str());
+        return 1;
+    }
+
+    ClusterHeader* header = (ClusterHeader*)segment.Data();
+    if (header->magic != ClusterMagic || options.worker < 0 || (unsigned)options.worker >= header->workers)
+    {
+        return 1;
+    }
+    WorkerSlot& slot = header->slots[options.worker];
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    // A contiguous range of chunks each, all chunks covered once
+    size_t chunks = ChaosChunkCount(header->params);
+    size_t first = chunks * options.worker / header->workers;
+    size_t end = chunks * (options.worker + 1) / header->workers;
+
+    // Cleared here rather than by the coordinator, so the pages are first
+    // touched by the process that fills them
+    unsigned* density = (unsigned*)((char*)segment.Data() + HistogramOffset(*header, options.worker));
+    memset(density, 0, (size_t)header->width * header->height * sizeof(unsigned));
+    AccumulateChaosDensity(header->params, first, end, header->width, header->height, density);
+
+    slot.milliseconds = MillisecondsSince(start);
+    slot.state.store(Worker_Done, std::memory_order_release);
+    return 0;
+}
+
+//
+// Coordinator side
+//
+
+#ifdef _WIN32
+
+typedef HANDLE WorkerProcess;
+
+static bool StartWorker(const char* segment, unsigned index, WorkerProcess* process)
+{
+    char exe[MAX_PATH];
+    if (!GetModuleFileNameA(NULL, exe, sizeof(exe)))
+    {
+        return false;
+    }
+
+    char commandLine[MAX_PATH + 256];
+    snprintf(commandLine, sizeof(commandLine), "\"%s\" --worker %u --segment %s", exe, index, segment);
+
+    STARTUPINFOA startup;
+    ZeroMemory(&startup, sizeof(startup));
+    startup.cb = sizeof(startup);
+    PROCESS_INFORMATION info;
+    if (!CreateProcessA(exe, commandLine, NULL, NULL, FALSE, 0, NULL, NULL, &startup, &info))
+    {
+        return false;
+    }
+    CloseHandle(info.hThread);
+    *process = info.hProcess;
+    return true;
+}
+
+static void WaitForWorkers(std::vector<WorkerProcess>& processes)
+{
+    if (!processes.empty())
+    {
+        WaitForMultipleObjects((DWORD)processes.size(), &processes[0], TRUE, INFINITE);
+    }
+    for (size_t i = 0; i < processes.size(); i++)
+    {
+        CloseHandle(processes[i]);
+    }
+    processes.clear();
+}
+
+static void SegmentName(unsigned workers, char* name, size_t size)
+{
+    snprintf(name, size, "Local\\DXPlayground.Chaos.%u.%u", (unsigned)GetCurrentProcessId(), workers);
+}
+
+#else
+
+typedef pid_t WorkerProcess;
+
+static bool StartWorker(const char* segment, unsigned index, WorkerProcess* process)
+{
+    // This same program again, wherever it was started from
+#ifdef __linux__
+    const char* exe = "/proc/self/exe";
+#else
+    const char* exe = getenv("_");
+#endif
+    char indexText[16];
+    snprintf(indexText, sizeof(indexText), "%u", index);
+    char* args[] = {(char*)"ChaosCluster", (char*)"--worker", indexText, (char*)"--segment", (char*)segment, NULL};
+    return exe && posix_spawn(process, exe, NULL, NULL, args, environ) == 0;
+}
+
+static void WaitForWorkers(std::vector<WorkerProcess>& processes)
+{
+    for (size_t i = 0; i < processes.size(); i++)
+    {
+        int status;
+        waitpid(processes[i], &status, 0);
+    }
+    processes.clear();
+}
+
+static void SegmentName(unsigned workers, char* name, size_t size)
+{
+    snprintf(name, size, "/dxplayground.chaos.%u.%u", (unsigned)getpid(), workers);
+}
+
+#endif
+
+struct RunResult
+{
+    unsigned workers;
+    double wall;                // starting the first worker to the last one exiting
+    double slowest;             // the longest any worker spent accumulating
+    double merge;
+    bool matches;
+};
+
+static bool RunCluster(const Options& options, const SierpinskiParams& params, unsigned workers,
+                       const std::vector<unsigned>& reference, ThreadPool* pool, std::vector<unsigned>* merged,
+                       RunResult* result)
+{
+    result->workers = workers;
+    result->slowest = 0.0;
+    result->merge = 0.0;
+    result->matches = false;
+
+    ClusterHeader layout;
+    layout.width = options.width;
+    layout.height = options.height;
+    size_t segmentBytes = HistogramOffset(layout, workers);
+
+    char name[128];
+    SegmentName(workers, name, sizeof(name));
+    SharedMemory segment;
+    if (!segment.Create(name, segmentBytes))
+    {
+        fprintf(stderr, "can't create a %.1f MB segment %s\n", segmentBytes / 1e6, name);
+        return false;
+    }
+
+    ClusterHeader* header = (ClusterHeader*)segment.Data();
+    header->magic = ClusterMagic;
+    header->width = options.width;
+    header->height = options.height;
+    header->workers = workers;
+    header->segmentBytes = segmentBytes;
+    header->params = params;
+    for (unsigned i = 0; i < workers; i++)
+    {
+        header->slots[i].state.store(Worker_Starting, std::memory_order_relaxed);
+        header->slots[i].milliseconds = 0.0;
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<WorkerProcess> processes;
+    bool started = true;
+    for (unsigned i = 0; i < workers && started; i++)
+    {
+        WorkerProcess process;
+        started = StartWorker(name, i, &process);
+        if (started)
+        {
+            processes.push_back(process);
+        }
+    }
+    WaitForWorkers(processes);
+    result->wall = MillisecondsSince(start);
+    if (!started)
+    {
+        fprintf(stderr, "couldn't start %u workers\n", workers);
+        return false;
+    }
+
+    std::vector<const unsigned*> partials(workers);
+    for (unsigned i = 0; i < workers; i++)
+    {
+        if (header->slots[i].state.load(std::memory_order_acquire) != Worker_Done)
+        {
+            fprintf(stderr, "worker %u of %u failed\n", i, workers);
+            return false;
+        }
+        double ms = header->slots[i].milliseconds;
+        result->slowest = ms > result->slowest ? ms : result->slowest;
+        partials[i] = (const unsigned*)((const char*)segment.Data() + HistogramOffset(*header, i));
+    }
+
+    size_t bins = (size_t)options.width * options.height;
+    merged->resize(bins);
+    start = std::chrono::steady_clock::now();
+    MergeHistograms(&partials[0], workers, bins, &(*merged)[0], pool);
+    result->merge = MillisecondsSince(start);
+
+    result->matches = reference.empty() || memcmp(&reference[0], &(*merged)[0], bins * sizeof(unsigned)) == 0;
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!ParseOptions(argc, argv, &options))
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    if (options.worker >= 0)
+    {
+        return RunWorker(options);
+    }
+
+    SierpinskiParams params;
+    DefaultSierpinski(options.width, options.height, options.iterations, options.seed, &params);
+    size_t bins = (size_t)options.width * options.height;
+
+    // The whole stream in this process, one thread
+    std::vector<unsigned> reference;
+    double referenceMs = 0.0;
+    if (options.verify)
+    {
+        reference.assign(bins, 0);
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        AccumulateChaosDensity(params, 0, ChaosChunkCount(params), options.width, options.height, &reference[0]);
+        referenceMs = MillisecondsSince(start);
+    }
+
+    ThreadPool pool(options.threads);
+    printf("%llu points in %llu chunks, %ux%u histogram, merging on %u threads\n",
+           (unsigned long long)options.iterations, (unsigned long long)ChaosChunkCount(params), options.width,
+           options.height, pool.ThreadCount());
+    if (options.verify)
+    {
+        printf("single process: %.1f ms, %.1f Mpoints/s\n", referenceMs, options.iterations / (referenceMs * 1000.0));
+    }
+    printf("%8s %12s %12s %10s %12s %9s %11s %8s\n", "workers", "wall ms", "slowest ms", "merge ms", "Mpoints/s",
+           "speedup", "efficiency", "matches");
+
+    bool ok = true;
+    double baseline = referenceMs;
+    std::vector<unsigned> merged;
+    for (size_t i = 0; i < options.workers.size(); i++)
+    {
+        RunResult result;
+        if (!RunCluster(options, params, options.workers[i], reference, &pool, &merged, &result))
+        {
+            ok = false;
+            continue;
+        }
+
+        // Against one worker process, spawning and merging included, so the
+        // fixed costs count against scaling; against the single process
+        // render until there's been one
+        double total = result.wall + result.merge;
+        if (result.workers == 1)
+        {
+            baseline = total;
+        }
+        double speedup = baseline / total;
+        printf("%8u %12.1f %12.1f %10.2f %12.1f %9.2f %10.0f%% %8s\n", result.workers, result.wall, result.slowest,
+               result.merge, options.iterations / (total * 1000.0), speedup, 100.0 * speedup / result.workers,
+               options.verify ? (result.matches ? "yes" : "NO") : "-");
+        ok &= result.matches;
+    }
+
+    if (!options.output.empty() && !merged.empty())
+    {
+        Image image;
+        RenderDensity(&merged[0], options.width, options.height, &image);
+        if (!image.WritePpm(options.output.c_str()))
+        {
+            fprintf(stderr, "could not write %s\n", options.output.c_str());
+            ok = false;
+        }
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,425 @@
+#include "BatchCulling.h"
+
+#include <math.h>
+#include <algorithm>
+
+#if defined(__AVX__)
+#define BATCHCULLING_AVX
+#include <immintrin.h>
+#elif defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BATCHCULLING_SSE
+#include <emmintrin.h>
+#endif
+
+static CullPlane NormalizePlane(float a, float b, float c, float d)
+{
+    float length = sqrtf(a * a + b * b + c * c);
+    CullPlane plane = { a / length, b / length, c / length, d / length };
+    return plane;
+}
+
+CullFrustum FrustumFromMatrix(const float m[16])
+{
+    // Column j of the matrix is m[j], m[4 + j], m[8 + j], m[12 + j]
+    CullFrustum frustum;
+    frustum.planes[0] = NormalizePlane(m[3] + m[0], m[7] + m[4], m[11] + m[8], m[15] + m[12]);  // left
+    frustum.planes[1] = NormalizePlane(m[3] - m[0], m[7] - m[4], m[11] - m[8], m[15] - m[12]);  // right
+    frustum.planes[2] = NormalizePlane(m[3] + m[1], m[7] + m[5], m[11] + m[9], m[15] + m[13]);  // bottom
+    frustum.planes[3] = NormalizePlane(m[3] - m[1], m[7] - m[5], m[11] - m[9], m[15] - m[13]);  // top
+    frustum.planes[4] = NormalizePlane(m[2], m[6], m[10], m[14]);                                // near
+    frustum.planes[5] = NormalizePlane(m[3] - m[2], m[7] - m[6], m[11] - m[10], m[15] - m[14]);  // far
+    return frustum;
+}
+
+void AabbSoA::Reserve(size_t count)
+{
+    centerX.reserve(count); centerY.reserve(count); centerZ.reserve(count);
+    extentX.reserve(count); extentY.reserve(count); extentZ.reserve(count);
+}
+
+void AabbSoA::Add(float cx, float cy, float cz, float ex, float ey, float ez)
+{
+    centerX.push_back(cx); centerY.push_back(cy); centerZ.push_back(cz);
+    extentX.push_back(ex); extentY.push_back(ey); extentZ.push_back(ez);
+}
+
+void AabbSoA::Clear()
+{
+    centerX.clear(); centerY.clear(); centerZ.clear();
+    extentX.clear(); extentY.clear(); extentZ.clear();
+}
+
+void SphereSoA::Reserve(size_t count)
+{
+    centerX.reserve(count); centerY.reserve(count); centerZ.reserve(count); radius.reserve(count);
+}
+
+void SphereSoA::Add(float cx, float cy, float cz, float r)
+{
+    centerX.push_back(cx); centerY.push_back(cy); centerZ.push_back(cz); radius.push_back(r);
+}
+
+void SphereSoA::Clear()
+{
+    centerX.clear(); centerY.clear(); centerZ.clear(); radius.clear();
+}
+
+// A box is outside a plane when even its corner furthest along the normal
+// is behind it: dot(n, c) + d + dot(|n|, e) < 0
+static inline bool BoxVisible(const CullFrustum& frustum, const AabbSoA& boxes, size_t i)
+{
+    for (int p = 0; p < 6; p++)
+    {
+        const CullPlane& plane = frustum.planes[p];
+        float distance = plane.a * boxes.centerX[i] + plane.b * boxes.centerY[i] + plane.c * boxes.centerZ[i] + plane.d;
+        float radius = fabsf(plane.a) * boxes.extentX[i] + fabsf(plane.b) * boxes.extentY[i] + fabsf(plane.c) * boxes.extentZ[i];
+        if (distance + radius < 0.0f)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static inline bool SphereVisible(const CullFrustum& frustum, const SphereSoA& spheres, size_t i)
+{
+    for (int p = 0; p < 6; p++)
+    {
+        const CullPlane& plane = frustum.planes[p];
+        float distance = plane.a * spheres.centerX[i] + plane.b * spheres.centerY[i] + plane.c * spheres.centerZ[i] + plane.d;
+        if (distance + spheres.radius[i] < 0.0f)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t CullAabbsScalar(const CullFrustum& frustum, const AabbSoA& boxes, std::vector<unsigned>* visible)
+{
+    visible->clear();
+    for (size_t i = 0; i < boxes.Size(); i++)
+    {
+        if (BoxVisible(frustum, boxes, i))
+        {
+            visible->push_back((unsigned)i);
+        }
+    }
+    return visible->size();
+}
+
+// Append the set bits of mask as indices base + bit, without branches
+static inline size_t Compact(unsigned mask, unsigned base, int width, unsigned* out)
+{
+    size_t n = 0;
+    for (int k = 0; k < width; k++)
+    {
+        out[n] = base + k;
+        n += (mask >> k) & 1;
+    }
+    return n;
+}
+
+// Box test of [begin, end) into out, returns the number written.
+// out must have room for end - begin + 8 entries.
+static size_t CullAabbRange(const CullFrustum& frustum, const AabbSoA& boxes, size_t begin, size_t end, unsigned* out)
+{
+    size_t n = 0;
+    size_t i = begin;
+
+#if defined(BATCHCULLING_AVX)
+    const __m256 signMask = _mm256_set1_ps(-0.0f);
+    for (; i + 8 <= end; i += 8)
+    {
+        __m256 cx = _mm256_loadu_ps(&boxes.centerX[i]);
+        __m256 cy = _mm256_loadu_ps(&boxes.centerY[i]);
+        __m256 cz = _mm256_loadu_ps(&boxes.centerZ[i]);
+        __m256 ex = _mm256_loadu_ps(&boxes.extentX[i]);
+        __m256 ey = _mm256_loadu_ps(&boxes.extentY[i]);
+        __m256 ez = _mm256_loadu_ps(&boxes.extentZ[i]);
+        __m256 outside = _mm256_setzero_ps();
+        for (int p = 0; p < 6; p++)
+        {
+            const CullPlane& plane = frustum.planes[p];
+            __m256 a = _mm256_set1_ps(plane.a);
+            __m256 b = _mm256_set1_ps(plane.b);
+            __m256 c = _mm256_set1_ps(plane.c);
+            __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a, cx), _mm256_mul_ps(b, cy)),
+                                            _mm256_add_ps(_mm256_mul_ps(c, cz), _mm256_set1_ps(plane.d)));
+            __m256 radius = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_andnot_ps(signMask, a), ex),
+                                                        _mm256_mul_ps(_mm256_andnot_ps(signMask, b), ey)),
+                                          _mm256_mul_ps(_mm256_andnot_ps(signMask, c), ez));
+            outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(distance, radius), _mm256_setzero_ps(), _CMP_LT_OQ));
+        }
+        unsigned mask = ~(unsigned)_mm256_movemask_ps(outside) & 0xFF;
+        n += Compact(mask, (unsigned)i, 8, out + n);
+    }
+#elif defined(BATCHCULLING_SSE)
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    for (; i + 4 <= end; i += 4)
+    {
+        __m128 cx = _mm_loadu_ps(&boxes.centerX[i]);
+        __m128 cy = _mm_loadu_ps(&boxes.centerY[i]);
+        __m128 cz = _mm_loadu_ps(&boxes.centerZ[i]);
+        __m128 ex = _mm_loadu_ps(&boxes.extentX[i]);
+        __m128 ey = _mm_loadu_ps(&boxes.extentY[i]);
+        __m128 ez = _mm_loadu_ps(&boxes.extentZ[i]);
+        __m128 outside = _mm_setzero_ps();
+        for (int p = 0; p < 6; p++)
+        {
+            const CullPlane& plane = frustum.planes[p];
+            __m128 a = _mm_set1_ps(plane.a);
+            __m128 b = _mm_set1_ps(plane.b);
+            __m128 c = _mm_set1_ps(plane.c);
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, cx), _mm_mul_ps(b, cy)),
+                                         _mm_add_ps(_mm_mul_ps(c, cz), _mm_set1_ps(plane.d)));
+            __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signMask, a), ex),
+                                                  _mm_mul_ps(_mm_andnot_ps(signMask, b), ey)),
+                                       _mm_mul_ps(_mm_andnot_ps(signMask, c), ez));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+        }
+        unsigned mask = ~(unsigned)_mm_movemask_ps(outside) & 0xF;
+        n += Compact(mask, (unsigned)i, 4, out + n);
+    }
+#endif
+
+    for (; i < end; i++)
+    {
+        out[n] = (unsigned)i;
+        n += BoxVisible(frustum, boxes, i) ? 1 : 0;
+    }
+    return n;
+}
+
+const char* CullKernelName()
+{
+#if defined(BATCHCULLING_AVX)
+    return "avx";
+#elif defined(BATCHCULLING_SSE)
+    return "sse";
+#else
+    return "scalar";
+#endif
+}
+
+size_t CullAabbs(const CullFrustum& frustum, const AabbSoA& boxes, std::vector<unsigned>* visible)
+{
+    visible->resize(boxes.Size() + 8);
+    size_t n = CullAabbRange(frustum, boxes, 0, boxes.Size(), &(*visible)[0]);
+    visible->resize(n);
+    return n;
+}
+
+size_t CullSpheres(const CullFrustum& frustum, const SphereSoA& spheres, std::vector<unsigned>* visible)
+{
+    visible->resize(spheres.Size() + 8);
+    unsigned* out = &(*visible)[0];
+    size_t n = 0;
+    size_t i = 0;
+
+#if defined(BATCHCULLING_AVX)
+    for (; i + 8 <= spheres.Size(); i += 8)
+    {
+        __m256 cx = _mm256_loadu_ps(&spheres.centerX[i]);
+        __m256 cy = _mm256_loadu_ps(&spheres.centerY[i]);
+        __m256 cz = _mm256_loadu_ps(&spheres.centerZ[i]);
+        __m256 r = _mm256_loadu_ps(&spheres.radius[i]);
+        __m256 outside = _mm256_setzero_ps();
+        for (int p = 0; p < 6; p++)
+        {
+            const CullPlane& plane = frustum.planes[p];
+            __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane.a), cx), _mm256_mul_ps(_mm256_set1_ps(plane.b), cy)),
+                                            _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane.c), cz), _mm256_set1_ps(plane.d)));
+            outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(distance, r), _mm256_setzero_ps(), _CMP_LT_OQ));
+        }
+        n += Compact(~(unsigned)_mm256_movemask_ps(outside) & 0xFF, (unsigned)i, 8, out + n);
+    }
+#elif defined(BATCHCULLING_SSE)
+    for (; i + 4 <= spheres.Size(); i += 4)
+    {
+        __m128 cx = _mm_loadu_ps(&spheres.centerX[i]);
+        __m128 cy = _mm_loadu_ps(&spheres.centerY[i]);
+        __m128 cz = _mm_loadu_ps(&spheres.centerZ[i]);
+        __m128 r = _mm_loadu_ps(&spheres.radius[i]);
+        __m128 outside = _mm_setzero_ps();
+        for (int p = 0; p < 6; p++)
+        {
+            const CullPlane& plane = frustum.planes[p];
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.a), cx), _mm_mul_ps(_mm_set1_ps(plane.b), cy)),
+                                         _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.c), cz), _mm_set1_ps(plane.d)));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, r), _mm_setzero_ps()));
+        }
+        n += Compact(~(unsigned)_mm_movemask_ps(outside) & 0xF, (unsigned)i, 4, out + n);
+    }
+#endif
+
+    for (; i < spheres.Size(); i++)
+    {
+        out[n] = (unsigned)i;
+        n += SphereVisible(frustum, spheres, i) ? 1 : 0;
+    }
+    visible->resize(n);
+    return n;
+}
+
+CullBvh::CullBvh() :
+    _leafSize(8)
+{
+}
+
+void CullBvh::Build(const AabbSoA& boxes, unsigned leafSize)
+{
+    _leafSize = leafSize < 1 ? 1 : leafSize;
+    _nodes.clear();
+    _boxes.Clear();
+
+    size_t count = boxes.Size();
+    std::vector<unsigned> order(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        order[i] = (unsigned)i;
+    }
+    if (count == 0)
+    {
+        _order.clear();
+        return;
+    }
+
+    _nodes.reserve(4 * count / _leafSize + 1);
+    _nodes.push_back(Node());
+    BuildNode(0, 0, (unsigned)count, order, boxes);
+
+    // Store the boxes in tree order so leaves are contiguous for the kernel
+    _boxes.Reserve(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        unsigned b = order[i];
+        _boxes.Add(boxes.centerX[b], boxes.centerY[b], boxes.centerZ[b],
+                   boxes.extentX[b], boxes.extentY[b], boxes.extentZ[b]);
+    }
+    _order.swap(order);
+}
+
+void CullBvh::BuildNode(unsigned index, unsigned first, unsigned count, std::vector<unsigned>& order, const AabbSoA& boxes)
+{
+    float bmin[3] = { INFINITY, INFINITY, INFINITY };
+    float bmax[3] = { -INFINITY, -INFINITY, -INFINITY };
+    float cmin[3] = { INFINITY, INFINITY, INFINITY };
+    float cmax[3] = { -INFINITY, -INFINITY, -INFINITY };
+    for (unsigned i = first; i < first + count; i++)
+    {
+        unsigned b = order[i];
+        float c[3] = { boxes.centerX[b], boxes.centerY[b], boxes.centerZ[b] };
+        float e[3] = { boxes.extentX[b], boxes.extentY[b], boxes.extentZ[b] };
+        for (int k = 0; k < 3; k++)
+        {
+            bmin[k] = std::min(bmin[k], c[k] - e[k]);
+            bmax[k] = std::max(bmax[k], c[k] + e[k]);
+            cmin[k] = std::min(cmin[k], c[k]);
+            cmax[k] = std::max(cmax[k], c[k]);
+        }
+    }
+
+    Node& node = _nodes[index];
+    node.minX = bmin[0]; node.minY = bmin[1]; node.minZ = bmin[2];
+    node.maxX = bmax[0]; node.maxY = bmax[1]; node.maxZ = bmax[2];
+    node.first = first;
+    node.count = count;
+    node.left = 0;
+
+    if (count <= _leafSize)
+    {
+        return;
+    }
+
+    // Median split along the widest spread of centers
+    int axis = 0;
+    for (int k = 1; k < 3; k++)
+    {
+        if (cmax[k] - cmin[k] > cmax[axis] - cmin[axis])
+        {
+            axis = k;
+        }
+    }
+    const std::vector<float>& centers = axis == 0 ? boxes.centerX : (axis == 1 ? boxes.centerY : boxes.centerZ);
+    unsigned half = count / 2;
+    std::nth_element(order.begin() + first, order.begin() + first + half, order.begin() + first + count,
+                     [&centers](unsigned a, unsigned b) { return centers[a] < centers[b]; });
+
+    // Siblings are allocated together so the right child is left + 1
+    unsigned left = (unsigned)_nodes.size();
+    _nodes[index].left = left;
+    _nodes.push_back(Node());
+    _nodes.push_back(Node());
+
+    BuildNode(left, first, half, order, boxes);
+    BuildNode(left + 1, first + half, count - half, order, boxes);
+}
+
+void CullBvh::CullNode(const CullFrustum& frustum, unsigned index, unsigned planeMask, unsigned* out, size_t* count) const
+{
+    const Node& node = _nodes[index];
+
+    float cx = 0.5f * (node.minX + node.maxX);
+    float cy = 0.5f * (node.minY + node.maxY);
+    float cz = 0.5f * (node.minZ + node.maxZ);
+    float ex = 0.5f * (node.maxX - node.minX);
+    float ey = 0.5f * (node.maxY - node.minY);
+    float ez = 0.5f * (node.maxZ - node.minZ);
+
+    // Only test the planes the parent straddles
+    for (int p = 0; p < 6; p++)
+    {
+        if (!(planeMask & (1u << p)))
+        {
+            continue;
+        }
+        const CullPlane& plane = frustum.planes[p];
+        float distance = plane.a * cx + plane.b * cy + plane.c * cz + plane.d;
+        float radius = fabsf(plane.a) * ex + fabsf(plane.b) * ey + fabsf(plane.c) * ez;
+        if (distance + radius < 0.0f)
+        {
+            return;
+        }
+        if (distance - radius >= 0.0f)
+        {
+            planeMask &= ~(1u << p);
+        }
+    }
+
+    if (planeMask == 0)
+    {
+        // Entirely inside, take the whole subtree
+        for (unsigned i = node.first; i < node.first + node.count; i++)
+        {
+            out[(*count)++] = _order[i];
+        }
+        return;
+    }
+
+    if (node.left == 0)
+    {
+        size_t n = CullAabbRange(frustum, _boxes, node.first, node.first + node.count, out + *count);
+        for (size_t i = 0; i < n; i++)
+        {
+            out[*count + i] = _order[out[*count + i]];
+        }
+        *count += n;
+        return;
+    }
+
+    CullNode(frustum, node.left, planeMask, out, count);
+    CullNode(frustum, node.left + 1, planeMask, out, count);
+}
+
+size_t CullBvh::Cull(const CullFrustum& frustum, std::vector<unsigned>* visible) const
+{
+    visible->resize(_order.size() + 8);
+    size_t count = 0;
+    if (!_nodes.empty())
+    {
+        CullNode(frustum, 0, 0x3F, &(*visible)[0], &count);
+    }
+    visible->resize(count);
+    return count;
+}
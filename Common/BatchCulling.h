@@ -0,0 +1,94 @@
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+// Plane a*x + b*y + c*z + d = 0 with the normal pointing into the frustum
+struct CullPlane
+{
+    float a, b, c, d;
+};
+
+struct CullFrustum
+{
+    CullPlane planes[6];
+};
+
+// Extract the six planes from a row-major view-projection matrix using the
+// Direct3D conventions (row vectors, clip z in [0, w]), the same layout as
+// XMFLOAT4X4.
+CullFrustum FrustumFromMatrix(const float viewProj[16]);
+
+// Axis aligned boxes as center/extents, one array per component so the
+// culling kernels can load four or eight boxes at a time
+struct AabbSoA
+{
+    std::vector<float> centerX, centerY, centerZ;
+    std::vector<float> extentX, extentY, extentZ;
+
+    size_t Size() const { return centerX.size(); }
+    void Reserve(size_t count);
+    void Add(float cx, float cy, float cz, float ex, float ey, float ez);
+    void Clear();
+};
+
+struct SphereSoA
+{
+    std::vector<float> centerX, centerY, centerZ, radius;
+
+    size_t Size() const { return centerX.size(); }
+    void Reserve(size_t count);
+    void Add(float cx, float cy, float cz, float r);
+    void Clear();
+};
+
+// Write the indices of boxes/spheres that intersect the frustum to visible
+// and return how many there are. Uses AVX when the compiler targets it,
+// otherwise SSE, otherwise plain C.
+size_t CullAabbs(const CullFrustum& frustum, const AabbSoA& boxes, std::vector<unsigned>* visible);
+size_t CullSpheres(const CullFrustum& frustum, const SphereSoA& spheres, std::vector<unsigned>* visible);
+
+// The kernel CullAabbs and CullSpheres were compiled with: "avx", "sse"
+// or "scalar"
+const char* CullKernelName();
+
+// One object per call, like XNA::IntersectAxisAlignedBoxFrustum. Kept as
+// the reference the batched paths are measured against.
+size_t CullAabbsScalar(const CullFrustum& frustum, const AabbSoA& boxes, std::vector<unsigned>* visible);
+
+// Bounding volume hierarchy over a fixed set of boxes, built in one go.
+// Subtrees completely inside the frustum are accepted without testing
+// their boxes, subtrees completely outside are skipped, and leaves that
+// straddle a plane are tested with the batched kernel.
+class CullBvh
+{
+public:
+    CullBvh();
+
+    // Build over boxes. Leaves hold at most leafSize boxes.
+    void Build(const AabbSoA& boxes, unsigned leafSize = 8);
+
+    // Same output as CullAabbs over the boxes passed to Build, but in
+    // tree order instead of index order
+    size_t Cull(const CullFrustum& frustum, std::vector<unsigned>* visible) const;
+
+    size_t NodeCount() const { return _nodes.size(); }
+
+private:
+    struct Node
+    {
+        float minX, minY, minZ;
+        float maxX, maxY, maxZ;
+        unsigned first;         // first box in tree order
+        unsigned count;         // boxes in the subtree
+        unsigned left;          // index of the left child, right is left + 1. 0 for leaves
+    };
+
+    std::vector<Node> _nodes;
+    std::vector<unsigned> _order;   // tree order -> original index
+    AabbSoA _boxes;                 // boxes in tree order
+    unsigned _leafSize;
+
+    void BuildNode(unsigned index, unsigned first, unsigned count, std::vector<unsigned>& order, const AabbSoA& boxes);
+    void CullNode(const CullFrustum& frustum, unsigned node, unsigned planeMask, unsigned* out, size_t* count) const;
+};
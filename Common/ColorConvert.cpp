@@ -0,0 +1,174 @@
+#include "ColorConvert.h"
+
+#ifdef COLORCONVERT_SSE2
+#include <emmintrin.h>
+#endif
+
+// BT.601 in 8.8 fixed point:
+//   Y = (66 R + 129 G + 25 B + 128) / 256 + 16
+//   U = (-38 R - 74 G + 112 B + 128) / 256 + 128
+//   V = (112 R - 94 G - 18 B + 128) / 256 + 128
+// U and V add 128 * 256 before dividing, so every sum is positive, fits
+// in 16 unsigned bits and the shift floors the same way in both versions.
+
+size_t I420Size(unsigned width, unsigned height)
+{
+    size_t chroma = (size_t)((width + 1) / 2) * ((height + 1) / 2);
+    return (size_t)width * height + 2 * chroma;
+}
+
+static inline unsigned char Luma(unsigned p)
+{
+    unsigned r = p & 0xFF, g = (p >> 8) & 0xFF, b = (p >> 16) & 0xFF;
+    return (unsigned char)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+}
+
+static inline void Chroma(unsigned p00, unsigned p01, unsigned p10, unsigned p11, unsigned char* u, unsigned char* v)
+{
+    int r = (int)(((p00 & 0xFF) + (p01 & 0xFF) + (p10 & 0xFF) + (p11 & 0xFF) + 2) >> 2);
+    int g = (int)((((p00 >> 8) & 0xFF) + ((p01 >> 8) & 0xFF) + ((p10 >> 8) & 0xFF) + ((p11 >> 8) & 0xFF) + 2) >> 2);
+    int b = (int)((((p00 >> 16) & 0xFF) + ((p01 >> 16) & 0xFF) + ((p10 >> 16) & 0xFF) + ((p11 >> 16) & 0xFF) + 2) >> 2);
+    *u = (unsigned char)((-38 * r - 74 * g + 112 * b + 128 + (128 << 8)) >> 8);
+    *v = (unsigned char)((112 * r - 94 * g - 18 * b + 128 + (128 << 8)) >> 8);
+}
+
+// Columns [x, width) of two rows; row1 is row0 again and y1 NULL when the
+// height is odd and this is the last row
+static void ConvertPairScalar(const unsigned* row0, const unsigned* row1, unsigned x, unsigned width,
+                              unsigned char* y0, unsigned char* y1, unsigned char* u, unsigned char* v)
+{
+    for (; x < width; x += 2)
+    {
+        unsigned next = x + 1 < width ? x + 1 : x;
+        y0[x] = Luma(row0[x]);
+        if (next != x)
+        {
+            y0[next] = Luma(row0[next]);
+        }
+        if (y1)
+        {
+            y1[x] = Luma(row1[x]);
+            if (next != x)
+            {
+                y1[next] = Luma(row1[next]);
+            }
+        }
+        Chroma(row0[x], row0[next], row1[x], row1[next], &u[x / 2], &v[x / 2]);
+    }
+}
+
+#ifdef COLORCONVERT_SSE2
+
+// R, G and B of 8 pixels as 16-bit lanes
+static inline void Deinterleave(const unsigned* p, __m128i* r, __m128i* g, __m128i* b)
+{
+    const __m128i mask = _mm_set1_epi32(0xFF);
+    __m128i lo = _mm_loadu_si128((const __m128i*)p);
+    __m128i hi = _mm_loadu_si128((const __m128i*)(p + 4));
+    *r = _mm_packs_epi32(_mm_and_si128(lo, mask), _mm_and_si128(hi, mask));
+    *g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(lo, 8), mask), _mm_and_si128(_mm_srli_epi32(hi, 8), mask));
+    *b = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(lo, 16), mask), _mm_and_si128(_mm_srli_epi32(hi, 16), mask));
+}
+
+// The products wrap in 16 bits but the sum is below 65536, so it's exact
+static inline __m128i Luma8(__m128i r, __m128i g, __m128i b)
+{
+    __m128i y = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(66)), _mm_mullo_epi16(g, _mm_set1_epi16(129)));
+    y = _mm_add_epi16(y, _mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(25)), _mm_set1_epi16(128)));
+    return _mm_add_epi16(_mm_srli_epi16(y, 8), _mm_set1_epi16(16));
+}
+
+// Rounded 2x2 averages of 8 columns of two rows, 4 results as 32-bit lanes
+static inline __m128i Average4(__m128i top, __m128i bottom)
+{
+    __m128i pairs = _mm_madd_epi16(_mm_add_epi16(top, bottom), _mm_set1_epi16(1));
+    return _mm_srli_epi32(_mm_add_epi32(pairs, _mm_set1_epi32(2)), 2);
+}
+
+static inline __m128i Chroma8(__m128i r, __m128i g, __m128i b, short cr, short cg, short cb)
+{
+    __m128i c = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(cr)), _mm_mullo_epi16(g, _mm_set1_epi16(cg)));
+    c = _mm_add_epi16(c, _mm_mullo_epi16(b, _mm_set1_epi16(cb)));
+    return _mm_srli_epi16(_mm_add_epi16(c, _mm_set1_epi16((short)(128 + (128 << 8)))), 8);
+}
+
+// 16 columns of two rows per iteration: 32 Y, 8 U and 8 V
+static void ConvertPair(const unsigned* row0, const unsigned* row1, unsigned width,
+                        unsigned char* y0, unsigned char* y1, unsigned char* u, unsigned char* v)
+{
+    unsigned x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        __m128i r00, g00, b00, r01, g01, b01, r10, g10, b10, r11, g11, b11;
+        Deinterleave(row0 + x, &r00, &g00, &b00);
+        Deinterleave(row0 + x + 8, &r01, &g01, &b01);
+        Deinterleave(row1 + x, &r10, &g10, &b10);
+        Deinterleave(row1 + x + 8, &r11, &g11, &b11);
+
+        _mm_storeu_si128((__m128i*)(y0 + x), _mm_packus_epi16(Luma8(r00, g00, b00), Luma8(r01, g01, b01)));
+        if (y1)
+        {
+            _mm_storeu_si128((__m128i*)(y1 + x), _mm_packus_epi16(Luma8(r10, g10, b10), Luma8(r11, g11, b11)));
+        }
+
+        __m128i r = _mm_packs_epi32(Average4(r00, r10), Average4(r01, r11));
+        __m128i g = _mm_packs_epi32(Average4(g00, g10), Average4(g01, g11));
+        __m128i b = _mm_packs_epi32(Average4(b00, b10), Average4(b01, b11));
+        __m128i cu = Chroma8(r, g, b, -38, -74, 112);
+        __m128i cv = Chroma8(r, g, b, 112, -94, -18);
+        _mm_storel_epi64((__m128i*)(u + x / 2), _mm_packus_epi16(cu, cu));
+        _mm_storel_epi64((__m128i*)(v + x / 2), _mm_packus_epi16(cv, cv));
+    }
+    ConvertPairScalar(row0, row1, x, width, y0, y1, u, v);
+}
+
+#else
+
+static void ConvertPair(const unsigned* row0, const unsigned* row1, unsigned width,
+                        unsigned char* y0, unsigned char* y1, unsigned char* u, unsigned char* v)
+{
+    ConvertPairScalar(row0, row1, 0, width, y0, y1, u, v);
+}
+
+#endif
+
+void RgbaToI420Rows(const unsigned* rgba, unsigned width, unsigned height, unsigned rowBegin, unsigned rowEnd,
+                    unsigned char* yuv)
+{
+    unsigned chromaWidth = (width + 1) / 2;
+    unsigned char* yPlane = yuv;
+    unsigned char* uPlane = yuv + (size_t)width * height;
+    unsigned char* vPlane = uPlane + (size_t)chromaWidth * ((height + 1) / 2);
+
+    for (unsigned y = rowBegin; y < rowEnd; y += 2)
+    {
+        bool last = y + 1 >= height;
+        const unsigned* row0 = rgba + (size_t)y * width;
+        const unsigned* row1 = last ? row0 : row0 + width;
+        size_t chroma = (size_t)(y / 2) * chromaWidth;
+        ConvertPair(row0, row1, width, yPlane + (size_t)y * width, last ? NULL : yPlane + (size_t)(y + 1) * width,
+                    uPlane + chroma, vPlane + chroma);
+    }
+}
+
+void RgbaToI420(const unsigned* rgba, unsigned width, unsigned height, unsigned char* yuv)
+{
+    RgbaToI420Rows(rgba, width, height, 0, height, yuv);
+}
+
+void RgbaToI420Scalar(const unsigned* rgba, unsigned width, unsigned height, unsigned char* yuv)
+{
+    unsigned chromaWidth = (width + 1) / 2;
+    unsigned char* yPlane = yuv;
+    unsigned char* uPlane = yuv + (size_t)width * height;
+    unsigned char* vPlane = uPlane + (size_t)chromaWidth * ((height + 1) / 2);
+
+    for (unsigned y = 0; y < height; y += 2)
+    {
+        bool last = y + 1 >= height;
+        const unsigned* row0 = rgba + (size_t)y * width;
+        size_t chroma = (size_t)(y / 2) * chromaWidth;
+        ConvertPairScalar(row0, last ? row0 : row0 + width, 0, width, yPlane + (size_t)y * width,
+                          last ? NULL : yPlane + (size_t)(y + 1) * width, uPlane + chroma, vPlane + chroma);
+    }
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stddef.h>
+
+// Use SSE2 kernels where the compiler guarantees SSE2
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define COLORCONVERT_SSE2
+#endif
+
+// Bytes of an I420 frame: the width x height Y plane, then the U and V
+// planes at half the width and height, rounded up
+size_t I420Size(unsigned width, unsigned height);
+
+// RGBA8 pixels as Image stores them (red in the low byte) to I420, BT.601
+// limited range. Each chroma sample averages a 2x2 block, centered like
+// Y4M's 420jpeg; odd edges repeat the last row or column. Integer math,
+// so the SIMD and scalar versions give the same bytes.
+void RgbaToI420(const unsigned* rgba, unsigned width, unsigned height, unsigned char* yuv);
+
+// Only rows [rowBegin, rowEnd) of the same frame, so bands can run on
+// different threads. rowBegin must be even, rowEnd even or height.
+void RgbaToI420Rows(const unsigned* rgba, unsigned width, unsigned height, unsigned rowBegin, unsigned rowEnd,
+                    unsigned char* yuv);
+
+// Plain C version, the reference for the SIMD one
+void RgbaToI420Scalar(const unsigned* rgba, unsigned width, unsigned height, unsigned char* yuv);
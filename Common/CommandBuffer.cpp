@@ -0,0 +1,244 @@
+#include "CommandBuffer.h"
+#include "LineRaster.h"
+#include "Telemetry.h"
+
+#include <string.h>
+
+CommandBuffer::CommandBuffer() :
+    _data(NULL),
+    _used(0),
+    _commands(0),
+    _lines(0),
+    _openLines(NoOpenLines),
+    _openColor(0),
+    _openWidth(0.0f)
+{
+}
+
+void CommandBuffer::Reset()
+{
+    _used = 0;
+    _commands = 0;
+    _lines = 0;
+    _openLines = NoOpenLines;
+}
+
+void CommandBuffer::Grow(size_t bytes)
+{
+    // Doubling keeps recording amortized O(1); after the first few frames
+    // the buffer is big enough and this never runs
+    size_t capacity = _storage.size() < 4096 ? 4096 : _storage.size() * 2;
+    while (capacity < _used + bytes)
+    {
+        capacity *= 2;
+    }
+    _storage.resize(capacity);
+    _data = &_storage[0];
+    Telemetry::Add(Telemetry_Allocations);
+}
+
+void CommandBuffer::Clear(unsigned color)
+{
+    ClearCommand* command = (ClearCommand*)Reserve(sizeof(ClearCommand));
+    command->header.type = DrawCommand_Clear;
+    command->header.bytes = sizeof(ClearCommand);
+    command->color = color;
+    _commands++;
+    _openLines = NoOpenLines;
+}
+
+void CommandBuffer::SetTransform(const Matrix3x2& transform)
+{
+    SetTransformCommand* command = (SetTransformCommand*)Reserve(sizeof(SetTransformCommand));
+    command->header.type = DrawCommand_SetTransform;
+    command->header.bytes = sizeof(SetTransformCommand);
+    command->transform = transform;
+    _commands++;
+    _openLines = NoOpenLines;
+}
+
+void CommandBuffer::SetClip(const PixelRect& rect)
+{
+    SetClipCommand* command = (SetClipCommand*)Reserve(sizeof(SetClipCommand));
+    command->header.type = DrawCommand_SetClip;
+    command->header.bytes = sizeof(SetClipCommand);
+    command->rect = rect;
+    _commands++;
+    _openLines = NoOpenLines;
+}
+
+void CommandBuffer::BeginLines(unsigned color, float width)
+{
+    _openLines = _used;
+    _openColor = color;
+    _openWidth = width;
+
+    LinesCommand* command = (LinesCommand*)Reserve(sizeof(LinesCommand));
+    command->header.type = DrawCommand_Lines;
+    command->header.bytes = sizeof(LinesCommand);
+    command->color = color;
+    command->width = width;
+    command->lineCount = 0;
+    _commands++;
+}
+
+void CommandBuffer::Replay(CommandBackend* backend) const
+{
+    size_t offset = 0;
+    while (offset < _used)
+    {
+        const DrawCommand* header = (const DrawCommand*)(_data + offset);
+        switch (header->type)
+        {
+        case DrawCommand_Clear:
+            backend->Clear(((const ClearCommand*)header)->color);
+            break;
+
+        case DrawCommand_SetTransform:
+            backend->SetTransform(((const SetTransformCommand*)header)->transform);
+            break;
+
+        case DrawCommand_SetClip:
+            backend->SetClip(((const SetClipCommand*)header)->rect);
+            break;
+
+        case DrawCommand_Lines:
+            {
+                const LinesCommand* command = (const LinesCommand*)header;
+                backend->DrawLines((const Float2*)(command + 1), command->lineCount, command->color, command->width);
+            }
+            break;
+        }
+        offset += header->bytes;
+    }
+}
+
+bool CommandBuffer::Load(const void* data, size_t bytes)
+{
+    Reset();
+    if (bytes == 0)
+    {
+        return true;
+    }
+
+    memcpy(Reserve(bytes), data, bytes);
+
+    // Walk the copy so Replay can trust the sizes
+    size_t offset = 0;
+    while (offset < _used)
+    {
+        if (_used - offset < sizeof(DrawCommand))
+        {
+            break;
+        }
+
+        const DrawCommand* header = (const DrawCommand*)(_data + offset);
+        if (header->bytes > _used - offset)
+        {
+            break;
+        }
+
+        size_t expected = 0;
+        switch (header->type)
+        {
+        case DrawCommand_Clear:
+            expected = sizeof(ClearCommand);
+            break;
+
+        case DrawCommand_SetTransform:
+            expected = sizeof(SetTransformCommand);
+            break;
+
+        case DrawCommand_SetClip:
+            expected = sizeof(SetClipCommand);
+            break;
+
+        case DrawCommand_Lines:
+            if (header->bytes >= sizeof(LinesCommand))
+            {
+                size_t payload = header->bytes - sizeof(LinesCommand);
+                unsigned lineCount = ((const LinesCommand*)header)->lineCount;
+                if (payload % (4 * sizeof(float)) == 0 && payload / (4 * sizeof(float)) == lineCount)
+                {
+                    expected = header->bytes;
+                    _lines += lineCount;
+                }
+            }
+            break;
+        }
+
+        if (expected == 0 || header->bytes != expected)
+        {
+            break;
+        }
+        offset += header->bytes;
+        _commands++;
+    }
+
+    if (offset != _used)
+    {
+        Reset();
+        return false;
+    }
+    return true;
+}
+
+void SoftwareCommandBackend::Clear(unsigned color)
+{
+    _image->Clear(color);
+}
+
+void SoftwareCommandBackend::SetTransform(const Matrix3x2& transform)
+{
+    _transform = transform;
+}
+
+void SoftwareCommandBackend::SetClip(const PixelRect& rect)
+{
+    _image->SetClip(rect);
+}
+
+void SoftwareCommandBackend::DrawLines(const Float2* points, unsigned lineCount, unsigned color, float /* width */)
+{
+    Telemetry::Add(Telemetry_Primitives, lineCount);
+
+    if (_lines)
+    {
+        _lines->DrawLines(_image, points, lineCount, _transform, color, _pool);
+        return;
+    }
+
+    const Matrix3x2& m = _transform;
+    bool identity = m._11 == 1.0f && m._12 == 0.0f && m._21 == 0.0f && m._22 == 1.0f && m._31 == 0.0f && m._32 == 0.0f;
+    if (identity)
+    {
+        for (unsigned i = 0; i < lineCount; i++)
+        {
+            DrawLine(_image, points[2 * i], points[2 * i + 1], color);
+        }
+        return;
+    }
+
+    float* x = _scratch ? _scratch->Allocate<float>(2 * lineCount) : NULL;
+    float* y = _scratch ? _scratch->Allocate<float>(2 * lineCount) : NULL;
+    if (x && y)
+    {
+        for (unsigned i = 0; i < 2 * lineCount; i++)
+        {
+            x[i] = points[i].x;
+            y[i] = points[i].y;
+        }
+        TransformPoints2(_transform, x, y, x, y, 2 * lineCount);
+
+        for (unsigned i = 0; i < lineCount; i++)
+        {
+            DrawLine(_image, Float2(x[2 * i], y[2 * i]), Float2(x[2 * i + 1], y[2 * i + 1]), color);
+        }
+        return;
+    }
+
+    for (unsigned i = 0; i < lineCount; i++)
+    {
+        DrawLine(_image, _transform.TransformPoint(points[2 * i]), _transform.TransformPoint(points[2 * i + 1]), color);
+    }
+}
@@ -0,0 +1,203 @@
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+#include "FrameArena.h"
+#include "SoftwareRaster.h"
+#include "VecMath.h"
+
+class LineRasterizer;
+class ThreadPool;
+
+// A frame's 2D drawing recorded as POD commands in one growing block of
+// memory, then replayed on a backend. Colors are packed with PackRgba.
+
+enum DrawCommandType
+{
+    DrawCommand_Clear,
+    DrawCommand_SetTransform,
+    DrawCommand_Lines,
+    DrawCommand_SetClip
+};
+
+// Every command starts with this. bytes covers the header and everything
+// after it up to the next command.
+struct DrawCommand
+{
+    unsigned type;
+    unsigned bytes;
+};
+
+struct ClearCommand
+{
+    DrawCommand header;
+    unsigned color;
+};
+
+struct SetTransformCommand
+{
+    DrawCommand header;
+    Matrix3x2 transform;
+};
+
+// In pixels of the target, not affected by the transform
+struct SetClipCommand
+{
+    DrawCommand header;
+    PixelRect rect;
+};
+
+// Followed by lineCount pairs of Float2 endpoints
+struct LinesCommand
+{
+    DrawCommand header;
+    unsigned color;
+    float width;
+    unsigned lineCount;
+};
+
+// What a recorded frame is replayed on
+class CommandBackend
+{
+public:
+    virtual ~CommandBackend() {}
+
+    virtual void Clear(unsigned color) = 0;
+    virtual void SetTransform(const Matrix3x2& transform) = 0;
+
+    // Later commands, Clear included, only touch pixels inside rect. A
+    // replay starts unclipped.
+    virtual void SetClip(const PixelRect& rect) = 0;
+
+    // points holds 2 * lineCount endpoints
+    virtual void DrawLines(const Float2* points, unsigned lineCount, unsigned color, float width) = 0;
+};
+
+class CommandBuffer
+{
+public:
+    CommandBuffer();
+
+    // Forget the recorded commands, keep the memory
+    void Reset();
+
+    void Clear(unsigned color);
+    void SetTransform(const Matrix3x2& transform);
+    void SetClip(const PixelRect& rect);
+
+    // Consecutive lines of the same color and width go into one command
+    void DrawLine(Float2 a, Float2 b, unsigned color, float width = 1.0f)
+    {
+        // A new command too once bytes would wrap, millions of lines in
+        if (_openLines == NoOpenLines || _openColor != color || _openWidth != width ||
+            ((const LinesCommand*)(_data + _openLines))->header.bytes > MaxLinesBytes)
+        {
+            BeginLines(color, width);
+        }
+
+        float* p = (float*)Reserve(4 * sizeof(float));
+        p[0] = a.x;
+        p[1] = a.y;
+        p[2] = b.x;
+        p[3] = b.y;
+        LinesCommand* command = (LinesCommand*)(_data + _openLines);
+        command->header.bytes += 4 * sizeof(float);
+        command->lineCount++;
+        _lines++;
+    }
+
+    // The plus sign Sierpinski draws for a point, arms of size units
+    void DrawCross(Float2 center, float size, unsigned color)
+    {
+        DrawLine(Float2(center.x - size, center.y), Float2(center.x + size, center.y), color);
+        DrawLine(Float2(center.x, center.y - size), Float2(center.x, center.y + size), color);
+    }
+
+    void Replay(CommandBackend* backend) const;
+
+    // Replace the contents with commands another buffer recorded, as
+    // returned by its Data. False and empty if they aren't well formed.
+    bool Load(const void* data, size_t bytes);
+
+    const unsigned char* Data() const { return _data; }
+    size_t Bytes() const { return _used; }
+    unsigned Commands() const { return _commands; }
+    unsigned Lines() const { return _lines; }
+
+private:
+    static const size_t NoOpenLines = ~(size_t)0;
+    static const unsigned MaxLinesBytes = ~0u - 4 * (unsigned)sizeof(float);
+
+    void* Reserve(size_t bytes)
+    {
+        if (_used + bytes > _storage.size())
+        {
+            Grow(bytes);
+        }
+        void* p = _data + _used;
+        _used += bytes;
+        return p;
+    }
+
+    void Grow(size_t bytes);
+    void BeginLines(unsigned color, float width);
+
+    std::vector<unsigned char> _storage;
+    unsigned char* _data;
+    size_t _used;
+    unsigned _commands;
+    unsigned _lines;
+
+    // The LinesCommand new lines are appended to, if any
+    size_t _openLines;
+    unsigned _openColor;
+    float _openWidth;
+
+    CommandBuffer(const CommandBuffer&);
+    CommandBuffer& operator=(const CommandBuffer&);
+};
+
+// Replays onto an Image with the software rasterizer. Lines are one pixel
+// wide whatever width was recorded, aliased unless SetAntialiasing. With a scratch arena each batch of
+// endpoints is transformed at once with TransformPoints2; the caller
+// resets the arena between frames.
+class SoftwareCommandBackend : public CommandBackend
+{
+public:
+    explicit SoftwareCommandBackend(Image* image, FrameArena* scratch = NULL) :
+        _image(image),
+        _scratch(scratch),
+        _transform(Matrix3x2::Identity()),
+        _lines(NULL),
+        _pool(NULL)
+    {
+        _image->ResetClip();
+    }
+
+    ~SoftwareCommandBackend()
+    {
+        _image->ResetClip();
+    }
+
+    // Draw lines antialiased like Direct2D with lines instead of the
+    // aliased DrawLine, the tiles spread over pool (may be NULL). NULL
+    // lines goes back to DrawLine.
+    void SetAntialiasing(LineRasterizer* lines, ThreadPool* pool)
+    {
+        _lines = lines;
+        _pool = pool;
+    }
+
+    void Clear(unsigned color);
+    void SetTransform(const Matrix3x2& transform);
+    void SetClip(const PixelRect& rect);
+    void DrawLines(const Float2* points, unsigned lineCount, unsigned color, float width);
+
+private:
+    Image* _image;
+    FrameArena* _scratch;
+    Matrix3x2 _transform;
+    LineRasterizer* _lines;
+    ThreadPool* _pool;
+};
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <d2d1.h>
+#include <d2d1helper.h>
+
+#include "CommandBuffer.h"
+#include "Telemetry.h"
+#include "VecMathInterop.h"
+
+// Replays a CommandBuffer on a Direct2D render target between BeginDraw
+// and EndDraw. The brush is recolored for each batch of lines. Clips are
+// axis-aligned clips, popped when the backend goes away, so destroy it
+// before EndDraw.
+class D2DCommandBackend : public CommandBackend
+{
+public:
+    D2DCommandBackend(ID2D1RenderTarget* target, ID2D1SolidColorBrush* brush) :
+        _target(target),
+        _brush(brush),
+        _clipped(false)
+    {
+    }
+
+    ~D2DCommandBackend()
+    {
+        if (_clipped)
+        {
+            _target->PopAxisAlignedClip();
+        }
+    }
+
+    void Clear(unsigned color)
+    {
+        _target->Clear(ToColor(color));
+    }
+
+    void SetTransform(const Matrix3x2& transform)
+    {
+        _target->SetTransform(ToD2D(transform));
+    }
+
+    void SetClip(const PixelRect& rect)
+    {
+        if (_clipped)
+        {
+            _target->PopAxisAlignedClip();
+        }
+
+        // Push applies the transform to the clip, rect is already in target units
+        D2D1_MATRIX_3X2_F transform;
+        _target->GetTransform(&transform);
+        _target->SetTransform(D2D1::Matrix3x2F::Identity());
+        _target->PushAxisAlignedClip(D2D1::RectF((float)rect.left, (float)rect.top, (float)rect.right, (float)rect.bottom),
+                                     D2D1_ANTIALIAS_MODE_ALIASED);
+        _target->SetTransform(transform);
+        _clipped = true;
+    }
+
+    void DrawLines(const Float2* points, unsigned lineCount, unsigned color, float width)
+    {
+        Telemetry::Add(Telemetry_DrawCalls, lineCount);
+        Telemetry::Add(Telemetry_Primitives, lineCount);
+
+        _brush->SetColor(ToColor(color));
+        for (unsigned i = 0; i < lineCount; i++)
+        {
+            _target->DrawLine(ToD2D(points[2 * i]), ToD2D(points[2 * i + 1]), _brush, width);
+        }
+    }
+
+private:
+    static D2D1_COLOR_F ToColor(unsigned color)
+    {
+        return D2D1::ColorF((color & 0xFF) / 255.0f, ((color >> 8) & 0xFF) / 255.0f,
+                            ((color >> 16) & 0xFF) / 255.0f, (color >> 24) / 255.0f);
+    }
+
+    ID2D1RenderTarget* _target;
+    ID2D1SolidColorBrush* _brush;
+    bool _clipped;
+};
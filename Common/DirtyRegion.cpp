@@ -0,0 +1,141 @@
+#include "DirtyRegion.h"
+
+#include <math.h>
+
+PixelRect Intersect(const PixelRect& a, const PixelRect& b)
+{
+    return MakePixelRect(a.left > b.left ? a.left : b.left, a.top > b.top ? a.top : b.top,
+                         a.right < b.right ? a.right : b.right, a.bottom < b.bottom ? a.bottom : b.bottom);
+}
+
+PixelRect Union(const PixelRect& a, const PixelRect& b)
+{
+    return MakePixelRect(a.left < b.left ? a.left : b.left, a.top < b.top ? a.top : b.top,
+                         a.right > b.right ? a.right : b.right, a.bottom > b.bottom ? a.bottom : b.bottom);
+}
+
+PixelRect BoundsOf(Float2 min, Float2 max, float pad)
+{
+    // A pixel covers [x, x + 1); one more on each side covers rounding
+    // and antialiased edges
+    return MakePixelRect((int)floorf(min.x - pad) - 1, (int)floorf(min.y - pad) - 1,
+                         (int)ceilf(max.x + pad) + 1, (int)ceilf(max.y + pad) + 1);
+}
+
+DirtyRegion::DirtyRegion() :
+    _count(0),
+    _width(0),
+    _height(0)
+{
+}
+
+void DirtyRegion::SetSize(int width, int height)
+{
+    _width = width;
+    _height = height;
+    AddAll();
+}
+
+void DirtyRegion::AddAll()
+{
+    _count = 0;
+    Add(MakePixelRect(0, 0, _width, _height));
+}
+
+bool DirtyRegion::IsFull() const
+{
+    return _count == 1 && _rects[0].left == 0 && _rects[0].top == 0 && _rects[0].right == _width &&
+           _rects[0].bottom == _height;
+}
+
+void DirtyRegion::Add(const PixelRect& rect)
+{
+    PixelRect added = Intersect(rect, MakePixelRect(0, 0, _width, _height));
+    if (::IsEmpty(added))
+    {
+        return;
+    }
+
+    // Fold in every rectangle that overlaps or is cheaper to redraw along
+    // with this one; the union can reach others, so look again from the start
+    for (size_t i = 0; i < _count;)
+    {
+        PixelRect merged = Union(_rects[i], added);
+        if (::Intersects(_rects[i], added) || ::Area(merged) <= ::Area(_rects[i]) + ::Area(added) + MergeSlack)
+        {
+            added = merged;
+            _rects[i] = _rects[--_count];
+            i = 0;
+            continue;
+        }
+        i++;
+    }
+
+    _rects[_count++] = added;
+    if (_count > MaxRects)
+    {
+        MergeCheapestPair();
+    }
+}
+
+void DirtyRegion::MergeCheapestPair()
+{
+    size_t bestA = 0, bestB = 1;
+    unsigned long long bestWaste = ~0ULL;
+    for (size_t a = 0; a < _count; a++)
+    {
+        for (size_t b = a + 1; b < _count; b++)
+        {
+            unsigned long long waste = ::Area(Union(_rects[a], _rects[b])) - ::Area(_rects[a]) - ::Area(_rects[b]);
+            if (waste < bestWaste)
+            {
+                bestWaste = waste;
+                bestA = a;
+                bestB = b;
+            }
+        }
+    }
+
+    // The union may overlap a third, Add folds that in too
+    PixelRect merged = Union(_rects[bestA], _rects[bestB]);
+    _rects[bestB] = _rects[--_count];
+    _rects[bestA] = _rects[--_count];
+    Add(merged);
+}
+
+PixelRect DirtyRegion::Bounds() const
+{
+    if (_count == 0)
+    {
+        return MakePixelRect(0, 0, 0, 0);
+    }
+
+    PixelRect bounds = _rects[0];
+    for (size_t i = 1; i < _count; i++)
+    {
+        bounds = Union(bounds, _rects[i]);
+    }
+    return bounds;
+}
+
+bool DirtyRegion::Intersects(const PixelRect& rect) const
+{
+    for (size_t i = 0; i < _count; i++)
+    {
+        if (::Intersects(_rects[i], rect))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+unsigned long long DirtyRegion::Area() const
+{
+    unsigned long long area = 0;
+    for (size_t i = 0; i < _count; i++)
+    {
+        area += ::Area(_rects[i]);
+    }
+    return area;
+}
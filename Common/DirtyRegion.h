@@ -0,0 +1,90 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "VecMath.h"
+
+// Pixel rectangle, right and bottom exclusive like a Win32 RECT
+struct PixelRect
+{
+    int left, top, right, bottom;
+};
+
+inline PixelRect MakePixelRect(int left, int top, int right, int bottom)
+{
+    PixelRect rect = {left, top, right, bottom};
+    return rect;
+}
+
+inline bool IsEmpty(const PixelRect& rect)
+{
+    return rect.right <= rect.left || rect.bottom <= rect.top;
+}
+
+inline unsigned long long Area(const PixelRect& rect)
+{
+    return IsEmpty(rect) ? 0 : (unsigned long long)(rect.right - rect.left) * (rect.bottom - rect.top);
+}
+
+inline bool Intersects(const PixelRect& a, const PixelRect& b)
+{
+    return a.left < b.right && b.left < a.right && a.top < b.bottom && b.top < a.bottom;
+}
+
+PixelRect Intersect(const PixelRect& a, const PixelRect& b);
+PixelRect Union(const PixelRect& a, const PixelRect& b);
+
+// Every pixel a shape within [min, max] can touch, lines drawn between
+// pixel centers included, grown by pad on each side
+PixelRect BoundsOf(Float2 min, Float2 max, float pad = 0.0f);
+
+// The parts of a target that changed since it was last drawn, as a few
+// rectangles that don't overlap. Rectangles that overlap, or that are
+// close enough that one bigger rectangle wastes less than MergeSlack
+// pixels, are merged as they're added; past MaxRects the two whose union
+// wastes least are merged, so a frame never redraws more than MaxRects
+// pieces however much input arrived. No heap memory.
+class DirtyRegion
+{
+public:
+    static const size_t MaxRects = 8;
+    static const unsigned long long MergeSlack = 64 * 64;
+
+    DirtyRegion();
+
+    // The size of the target, everything outside is dropped. Marks the
+    // whole target dirty, since a resized target needs a full redraw.
+    void SetSize(int width, int height);
+    int Width() const { return _width; }
+    int Height() const { return _height; }
+
+    void Add(const PixelRect& rect);
+    void AddAll();
+
+    // Call once the dirty parts are redrawn
+    void Clear() { _count = 0; }
+
+    bool IsEmpty() const { return _count == 0; }
+    bool IsFull() const;
+
+    size_t Count() const { return _count; }
+    const PixelRect& Rect(size_t i) const { return _rects[i]; }
+
+    // Smallest rectangle holding all of them
+    PixelRect Bounds() const;
+
+    // True if rect touches any of them
+    bool Intersects(const PixelRect& rect) const;
+
+    // Pixels a redraw touches; the rectangles don't overlap so nothing is
+    // counted twice
+    unsigned long long Area() const;
+
+private:
+    void MergeCheapestPair();
+
+    PixelRect _rects[MaxRects + 1];
+    size_t _count;
+    int _width;
+    int _height;
+};
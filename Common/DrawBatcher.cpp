@@ -0,0 +1,172 @@
+#include "DrawBatcher.h"
+
+#include <string.h>
+#include <algorithm>
+
+bool operator==(const DrawStateKey& a, const DrawStateKey& b)
+{
+    return a.topology == b.topology &&
+           a.vertexShader == b.vertexShader &&
+           a.pixelShader == b.pixelShader &&
+           a.inputLayout == b.inputLayout &&
+           a.stride == b.stride;
+}
+
+bool operator<(const DrawStateKey& a, const DrawStateKey& b)
+{
+    // Most expensive state changes first so they happen least often
+    if (a.vertexShader != b.vertexShader) return a.vertexShader < b.vertexShader;
+    if (a.pixelShader != b.pixelShader) return a.pixelShader < b.pixelShader;
+    if (a.inputLayout != b.inputLayout) return a.inputLayout < b.inputLayout;
+    if (a.stride != b.stride) return a.stride < b.stride;
+    return a.topology < b.topology;
+}
+
+bool IsMergeable(unsigned topology)
+{
+    return topology == BatchTopology_PointList ||
+           topology == BatchTopology_LineList ||
+           topology == BatchTopology_TriangleList;
+}
+
+bool DrawBatcher::RequestLess::operator()(const Request& a, const Request& b) const
+{
+    if (a.key < b.key) return true;
+    if (b.key < a.key) return false;
+    return a.order < b.order;
+}
+
+DrawBatcher::DrawBatcher() :
+    _preserveOrder(false)
+{
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+void* DrawBatcher::Allocate(const DrawStateKey& key, unsigned vertexCount)
+{
+    if (vertexCount == 0 || key.stride == 0)
+    {
+        return NULL;
+    }
+
+    Request request;
+    request.key = key;
+    request.offset = _staging.size();
+    request.count = vertexCount;
+    request.order = (unsigned)_requests.size();
+    _requests.push_back(request);
+
+    _staging.resize(_staging.size() + (size_t)vertexCount * key.stride);
+    return &_staging[request.offset];
+}
+
+void DrawBatcher::Submit(const DrawStateKey& key, const void* vertices, unsigned vertexCount)
+{
+    void* dst = Allocate(key, vertexCount);
+    if (dst)
+    {
+        memcpy(dst, vertices, (size_t)vertexCount * key.stride);
+    }
+}
+
+void DrawBatcher::EmitRun(DrawBackend* backend, size_t begin, size_t end)
+{
+    const DrawStateKey& key = _requests[begin].key;
+
+    // Gather the run's vertices into one range
+    _packed.clear();
+    for (size_t i = begin; i < end; i++)
+    {
+        const unsigned char* src = &_staging[_requests[i].offset];
+        _packed.insert(_packed.end(), src, src + (size_t)_requests[i].count * key.stride);
+    }
+    unsigned vertexCount = (unsigned)(_packed.size() / key.stride);
+
+    unsigned firstVertex;
+    if (!backend->UploadVertices(&_packed[0], _packed.size(), key.stride, &firstVertex))
+    {
+        return;
+    }
+    _stats.uploads++;
+    _stats.bytes += _packed.size();
+    _stats.vertices += vertexCount;
+
+    backend->SetState(key);
+    _stats.stateChanges++;
+
+    if (IsMergeable(key.topology))
+    {
+        backend->Draw(vertexCount, firstVertex);
+        _stats.submitted++;
+    }
+    else
+    {
+        // Strips share the upload but still need a draw each
+        for (size_t i = begin; i < end; i++)
+        {
+            backend->Draw(_requests[i].count, firstVertex);
+            firstVertex += _requests[i].count;
+            _stats.submitted++;
+        }
+    }
+}
+
+void DrawBatcher::Flush(DrawBackend* backend)
+{
+    memset(&_stats, 0, sizeof(_stats));
+    _stats.requested = (unsigned)_requests.size();
+
+    if (!_preserveOrder)
+    {
+        std::sort(_requests.begin(), _requests.end(), RequestLess());
+    }
+
+    size_t begin = 0;
+    while (begin < _requests.size())
+    {
+        size_t end = begin + 1;
+        while (end < _requests.size() && _requests[end].key == _requests[begin].key)
+        {
+            end++;
+        }
+        EmitRun(backend, begin, end);
+        begin = end;
+    }
+
+    // Keep the capacity around for the next frame
+    _requests.clear();
+    _staging.clear();
+}
+
+void RecordingDrawBackend::SetState(const DrawStateKey& key)
+{
+    Command command = { Command_SetState, key, 0, 0 };
+    _commands.push_back(command);
+}
+
+bool RecordingDrawBackend::UploadVertices(const void* data, size_t bytes, unsigned stride, unsigned* firstVertex)
+{
+    // Pad so the upload starts on a whole vertex, like a stride aligned ring
+    size_t start = (_vertices.size() + stride - 1) / stride * stride;
+    _vertices.resize(start + bytes);
+    memcpy(&_vertices[start], data, bytes);
+    *firstVertex = (unsigned)(start / stride);
+
+    DrawStateKey none = { 0, 0, 0, 0, stride };
+    Command command = { Command_Upload, none, (unsigned)(bytes / stride), *firstVertex };
+    _commands.push_back(command);
+    return true;
+}
+
+void RecordingDrawBackend::Draw(unsigned vertexCount, unsigned firstVertex)
+{
+    DrawStateKey none = { 0, 0, 0, 0, 0 };
+    Command command = { Command_Draw, none, vertexCount, firstVertex };
+    _commands.push_back(command);
+}
+
+void RecordingDrawBackend::Clear()
+{
+    _commands.clear();
+    _vertices.clear();
+}
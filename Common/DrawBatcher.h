@@ -0,0 +1,141 @@
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+// Primitive topologies the batcher knows how to merge
+enum BatchTopology
+{
+    BatchTopology_PointList,
+    BatchTopology_LineList,
+    BatchTopology_TriangleList,
+    BatchTopology_LineStrip,
+    BatchTopology_TriangleStrip
+};
+
+// Pipeline state a draw depends on. Shaders and layouts are identified by
+// whatever index the backend registered them under.
+struct DrawStateKey
+{
+    unsigned topology;
+    unsigned vertexShader;
+    unsigned pixelShader;
+    unsigned inputLayout;
+    unsigned stride;
+};
+
+bool operator==(const DrawStateKey& a, const DrawStateKey& b);
+bool operator<(const DrawStateKey& a, const DrawStateKey& b);
+
+// List topologies can be concatenated into one draw, strips cannot
+bool IsMergeable(unsigned topology);
+
+// What the batcher drives. Implemented by the D3D11 renderer and by
+// RecordingDrawBackend.
+class DrawBackend
+{
+public:
+    virtual ~DrawBackend() {}
+
+    virtual void SetState(const DrawStateKey& key) = 0;
+
+    // Copy vertices for this frame somewhere the GPU can read them.
+    // Returns the index of the first vertex in the bound vertex buffer.
+    virtual bool UploadVertices(const void* data, size_t bytes, unsigned stride, unsigned* firstVertex) = 0;
+
+    virtual void Draw(unsigned vertexCount, unsigned firstVertex) = 0;
+};
+
+struct DrawBatchStats
+{
+    unsigned requested;         // draws submitted by the app
+    unsigned submitted;         // draws issued to the backend
+    unsigned stateChanges;
+    unsigned uploads;
+    unsigned long long vertices;
+    unsigned long long bytes;
+};
+
+// Collects draws for a frame, sorts them by state and emits one draw per
+// run of mergeable draws that share a state. By default submission order
+// is NOT kept across states: draws with the same state keep their order
+// among themselves, but may move past draws with other states.
+class DrawBatcher
+{
+public:
+    DrawBatcher();
+
+    // Keep submission order and only merge neighbouring draws. Off by
+    // default; needed when draws overlap and blending or painter's order
+    // matters.
+    void SetPreserveOrder(bool preserveOrder) { _preserveOrder = preserveOrder; }
+
+    // Reserve room for vertexCount vertices of key.stride bytes and return
+    // a pointer to fill in. Valid until the next Allocate, Submit or Flush.
+    void* Allocate(const DrawStateKey& key, unsigned vertexCount);
+
+    // Copy vertices into the batch
+    void Submit(const DrawStateKey& key, const void* vertices, unsigned vertexCount);
+
+    // Issue everything submitted since the last flush and start a new frame
+    void Flush(DrawBackend* backend);
+
+    // Stats of the last flush
+    const DrawBatchStats& Stats() const { return _stats; }
+
+private:
+    struct Request
+    {
+        DrawStateKey key;
+        size_t offset;          // byte offset into _staging
+        unsigned count;
+        unsigned order;
+    };
+
+    struct RequestLess
+    {
+        bool operator()(const Request& a, const Request& b) const;
+    };
+
+    std::vector<Request> _requests;
+    std::vector<unsigned char> _staging;
+    std::vector<unsigned char> _packed;
+    DrawBatchStats _stats;
+    bool _preserveOrder;
+
+    void EmitRun(DrawBackend* backend, size_t begin, size_t end);
+};
+
+// Backend that records what would be sent to the GPU
+class RecordingDrawBackend : public DrawBackend
+{
+public:
+    enum CommandType
+    {
+        Command_SetState,
+        Command_Upload,
+        Command_Draw
+    };
+
+    struct Command
+    {
+        CommandType type;
+        DrawStateKey key;       // Command_SetState
+        unsigned count;         // Command_Upload: vertices, Command_Draw: vertex count
+        unsigned first;         // first vertex of the upload or draw
+    };
+
+    void SetState(const DrawStateKey& key);
+    bool UploadVertices(const void* data, size_t bytes, unsigned stride, unsigned* firstVertex);
+    void Draw(unsigned vertexCount, unsigned firstVertex);
+
+    void Clear();
+
+    // Uploads are appended, so vertex i of a stride s upload starts at byte i * s
+    const std::vector<Command>& Commands() const { return _commands; }
+    const std::vector<unsigned char>& Vertices() const { return _vertices; }
+
+private:
+    std::vector<Command> _commands;
+    std::vector<unsigned char> _vertices;
+};
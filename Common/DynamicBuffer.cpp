@@ -0,0 +1,61 @@
+#include "DynamicBuffer.h"
+
+CpuDynamicBuffer::CpuDynamicBuffer(size_t capacity, bool supportsDiscard, unsigned gpuLatencyFrames) :
+    _storage(capacity),
+    _supportsDiscard(supportsDiscard),
+    _mapped(false),
+    _gpuLatency(gpuLatencyFrames),
+    _signaledFrame(0),
+    _completedFrame(0),
+    _discardMaps(0),
+    _noOverwriteMaps(0),
+    _waits(0)
+{
+}
+
+unsigned char* CpuDynamicBuffer::Map(DynamicMapMode mode)
+{
+    if (_mapped || _storage.empty())
+    {
+        return NULL;
+    }
+    if (mode == DynamicMap_Discard)
+    {
+        _discardMaps++;
+    }
+    else
+    {
+        _noOverwriteMaps++;
+    }
+    _mapped = true;
+    return &_storage[0];
+}
+
+void CpuDynamicBuffer::Unmap()
+{
+    _mapped = false;
+}
+
+void CpuDynamicBuffer::SignalFrame(unsigned long long frame)
+{
+    _signaledFrame = frame;
+    // The simulated GPU finishes frames a fixed distance behind the CPU
+    if (frame > _gpuLatency && frame - _gpuLatency > _completedFrame)
+    {
+        _completedFrame = frame - _gpuLatency;
+    }
+}
+
+unsigned long long CpuDynamicBuffer::CompletedFrame()
+{
+    return _completedFrame;
+}
+
+void CpuDynamicBuffer::WaitForFrame(unsigned long long frame)
+{
+    _waits++;
+    if (frame > _completedFrame)
+    {
+        _completedFrame = frame < _signaledFrame ? frame : _signaledFrame;
+    }
+}
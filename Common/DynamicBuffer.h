@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+// How a dynamic buffer is mapped for writing
+enum DynamicMapMode
+{
+    DynamicMap_Discard,         // orphan the previous contents (D3D11_MAP_WRITE_DISCARD)
+    DynamicMap_NoOverwrite      // only touch bytes the GPU is not reading (D3D11_MAP_WRITE_NO_OVERWRITE)
+};
+
+// A CPU-writable buffer the GPU reads from, plus the frame fences that
+// tell us when the GPU is done with a frame's data.
+class DynamicBufferBackend
+{
+public:
+    virtual ~DynamicBufferBackend() {}
+
+    // Size of the buffer in bytes
+    virtual size_t Capacity() const = 0;
+
+    // Whether a discard map hands back fresh memory while the GPU keeps
+    // reading the old one. If not, the allocator has to wait for fences.
+    virtual bool SupportsDiscard() const = 0;
+
+    // Map the whole buffer. Returns the base pointer or NULL on failure.
+    virtual unsigned char* Map(DynamicMapMode mode) = 0;
+    virtual void Unmap() = 0;
+
+    // Mark the end of the GPU work for a frame
+    virtual void SignalFrame(unsigned long long frame) = 0;
+
+    // Highest frame the GPU has finished with
+    virtual unsigned long long CompletedFrame() = 0;
+
+    // Block until the GPU has finished the given frame
+    virtual void WaitForFrame(unsigned long long frame) = 0;
+};
+
+// Plain system memory backend with a simulated GPU that lags a fixed number
+// of frames behind. Used to exercise the allocation policy without a device.
+class CpuDynamicBuffer : public DynamicBufferBackend
+{
+public:
+    CpuDynamicBuffer(size_t capacity, bool supportsDiscard, unsigned gpuLatencyFrames);
+
+    size_t Capacity() const { return _storage.size(); }
+    bool SupportsDiscard() const { return _supportsDiscard; }
+    unsigned char* Map(DynamicMapMode mode);
+    void Unmap();
+    void SignalFrame(unsigned long long frame);
+    unsigned long long CompletedFrame();
+    void WaitForFrame(unsigned long long frame);
+
+    const unsigned char* Data() const { return &_storage[0]; }
+    bool IsMapped() const { return _mapped; }
+
+    // Counters for checking what the allocator asked for
+    unsigned long long DiscardMaps() const { return _discardMaps; }
+    unsigned long long NoOverwriteMaps() const { return _noOverwriteMaps; }
+    unsigned long long Waits() const { return _waits; }
+
+private:
+    std::vector<unsigned char> _storage;
+    bool _supportsDiscard;
+    bool _mapped;
+    unsigned _gpuLatency;
+    unsigned long long _signaledFrame;
+    unsigned long long _completedFrame;
+    unsigned long long _discardMaps;
+    unsigned long long _noOverwriteMaps;
+    unsigned long long _waits;
+};
@@ -0,0 +1,113 @@
+#include "FrameArena.h"
+#include "Telemetry.h"
+
+#include <stdlib.h>
+
+FrameArena::FrameArena(size_t blockSize) :
+    _current(0),
+    _offset(0),
+    _blockSize(blockSize),
+    _used(0),
+    _highWater(0),
+    _blockAllocations(0)
+{
+}
+
+FrameArena::~FrameArena()
+{
+    FreeBlocks();
+}
+
+void* FrameArena::Allocate(size_t bytes, size_t alignment)
+{
+    if (_current < _blocks.size())
+    {
+        const Block& block = _blocks[_current];
+        size_t start = ((size_t)block.data + _offset + alignment - 1) & ~(alignment - 1);
+        size_t end = start - (size_t)block.data + bytes;
+        if (end <= block.size)
+        {
+            _used += end - _offset;
+            _offset = end;
+            return (void*)start;
+        }
+    }
+
+    if (!NextBlock(bytes, alignment))
+    {
+        return NULL;
+    }
+    return Allocate(bytes, alignment);
+}
+
+bool FrameArena::NextBlock(size_t bytes, size_t alignment)
+{
+    // Count the tail of the block we're leaving, it's lost for this frame
+    if (_current < _blocks.size())
+    {
+        _used += _blocks[_current].size - _offset;
+        _current++;
+    }
+    _offset = 0;
+
+    // Reuse a block a previous frame allocated if the request fits
+    if (_current < _blocks.size() && bytes + alignment <= _blocks[_current].size)
+    {
+        return true;
+    }
+
+    size_t size = bytes + alignment > _blockSize ? bytes + alignment : _blockSize;
+    Block block = {(unsigned char*)malloc(size), size};
+    if (!block.data)
+    {
+        return false;
+    }
+    _blocks.insert(_blocks.begin() + _current, block);
+    _blockAllocations++;
+    Telemetry::Add(Telemetry_Allocations);
+    return true;
+}
+
+void FrameArena::Reset()
+{
+    _highWater = _used > _highWater ? _used : _highWater;
+
+    // This frame spilled into more blocks; replace them with one that
+    // holds everything so the next frame fits without growing
+    if (_current > 0)
+    {
+        size_t size = Capacity();
+        FreeBlocks();
+
+        Block block = {(unsigned char*)malloc(size), size};
+        if (block.data)
+        {
+            _blocks.push_back(block);
+            _blockAllocations++;
+            Telemetry::Add(Telemetry_Allocations);
+        }
+    }
+
+    _current = 0;
+    _offset = 0;
+    _used = 0;
+}
+
+size_t FrameArena::Capacity() const
+{
+    size_t capacity = 0;
+    for (size_t i = 0; i < _blocks.size(); i++)
+    {
+        capacity += _blocks[i].size;
+    }
+    return capacity;
+}
+
+void FrameArena::FreeBlocks()
+{
+    for (size_t i = 0; i < _blocks.size(); i++)
+    {
+        free(_blocks[i].data);
+    }
+    _blocks.clear();
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <stddef.h>
+#include <new>
+#include <vector>
+
+// Bump allocator for scratch memory that lives for one frame. Allocate is
+// a pointer increment; nothing is freed until Reset, which makes all of it
+// reusable at once. When a frame needs more than one block, Reset merges
+// the blocks into one big enough for that frame, so after the first few
+// frames the arena stops touching the heap.
+class FrameArena
+{
+public:
+    explicit FrameArena(size_t blockSize = 1 << 20);
+    ~FrameArena();
+
+    // alignment must be a power of two. NULL if the heap is exhausted.
+    void* Allocate(size_t bytes, size_t alignment = 16);
+
+    template <class T>
+    T* Allocate(size_t count)
+    {
+        return static_cast<T*>(Allocate(count * sizeof(T), __alignof(T) > 16 ? __alignof(T) : 16));
+    }
+
+    // Start the next frame
+    void Reset();
+
+    // Bytes handed out since the last Reset, and the most any frame used
+    size_t Used() const { return _used; }
+    size_t HighWater() const { return _highWater; }
+    size_t Capacity() const;
+
+    // Blocks taken from the heap over the arena's life
+    unsigned BlockAllocations() const { return _blockAllocations; }
+
+private:
+    struct Block
+    {
+        unsigned char* data;
+        size_t size;
+    };
+
+    bool NextBlock(size_t bytes, size_t alignment);
+    void FreeBlocks();
+
+    std::vector<Block> _blocks;
+    size_t _current;            // index in _blocks
+    size_t _offset;             // in the current block
+    size_t _blockSize;
+    size_t _used;
+    size_t _highWater;
+    unsigned _blockAllocations;
+
+    FrameArena(const FrameArena&);
+    FrameArena& operator=(const FrameArena&);
+};
+
+// Standard allocator over a FrameArena, for containers that only live for
+// a frame. deallocate does nothing; reserve up front, since every time a
+// vector grows the old buffer stays used until Reset.
+template <class T>
+class FrameAllocator
+{
+public:
+    typedef T value_type;
+    typedef T* pointer;
+    typedef const T* const_pointer;
+    typedef T& reference;
+    typedef const T& const_reference;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+
+    template <class U>
+    struct rebind
+    {
+        typedef FrameAllocator<U> other;
+    };
+
+    explicit FrameAllocator(FrameArena* arena) : _arena(arena) {}
+
+    template <class U>
+    FrameAllocator(const FrameAllocator<U>& other) : _arena(other.Arena()) {}
+
+    T* allocate(size_t count, const void* /* hint */ = 0)
+    {
+        T* p = _arena->Allocate<T>(count);
+        if (!p)
+        {
+            throw std::bad_alloc();
+        }
+        return p;
+    }
+    void deallocate(T* /* p */, size_t /* count */) {}
+
+    T* address(T& value) const { return &value; }
+    const T* address(const T& value) const { return &value; }
+    size_t max_size() const { return ~(size_t)0 / sizeof(T); }
+
+    void construct(T* p, const T& value) { new (p) T(value); }
+    void destroy(T* p) { p->~T(); }
+
+    FrameArena* Arena() const { return _arena; }
+
+private:
+    FrameArena* _arena;
+};
+
+template <class T, class U>
+bool operator==(const FrameAllocator<T>& a, const FrameAllocator<U>& b)
+{
+    return a.Arena() == b.Arena();
+}
+
+template <class T, class U>
+bool operator!=(const FrameAllocator<T>& a, const FrameAllocator<U>& b)
+{
+    return a.Arena() != b.Arena();
+}
@@ -0,0 +1,191 @@
+#include "FrameCapture.h"
+#include "CommandBuffer.h"
+
+#include <string.h>
+
+FrameCaptureWriter::FrameCaptureWriter() :
+    _file(NULL),
+    _frames(0)
+{
+}
+
+FrameCaptureWriter::~FrameCaptureWriter()
+{
+    Close();
+}
+
+bool FrameCaptureWriter::Open(const char* path)
+{
+    Close();
+
+    _file = fopen(path, "wb");
+    if (!_file)
+    {
+        return false;
+    }
+
+    CaptureFileHeader header = {CaptureMagic, CaptureVersion};
+    if (fwrite(&header, sizeof(header), 1, _file) != 1)
+    {
+        Close();
+        return false;
+    }
+
+    _start = std::chrono::steady_clock::now();
+    _frames = 0;
+    return true;
+}
+
+bool FrameCaptureWriter::Close()
+{
+    if (!_file)
+    {
+        return true;
+    }
+
+    bool ok = ferror(_file) == 0;
+    ok = fclose(_file) == 0 && ok;
+    _file = NULL;
+    return ok;
+}
+
+unsigned long long FrameCaptureWriter::Elapsed() const
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - _start).count();
+}
+
+void FrameCaptureWriter::Write(unsigned type, const void* a, size_t aBytes, const void* b, size_t bBytes)
+{
+    CaptureRecordHeader header = {type, (unsigned)(aBytes + bBytes)};
+    fwrite(&header, sizeof(header), 1, _file);
+    fwrite(a, 1, aBytes, _file);
+    if (bBytes)
+    {
+        fwrite(b, 1, bBytes, _file);
+    }
+}
+
+void FrameCaptureWriter::Input(InputEventKind kind, int x, int y, unsigned key)
+{
+    if (!_file)
+    {
+        return;
+    }
+
+    InputEvent event = {(unsigned)kind, x, y, key, Elapsed()};
+    Write(CaptureRecord_Input, &event, sizeof(event), NULL, 0);
+}
+
+void FrameCaptureWriter::Frame(unsigned width, unsigned height, const CommandBuffer& commands)
+{
+    if (!_file)
+    {
+        return;
+    }
+
+    FrameRecord frame = {_frames++, width, height, (unsigned)commands.Bytes(), Elapsed()};
+    Write(CaptureRecord_Frame, &frame, sizeof(frame), commands.Data(), commands.Bytes());
+}
+
+FrameCaptureReader::FrameCaptureReader() :
+    _file(NULL),
+    _failed(false)
+{
+}
+
+FrameCaptureReader::~FrameCaptureReader()
+{
+    Close();
+}
+
+bool FrameCaptureReader::Open(const char* path)
+{
+    Close();
+    _failed = false;
+
+    _file = fopen(path, "rb");
+    if (!_file)
+    {
+        return false;
+    }
+
+    CaptureFileHeader header;
+    if (fread(&header, sizeof(header), 1, _file) != 1 || header.magic != CaptureMagic ||
+        header.version != CaptureVersion)
+    {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+void FrameCaptureReader::Close()
+{
+    if (_file)
+    {
+        fclose(_file);
+        _file = NULL;
+    }
+}
+
+bool FrameCaptureReader::Next(CaptureRecord* record)
+{
+    if (!_file || _failed)
+    {
+        return false;
+    }
+
+    CaptureRecordHeader header;
+    if (fread(&header, sizeof(header), 1, _file) != 1)
+    {
+        // A clean end of file lands exactly between records
+        _failed = ferror(_file) != 0;
+        return false;
+    }
+
+    record->type = header.type;
+    bool ok = false;
+    switch (header.type)
+    {
+    case CaptureRecord_Input:
+        ok = header.bytes == sizeof(InputEvent) && fread(&record->input, sizeof(InputEvent), 1, _file) == 1;
+        break;
+
+    case CaptureRecord_Frame:
+        ok = header.bytes >= sizeof(FrameRecord) && fread(&record->frame, sizeof(FrameRecord), 1, _file) == 1 &&
+             header.bytes - sizeof(FrameRecord) == record->frame.commandBytes;
+        if (ok)
+        {
+            record->commands.resize(record->frame.commandBytes);
+            ok = record->commands.empty() ||
+                 fread(&record->commands[0], 1, record->commands.size(), _file) == record->commands.size();
+        }
+        break;
+    }
+
+    _failed = !ok;
+    return ok;
+}
+
+bool FindCaptureArgument(const char* commandLine, std::string* path)
+{
+    const char* arg = commandLine ? strstr(commandLine, "--capture") : NULL;
+    if (!arg)
+    {
+        return false;
+    }
+
+    const char* begin = arg + strlen("--capture");
+    while (*begin == ' ' || *begin == '"')
+    {
+        begin++;
+    }
+    const char* end = begin + strlen(begin);
+    while (end > begin && (end[-1] == ' ' || end[-1] == '"'))
+    {
+        end--;
+    }
+
+    path->assign(begin, end);
+    return !path->empty();
+}
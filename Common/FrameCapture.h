@@ -0,0 +1,126 @@
+#pragma once
+
+#include <stdio.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+class CommandBuffer;
+
+// Binary trace of an interactive session: the input the app handled and
+// the commands each frame recorded, in the order they happened. Written
+// by the apps with --capture and replayed by Headless --replay.
+//
+// The file is a CaptureFileHeader followed by records, each a
+// CaptureRecordHeader and its payload. Values are in the byte order of the
+// machine that wrote them.
+
+static const unsigned CaptureMagic = 0x43464458;    // "XDFC" in memory
+static const unsigned CaptureVersion = 1;
+
+enum CaptureRecordType
+{
+    CaptureRecord_Input,
+    CaptureRecord_Frame
+};
+
+enum InputEventKind
+{
+    InputEvent_LButtonUp,
+    InputEvent_KeyDown
+};
+
+struct CaptureFileHeader
+{
+    unsigned magic;
+    unsigned version;
+};
+
+struct CaptureRecordHeader
+{
+    unsigned type;
+    unsigned bytes;             // of the payload that follows
+};
+
+struct InputEvent
+{
+    unsigned kind;
+    int x, y;                   // InputEvent_LButtonUp
+    unsigned key;               // InputEvent_KeyDown, the virtual key
+    unsigned long long time;    // microseconds since the capture started
+};
+
+// Payload of a frame record, followed by commandBytes of CommandBuffer data
+struct FrameRecord
+{
+    unsigned index;
+    unsigned width, height;     // of the render target
+    unsigned commandBytes;
+    unsigned long long time;
+};
+
+class FrameCaptureWriter
+{
+public:
+    FrameCaptureWriter();
+    ~FrameCaptureWriter();
+
+    bool Open(const char* path);
+    bool IsOpen() const { return _file != NULL; }
+
+    // False if anything failed to write
+    bool Close();
+
+    // Both do nothing unless the capture is open
+    void Input(InputEventKind kind, int x, int y, unsigned key);
+    void Frame(unsigned width, unsigned height, const CommandBuffer& commands);
+
+    unsigned Frames() const { return _frames; }
+
+private:
+    unsigned long long Elapsed() const;
+    void Write(unsigned type, const void* a, size_t aBytes, const void* b, size_t bBytes);
+
+    FILE* _file;
+    std::chrono::steady_clock::time_point _start;
+    unsigned _frames;
+
+    FrameCaptureWriter(const FrameCaptureWriter&);
+    FrameCaptureWriter& operator=(const FrameCaptureWriter&);
+};
+
+// One record read back
+struct CaptureRecord
+{
+    unsigned type;
+    InputEvent input;                       // CaptureRecord_Input
+    FrameRecord frame;                      // CaptureRecord_Frame
+    std::vector<unsigned char> commands;    // CaptureRecord_Frame
+};
+
+class FrameCaptureReader
+{
+public:
+    FrameCaptureReader();
+    ~FrameCaptureReader();
+
+    // False if the file is missing or isn't a capture of this version
+    bool Open(const char* path);
+    void Close();
+
+    // False at the end of the file or when the data is malformed, Failed
+    // tells which
+    bool Next(CaptureRecord* record);
+    bool Failed() const { return _failed; }
+
+private:
+    FILE* _file;
+    bool _failed;
+
+    FrameCaptureReader(const FrameCaptureReader&);
+    FrameCaptureReader& operator=(const FrameCaptureReader&);
+};
+
+// The path after --capture in a WinMain command line, false if there is
+// none. The path runs to the end of the line and may be quoted.
+bool FindCaptureArgument(const char* commandLine, std::string* path);
@@ -0,0 +1,118 @@
+#include "FrameScheduler.h"
+
+#include <algorithm>
+#include <chrono>
+
+FrameScheduler::FrameScheduler(unsigned long long intervalMicroseconds) :
+    _interval(intervalMicroseconds),
+    _continuous(false),
+    _dirty(false),
+    _started(false),
+    _firstInvalidation(0),
+    _frameInvalidation(0),
+    _lastFrame(0),
+    _frames(0),
+    _invalidations(0),
+    _coalesced(0),
+    _pending(0),
+    _nextLatency(0)
+{
+    _latencies.reserve(LatencyWindow);
+}
+
+unsigned long long FrameScheduler::Now()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void FrameScheduler::Invalidate(unsigned long long now)
+{
+    if (!_dirty)
+    {
+        _dirty = true;
+        _firstInvalidation = now;
+    }
+    _invalidations++;
+    _pending++;
+}
+
+unsigned long long FrameScheduler::NextWait(unsigned long long now) const
+{
+    if (!IsDirty())
+    {
+        return WaitForever;
+    }
+    if (!_started)
+    {
+        return 0;
+    }
+
+    unsigned long long due = _lastFrame + _interval;
+    return due > now ? due - now : 0;
+}
+
+void FrameScheduler::BeginFrame(unsigned long long now)
+{
+    if (_dirty)
+    {
+        _frameInvalidation = _firstInvalidation;
+    }
+    else
+    {
+        // Continuous and nothing changed: measure from when it was due
+        unsigned long long due = _started ? _lastFrame + _interval : now;
+        _frameInvalidation = due < now ? due : now;
+    }
+
+    if (_pending > 1)
+    {
+        _coalesced += _pending - 1;
+    }
+    _pending = 0;
+    _dirty = false;
+
+    // Pace from the ideal start so a late frame doesn't push every later
+    // one back, unless we fell more than a whole interval behind
+    unsigned long long ideal = _lastFrame + _interval;
+    _lastFrame = _started && now - ideal < _interval ? ideal : now;
+    _started = true;
+}
+
+void FrameScheduler::EndFrame(unsigned long long now)
+{
+    unsigned long long latency = now > _frameInvalidation ? now - _frameInvalidation : 0;
+    if (_latencies.size() < LatencyWindow)
+    {
+        _latencies.push_back(latency);
+    }
+    else
+    {
+        _latencies[_nextLatency] = latency;
+    }
+    _nextLatency = (_nextLatency + 1) % LatencyWindow;
+    _frames++;
+}
+
+FrameLatencyStats FrameScheduler::Stats() const
+{
+    FrameLatencyStats stats;
+    stats.frames = _frames;
+    stats.invalidations = _invalidations;
+    stats.coalesced = _coalesced;
+    stats.samples = _latencies.size();
+    stats.p50 = stats.p95 = stats.p99 = stats.max = 0.0;
+    if (_latencies.empty())
+    {
+        return stats;
+    }
+
+    std::vector<unsigned long long> sorted(_latencies);
+    std::sort(sorted.begin(), sorted.end());
+    size_t last = sorted.size() - 1;
+    stats.p50 = sorted[(size_t)(0.50 * last + 0.5)] / 1000.0;
+    stats.p95 = sorted[(size_t)(0.95 * last + 0.5)] / 1000.0;
+    stats.p99 = sorted[(size_t)(0.99 * last + 0.5)] / 1000.0;
+    stats.max = sorted[last] / 1000.0;
+    return stats;
+}
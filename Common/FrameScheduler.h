@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+// Percentiles of the frame latencies still in the scheduler's window
+struct FrameLatencyStats
+{
+    unsigned long long frames;
+    unsigned long long invalidations;
+    unsigned long long coalesced;       // invalidations that didn't get a frame of their own
+    size_t samples;
+    double p50, p95, p99, max;          // milliseconds
+};
+
+// Decides when a window should render. Input marks the scene dirty; any
+// number of invalidations before the next frame collapse into that frame,
+// and frames start at most once per target interval. When nothing is
+// dirty the loop is told to wait forever, so an idle app sleeps.
+//
+// Time is passed in, in microseconds from any fixed origin, so the logic
+// runs the same under a real clock or a test's. Not thread safe; call it
+// from the thread that runs the message loop.
+class FrameScheduler
+{
+public:
+    static const unsigned long long WaitForever = ~0ULL;
+    static const size_t LatencyWindow = 1024;
+
+    explicit FrameScheduler(unsigned long long intervalMicroseconds = 16667);
+
+    // Microseconds on the steady clock
+    static unsigned long long Now();
+
+    void SetInterval(unsigned long long intervalMicroseconds) { _interval = intervalMicroseconds; }
+    unsigned long long Interval() const { return _interval; }
+
+    // Render every interval whether or not anything changed, for animation
+    void SetContinuous(bool continuous) { _continuous = continuous; }
+
+    // Something on screen changed at now
+    void Invalidate(unsigned long long now);
+
+    bool IsDirty() const { return _dirty || _continuous; }
+
+    // How long the loop can sleep before it should render: 0 if a frame is
+    // due, WaitForever if nothing is dirty
+    unsigned long long NextWait(unsigned long long now) const;
+
+    // Call when NextWait is 0, before drawing. Clears the dirty flag, so
+    // input that arrives while drawing gets the next frame.
+    void BeginFrame(unsigned long long now);
+
+    // Call when the frame is on its way to the screen. The latency is from
+    // the first invalidation the frame covers, or for a continuous frame
+    // nobody asked for, from when it was due.
+    void EndFrame(unsigned long long now);
+
+    FrameLatencyStats Stats() const;
+
+private:
+    unsigned long long _interval;
+    bool _continuous;
+    bool _dirty;
+    bool _started;                      // a frame has begun, _lastFrame is valid
+    unsigned long long _firstInvalidation;  // of the frame being waited for
+    unsigned long long _frameInvalidation;  // of the frame being drawn
+    unsigned long long _lastFrame;
+    unsigned long long _frames;
+    unsigned long long _invalidations;
+    unsigned long long _coalesced;
+    unsigned _pending;                  // invalidations since the last BeginFrame
+    std::vector<unsigned long long> _latencies;     // ring of LatencyWindow
+    size_t _nextLatency;
+};
@@ -0,0 +1,84 @@
+#include "Histogram.h"
+#include "ThreadPool.h"
+
+#include <string.h>
+
+#ifdef HISTOGRAM_SSE2
+#include <emmintrin.h>
+#endif
+
+void AddHistogramScalar(unsigned* dst, const unsigned* src, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        dst[i] += src[i];
+    }
+}
+
+#ifdef HISTOGRAM_SSE2
+
+void AddHistogram(unsigned* dst, const unsigned* src, size_t count)
+{
+    // 16 bins per iteration, four independent adds in flight
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i a0 = _mm_loadu_si128((const __m128i*)(dst + i));
+        __m128i a1 = _mm_loadu_si128((const __m128i*)(dst + i + 4));
+        __m128i a2 = _mm_loadu_si128((const __m128i*)(dst + i + 8));
+        __m128i a3 = _mm_loadu_si128((const __m128i*)(dst + i + 12));
+        a0 = _mm_add_epi32(a0, _mm_loadu_si128((const __m128i*)(src + i)));
+        a1 = _mm_add_epi32(a1, _mm_loadu_si128((const __m128i*)(src + i + 4)));
+        a2 = _mm_add_epi32(a2, _mm_loadu_si128((const __m128i*)(src + i + 8)));
+        a3 = _mm_add_epi32(a3, _mm_loadu_si128((const __m128i*)(src + i + 12)));
+        _mm_storeu_si128((__m128i*)(dst + i), a0);
+        _mm_storeu_si128((__m128i*)(dst + i + 4), a1);
+        _mm_storeu_si128((__m128i*)(dst + i + 8), a2);
+        _mm_storeu_si128((__m128i*)(dst + i + 12), a3);
+    }
+    AddHistogramScalar(dst + i, src + i, count - i);
+}
+
+#else
+
+void AddHistogram(unsigned* dst, const unsigned* src, size_t count)
+{
+    AddHistogramScalar(dst, src, count);
+}
+
+#endif
+
+void MergeHistograms(const unsigned* const* partials, size_t partialCount, size_t count, unsigned* dst,
+                     ThreadPool* pool)
+{
+    size_t tiles = (count + HistogramTileSize - 1) / HistogramTileSize;
+    std::function<void(size_t, size_t)> body = [=](size_t begin, size_t end) {
+        for (size_t tile = begin; tile < end; tile++)
+        {
+            size_t first = tile * HistogramTileSize;
+            size_t bins = first + HistogramTileSize < count ? HistogramTileSize : count - first;
+            if (partialCount == 0)
+            {
+                memset(dst + first, 0, bins * sizeof(unsigned));
+                continue;
+            }
+            if (partials[0] != dst)
+            {
+                memcpy(dst + first, partials[0] + first, bins * sizeof(unsigned));
+            }
+            for (size_t p = 1; p < partialCount; p++)
+            {
+                AddHistogram(dst + first, partials[p] + first, bins);
+            }
+        }
+    };
+
+    if (pool)
+    {
+        pool->ParallelFor(tiles, 1, body);
+    }
+    else
+    {
+        body(0, tiles);
+    }
+}
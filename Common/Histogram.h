@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stddef.h>
+
+// Use SSE2 kernels where the compiler guarantees SSE2
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HISTOGRAM_SSE2
+#endif
+
+class ThreadPool;
+
+// Bins per merge task, 64 KB: the tile of the sum stays in cache while
+// every partial's tile is added to it
+static const size_t HistogramTileSize = 1 << 14;
+
+// dst[i] += src[i] for count bins
+void AddHistogram(unsigned* dst, const unsigned* src, size_t count);
+
+// Plain C version, the reference for the SIMD one
+void AddHistogramScalar(unsigned* dst, const unsigned* src, size_t count);
+
+// dst = the sum of partialCount histograms of count bins each, one tile
+// at a time, the tiles spread over pool (may be NULL). dst may be one of
+// the partials only if it's the first.
+void MergeHistograms(const unsigned* const* partials, size_t partialCount, size_t count, unsigned* dst,
+                     ThreadPool* pool);
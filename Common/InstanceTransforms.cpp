@@ -0,0 +1,48 @@
+#include "InstanceTransforms.h"
+#include "ThreadPool.h"
+
+#include <math.h>
+
+// Run body over [0, count) objects on the pool, or inline without one
+static void ForEachChunk(ThreadPool* pool, size_t count, const std::function<void(size_t, size_t)>& body)
+{
+    if (pool)
+    {
+        pool->ParallelFor(count, InstanceChunkSize, body);
+    }
+    else
+    {
+        body(0, count);
+    }
+}
+
+void GridWorlds(size_t count, float spacing, float time, Matrix4x4* worlds, ThreadPool* pool)
+{
+    size_t side = (size_t)ceil(sqrt((double)count));
+    float half = 0.5f * spacing * (side > 0 ? side - 1 : 0);
+
+    ForEachChunk(pool, count, [=](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+        {
+            // RotationY, then moved to its cell
+            float angle = time + 0.37f * (i % 17);
+            float s = sinf(angle), c = cosf(angle);
+            Matrix4x4& m = worlds[i];
+            m.m[0][0] = c;    m.m[0][1] = 0.0f; m.m[0][2] = -s;   m.m[0][3] = 0.0f;
+            m.m[1][0] = 0.0f; m.m[1][1] = 1.0f; m.m[1][2] = 0.0f; m.m[1][3] = 0.0f;
+            m.m[2][0] = s;    m.m[2][1] = 0.0f; m.m[2][2] = c;    m.m[2][3] = 0.0f;
+            m.m[3][0] = (i % side) * spacing - half;
+            m.m[3][1] = 0.0f;
+            m.m[3][2] = (i / side) * spacing - half;
+            m.m[3][3] = 1.0f;
+        }
+    });
+}
+
+void ComputeWorldViewProj(const Matrix4x4* worlds, const Matrix4x4& viewProj, Matrix4x4* out, size_t count,
+                          ThreadPool* pool)
+{
+    ForEachChunk(pool, count, [=, &viewProj](size_t begin, size_t end) {
+        MultiplyMatrices(worlds + begin, viewProj, out + begin, end - begin);
+    });
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "VecMath.h"
+
+class ThreadPool;
+
+// Per-object matrices for drawing many copies of one mesh in one call.
+// Box's colorInstanced.fx reads the results from a structured buffer
+// indexed by SV_InstanceID.
+
+// Matrices per task; 64 KB of output, so workers don't share cache lines
+static const size_t InstanceChunkSize = 1024;
+
+// count objects on a square grid in the xz plane, spacing apart and
+// centered on the origin, each turned about its own y axis by time plus a
+// phase of its own, so every matrix changes every frame
+void GridWorlds(size_t count, float spacing, float time, Matrix4x4* worlds, ThreadPool* pool);
+
+// out[i] = worlds[i] * viewProj for every object, in chunks on pool (may
+// be NULL) with the SIMD MultiplyMatrices. The array is contiguous and row
+// major, ready to copy into a StructuredBuffer of row_major float4x4.
+void ComputeWorldViewProj(const Matrix4x4* worlds, const Matrix4x4& viewProj, Matrix4x4* out, size_t count,
+                          ThreadPool* pool);
@@ -0,0 +1,465 @@
+#include "LineRaster.h"
+#include "Telemetry.h"
+#include "ThreadPool.h"
+
+#include <math.h>
+#include <string.h>
+
+#ifdef LINE_RASTER_SSE2
+#include <emmintrin.h>
+#endif
+
+// floorf and ceilf for the small values a prepared segment has, without
+// the library call they are on SSE2
+static inline int Floor(float f)
+{
+    int i = (int)f;
+    return i - (f < i);
+}
+
+static inline int Ceil(float f)
+{
+    int i = (int)f;
+    return i + (f > i);
+}
+
+bool PrepareLineSegment(Float2 a, Float2 b, unsigned width, unsigned height, LineSegment* segment)
+{
+    // NaN and infinity fail this too
+    const float limit = 1e30f;
+    if (!(fabsf(a.x) < limit && fabsf(a.y) < limit && fabsf(b.x) < limit && fabsf(b.y) < limit))
+    {
+        return false;
+    }
+
+    // Cut a couple of pixels outside the target, the stroke reaches less
+    // than a pixel past its center line so nothing inside changes
+    float hiX = width + 2.0f, hiY = height + 2.0f;
+    bool inside = a.x >= -2.0f && a.x <= hiX && a.y >= -2.0f && a.y <= hiY &&
+                  b.x >= -2.0f && b.x <= hiX && b.y >= -2.0f && b.y <= hiY;
+    if (!inside && !ClipSegment(&a, &b, -2.0f, -2.0f, hiX, hiY))
+    {
+        return false;
+    }
+
+    bool steep = fabsf(b.y - a.y) > fabsf(b.x - a.x);
+    float u0 = steep ? a.y : a.x, v0 = steep ? a.x : a.y;
+    float u1 = steep ? b.y : b.x, v1 = steep ? b.x : b.y;
+    if (u1 < u0)
+    {
+        float t = u0; u0 = u1; u1 = t;
+        t = v0; v0 = v1; v1 = t;
+    }
+    if (u1 == u0)
+    {
+        return false;
+    }
+
+    segment->u0 = u0;
+    segment->v0 = v0;
+    segment->u1 = u1;
+    segment->slope = (v1 - v0) / (u1 - u0);
+    segment->thickness = sqrtf(1.0f + segment->slope * segment->slope);
+    segment->steep = steep;
+    return true;
+}
+
+// Adds one column's three coverages from row j0 on, skipping rows outside
+// [vLo, vHi)
+static inline void AddColumn(unsigned char* p, int j0, const int add[3], int vLo, int vHi, ptrdiff_t vStep)
+{
+    for (int k = 0; k < 3; k++, p += vStep)
+    {
+        int j = j0 + k;
+        if (j >= vLo && j < vHi)
+        {
+            int sum = *p + add[k];
+            *p = (unsigned char)(sum > 255 ? 255 : sum);
+        }
+    }
+}
+
+void CoverLineSegment(const LineSegment& segment, const PixelRect& rect, unsigned char* coverage, int originX,
+                      int originY, int stride)
+{
+    // Locals, so the byte stores below don't make the compiler reload them
+    bool steep = segment.steep;
+    float u0 = segment.u0, u1 = segment.u1, v0 = segment.v0, slope = segment.slope;
+    float half = 0.5f * segment.thickness;
+
+    int uLo = steep ? rect.top : rect.left, uHi = steep ? rect.bottom : rect.right;
+    int vLo = steep ? rect.left : rect.top, vHi = steep ? rect.right : rect.bottom;
+    int uOrigin = steep ? originY : originX, vOrigin = steep ? originX : originY;
+    ptrdiff_t uStep = steep ? stride : 1, vStep = steep ? 1 : stride;
+
+    int first = Floor(u0), end = Ceil(u1);
+    first = first < uLo ? uLo : first;
+    end = end > uHi ? uHi : end;
+
+    // Only the columns whose center gets within a few pixels of rect's
+    // rows: a tile the line passes the corner of walks a few columns, not
+    // all of them
+    if (slope != 0.0f && first < end)
+    {
+        float a = u0 + (vLo - 3.0f - v0) / slope, b = u0 + (vHi + 3.0f - v0) / slope;
+        float lo = a < b ? a : b, hi = a < b ? b : a;
+        if (lo > first)
+        {
+            first = lo < end ? Floor(lo) : end;
+        }
+        if (hi < end)
+        {
+            end = hi > first ? Ceil(hi) + 1 : first;
+        }
+    }
+
+    // Per column: how much of it the line spans, less than all at the
+    // flat caps, and where the stroke crosses its center, [top, bottom).
+    // That's at most sqrt(2) long so within three pixels; always doing
+    // three keeps the loop free of branches that go both ways. Column
+    // positions are floats counted up rather than converted, whole
+    // numbers this small are exact.
+    int i = first;
+    float fi = (float)first;
+#ifdef LINE_RASTER_SSE2
+    // Four columns at a time, the same operations in the same order as
+    // the columns after them so either gives the same bytes
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 steps = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+    for (; i + 4 <= end; i += 4, fi += 4.0f)
+    {
+        __m128 column = _mm_add_ps(_mm_set1_ps(fi), steps);
+        __m128 from = _mm_max_ps(_mm_set1_ps(u0), column);
+        __m128 to = _mm_min_ps(_mm_set1_ps(u1), _mm_add_ps(column, one));
+        __m128 uCover = _mm_sub_ps(to, from);
+
+        __m128 center = _mm_add_ps(_mm_set1_ps(v0), _mm_mul_ps(_mm_sub_ps(_mm_add_ps(column, _mm_set1_ps(0.5f)),
+                                                                         _mm_set1_ps(u0)),
+                                                              _mm_set1_ps(slope)));
+        __m128 top = _mm_sub_ps(center, _mm_set1_ps(half));
+        __m128 bottom = _mm_add_ps(center, _mm_set1_ps(half));
+
+        // Floor: truncate, then one less where that went up
+        __m128i j0 = _mm_cvttps_epi32(top);
+        j0 = _mm_add_epi32(j0, _mm_castps_si128(_mm_cmpgt_ps(_mm_cvtepi32_ps(j0), top)));
+        __m128 row = _mm_cvtepi32_ps(j0);
+
+        int add[3][4];
+        for (int k = 0; k < 3; k++, row = _mm_add_ps(row, one))
+        {
+            __m128 vTop = _mm_max_ps(top, row);
+            __m128 vBottom = _mm_min_ps(bottom, _mm_add_ps(row, one));
+            __m128 cover = _mm_max_ps(_mm_mul_ps(uCover, _mm_sub_ps(vBottom, vTop)), _mm_setzero_ps());
+            __m128i bytes = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(cover, _mm_set1_ps(255.0f)), _mm_set1_ps(0.5f)));
+            _mm_storeu_si128((__m128i*)add[k], bytes);
+        }
+
+        int rows[4];
+        _mm_storeu_si128((__m128i*)rows, j0);
+        for (int c = 0; c < 4; c++)
+        {
+            int columnAdd[3] = {add[0][c], add[1][c], add[2][c]};
+            unsigned char* p = coverage + (i + c - uOrigin) * uStep + (rows[c] - vOrigin) * vStep;
+            AddColumn(p, rows[c], columnAdd, vLo, vHi, vStep);
+        }
+    }
+#endif
+    for (; i < end; i++, fi += 1.0f)
+    {
+        float from = u0 > fi ? u0 : fi;
+        float to = u1 < fi + 1.0f ? u1 : fi + 1.0f;
+        float uCover = to - from;
+
+        float center = v0 + (fi + 0.5f - u0) * slope;
+        float top = center - half, bottom = center + half;
+        int j0 = Floor(top);
+        float row = (float)j0;
+
+        int add[3];
+        for (int k = 0; k < 3; k++, row += 1.0f)
+        {
+            float vTop = top > row ? top : row;
+            float vBottom = bottom < row + 1.0f ? bottom : row + 1.0f;
+            float cover = uCover * (vBottom - vTop);
+            cover = cover > 0.0f ? cover : 0.0f;
+            add[k] = (int)(cover * 255.0f + 0.5f);
+        }
+        AddColumn(coverage + (i - uOrigin) * uStep + (j0 - vOrigin) * vStep, j0, add, vLo, vHi, vStep);
+    }
+}
+
+// Rounded x / 255 for x up to 255 * 255
+static inline unsigned Div255(unsigned x)
+{
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+void BlendCoverageScalar(unsigned* dst, const unsigned char* coverage, size_t count, unsigned color)
+{
+    unsigned alpha = color >> 24;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (coverage[i] == 0)
+        {
+            continue;
+        }
+
+        unsigned a = Div255(coverage[i] * alpha);
+        unsigned d = dst[i], out = 0;
+        for (int shift = 0; shift < 32; shift += 8)
+        {
+            out |= Div255(((d >> shift) & 255) * (255 - a) + ((color >> shift) & 255) * a) << shift;
+        }
+        dst[i] = out;
+    }
+}
+
+#ifdef LINE_RASTER_SSE2
+
+// Div255 on eight 16-bit lanes, which the products fit unsigned
+static inline __m128i Div255(__m128i x)
+{
+    x = _mm_add_epi16(x, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+void BlendCoverage(unsigned* dst, const unsigned char* coverage, size_t count, unsigned color)
+{
+    // Four pixels per iteration, as 16-bit channels two pixels to a
+    // register. Most groups of a tile are empty and skipped whole.
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i full = _mm_set1_epi16(255);
+    const __m128i src = _mm_unpacklo_epi8(_mm_set1_epi32((int)color), zero);
+    const __m128i alpha = _mm_set1_epi16((short)(color >> 24));
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        int cover;
+        memcpy(&cover, coverage + i, sizeof(cover));
+        if (cover == 0)
+        {
+            continue;
+        }
+
+        // a0 a1 a2 a3 spread to every channel of their pixel
+        __m128i a = Div255(_mm_mullo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(cover), zero), alpha));
+        a = _mm_unpacklo_epi16(a, a);
+        __m128i a01 = _mm_unpacklo_epi32(a, a);
+        __m128i a23 = _mm_unpackhi_epi32(a, a);
+
+        __m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+        __m128i d01 = _mm_unpacklo_epi8(d, zero);
+        __m128i d23 = _mm_unpackhi_epi8(d, zero);
+        d01 = Div255(_mm_add_epi16(_mm_mullo_epi16(d01, _mm_sub_epi16(full, a01)), _mm_mullo_epi16(src, a01)));
+        d23 = Div255(_mm_add_epi16(_mm_mullo_epi16(d23, _mm_sub_epi16(full, a23)), _mm_mullo_epi16(src, a23)));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(d01, d23));
+    }
+    BlendCoverageScalar(dst + i, coverage + i, count - i, color);
+}
+
+#else
+
+void BlendCoverage(unsigned* dst, const unsigned char* coverage, size_t count, unsigned color)
+{
+    BlendCoverageScalar(dst, coverage, count, color);
+}
+
+#endif
+
+void DrawAntialiasedLinesScalar(Image* image, const Float2* points, unsigned lineCount, unsigned color)
+{
+    const PixelRect clip = image->Clip();
+    if (IsEmpty(clip))
+    {
+        return;
+    }
+
+    int width = clip.right - clip.left;
+    std::vector<unsigned char> coverage((size_t)width * (clip.bottom - clip.top));
+    for (unsigned i = 0; i < lineCount; i++)
+    {
+        LineSegment segment;
+        if (PrepareLineSegment(points[2 * i], points[2 * i + 1], image->Width(), image->Height(), &segment))
+        {
+            CoverLineSegment(segment, clip, &coverage[0], clip.left, clip.top, width);
+        }
+    }
+
+    for (int y = clip.top; y < clip.bottom; y++)
+    {
+        BlendCoverageScalar(image->Row(y) + clip.left, &coverage[(size_t)(y - clip.top) * width], width, color);
+    }
+}
+
+// Calls visit(tile) once for each tile inside clip the segment may cover:
+// along the long axis a tile at a time, the short axis range it spans
+// there grown by the stroke and a pixel to spare for rounding
+template <typename Visit>
+static void ForEachTile(const LineSegment& s, const PixelRect& clip, int tilesX, Visit visit)
+{
+    int uLo = s.steep ? clip.top : clip.left, uHi = s.steep ? clip.bottom : clip.right;
+    int vLo = s.steep ? clip.left : clip.top, vHi = s.steep ? clip.right : clip.bottom;
+
+    int first = Floor(s.u0), end = Ceil(s.u1);
+    first = first < uLo ? uLo : first;
+    end = end > uHi ? uHi : end;
+    float half = 0.5f * s.thickness + 1.0f;
+    if (first >= end)
+    {
+        return;
+    }
+
+    // Most short lines are inside one tile, which needs no walking
+    float vEnd = s.v0 + (s.u1 - s.u0) * s.slope;
+    int lo = Floor((s.v0 < vEnd ? s.v0 : vEnd) - half - 1.0f);
+    int hi = Floor((s.v0 < vEnd ? vEnd : s.v0) + half + 1.0f);
+    int tu = first / LineTileSize, tv = lo / LineTileSize;
+    if (lo >= vLo && hi < vHi && tu == (end - 1) / LineTileSize && tv == hi / LineTileSize)
+    {
+        visit(s.steep ? (unsigned)(tu * tilesX + tv) : (unsigned)(tv * tilesX + tu));
+        return;
+    }
+
+    for (int t = first / LineTileSize; t * LineTileSize < end; t++)
+    {
+        int a = t * LineTileSize > first ? t * LineTileSize : first;
+        int b = (t + 1) * LineTileSize < end ? (t + 1) * LineTileSize : end;
+        float va = s.v0 + (a + 0.5f - s.u0) * s.slope;
+        float vb = s.v0 + (b - 0.5f - s.u0) * s.slope;
+        int lo = Floor((va < vb ? va : vb) - half);
+        int hi = Floor((va < vb ? vb : va) + half);
+        lo = lo < vLo ? vLo : lo;
+        hi = hi > vHi - 1 ? vHi - 1 : hi;
+        if (lo > hi)
+        {
+            continue;
+        }
+
+        for (int tv = lo / LineTileSize; tv <= hi / LineTileSize; tv++)
+        {
+            visit(s.steep ? (unsigned)(t * tilesX + tv) : (unsigned)(tv * tilesX + t));
+        }
+    }
+}
+
+void LineRasterizer::DrawLines(Image* image, const Float2* points, unsigned lineCount, const Matrix3x2& m,
+                               unsigned color, ThreadPool* pool)
+{
+    const PixelRect clip = image->Clip();
+    if (lineCount == 0 || IsEmpty(clip))
+    {
+        return;
+    }
+
+    size_t capacity = _segments.capacity() + _hits.capacity() + _binStart.capacity() + _binned.capacity() +
+                      _tiles.capacity();
+
+    bool identity = m._11 == 1.0f && m._12 == 0.0f && m._21 == 0.0f && m._22 == 1.0f && m._31 == 0.0f && m._32 == 0.0f;
+    _segments.clear();
+    for (unsigned i = 0; i < lineCount; i++)
+    {
+        Float2 a = identity ? points[2 * i] : m.TransformPoint(points[2 * i]);
+        Float2 b = identity ? points[2 * i + 1] : m.TransformPoint(points[2 * i + 1]);
+        LineSegment segment;
+        if (PrepareLineSegment(a, b, image->Width(), image->Height(), &segment))
+        {
+            _segments.push_back(segment);
+        }
+    }
+
+    // Walk every segment's tiles once, then bin by counting sort: count
+    // each tile's hits, turn the counts into starts and drop each segment
+    // into its tiles' ranges
+    int tilesX = ((int)image->Width() + LineTileSize - 1) / LineTileSize;
+    int tilesY = ((int)image->Height() + LineTileSize - 1) / LineTileSize;
+    size_t tileCount = (size_t)tilesX * tilesY;
+    _hits.clear();
+    for (size_t i = 0; i < _segments.size(); i++)
+    {
+        ForEachTile(_segments[i], clip, tilesX, [&](unsigned tile) {
+            TileHit hit = {tile, (unsigned)i};
+            _hits.push_back(hit);
+        });
+    }
+
+    _binStart.assign(tileCount + 1, 0);
+    unsigned* start = &_binStart[0];
+    for (size_t h = 0; h < _hits.size(); h++)
+    {
+        start[_hits[h].tile + 1]++;
+    }
+
+    _tiles.clear();
+    for (size_t t = 0; t < tileCount; t++)
+    {
+        if (start[t + 1] != 0)
+        {
+            _tiles.push_back((unsigned)t);
+        }
+        start[t + 1] += start[t];
+    }
+    if (_tiles.empty())
+    {
+        return;
+    }
+
+    // Copies rather than indices, so a tile reads its segments in order
+    // instead of gathering them from all over _segments
+    _binned.resize(_hits.size());
+    LineSegment* binned = &_binned[0];
+    for (size_t h = 0; h < _hits.size(); h++)
+    {
+        binned[start[_hits[h].tile]++] = _segments[_hits[h].segment];
+    }
+
+    // Every start moved up to the next tile's, move them back
+    for (size_t t = tileCount; t > 0; t--)
+    {
+        start[t] = start[t - 1];
+    }
+    start[0] = 0;
+
+    if (_segments.capacity() + _hits.capacity() + _binStart.capacity() + _binned.capacity() + _tiles.capacity() !=
+        capacity)
+    {
+        Telemetry::Add(Telemetry_Allocations);
+    }
+
+    const unsigned* tiles = &_tiles[0];
+    std::function<void(size_t, size_t)> body = [=](size_t begin, size_t end) {
+        unsigned char coverage[LineTileSize * LineTileSize];
+        for (size_t k = begin; k < end; k++)
+        {
+            int tx = (int)(tiles[k] % tilesX), ty = (int)(tiles[k] / tilesX);
+            PixelRect rect = Intersect(MakePixelRect(tx * LineTileSize, ty * LineTileSize, (tx + 1) * LineTileSize,
+                                                     (ty + 1) * LineTileSize),
+                                       clip);
+            int width = rect.right - rect.left;
+            for (int y = rect.top; y < rect.bottom; y++)
+            {
+                memset(coverage + (y - rect.top) * LineTileSize, 0, width);
+            }
+
+            for (unsigned j = start[tiles[k]]; j < start[tiles[k] + 1]; j++)
+            {
+                CoverLineSegment(binned[j], rect, coverage, rect.left, rect.top, LineTileSize);
+            }
+
+            for (int y = rect.top; y < rect.bottom; y++)
+            {
+                BlendCoverage(image->Row(y) + rect.left, coverage + (y - rect.top) * LineTileSize, width, color);
+            }
+        }
+    };
+
+    if (pool && _tiles.size() > 1)
+    {
+        pool->ParallelFor(_tiles.size(), 1, body);
+    }
+    else
+    {
+        body(0, _tiles.size());
+    }
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+#include "SoftwareRaster.h"
+#include "VecMath.h"
+
+// Use SSE2 kernels where the compiler guarantees SSE2
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LINE_RASTER_SSE2
+#endif
+
+class ThreadPool;
+
+// Antialiased lines the way Direct2D strokes them 1 pixel wide with flat
+// caps: each pixel gets the area of the stroke's box that falls inside
+// it, measured Wu style one column (or row, for steep lines) at a time.
+// The coverage of all lines of a batch is added up, saturating, and
+// blended over the image once, so where lines of a polyline meet the
+// joint isn't drawn twice.
+
+// Screen tiles the lines are binned into, a tile's coverage is 4 KB
+static const int LineTileSize = 64;
+
+// One line of a batch, in the axes of its direction: u runs along the
+// longer axis from u0 to u1, v = v0 + (u - u0) * slope. thickness is the
+// stroke's extent along v.
+struct LineSegment
+{
+    float u0;
+    float v0;
+    float u1;
+    float slope;
+    float thickness;
+    bool steep;                 // u is y
+};
+
+// Ends are in pixels, pixel (x, y) covering [x, x + 1). False if the line
+// has no length or misses a target of width x height entirely.
+bool PrepareLineSegment(Float2 a, Float2 b, unsigned width, unsigned height, LineSegment* segment);
+
+// Adds the coverage of the pixels of segment inside rect to coverage,
+// which holds pixel (x, y) at (y - originY) * stride + x - originX.
+// Each pixel's coverage is the same whatever rect it's drawn through.
+void CoverLineSegment(const LineSegment& segment, const PixelRect& rect, unsigned char* coverage, int originX,
+                      int originY, int stride);
+
+// dst[i] = color over dst[i] with coverage[i] / 255 of color's alpha
+void BlendCoverage(unsigned* dst, const unsigned char* coverage, size_t count, unsigned color);
+
+// Plain C version, the reference for the SIMD one
+void BlendCoverageScalar(unsigned* dst, const unsigned char* coverage, size_t count, unsigned color);
+
+// One batch on a single full size coverage buffer with the plain C blend,
+// what LineRasterizer has to match byte for byte
+void DrawAntialiasedLinesScalar(Image* image, const Float2* points, unsigned lineCount, unsigned color);
+
+// Draws batches of antialiased lines by tiles: every line is binned into
+// the tiles it crosses, then the tiles are covered and blended in
+// parallel, each in its own cache sized buffer. Keeps the bins between
+// batches so a frame's lines don't allocate once it has warmed up.
+class LineRasterizer
+{
+public:
+    LineRasterizer() {}
+
+    // lineCount lines between pairs of points, transformed by m, blended
+    // over the image's clip. pool may be NULL.
+    void DrawLines(Image* image, const Float2* points, unsigned lineCount, const Matrix3x2& m, unsigned color,
+                   ThreadPool* pool);
+
+private:
+    struct TileHit
+    {
+        unsigned tile;
+        unsigned segment;
+    };
+
+    std::vector<LineSegment> _segments;
+    std::vector<TileHit> _hits;             // every tile each segment crosses, in segment order
+    std::vector<unsigned> _binStart;        // per tile, into _binned, then one past the last
+    std::vector<LineSegment> _binned;       // the segments again, by tile
+    std::vector<unsigned> _tiles;           // tiles with anything in them
+
+    LineRasterizer(const LineRasterizer&);
+    LineRasterizer& operator=(const LineRasterizer&);
+};
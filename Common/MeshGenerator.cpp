@@ -0,0 +1,221 @@
+#include "MeshGenerator.h"
+#include "ThreadPool.h"
+
+#include <math.h>
+
+static const float Pi = 3.1415926535f;
+
+static void SetVertex(MeshVertex& v, float px, float py, float pz, float nx, float ny, float nz,
+                      float tx, float ty, float tz, float u, float w)
+{
+    v.position[0] = px; v.position[1] = py; v.position[2] = pz;
+    v.normal[0] = nx;   v.normal[1] = ny;   v.normal[2] = nz;
+    v.tangentU[0] = tx; v.tangentU[1] = ty; v.tangentU[2] = tz;
+    v.texC[0] = u;      v.texC[1] = w;
+}
+
+// Run body over [0, count) rows on the pool, or inline without one
+static void ForEachRow(ThreadPool* pool, size_t count, size_t grain, const std::function<void(size_t, size_t)>& body)
+{
+    if (pool)
+    {
+        pool->ParallelFor(count, grain, body);
+    }
+    else
+    {
+        body(0, count);
+    }
+}
+
+void MeshGenerator::CreateGrid(float width, float depth, unsigned m, unsigned n, MeshData& meshData, ThreadPool* pool)
+{
+    meshData.vertices.clear();
+    meshData.indices.clear();
+    if (m < 2 || n < 2)
+    {
+        return;
+    }
+
+    size_t faceCount = (size_t)(m - 1) * (n - 1) * 2;
+    meshData.vertices.resize((size_t)m * n);
+    meshData.indices.resize(faceCount * 3);
+
+    //
+    // Create the vertices.
+    //
+
+    float halfWidth = 0.5f * width;
+    float halfDepth = 0.5f * depth;
+
+    float dx = width / (n - 1);
+    float dz = depth / (m - 1);
+
+    float du = 1.0f / (n - 1);
+    float dv = 1.0f / (m - 1);
+
+    MeshVertex* vertices = &meshData.vertices[0];
+    ForEachRow(pool, m, 64, [=](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+        {
+            float z = halfDepth - i * dz;
+            for (unsigned j = 0; j < n; j++)
+            {
+                float x = -halfWidth + j * dx;
+                SetVertex(vertices[i * n + j], x, 0.0f, z, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, j * du, i * dv);
+            }
+        }
+    });
+
+    //
+    // Create the indices, two triangles per quad.
+    //
+
+    unsigned* indices = &meshData.indices[0];
+    ForEachRow(pool, m - 1, 64, [=](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+        {
+            unsigned* k = indices + i * (n - 1) * 6;
+            unsigned row = (unsigned)i * n;
+            for (unsigned j = 0; j < n - 1; j++)
+            {
+                k[0] = row + j;
+                k[1] = row + j + 1;
+                k[2] = row + n + j;
+
+                k[3] = row + n + j;
+                k[4] = row + j + 1;
+                k[5] = row + n + j + 1;
+
+                k += 6;
+            }
+        }
+    });
+}
+
+void MeshGenerator::CreateSphere(float radius, unsigned sliceCount, unsigned stackCount, MeshData& meshData, ThreadPool* pool)
+{
+    meshData.vertices.clear();
+    meshData.indices.clear();
+    if (sliceCount < 3 || stackCount < 2)
+    {
+        return;
+    }
+
+    //
+    // Compute the vertices stating at the top pole and moving down the stacks.
+    // Poles: note that there will be texture coordinate distortion as there is
+    // not a unique point on the texture map to assign to the pole when mapping
+    // a rectangular texture onto a sphere.
+    //
+
+    unsigned ringVertexCount = sliceCount + 1;
+    unsigned ringCount = stackCount - 1;
+    size_t vertexCount = 2 + (size_t)ringCount * ringVertexCount;
+    size_t indexCount = (size_t)sliceCount * 6 + (size_t)(ringCount - 1) * sliceCount * 6;
+
+    meshData.vertices.resize(vertexCount);
+    meshData.indices.resize(indexCount);
+
+    MeshVertex* vertices = &meshData.vertices[0];
+    SetVertex(vertices[0], 0.0f, +radius, 0.0f, 0.0f, +1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f);
+    SetVertex(vertices[vertexCount - 1], 0.0f, -radius, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f);
+
+    float phiStep = Pi / stackCount;
+    float thetaStep = 2.0f * Pi / sliceCount;
+
+    // Compute vertices for each stack ring (do not count the poles as rings).
+    ForEachRow(pool, ringCount, 16, [=](size_t begin, size_t end) {
+        for (size_t ring = begin; ring < end; ring++)
+        {
+            float phi = (ring + 1) * phiStep;
+            float sinPhi = sinf(phi);
+            float cosPhi = cosf(phi);
+            MeshVertex* v = vertices + 1 + ring * ringVertexCount;
+
+            // Vertices of ring.
+            for (unsigned j = 0; j <= sliceCount; j++)
+            {
+                float theta = j * thetaStep;
+                float sinTheta = sinf(theta);
+                float cosTheta = cosf(theta);
+
+                // spherical to cartesian
+                float px = radius * sinPhi * cosTheta;
+                float py = radius * cosPhi;
+                float pz = radius * sinPhi * sinTheta;
+
+                // Partial derivative of P with respect to theta
+                float tx = -radius * sinPhi * sinTheta;
+                float tz = +radius * sinPhi * cosTheta;
+                float tl = sqrtf(tx * tx + tz * tz);
+                if (tl > 0.0f)
+                {
+                    tx /= tl;
+                    tz /= tl;
+                }
+
+                SetVertex(v[j], px, py, pz, px / radius, py / radius, pz / radius,
+                          tx, 0.0f, tz, theta / (2.0f * Pi), phi / Pi);
+            }
+        }
+    });
+
+    //
+    // Compute indices for top stack. The top stack was written first to the vertex buffer
+    // and connects the top pole to the first ring.
+    //
+
+    unsigned* indices = &meshData.indices[0];
+    for (unsigned i = 1; i <= sliceCount; i++)
+    {
+        indices[(i - 1) * 3 + 0] = 0;
+        indices[(i - 1) * 3 + 1] = i + 1;
+        indices[(i - 1) * 3 + 2] = i;
+    }
+
+    //
+    // Compute indices for inner stacks (not connected to poles).
+    //
+
+    // Offset the indices to the index of the first vertex in the first ring.
+    // This is just skipping the top pole vertex.
+    unsigned baseIndex = 1;
+    unsigned* inner = indices + sliceCount * 3;
+    ForEachRow(pool, ringCount - 1, 16, [=](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+        {
+            unsigned* k = inner + i * sliceCount * 6;
+            unsigned ring = baseIndex + (unsigned)i * ringVertexCount;
+            for (unsigned j = 0; j < sliceCount; j++)
+            {
+                k[0] = ring + j;
+                k[1] = ring + j + 1;
+                k[2] = ring + ringVertexCount + j;
+
+                k[3] = ring + ringVertexCount + j;
+                k[4] = ring + j + 1;
+                k[5] = ring + ringVertexCount + j + 1;
+
+                k += 6;
+            }
+        }
+    });
+
+    //
+    // Compute indices for bottom stack. The bottom stack was written last to the vertex buffer
+    // and connects the bottom pole to the bottom ring.
+    //
+
+    unsigned southPoleIndex = (unsigned)vertexCount - 1;
+
+    // Offset the indices to the index of the first vertex in the last ring.
+    baseIndex = southPoleIndex - ringVertexCount;
+
+    unsigned* bottom = inner + (size_t)(ringCount - 1) * sliceCount * 6;
+    for (unsigned i = 0; i < sliceCount; i++)
+    {
+        bottom[i * 3 + 0] = southPoleIndex;
+        bottom[i * 3 + 1] = baseIndex + i;
+        bottom[i * 3 + 2] = baseIndex + i + 1;
+    }
+}
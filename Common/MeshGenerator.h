@@ -0,0 +1,33 @@
+#pragma once
+
+#include <vector>
+
+class ThreadPool;
+
+// Same layout as GeometryGenerator::Vertex, without the XNA math types
+struct MeshVertex
+{
+    float position[3];
+    float normal[3];
+    float tangentU[3];
+    float texC[2];
+};
+
+struct MeshData
+{
+    std::vector<MeshVertex> vertices;
+    std::vector<unsigned> indices;
+};
+
+// Builds the same grid and sphere meshes as GeometryGenerator, but fills
+// rows in parallel so very high tessellations don't stall startup.
+// pool may be NULL to build on the calling thread.
+class MeshGenerator
+{
+public:
+    // m x n grid in the xz-plane centered at the origin
+    static void CreateGrid(float width, float depth, unsigned m, unsigned n, MeshData& meshData, ThreadPool* pool);
+
+    // UV sphere centered at the origin
+    static void CreateSphere(float radius, unsigned sliceCount, unsigned stackCount, MeshData& meshData, ThreadPool* pool);
+};
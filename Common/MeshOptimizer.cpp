@@ -0,0 +1,257 @@
+#include "MeshOptimizer.h"
+
+#include <math.h>
+#include <string.h>
+
+VertexCacheStats AnalyzeVertexCache(const unsigned* indices, size_t indexCount, size_t vertexCount, unsigned cacheSize)
+{
+    VertexCacheStats stats;
+    memset(&stats, 0, sizeof(stats));
+    stats.triangles = indexCount / 3;
+    if (indexCount == 0 || cacheSize == 0)
+    {
+        return stats;
+    }
+
+    // FIFO: each vertex remembers when it entered the cache
+    std::vector<size_t> entered(vertexCount, 0);
+    std::vector<bool> referenced(vertexCount, false);
+    size_t clock = 0;
+    size_t unique = 0;
+
+    for (size_t i = 0; i < indexCount; i++)
+    {
+        unsigned v = indices[i];
+        if (!referenced[v])
+        {
+            referenced[v] = true;
+            unique++;
+        }
+        if (entered[v] == 0 || clock - entered[v] >= cacheSize)
+        {
+            clock++;
+            entered[v] = clock;
+            stats.transforms++;
+        }
+    }
+
+    stats.acmr = stats.triangles ? (float)stats.transforms / stats.triangles : 0.0f;
+    stats.atvr = unique ? (float)stats.transforms / unique : 0.0f;
+    return stats;
+}
+
+// Forsyth's scoring. The LRU cache modelled here is larger than the FIFO
+// we measure with, which is what the original article recommends.
+static const int ForsythCacheSize = 32;
+
+struct ForsythTables
+{
+    float cache[ForsythCacheSize];
+    float valence[64];
+
+    ForsythTables()
+    {
+        const float cacheDecayPower = 1.5f;
+        const float lastTriScore = 0.75f;
+        const float valenceBoostScale = 2.0f;
+        const float valenceBoostPower = 0.5f;
+
+        for (int i = 0; i < ForsythCacheSize; i++)
+        {
+            if (i < 3)
+            {
+                // The last triangle's vertices get a fixed score so that
+                // we don't just ping-pong around one triangle
+                cache[i] = lastTriScore;
+            }
+            else
+            {
+                float scaler = 1.0f - (float)(i - 3) / (ForsythCacheSize - 3);
+                cache[i] = powf(scaler, cacheDecayPower);
+            }
+        }
+        valence[0] = 0.0f;
+        for (int i = 1; i < 64; i++)
+        {
+            // Favour vertices with few triangles left so they get finished
+            valence[i] = valenceBoostScale * powf((float)i, -valenceBoostPower);
+        }
+    }
+};
+
+static float VertexScore(const ForsythTables& tables, int cachePosition, unsigned remaining)
+{
+    if (remaining == 0)
+    {
+        return -1.0f;
+    }
+    float score = cachePosition >= 0 ? tables.cache[cachePosition] : 0.0f;
+    score += remaining < 64 ? tables.valence[remaining] : 0.0f;
+    return score;
+}
+
+void OptimizeVertexCache(unsigned* indices, size_t indexCount, size_t vertexCount)
+{
+    static const ForsythTables tables;
+
+    size_t triangleCount = indexCount / 3;
+    if (triangleCount == 0)
+    {
+        return;
+    }
+
+    // Triangles using each vertex, as offsets into one array
+    std::vector<unsigned> remaining(vertexCount, 0);
+    for (size_t i = 0; i < triangleCount * 3; i++)
+    {
+        remaining[indices[i]]++;
+    }
+    std::vector<size_t> firstTriangle(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; v++)
+    {
+        firstTriangle[v + 1] = firstTriangle[v] + remaining[v];
+    }
+    std::vector<unsigned> vertexTriangles(triangleCount * 3);
+    std::vector<size_t> fill(firstTriangle.begin(), firstTriangle.end() - 1);
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            unsigned v = indices[t * 3 + k];
+            vertexTriangles[fill[v]++] = (unsigned)t;
+        }
+    }
+
+    std::vector<float> vertexScore(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++)
+    {
+        vertexScore[v] = VertexScore(tables, -1, remaining[v]);
+    }
+
+    std::vector<float> triangleScore(triangleCount);
+    std::vector<bool> emitted(triangleCount, false);
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+    }
+
+    std::vector<unsigned> output(triangleCount * 3);
+    int cache[ForsythCacheSize + 3];
+    int cacheCount = 0;
+    size_t scanCursor = 0;
+
+    size_t best = 0;
+    for (size_t t = 1; t < triangleCount; t++)
+    {
+        if (triangleScore[t] > triangleScore[best])
+        {
+            best = t;
+        }
+    }
+
+    for (size_t out = 0; out < triangleCount; out++)
+    {
+        if (best == (size_t)-1)
+        {
+            // Nothing in the cache has triangles left; take the next
+            // unemitted triangle in input order
+            while (emitted[scanCursor])
+            {
+                scanCursor++;
+            }
+            best = scanCursor;
+        }
+
+        emitted[best] = true;
+        unsigned tri[3] = { indices[best * 3], indices[best * 3 + 1], indices[best * 3 + 2] };
+        memcpy(&output[out * 3], tri, sizeof(tri));
+
+        // Move the triangle's vertices to the front of the LRU cache
+        int newCache[ForsythCacheSize + 3];
+        int newCount = 0;
+        for (int k = 0; k < 3; k++)
+        {
+            if (k == 0 || (tri[k] != tri[0] && (k == 1 || tri[k] != tri[1])))
+            {
+                newCache[newCount++] = (int)tri[k];
+            }
+            remaining[tri[k]]--;
+            // Take the triangle out of the vertex's list
+            unsigned* list = &vertexTriangles[firstTriangle[tri[k]]];
+            unsigned n = remaining[tri[k]] + 1;
+            for (unsigned e = 0; e < n; e++)
+            {
+                if (list[e] == best)
+                {
+                    list[e] = list[n - 1];
+                    break;
+                }
+            }
+        }
+        for (int c = 0; c < cacheCount; c++)
+        {
+            int v = cache[c];
+            if (v != (int)tri[0] && v != (int)tri[1] && v != (int)tri[2])
+            {
+                newCache[newCount++] = v;
+            }
+        }
+
+        // Rescore everything that was in the cache, including what just fell out
+        for (int c = 0; c < newCount; c++)
+        {
+            int v = newCache[c];
+            vertexScore[v] = VertexScore(tables, c < ForsythCacheSize ? c : -1, remaining[v]);
+        }
+
+        // Pick the best triangle touching the cache
+        best = (size_t)-1;
+        float bestScore = -1.0f;
+        for (int c = 0; c < newCount; c++)
+        {
+            int v = newCache[c];
+            const unsigned* list = &vertexTriangles[firstTriangle[v]];
+            for (unsigned e = 0; e < remaining[v]; e++)
+            {
+                unsigned t = list[e];
+                float score = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+                triangleScore[t] = score;
+                if (score > bestScore)
+                {
+                    bestScore = score;
+                    best = t;
+                }
+            }
+        }
+
+        cacheCount = newCount < ForsythCacheSize ? newCount : ForsythCacheSize;
+        memcpy(cache, newCache, cacheCount * sizeof(int));
+    }
+
+    memcpy(indices, &output[0], triangleCount * 3 * sizeof(unsigned));
+}
+
+size_t OptimizeVertexFetch(unsigned* indices, size_t indexCount, size_t vertexCount, std::vector<unsigned>* remap)
+{
+    remap->assign(vertexCount, ~0u);
+    unsigned next = 0;
+    for (size_t i = 0; i < indexCount; i++)
+    {
+        unsigned& slot = (*remap)[indices[i]];
+        if (slot == ~0u)
+        {
+            slot = next++;
+        }
+        indices[i] = slot;
+    }
+    return next;
+}
+
+void ConvertIndices16(const unsigned* indices, size_t indexCount, std::vector<unsigned short>* indices16)
+{
+    indices16->resize(indexCount);
+    for (size_t i = 0; i < indexCount; i++)
+    {
+        (*indices16)[i] = (unsigned short)indices[i];
+    }
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+// Post-transform vertex cache statistics of a triangle list, simulated
+// with a FIFO cache.
+//  ACMR: vertex shader invocations per triangle (0.5 is ideal, 3 is worst)
+//  ATVR: vertex shader invocations per referenced vertex (1 is ideal)
+struct VertexCacheStats
+{
+    float acmr;
+    float atvr;
+    size_t transforms;
+    size_t triangles;
+};
+
+VertexCacheStats AnalyzeVertexCache(const unsigned* indices, size_t indexCount, size_t vertexCount, unsigned cacheSize = 16);
+
+// Reorder the triangles of an indexed triangle list so vertices are reused
+// while they are still in the post-transform cache. Tom Forsyth's linear
+// speed vertex cache optimisation.
+void OptimizeVertexCache(unsigned* indices, size_t indexCount, size_t vertexCount);
+
+// Renumber vertices in the order the index buffer first touches them, so
+// vertex fetch walks memory forwards. Fills remap with old -> new indices
+// (~0u for unreferenced vertices) and returns the number of used vertices.
+size_t OptimizeVertexFetch(unsigned* indices, size_t indexCount, size_t vertexCount, std::vector<unsigned>* remap);
+
+// Move vertices to the slots chosen by OptimizeVertexFetch and drop the
+// unreferenced ones
+template<typename Vertex>
+void RemapVertices(std::vector<Vertex>& vertices, const std::vector<unsigned>& remap, size_t usedCount)
+{
+    std::vector<Vertex> reordered(usedCount);
+    for (size_t i = 0; i < vertices.size(); i++)
+    {
+        if (remap[i] != ~0u)
+        {
+            reordered[remap[i]] = vertices[i];
+        }
+    }
+    vertices.swap(reordered);
+}
+
+// Whether the mesh can use DXGI_FORMAT_R16_UINT indices
+inline bool FitsIndex16(size_t vertexCount)
+{
+    return vertexCount <= 0xFFFF;
+}
+
+// Narrow indices to 16 bits. The caller checks FitsIndex16 first.
+void ConvertIndices16(const unsigned* indices, size_t indexCount, std::vector<unsigned short>* indices16);
+
+struct MeshOptimizeReport
+{
+    VertexCacheStats before;
+    VertexCacheStats after;
+    bool index16;
+};
+
+// Cache order the triangles, then fetch order the vertices
+template<typename Vertex>
+MeshOptimizeReport OptimizeMesh(std::vector<Vertex>& vertices, std::vector<unsigned>& indices)
+{
+    MeshOptimizeReport report;
+    if (indices.empty())
+    {
+        report.before = report.after = AnalyzeVertexCache(NULL, 0, vertices.size());
+        report.index16 = FitsIndex16(vertices.size());
+        return report;
+    }
+
+    report.before = AnalyzeVertexCache(&indices[0], indices.size(), vertices.size());
+
+    OptimizeVertexCache(&indices[0], indices.size(), vertices.size());
+
+    std::vector<unsigned> remap;
+    size_t used = OptimizeVertexFetch(&indices[0], indices.size(), vertices.size(), &remap);
+    RemapVertices(vertices, remap, used);
+
+    report.after = AnalyzeVertexCache(&indices[0], indices.size(), vertices.size());
+    report.index16 = FitsIndex16(vertices.size());
+    return report;
+}
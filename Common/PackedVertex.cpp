@@ -0,0 +1,127 @@
+#include "PackedVertex.h"
+
+#include <math.h>
+#include <string.h>
+
+#ifdef PACKEDVERTEX_SSE2
+#include <emmintrin.h>
+#endif
+
+static inline float Clamp(float v, float lo, float hi)
+{
+    return v < lo ? lo : (v > hi ? hi : v);
+}
+
+void PackVerticesScalar(const FloatVertex* src, PackedVertex* dst, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        // lrintf rounds to nearest even, like cvtps2dq
+        dst[i].x = (short)lrintf(Clamp(src[i].x, -1.0f, 1.0f) * 32767.0f);
+        dst[i].y = (short)lrintf(Clamp(src[i].y, -1.0f, 1.0f) * 32767.0f);
+        dst[i].z = (short)lrintf(Clamp(src[i].z, -1.0f, 1.0f) * 32767.0f);
+        dst[i].w = 32767;
+        dst[i].r = (unsigned char)lrintf(Clamp(src[i].r, 0.0f, 1.0f) * 255.0f);
+        dst[i].g = (unsigned char)lrintf(Clamp(src[i].g, 0.0f, 1.0f) * 255.0f);
+        dst[i].b = (unsigned char)lrintf(Clamp(src[i].b, 0.0f, 1.0f) * 255.0f);
+        dst[i].a = (unsigned char)lrintf(Clamp(src[i].a, 0.0f, 1.0f) * 255.0f);
+    }
+}
+
+void UnpackVerticesScalar(const PackedVertex* src, FloatVertex* dst, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        // snorm: -32768 and -32767 both map to -1
+        dst[i].x = Clamp(src[i].x / 32767.0f, -1.0f, 1.0f);
+        dst[i].y = Clamp(src[i].y / 32767.0f, -1.0f, 1.0f);
+        dst[i].z = Clamp(src[i].z / 32767.0f, -1.0f, 1.0f);
+        dst[i].r = src[i].r / 255.0f;
+        dst[i].g = src[i].g / 255.0f;
+        dst[i].b = src[i].b / 255.0f;
+        dst[i].a = src[i].a / 255.0f;
+    }
+}
+
+#ifdef PACKEDVERTEX_SSE2
+
+// Position lanes x, y, z with w forced to 1, scaled to snorm16 range
+static inline __m128i QuantizePosition(const FloatVertex* v, __m128 xyzMask, __m128 oneW)
+{
+    __m128 p = _mm_loadu_ps(&v->x);   // x y z r
+    p = _mm_or_ps(_mm_and_ps(p, xyzMask), oneW);
+    p = _mm_min_ps(_mm_max_ps(p, _mm_set1_ps(-1.0f)), _mm_set1_ps(1.0f));
+    return _mm_cvtps_epi32(_mm_mul_ps(p, _mm_set1_ps(32767.0f)));
+}
+
+static inline __m128i QuantizeColor(const FloatVertex* v)
+{
+    __m128 c = _mm_loadu_ps(&v->r);   // r g b a
+    c = _mm_min_ps(_mm_max_ps(c, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+    return _mm_cvtps_epi32(_mm_mul_ps(c, _mm_set1_ps(255.0f)));
+}
+
+void PackVertices(const FloatVertex* src, PackedVertex* dst, size_t count)
+{
+    const __m128 xyzMask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+    const __m128 oneW = _mm_set_ps(1.0f, 0.0f, 0.0f, 0.0f);
+
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2)
+    {
+        // Two vertices per iteration so the saturating packs fill a register
+        __m128i p = _mm_packs_epi32(QuantizePosition(src + i, xyzMask, oneW),
+                                    QuantizePosition(src + i + 1, xyzMask, oneW));
+        __m128i c = _mm_packs_epi32(QuantizeColor(src + i), QuantizeColor(src + i + 1));
+        c = _mm_packus_epi16(c, c);
+
+        _mm_storel_epi64((__m128i*)&dst[i].x, p);
+        _mm_storel_epi64((__m128i*)&dst[i + 1].x, _mm_unpackhi_epi64(p, p));
+        int c0 = _mm_cvtsi128_si32(c);
+        int c1 = _mm_cvtsi128_si32(_mm_srli_si128(c, 4));
+        memcpy(&dst[i].r, &c0, 4);
+        memcpy(&dst[i + 1].r, &c1, 4);
+    }
+    PackVerticesScalar(src + i, dst + i, count - i);
+}
+
+// One vertex per iteration. Divides rather than multiplying by the
+// reciprocal, so the floats match UnpackVerticesScalar bit for bit.
+void UnpackVertices(const PackedVertex* src, FloatVertex* dst, size_t count)
+{
+    const __m128 posScale = _mm_set1_ps(32767.0f);
+    const __m128 colorScale = _mm_set1_ps(255.0f);
+    const __m128 minusOne = _mm_set1_ps(-1.0f);
+    const __m128i zero = _mm_setzero_si128();
+
+    for (size_t i = 0; i < count; i++)
+    {
+        __m128i p = _mm_loadl_epi64((const __m128i*)&src[i].x);
+        p = _mm_srai_epi32(_mm_unpacklo_epi16(p, p), 16);   // sign extend
+        __m128 pos = _mm_max_ps(_mm_div_ps(_mm_cvtepi32_ps(p), posScale), minusOne);
+
+        int packed;
+        memcpy(&packed, &src[i].r, 4);
+        __m128i c = _mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero);
+        c = _mm_unpacklo_epi16(c, zero);
+        __m128 color = _mm_div_ps(_mm_cvtepi32_ps(c), colorScale);
+
+        // The position store spills w into r, the color store then overwrites it
+        _mm_storeu_ps(&dst[i].x, pos);
+        _mm_storeu_ps(&dst[i].r, color);
+    }
+}
+
+#else
+
+void PackVertices(const FloatVertex* src, PackedVertex* dst, size_t count)
+{
+    PackVerticesScalar(src, dst, count);
+}
+
+void UnpackVertices(const PackedVertex* src, FloatVertex* dst, size_t count)
+{
+    UnpackVerticesScalar(src, dst, count);
+}
+
+#endif
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stddef.h>
+
+// Use SSE2 kernels where the compiler guarantees SSE2
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PACKEDVERTEX_SSE2
+#endif
+
+// Full precision vertex, same layout as a float3 position followed by a
+// D3DXCOLOR. 28 bytes.
+struct FloatVertex
+{
+    float x, y, z;
+    float r, g, b, a;
+};
+
+// Compact vertex for streaming, 12 bytes.
+// Position is snorm16 x4 (w is always 1.0) which maps to
+// DXGI_FORMAT_R16G16B16A16_SNORM, so positions must lie in [-1, 1].
+// Color is RGBA8 in memory order, DXGI_FORMAT_R8G8B8A8_UNORM.
+struct PackedVertex
+{
+    short x, y, z, w;
+    unsigned char r, g, b, a;
+};
+
+// Byte offsets for the input layout
+#define PACKEDVERTEX_POSITION_OFFSET 0
+#define PACKEDVERTEX_COLOR_OFFSET    8
+
+// Quantize count vertices. Out of range values are clamped.
+void PackVertices(const FloatVertex* src, PackedVertex* dst, size_t count);
+
+// Expand count vertices back to floats
+void UnpackVertices(const PackedVertex* src, FloatVertex* dst, size_t count);
+
+// Plain C versions of the above, used for the remainder and for checking
+// that the SIMD kernels round the same way.
+void PackVerticesScalar(const FloatVertex* src, PackedVertex* dst, size_t count);
+void UnpackVerticesScalar(const PackedVertex* src, FloatVertex* dst, size_t count);
@@ -0,0 +1,228 @@
+#include "ParallelWaves.h"
+#include "ThreadPool.h"
+
+#include <math.h>
+#include <algorithm>
+
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PARALLELWAVES_SSE2
+#include <emmintrin.h>
+#endif
+
+ParallelWaves::ParallelWaves() :
+    _rows(0),
+    _cols(0),
+    _blockRows(32),
+    _dx(0.0f),
+    _timeStep(0.0f),
+    _accumulated(0.0f),
+    _computeNormals(true),
+    _pool(NULL),
+    _k1(0.0f),
+    _k2(0.0f),
+    _k3(0.0f)
+{
+}
+
+void ParallelWaves::Init(unsigned m, unsigned n, float dx, float dt, float speed, float damping, ThreadPool* pool)
+{
+    _rows = m;
+    _cols = n;
+    _dx = dx;
+    _timeStep = dt;
+    _accumulated = 0.0f;
+    _pool = pool;
+
+    float d = damping * dt + 2.0f;
+    float e = (speed * speed) * (dt * dt) / (dx * dx);
+    _k1 = (damping * dt - 2.0f) / d;
+    _k2 = (4.0f - 8.0f * e) / d;
+    _k3 = (2.0f * e) / d;
+
+    size_t count = (size_t)m * n;
+    _prev.assign(count, 0.0f);
+    _curr.assign(count, 0.0f);
+    _normalX.assign(count, 0.0f);
+    _normalY.assign(count, 1.0f);
+    _normalZ.assign(count, 0.0f);
+    _tangentX.assign(count, 1.0f);
+    _tangentY.assign(count, 0.0f);
+}
+
+void ParallelWaves::Update(float elapsed)
+{
+    _accumulated += elapsed;
+    while (_timeStep > 0.0f && _accumulated >= _timeStep)
+    {
+        Step();
+        _accumulated -= _timeStep;
+    }
+}
+
+void ParallelWaves::Disturb(unsigned i, unsigned j, float magnitude)
+{
+    // Don't disturb boundaries
+    if (i <= 1 || i >= _rows - 2 || j <= 1 || j >= _cols - 2)
+    {
+        return;
+    }
+
+    float halfMag = 0.5f * magnitude;
+    _curr[i * _cols + j] += magnitude;
+    _curr[i * _cols + j + 1] += halfMag;
+    _curr[i * _cols + j - 1] += halfMag;
+    _curr[(i + 1) * _cols + j] += halfMag;
+    _curr[(i - 1) * _cols + j] += halfMag;
+}
+
+void ParallelWaves::StepRow(unsigned i)
+{
+    const float* up = &_curr[(i - 1) * _cols];
+    const float* row = &_curr[i * _cols];
+    const float* down = &_curr[(i + 1) * _cols];
+    float* next = &_prev[i * _cols];
+
+    unsigned j = 1;
+#ifdef PARALLELWAVES_SSE2
+    const __m128 k1 = _mm_set1_ps(_k1);
+    const __m128 k2 = _mm_set1_ps(_k2);
+    const __m128 k3 = _mm_set1_ps(_k3);
+    for (; j + 4 <= _cols - 1; j += 4)
+    {
+        __m128 sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(up + j), _mm_loadu_ps(down + j)),
+                                _mm_add_ps(_mm_loadu_ps(row + j - 1), _mm_loadu_ps(row + j + 1)));
+        __m128 v = _mm_add_ps(_mm_mul_ps(k1, _mm_loadu_ps(next + j)), _mm_mul_ps(k2, _mm_loadu_ps(row + j)));
+        _mm_storeu_ps(next + j, _mm_add_ps(v, _mm_mul_ps(k3, sum)));
+    }
+#endif
+    for (; j < _cols - 1; j++)
+    {
+        next[j] = _k1 * next[j] + _k2 * row[j] + _k3 * (up[j] + down[j] + row[j - 1] + row[j + 1]);
+    }
+}
+
+void ParallelWaves::NormalRow(const float* h, unsigned i)
+{
+    const float* up = h + (i - 1) * _cols;
+    const float* row = h + i * _cols;
+    const float* down = h + (i + 1) * _cols;
+    size_t base = (size_t)i * _cols;
+    float twoDx = 2.0f * _dx;
+
+    unsigned j = 1;
+#ifdef PARALLELWAVES_SSE2
+    const __m128 vTwoDx = _mm_set1_ps(twoDx);
+    const __m128 twoDxSq = _mm_set1_ps(twoDx * twoDx);
+    const __m128 one = _mm_set1_ps(1.0f);
+    for (; j + 4 <= _cols - 1; j += 4)
+    {
+        __m128 l = _mm_loadu_ps(row + j - 1);
+        __m128 r = _mm_loadu_ps(row + j + 1);
+        __m128 t = _mm_loadu_ps(up + j);
+        __m128 b = _mm_loadu_ps(down + j);
+
+        // normal = normalize(l - r, 2dx, b - t)
+        __m128 nx = _mm_sub_ps(l, r);
+        __m128 nz = _mm_sub_ps(b, t);
+        __m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(nz, nz)), twoDxSq));
+        __m128 inv = _mm_div_ps(one, len);
+        _mm_storeu_ps(&_normalX[base + j], _mm_mul_ps(nx, inv));
+        _mm_storeu_ps(&_normalY[base + j], _mm_mul_ps(vTwoDx, inv));
+        _mm_storeu_ps(&_normalZ[base + j], _mm_mul_ps(nz, inv));
+
+        // tangent = normalize(2dx, r - l, 0)
+        __m128 ty = _mm_sub_ps(r, l);
+        inv = _mm_div_ps(one, _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(ty, ty), twoDxSq)));
+        _mm_storeu_ps(&_tangentX[base + j], _mm_mul_ps(vTwoDx, inv));
+        _mm_storeu_ps(&_tangentY[base + j], _mm_mul_ps(ty, inv));
+    }
+#endif
+    for (; j < _cols - 1; j++)
+    {
+        float l = row[j - 1];
+        float r = row[j + 1];
+        float t = up[j];
+        float b = down[j];
+
+        float nx = l - r;
+        float nz = b - t;
+        float inv = 1.0f / sqrtf(nx * nx + twoDx * twoDx + nz * nz);
+        _normalX[base + j] = nx * inv;
+        _normalY[base + j] = twoDx * inv;
+        _normalZ[base + j] = nz * inv;
+
+        float ty = r - l;
+        inv = 1.0f / sqrtf(twoDx * twoDx + ty * ty);
+        _tangentX[base + j] = twoDx * inv;
+        _tangentY[base + j] = ty * inv;
+    }
+}
+
+void ParallelWaves::StepStrip(unsigned begin, unsigned end)
+{
+    for (unsigned i = begin; i < end; i++)
+    {
+        StepRow(i);
+
+        // Row i - 1 now has new heights on both sides, as long as its upper
+        // neighbour was also computed by this strip
+        if (_computeNormals && i >= begin + 2)
+        {
+            NormalRow(&_prev[0], i - 1);
+        }
+    }
+}
+
+void ParallelWaves::Step()
+{
+    if (_rows < 3 || _cols < 3)
+    {
+        return;
+    }
+
+    // Interior rows only, the border stays at rest
+    unsigned interior = _rows - 2;
+    unsigned block = _blockRows;
+
+    if (_pool)
+    {
+        _pool->ParallelFor(interior, block, [this](size_t begin, size_t end) {
+            StepStrip((unsigned)begin + 1, (unsigned)end + 1);
+        });
+    }
+    else
+    {
+        StepStrip(1, _rows - 1);
+        block = interior;
+    }
+
+    // The new heights were written over the old ones
+    std::swap(_prev, _curr);
+
+    if (_computeNormals)
+    {
+        // The first and last row of each strip needed a neighbour from the
+        // strip next door, fill them in now that every strip is done
+        unsigned strips = (interior + block - 1) / block;
+        auto fixup = [this, block, interior](size_t first, size_t last) {
+            for (size_t s = first; s < last; s++)
+            {
+                unsigned begin = (unsigned)(s * block) + 1;
+                unsigned end = std::min(begin + block, interior + 1);
+                NormalRow(&_curr[0], begin);
+                if (end - 1 > begin)
+                {
+                    NormalRow(&_curr[0], end - 1);
+                }
+            }
+        };
+        if (_pool)
+        {
+            _pool->ParallelFor(strips, 16, fixup);
+        }
+        else
+        {
+            fixup(0, strips);
+        }
+    }
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <vector>
+
+class ThreadPool;
+
+// Height field wave solver with the same finite difference scheme as the
+// book's Waves class, laid out for large grids:
+//  - heights, normals and tangents live in separate float arrays (SoA)
+//  - two height buffers are swapped each step instead of copying vertices
+//  - rows are processed in cache sized strips spread over a thread pool
+//  - the stencil and the normal pass run four columns at a time with SSE
+class ParallelWaves
+{
+public:
+    ParallelWaves();
+
+    // m rows by n columns with spacing dx. dt is the fixed simulation step.
+    // pool may be NULL to run single threaded.
+    void Init(unsigned m, unsigned n, float dx, float dt, float speed, float damping, ThreadPool* pool);
+
+    // Recompute normals and tangents as part of every step
+    void SetComputeNormals(bool computeNormals) { _computeNormals = computeNormals; }
+
+    // Rows per strip. Three rows of each array per strip should fit in L2.
+    void SetBlockRows(unsigned blockRows) { _blockRows = blockRows < 4 ? 4 : blockRows; }
+
+    // Advance by elapsed seconds, taking as many fixed steps as fit
+    void Update(float elapsed);
+
+    // Take exactly one simulation step
+    void Step();
+
+    // Push the surface down at (i, j) and half as much at its neighbours.
+    // The point must be at least two cells away from the border.
+    void Disturb(unsigned i, unsigned j, float magnitude);
+
+    unsigned RowCount() const { return _rows; }
+    unsigned ColumnCount() const { return _cols; }
+    unsigned VertexCount() const { return _rows * _cols; }
+    float Width() const { return _cols * _dx; }
+    float Depth() const { return _rows * _dx; }
+
+    // Grid position of a vertex; the height is Height(i, j)
+    float X(unsigned j) const { return -0.5f * (_cols - 1) * _dx + j * _dx; }
+    float Z(unsigned i) const { return 0.5f * (_rows - 1) * _dx - i * _dx; }
+    float Height(unsigned i, unsigned j) const { return _curr[i * _cols + j]; }
+
+    // Row major arrays of VertexCount() entries. Tangent z is always 0.
+    const float* Heights() const { return &_curr[0]; }
+    const float* NormalX() const { return &_normalX[0]; }
+    const float* NormalY() const { return &_normalY[0]; }
+    const float* NormalZ() const { return &_normalZ[0]; }
+    const float* TangentX() const { return &_tangentX[0]; }
+    const float* TangentY() const { return &_tangentY[0]; }
+
+private:
+    unsigned _rows;
+    unsigned _cols;
+    unsigned _blockRows;
+    float _dx;
+    float _timeStep;
+    float _accumulated;
+    bool _computeNormals;
+    ThreadPool* _pool;
+
+    // Simulation constants
+    float _k1;
+    float _k2;
+    float _k3;
+
+    std::vector<float> _prev;
+    std::vector<float> _curr;
+    std::vector<float> _normalX;
+    std::vector<float> _normalY;
+    std::vector<float> _normalZ;
+    std::vector<float> _tangentX;
+    std::vector<float> _tangentY;
+
+    // Write the next heights of row i into _prev
+    void StepRow(unsigned i);
+
+    // Normals and tangents of row i from the heights in buffer h
+    void NormalRow(const float* h, unsigned i);
+
+    // Heights for rows [begin, end), plus normals of the rows whose
+    // neighbours all fall inside the strip
+    void StepStrip(unsigned begin, unsigned end);
+};
@@ -0,0 +1,466 @@
+#include "PointCloudWriter.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <malloc.h>
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const size_t BlockHeaderBytes = sizeof(PointBlockHeader);
+static const size_t PlyVertexBytes = 9;
+
+static unsigned char* AllocateAligned(size_t bytes)
+{
+#ifdef _WIN32
+    return (unsigned char*)_aligned_malloc(bytes, PointCloudAlignment);
+#else
+    void* p = NULL;
+    return posix_memalign(&p, PointCloudAlignment, bytes) == 0 ? (unsigned char*)p : NULL;
+#endif
+}
+
+static void FreeAligned(unsigned char* p)
+{
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+}
+
+static size_t RoundUp(size_t n, size_t multiple)
+{
+    return (n + multiple - 1) / multiple * multiple;
+}
+
+static double MillisecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+PointCloudWriter::PointCloudWriter() :
+    _format(PointCloud_Blocks),
+    _bufferBytes(0),
+    _blockCapacity(0),
+    _promised(0),
+    _open(false),
+    _writing(false),
+    _failed(false),
+#ifdef _WIN32
+    _file(INVALID_HANDLE_VALUE),
+#else
+    _file(-1),
+#endif
+    _current(NULL),
+    _closing(false),
+    _writeFailed(false)
+{
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+PointCloudWriter::~PointCloudWriter()
+{
+    Close();
+}
+
+bool PointCloudWriter::Open(const char* path, PointCloudFormat format, unsigned long long points,
+                            const Float2 corners[3], const PointCloudSettings& settings)
+{
+    Close();
+    memset(&_stats, 0, sizeof(_stats));
+    _start = std::chrono::steady_clock::now();
+
+    _format = format;
+    _bufferBytes = RoundUp(settings.bufferBytes > PointCloudAlignment ? settings.bufferBytes : PointCloudAlignment,
+                           PointCloudAlignment);
+
+    // A multiple of 16 points keeps y and the corners 64 byte aligned
+    _blockCapacity = (_bufferBytes - BlockHeaderBytes) / 9 / 16 * 16;
+    _promised = points;
+    _failed = false;
+
+    _writing = path && path[0];
+    if (_writing && !OpenOutput(path, settings.direct))
+    {
+        return false;
+    }
+
+    unsigned count = settings.buffers > 2 ? settings.buffers : 2;
+    _buffers.resize(count);
+    for (unsigned i = 0; i < count; i++)
+    {
+        _buffers[i].data = AllocateAligned(_bufferBytes);
+        _buffers[i].used = 0;
+        if (!_buffers[i].data)
+        {
+            for (unsigned j = 0; j < i; j++)
+            {
+                FreeAligned(_buffers[j].data);
+            }
+            _buffers.clear();
+            CloseOutput();
+            return false;
+        }
+        _free.push_back(&_buffers[i]);
+    }
+
+    _closing = false;
+    _writeFailed = false;
+    _thread = std::thread([this]() { WriteLoop(); });
+    _open = true;
+
+    Acquire();
+    if (_format == PointCloud_Blocks)
+    {
+        // The header on its own, so every block starts aligned
+        PointCloudHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, "PTCLOUD", 8);
+        header.version = 1;
+        header.headerBytes = (unsigned)PointCloudAlignment;
+        header.points = points;
+        header.blockCapacity = (unsigned)_blockCapacity;
+        header.blockBytes = (unsigned)_bufferBytes;
+        for (int i = 0; i < 3; i++)
+        {
+            header.corners[i * 2 + 0] = corners[i].x;
+            header.corners[i * 2 + 1] = corners[i].y;
+        }
+
+        memset(_current->data, 0, PointCloudAlignment);
+        memcpy(_current->data, &header, sizeof(header));
+        _current->used = PointCloudAlignment;
+        Submit();
+        Acquire();
+        BeginBlock();
+    }
+    else
+    {
+        int length = snprintf((char*)_current->data, _bufferBytes,
+                              "ply\n"
+                              "format binary_little_endian 1.0\n"
+                              "comment chaos game, corners %g %g %g %g %g %g\n"
+                              "element vertex %llu\n"
+                              "property float x\n"
+                              "property float y\n"
+                              "property uchar corner\n"
+                              "end_header\n",
+                              corners[0].x, corners[0].y, corners[1].x, corners[1].y, corners[2].x, corners[2].y,
+                              points);
+        _current->used = (size_t)length;
+    }
+    return true;
+}
+
+bool PointCloudWriter::Write(const float* x, const float* y, const unsigned char* corners, size_t count)
+{
+    if (!_open || _failed)
+    {
+        return false;
+    }
+
+    if (_format == PointCloud_Blocks)
+    {
+        while (count > 0 && !_failed)
+        {
+            PointBlockHeader* block = (PointBlockHeader*)_current->data;
+            float* blockX = (float*)(_current->data + BlockHeaderBytes);
+            float* blockY = blockX + _blockCapacity;
+            unsigned char* blockCorners = (unsigned char*)(blockY + _blockCapacity);
+
+            size_t n = _blockCapacity - block->count < count ? _blockCapacity - block->count : count;
+            memcpy(blockX + block->count, x, n * sizeof(float));
+            memcpy(blockY + block->count, y, n * sizeof(float));
+            memcpy(blockCorners + block->count, corners, n);
+            block->count += (unsigned)n;
+            _stats.points += n;
+            x += n;
+            y += n;
+            corners += n;
+            count -= n;
+
+            if (block->count == _blockCapacity)
+            {
+                // The file ends after the last corner byte, padding or not
+                _current->used = _stats.points == _promised ? BlockHeaderBytes + 9 * _blockCapacity : _bufferBytes;
+                Submit();
+                Acquire();
+                BeginBlock();
+            }
+        }
+        return !_failed;
+    }
+
+    for (size_t i = 0; i < count && !_failed; i++)
+    {
+        unsigned char vertex[PlyVertexBytes];
+        memcpy(vertex, &x[i], sizeof(float));
+        memcpy(vertex + 4, &y[i], sizeof(float));
+        vertex[8] = corners[i];
+
+        // A vertex may straddle two buffers
+        size_t room = _bufferBytes - _current->used;
+        if (room >= PlyVertexBytes)
+        {
+            memcpy(_current->data + _current->used, vertex, PlyVertexBytes);
+            _current->used += PlyVertexBytes;
+        }
+        else
+        {
+            memcpy(_current->data + _current->used, vertex, room);
+            _current->used = _bufferBytes;
+            Submit();
+            Acquire();
+            memcpy(_current->data, vertex + room, PlyVertexBytes - room);
+            _current->used = PlyVertexBytes - room;
+        }
+        _stats.points++;
+    }
+    return !_failed;
+}
+
+bool PointCloudWriter::Close()
+{
+    if (!_open)
+    {
+        return false;
+    }
+
+    // What's left: the last, partly filled block or the end of the PLY
+    bool pending = _format == PointCloud_Blocks ? ((PointBlockHeader*)_current->data)->count > 0
+                                                : _current->used > 0;
+    if (pending)
+    {
+        if (_format == PointCloud_Blocks)
+        {
+            unsigned count = ((PointBlockHeader*)_current->data)->count;
+            _current->used = BlockHeaderBytes + 8 * _blockCapacity + count;
+        }
+        Submit();
+    }
+    _current = NULL;
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _closing = true;
+    }
+    _wake.notify_all();
+    _thread.join();
+
+    bool ok = !_writeFailed && _stats.points == _promised;
+    if (_writing)
+    {
+        ok = FinishOutput(_stats.bytes) && ok;
+        CloseOutput();
+    }
+
+    for (size_t i = 0; i < _buffers.size(); i++)
+    {
+        FreeAligned(_buffers[i].data);
+    }
+    _buffers.clear();
+    _free.clear();
+    _full.clear();
+
+    _stats.wall = MillisecondsSince(_start);
+    _open = false;
+    return ok;
+}
+
+void PointCloudWriter::Submit()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _full.push_back(_current);
+    }
+    _current = NULL;
+    _wake.notify_all();
+}
+
+void PointCloudWriter::Acquire()
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _wake.wait(lock, [this] { return !_free.empty(); });
+        _current = _free.front();
+        _free.pop_front();
+        _failed = _failed || _writeFailed;
+    }
+    _stats.wait += MillisecondsSince(start);
+    _current->used = 0;
+}
+
+void PointCloudWriter::BeginBlock()
+{
+    PointBlockHeader* block = (PointBlockHeader*)_current->data;
+    memset(block, 0, sizeof(*block));
+    block->first = _stats.points;
+}
+
+void PointCloudWriter::WriteLoop()
+{
+    for (;;)
+    {
+        Buffer* buffer;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _wake.wait(lock, [this] { return !_full.empty() || _closing; });
+            if (_full.empty())
+            {
+                break;
+            }
+            buffer = _full.front();
+            _full.pop_front();
+        }
+
+        bool ok = true;
+        if (_writing)
+        {
+            // Only the last buffer is short. Bypassing the cache it still
+            // has to be a whole number of sectors, FinishOutput cuts the
+            // padding off again.
+            size_t bytes = _stats.direct ? RoundUp(buffer->used, PointCloudAlignment) : buffer->used;
+            memset(buffer->data + buffer->used, 0, bytes - buffer->used);
+
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            ok = WriteOutput(buffer->data, bytes);
+            _stats.write += MillisecondsSince(start);
+        }
+        _stats.bytes += buffer->used;
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _writeFailed = _writeFailed || !ok;
+            _free.push_back(buffer);
+        }
+        _wake.notify_all();
+    }
+}
+
+#ifdef _WIN32
+
+bool PointCloudWriter::OpenOutput(const char* path, bool direct)
+{
+    HANDLE file = INVALID_HANDLE_VALUE;
+    if (direct)
+    {
+        file = CreateFileA(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                           FILE_ATTRIBUTE_NORMAL | FILE_FLAG_NO_BUFFERING | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        _stats.direct = file != INVALID_HANDLE_VALUE;
+    }
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        file = CreateFileA(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                           FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    }
+    _file = file;
+    return file != INVALID_HANDLE_VALUE;
+}
+
+bool PointCloudWriter::WriteOutput(const unsigned char* data, size_t bytes)
+{
+    while (bytes > 0)
+    {
+        DWORD chunk = bytes < (1u << 30) ? (DWORD)bytes : (1u << 30);
+        DWORD written = 0;
+        if (!::WriteFile((HANDLE)_file, data, chunk, &written, NULL) || written == 0)
+        {
+            return false;
+        }
+        data += written;
+        bytes -= written;
+    }
+    return true;
+}
+
+bool PointCloudWriter::FinishOutput(unsigned long long bytes)
+{
+    if (!_stats.direct || bytes % PointCloudAlignment == 0)
+    {
+        return true;
+    }
+    LARGE_INTEGER size;
+    size.QuadPart = (LONGLONG)bytes;
+    return SetFilePointerEx((HANDLE)_file, size, NULL, FILE_BEGIN) && SetEndOfFile((HANDLE)_file);
+}
+
+void PointCloudWriter::CloseOutput()
+{
+    if (_file != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle((HANDLE)_file);
+        _file = INVALID_HANDLE_VALUE;
+    }
+}
+
+#else
+
+bool PointCloudWriter::OpenOutput(const char* path, bool direct)
+{
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+    int file = -1;
+#ifdef O_DIRECT
+    // File systems without it, tmpfs for one, refuse the open
+    if (direct)
+    {
+        file = open(path, flags | O_DIRECT, 0644);
+        _stats.direct = file >= 0;
+    }
+#else
+    (void)direct;
+#endif
+    if (file < 0)
+    {
+        file = open(path, flags, 0644);
+    }
+    _file = file;
+    return file >= 0;
+}
+
+bool PointCloudWriter::WriteOutput(const unsigned char* data, size_t bytes)
+{
+    while (bytes > 0)
+    {
+        ssize_t written = write(_file, data, bytes);
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (written <= 0)
+        {
+            return false;
+        }
+        data += written;
+        bytes -= (size_t)written;
+    }
+    return true;
+}
+
+bool PointCloudWriter::FinishOutput(unsigned long long bytes)
+{
+    if (!_stats.direct || bytes % PointCloudAlignment == 0)
+    {
+        return true;
+    }
+    return ftruncate(_file, (off_t)bytes) == 0;
+}
+
+void PointCloudWriter::CloseOutput()
+{
+    if (_file >= 0)
+    {
+        close(_file);
+        _file = -1;
+    }
+}
+
+#endif
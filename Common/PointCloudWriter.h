@@ -0,0 +1,144 @@
+#pragma once
+
+#include <stddef.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "VecMath.h"
+
+// Points of the chaos game with the corner each one moved halfway to,
+// streamed to a file for other tools.
+//
+// PointCloud_Blocks is structure of arrays: a PointCloudHeader padded to
+// PointCloudAlignment bytes, then blocks of blockBytes each. A block is a
+// PointBlockHeader, blockCapacity floats x, blockCapacity floats y and
+// blockCapacity corner bytes; every array starts 64 byte aligned. Only
+// the last block has fewer than blockCapacity points, and the file ends
+// after its last corner byte.
+//
+// PointCloud_Ply is binary little endian PLY, one vertex of float x,
+// float y, uchar corner per point, the corners in a comment.
+
+enum PointCloudFormat
+{
+    PointCloud_Blocks,
+    PointCloud_Ply
+};
+
+// Buffers are aligned to this and written in multiples of it, as O_DIRECT
+// and FILE_FLAG_NO_BUFFERING need
+static const size_t PointCloudAlignment = 4096;
+
+struct PointCloudHeader
+{
+    char magic[8];              // "PTCLOUD" and a zero
+    unsigned version;           // 1
+    unsigned headerBytes;       // where the first block starts
+    unsigned long long points;
+    unsigned blockCapacity;
+    unsigned blockBytes;
+    float corners[6];           // x, y of each corner of the triangle
+};
+
+struct PointBlockHeader
+{
+    unsigned long long first;   // index of the block's first point
+    unsigned count;
+    unsigned char reserved[52];
+};
+
+struct PointCloudSettings
+{
+    PointCloudFormat format;
+    size_t bufferBytes;         // rounded up to PointCloudAlignment, a block each with PointCloud_Blocks
+    unsigned buffers;           // going round between Write and the writer thread, at least 2
+    bool direct;                // bypass the OS cache where the file system allows it
+};
+
+// Milliseconds unless noted
+struct PointCloudStats
+{
+    unsigned long long points;
+    unsigned long long bytes;   // in the file
+    double wall;                // Open to Close
+    double write;               // the writer thread in write calls
+    double wait;                // Write waiting for a buffer to come back
+    bool direct;                // the OS cache was bypassed
+};
+
+// Formats points into large aligned buffers on the calling thread and
+// writes full buffers on a thread of its own, so the caller only waits
+// when the disk is slower than it is and every buffer is queued.
+class PointCloudWriter
+{
+public:
+    PointCloudWriter();
+    ~PointCloudWriter();
+
+    // points is how many Write will be given in all, it goes in the
+    // header. path NULL or empty formats the points and drops them.
+    bool Open(const char* path, PointCloudFormat format, unsigned long long points, const Float2 corners[3],
+              const PointCloudSettings& settings);
+
+    // corners[i] is 0, 1 or 2. False once a write has failed.
+    bool Write(const float* x, const float* y, const unsigned char* corners, size_t count);
+
+    // Writes what is buffered and stops the thread. False if a write
+    // failed or Write wasn't given the points promised to Open.
+    bool Close();
+
+    // Complete once Close has returned
+    const PointCloudStats& Stats() const { return _stats; }
+
+private:
+    struct Buffer
+    {
+        unsigned char* data;
+        size_t used;
+    };
+
+    PointCloudFormat _format;
+    size_t _bufferBytes;
+    size_t _blockCapacity;
+    unsigned long long _promised;
+    bool _open;
+    bool _writing;
+    bool _failed;
+    PointCloudStats _stats;
+    std::chrono::steady_clock::time_point _start;
+
+#ifdef _WIN32
+    void* _file;
+#else
+    int _file;
+#endif
+
+    std::vector<Buffer> _buffers;
+    Buffer* _current;               // being filled by Write
+
+    // Shared with the writer thread
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    std::deque<Buffer*> _full;
+    std::deque<Buffer*> _free;
+    bool _closing;
+    bool _writeFailed;
+    std::thread _thread;
+
+    bool OpenOutput(const char* path, bool direct);
+    bool WriteOutput(const unsigned char* data, size_t bytes);
+    bool FinishOutput(unsigned long long bytes);
+    void CloseOutput();
+
+    void Submit();
+    void Acquire();
+    void BeginBlock();
+    void WriteLoop();
+
+    PointCloudWriter(const PointCloudWriter&);
+    PointCloudWriter& operator=(const PointCloudWriter&);
+};
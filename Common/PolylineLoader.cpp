@@ -0,0 +1,241 @@
+#include "PolylineLoader.h"
+#include "Profiler.h"
+#include "ThreadPool.h"
+
+#include <string.h>
+#include <fstream>
+
+static double MillisecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+PolylineLoader::PolylineLoader() :
+    _transform(Matrix3x2::Identity()),
+    _state(PolylineLoad_Idle),
+    _running(false),
+    _cancel(false)
+{
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+PolylineLoader::~PolylineLoader()
+{
+    // The worker holds this pointer
+    Cancel();
+}
+
+bool PolylineLoader::Start(const std::string& path, const Matrix3x2& m, ThreadPool* pool,
+                           const PolylineReadyFunction& ready)
+{
+    if (!Begin(m, ready))
+    {
+        return false;
+    }
+    pool->Submit([this, path]() { Load(path, NULL); });
+    return true;
+}
+
+bool PolylineLoader::Start(std::istream* in, const Matrix3x2& m, ThreadPool* pool, const PolylineReadyFunction& ready)
+{
+    if (!Begin(m, ready))
+    {
+        return false;
+    }
+    pool->Submit([this, in]() { Load(std::string(), in); });
+    return true;
+}
+
+bool PolylineLoader::Begin(const Matrix3x2& m, const PolylineReadyFunction& ready)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_running)
+    {
+        return false;
+    }
+
+    _transform = m;
+    _ready = ready;
+    _start = std::chrono::steady_clock::now();
+    _completed.clear();
+    _state = PolylineLoad_Loading;
+    _running = true;
+    memset(&_stats, 0, sizeof(_stats));
+    _cancel = false;
+    return true;
+}
+
+bool PolylineLoader::Take(std::vector<PolylineBatch>* batches)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_completed.empty())
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < _completed.size(); i++)
+    {
+        batches->push_back(PolylineBatch());
+        batches->back().first = _completed[i].first;
+        batches->back().lines.swap(_completed[i].lines);
+        batches->back().bounds = _completed[i].bounds;
+    }
+    _completed.clear();
+    return true;
+}
+
+void PolylineLoader::Cancel()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _cancel = true;
+    }
+    Wait();
+}
+
+void PolylineLoader::Wait()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    _finished.wait(lock, [this] { return !_running; });
+}
+
+PolylineLoadState PolylineLoader::State() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _state;
+}
+
+PolylineLoadStats PolylineLoader::Stats() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _stats;
+}
+
+bool PolylineLoader::Cancelled()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _cancel;
+}
+
+void PolylineLoader::Load(const std::string& path, std::istream* in)
+{
+    PROFILE_ZONE("LoadPolylines");
+
+    std::ifstream file;
+    if (!in)
+    {
+        file.open(path.c_str());
+        in = &file;
+    }
+
+    int numLines = 0;
+    bool ok = in->good() && (*in >> numLines) && numLines >= 0;
+
+    PolylineBatch batch;
+    batch.first = 0;
+    size_t points = 0;
+    size_t limit = FirstBatchPoints;
+    bool cancelled = false;
+    for (int i = 0; ok && i < numLines; i++)
+    {
+        batch.lines.push_back(std::vector<Float2>());
+        if (!ReadPolyline(*in, &batch.lines.back()))
+        {
+            // Whatever came before is still worth drawing
+            batch.lines.pop_back();
+            ok = false;
+            break;
+        }
+
+        points += batch.lines.back().size();
+        if (points >= limit)
+        {
+            Publish(&batch, points);
+            batch.first = i + 1;
+            points = 0;
+            limit = limit * 2 < MaxBatchPoints ? limit * 2 : MaxBatchPoints;
+
+            // Checked between batches only, one lock per batch
+            if (Cancelled())
+            {
+                cancelled = true;
+                break;
+            }
+        }
+    }
+    if (!cancelled && !batch.lines.empty())
+    {
+        Publish(&batch, points);
+    }
+
+    PolylineReadyFunction ready;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stats.total = MillisecondsSince(_start);
+        _state = cancelled ? PolylineLoad_Cancelled : ok ? PolylineLoad_Done : PolylineLoad_Failed;
+        ready = _ready;
+    }
+
+    // Whoever ready tells sees the final state
+    if (ready)
+    {
+        ready();
+    }
+
+    // Under the lock: once Wait returns this object may be gone
+    std::lock_guard<std::mutex> lock(_mutex);
+    _running = false;
+    _finished.notify_all();
+}
+
+void PolylineLoader::Publish(PolylineBatch* batch, size_t points)
+{
+    // Transforming here keeps it off the thread that draws
+    Float2 lo(0.0f, 0.0f), hi(0.0f, 0.0f);
+    bool any = false;
+    for (size_t i = 0; i < batch->lines.size(); i++)
+    {
+        std::vector<Float2>& line = batch->lines[i];
+        for (size_t j = 0; j < line.size(); j++)
+        {
+            Float2 p = _transform.TransformPoint(line[j]);
+            line[j] = p;
+            if (!any)
+            {
+                lo = hi = p;
+                any = true;
+            }
+            lo.x = p.x < lo.x ? p.x : lo.x;
+            lo.y = p.y < lo.y ? p.y : lo.y;
+            hi.x = p.x > hi.x ? p.x : hi.x;
+            hi.y = p.y > hi.y ? p.y : hi.y;
+        }
+    }
+
+    // Half the 1 pixel stroke on each side
+    batch->bounds = any ? BoundsOf(lo, hi, 0.5f) : MakePixelRect(0, 0, 0, 0);
+
+    PolylineReadyFunction ready;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_stats.batches == 0)
+        {
+            _stats.firstBatch = MillisecondsSince(_start);
+        }
+        _stats.batches++;
+        _stats.lines += batch->lines.size();
+        _stats.points += points;
+
+        _completed.push_back(PolylineBatch());
+        _completed.back().first = batch->first;
+        _completed.back().lines.swap(batch->lines);
+        _completed.back().bounds = batch->bounds;
+        ready = _ready;
+    }
+    batch->lines.clear();
+
+    if (ready)
+    {
+        ready();
+    }
+}
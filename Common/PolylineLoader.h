@@ -0,0 +1,112 @@
+#pragma once
+
+#include <stddef.h>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <istream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "DirtyRegion.h"
+#include "Scenes.h"
+#include "VecMath.h"
+
+class ThreadPool;
+
+// Consecutive polylines of a file, already transformed
+struct PolylineBatch
+{
+    size_t first;               // index in the file of lines[0]
+    Polylines lines;
+    PixelRect bounds;           // every pixel the lines can touch
+};
+
+enum PolylineLoadState
+{
+    PolylineLoad_Idle,
+    PolylineLoad_Loading,
+    PolylineLoad_Done,
+    PolylineLoad_Failed,        // missing or malformed, what came before the error was delivered
+    PolylineLoad_Cancelled
+};
+
+// Milliseconds from Start
+struct PolylineLoadStats
+{
+    double firstBatch;          // until the first batch could be taken, 0 if there was none
+    double total;               // until loading ended
+    size_t lines;
+    size_t points;
+    unsigned batches;
+};
+
+// Called on the worker when a batch is ready to take and when loading
+// ends, e.g. to post a message to the window that takes them
+typedef std::function<void()> PolylineReadyFunction;
+
+// Reads a file in the dino.dat format on a thread pool and hands the
+// polylines over in batches, so a window can draw the first ones while
+// the rest are still being read and transformed. Batches start at
+// FirstBatchPoints points, so the first comes quickly, and double up to
+// MaxBatchPoints, so a big file doesn't cost a frame per few polylines.
+//
+// A pool task, a queue of finished batches and the ready callback, like
+// TextureStreamer, rather than a coroutine: Common is C++11 throughout, and
+// a coroutine would still have to be resumed on the window's thread by a
+// posted message.
+//
+// Call everything from one thread, the one that draws.
+class PolylineLoader
+{
+public:
+    static const size_t FirstBatchPoints = 1024;
+    static const size_t MaxBatchPoints = 1 << 16;
+
+    PolylineLoader();
+    ~PolylineLoader();
+
+    // Start reading path, its points transformed by m. The file is opened
+    // on the worker; if it can't be the load ends as Failed. False if a
+    // load is still running.
+    bool Start(const std::string& path, const Matrix3x2& m, ThreadPool* pool, const PolylineReadyFunction& ready);
+
+    // The same from a stream that outlives the load
+    bool Start(std::istream* in, const Matrix3x2& m, ThreadPool* pool, const PolylineReadyFunction& ready);
+
+    // Appends the batches finished since the last call. False if there
+    // were none.
+    bool Take(std::vector<PolylineBatch>* batches);
+
+    // Stop at the end of the batch being read and wait for the worker
+    void Cancel();
+
+    // Wait until loading ends and the worker has let go of the loader
+    void Wait();
+
+    PolylineLoadState State() const;
+    PolylineLoadStats Stats() const;
+
+private:
+    Matrix3x2 _transform;
+    PolylineReadyFunction _ready;
+    std::chrono::steady_clock::time_point _start;
+
+    // Shared with the worker
+    mutable std::mutex _mutex;
+    std::condition_variable _finished;
+    std::vector<PolylineBatch> _completed;
+    PolylineLoadState _state;
+    PolylineLoadStats _stats;
+    bool _running;              // until the worker is done with this object
+    bool _cancel;
+
+    bool Begin(const Matrix3x2& m, const PolylineReadyFunction& ready);
+    void Load(const std::string& path, std::istream* in);
+    void Publish(PolylineBatch* batch, size_t points);
+    bool Cancelled();
+
+    PolylineLoader(const PolylineLoader&);
+    PolylineLoader& operator=(const PolylineLoader&);
+};
@@ -0,0 +1,329 @@
+#include "Profiler.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#define PROFILER_RDTSC 1
+#endif
+
+// Ring of closed zones owned by one thread. Only that thread writes it;
+// head is published with release so readers see complete events.
+struct ProfileThreadBuffer
+{
+    unsigned id;
+    std::string name;
+    std::atomic<unsigned long long> head;
+    ProfileEvent events[Profiler::EventsPerThread];
+};
+
+static_assert((Profiler::EventsPerThread & (Profiler::EventsPerThread - 1)) == 0, "EventsPerThread must be a power of two");
+
+static unsigned long long ReadTicks()
+{
+#ifdef PROFILER_RDTSC
+    return __rdtsc();
+#else
+    return (unsigned long long)std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+// Pairs of (ticks, clock) taken at startup and whenever events are read,
+// to convert ticks to nanoseconds without calling the clock per zone
+static const std::chrono::steady_clock::time_point ProfilerEpoch = std::chrono::steady_clock::now();
+static const unsigned long long ProfilerEpochTicks = ReadTicks();
+
+static double NanosecondsPerTick()
+{
+#ifdef PROFILER_RDTSC
+    // Calibrate over at least 10ms
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    double elapsed = std::chrono::duration<double, std::nano>(now - ProfilerEpoch).count();
+    if (elapsed < 1e7)
+    {
+        std::this_thread::sleep_for(std::chrono::nanoseconds((long long)(1e7 - elapsed)));
+        now = std::chrono::steady_clock::now();
+        elapsed = std::chrono::duration<double, std::nano>(now - ProfilerEpoch).count();
+    }
+    unsigned long long ticks = ReadTicks() - ProfilerEpochTicks;
+    return ticks ? elapsed / ticks : 1.0;
+#else
+    return (double)std::chrono::steady_clock::period::num * 1e9 / std::chrono::steady_clock::period::den;
+#endif
+}
+
+static thread_local ProfileThreadBuffer* t_buffer = NULL;
+static thread_local unsigned t_depth = 0;
+
+// Buffers are never freed, a thread's events stay readable after it exits
+static std::mutex& RegistryMutex()
+{
+    static std::mutex mutex;
+    return mutex;
+}
+
+static std::vector<ProfileThreadBuffer*>& Registry()
+{
+    static std::vector<ProfileThreadBuffer*> buffers;
+    return buffers;
+}
+
+static ProfileThreadBuffer* RegisterThread()
+{
+    ProfileThreadBuffer* buffer = new ProfileThreadBuffer;
+    buffer->head.store(0, std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lock(RegistryMutex());
+    buffer->id = (unsigned)Registry().size() + 1;
+    Registry().push_back(buffer);
+    t_buffer = buffer;
+    return buffer;
+}
+
+unsigned long long Profiler::Now()
+{
+    return ReadTicks();
+}
+
+unsigned& Profiler::Depth()
+{
+    return t_depth;
+}
+
+void Profiler::SetThreadName(const char* name)
+{
+    ProfileThreadBuffer* buffer = t_buffer ? t_buffer : RegisterThread();
+
+    std::lock_guard<std::mutex> lock(RegistryMutex());
+    buffer->name = name;
+}
+
+void Profiler::Record(const char* name, unsigned long long begin, unsigned long long end, unsigned depth)
+{
+    ProfileThreadBuffer* buffer = t_buffer;
+    if (!buffer)
+    {
+        buffer = RegisterThread();
+    }
+
+    unsigned long long head = buffer->head.load(std::memory_order_relaxed);
+    ProfileEvent& event = buffer->events[head & (EventsPerThread - 1)];
+    event.name = name;
+    event.begin = begin;
+    event.end = end;
+    event.depth = depth;
+    buffer->head.store(head + 1, std::memory_order_release);
+}
+
+void Profiler::Collect(std::vector<ProfileEvent>* events, std::vector<unsigned>* threads)
+{
+    events->clear();
+    if (threads)
+    {
+        threads->clear();
+    }
+
+    double scale = NanosecondsPerTick();
+
+    std::lock_guard<std::mutex> lock(RegistryMutex());
+    std::vector<ProfileThreadBuffer*>& buffers = Registry();
+    for (size_t i = 0; i < buffers.size(); i++)
+    {
+        ProfileThreadBuffer* buffer = buffers[i];
+        unsigned long long head = buffer->head.load(std::memory_order_acquire);
+        unsigned long long first = head > EventsPerThread ? head - EventsPerThread : 0;
+
+        size_t start = events->size();
+        for (unsigned long long j = first; j < head; j++)
+        {
+            events->push_back(buffer->events[j & (EventsPerThread - 1)]);
+        }
+
+        // Drop whatever the owner overwrote while we were copying
+        unsigned long long after = buffer->head.load(std::memory_order_acquire);
+        unsigned long long valid = after > EventsPerThread ? after - EventsPerThread : 0;
+        size_t skip = valid > first ? (size_t)std::min(valid - first, head - first) : 0;
+        events->erase(events->begin() + start, events->begin() + start + skip);
+
+        for (size_t j = start; j < events->size(); j++)
+        {
+            ProfileEvent& event = (*events)[j];
+            event.begin = (unsigned long long)((long long)(event.begin - ProfilerEpochTicks) * scale);
+            event.end = (unsigned long long)((long long)(event.end - ProfilerEpochTicks) * scale);
+        }
+
+        if (threads)
+        {
+            threads->resize(events->size(), buffer->id);
+        }
+    }
+}
+
+void Profiler::Summarize(std::vector<ProfileZoneStats>* zones)
+{
+    std::vector<ProfileEvent> events;
+    Collect(&events, NULL);
+
+    // Group by text, the same literal may have several addresses
+    std::map<std::string, std::vector<double> > durations;
+    std::map<std::string, const char*> names;
+    for (size_t i = 0; i < events.size(); i++)
+    {
+        durations[events[i].name].push_back((events[i].end - events[i].begin) * 0.001);
+        names[events[i].name] = events[i].name;
+    }
+
+    zones->clear();
+    for (std::map<std::string, std::vector<double> >::iterator it = durations.begin(); it != durations.end(); ++it)
+    {
+        std::vector<double>& d = it->second;
+        std::sort(d.begin(), d.end());
+
+        double total = 0.0;
+        for (size_t i = 0; i < d.size(); i++)
+        {
+            total += d[i];
+        }
+
+        // Nearest rank
+        ProfileZoneStats zone;
+        zone.name = names[it->first];
+        zone.count = d.size();
+        zone.p50 = d[(d.size() - 1) * 50 / 100];
+        zone.p95 = d[(d.size() - 1) * 95 / 100];
+        zone.p99 = d[(d.size() - 1) * 99 / 100];
+        zone.mean = total / d.size();
+        zone.max = d.back();
+        zones->push_back(zone);
+    }
+
+    std::sort(zones->begin(), zones->end(), [](const ProfileZoneStats& a, const ProfileZoneStats& b) {
+        return a.mean * a.count > b.mean * b.count;
+    });
+}
+
+std::string Profiler::Report()
+{
+    std::vector<ProfileZoneStats> zones;
+    Summarize(&zones);
+
+    std::ostringstream out;
+    char line[256];
+    snprintf(line, sizeof(line), "%-24s %8s %10s %10s %10s %10s\n", "zone (us)", "count", "p50", "p95", "p99", "max");
+    out << line;
+    for (size_t i = 0; i < zones.size(); i++)
+    {
+        snprintf(line, sizeof(line), "%-24s %8u %10.2f %10.2f %10.2f %10.2f\n", zones[i].name, (unsigned)zones[i].count,
+                 zones[i].p50, zones[i].p95, zones[i].p99, zones[i].max);
+        out << line;
+    }
+    return out.str();
+}
+
+static void WriteJsonString(FILE* file, const char* s)
+{
+    fputc('"', file);
+    for (; *s; s++)
+    {
+        if (*s == '"' || *s == '\\')
+        {
+            fputc('\\', file);
+            fputc(*s, file);
+        }
+        else if ((unsigned char)*s < 0x20)
+        {
+            fprintf(file, "\\u%04x", (unsigned char)*s);
+        }
+        else
+        {
+            fputc(*s, file);
+        }
+    }
+    fputc('"', file);
+}
+
+bool Profiler::WriteChromeTrace(const char* path)
+{
+    std::vector<ProfileEvent> events;
+    std::vector<unsigned> threads;
+    Collect(&events, &threads);
+
+    FILE* file = fopen(path, "w");
+    if (!file)
+    {
+        return false;
+    }
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+
+    {
+        std::lock_guard<std::mutex> lock(RegistryMutex());
+        std::vector<ProfileThreadBuffer*>& buffers = Registry();
+        for (size_t i = 0; i < buffers.size(); i++)
+        {
+            if (buffers[i]->name.empty())
+            {
+                continue;
+            }
+            fprintf(file, "%s{\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"name\":\"thread_name\",\"args\":{\"name\":",
+                    first ? "" : ",\n", buffers[i]->id);
+            WriteJsonString(file, buffers[i]->name.c_str());
+            fprintf(file, "}}");
+            first = false;
+        }
+    }
+
+    // Complete events, timestamps in microseconds
+    for (size_t i = 0; i < events.size(); i++)
+    {
+        fprintf(file, "%s{\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"name\":", first ? "" : ",\n", threads[i]);
+        WriteJsonString(file, events[i].name);
+        fprintf(file, ",\"ts\":%.3f,\"dur\":%.3f}", events[i].begin * 0.001, (events[i].end - events[i].begin) * 0.001);
+        first = false;
+    }
+
+    fprintf(file, "\n]}\n");
+    bool ok = ferror(file) == 0;
+    return fclose(file) == 0 && ok;
+}
+
+double Profiler::MeasureZoneOverhead(unsigned iterations)
+{
+    if (iterations == 0)
+    {
+        return 0.0;
+    }
+
+    // On a thread of its own so the caller's buffer keeps its events
+    double result = 0.0;
+    std::thread thread([&] {
+        SetThreadName("Profiler overhead");
+
+        // Warm up so the page faults in the buffer aren't counted
+        for (unsigned i = 0; i < EventsPerThread; i++)
+        {
+            ProfileZone zone("ProfilerOverhead");
+        }
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (unsigned i = 0; i < iterations; i++)
+        {
+            ProfileZone zone("ProfilerOverhead");
+        }
+        result = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / iterations;
+    });
+    thread.join();
+    return result;
+}
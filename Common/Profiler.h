@@ -0,0 +1,108 @@
+#pragma once
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+// Compile zones out with PROFILER_ENABLED=0
+#ifndef PROFILER_ENABLED
+#define PROFILER_ENABLED 1
+#endif
+
+// One closed zone. name must be a string literal or otherwise outlive the
+// profiler, only the pointer is stored.
+struct ProfileEvent
+{
+    const char* name;
+    unsigned long long begin;   // ns since the profiler started, ticks while buffered
+    unsigned long long end;
+    unsigned depth;             // nesting level on its thread, 0 at the top
+};
+
+// Timings of one zone over the events still in the ring buffers
+struct ProfileZoneStats
+{
+    const char* name;
+    size_t count;
+    double p50, p95, p99;       // microseconds
+    double mean, max;
+};
+
+// Scoped CPU profiler.
+//
+// Each thread writes closed zones to its own ring buffer, so opening and
+// closing a zone takes no lock. The global lock is only taken the first
+// time a thread records anything, to register its buffer. The buffers keep
+// the most recent EventsPerThread zones, which is the window the
+// percentiles and the trace cover. Reading another thread's buffer while
+// it records is safe but may miss the events it is overwriting.
+class Profiler
+{
+public:
+    static const size_t EventsPerThread = 1 << 15;
+
+    // Timestamp counter, or the steady clock where there is none. Only
+    // converted to ns when events are read.
+    static unsigned long long Now();
+
+    // Name shown for the calling thread in the trace
+    static void SetThreadName(const char* name);
+
+    // Appends a closed zone to the calling thread's buffer
+    static void Record(const char* name, unsigned long long begin, unsigned long long end, unsigned depth);
+
+    // Nesting level of the next zone opened on the calling thread
+    static unsigned& Depth();
+
+    // Copy of every thread's buffered events, oldest first per thread
+    static void Collect(std::vector<ProfileEvent>* events, std::vector<unsigned>* threads);
+
+    // Percentiles per zone name, sorted by total time
+    static void Summarize(std::vector<ProfileZoneStats>* zones);
+
+    // One line per zone, for the debug output
+    static std::string Report();
+
+    // Chrome trace event JSON, open it in chrome://tracing or Perfetto
+    static bool WriteChromeTrace(const char* path);
+
+    // Average cost of one empty zone in ns. Runs on a new thread, which
+    // shows up in the trace as "Profiler overhead".
+    static double MeasureZoneOverhead(unsigned iterations);
+};
+
+// Records the time between construction and destruction
+class ProfileZone
+{
+public:
+    explicit ProfileZone(const char* name) :
+        _name(name),
+        _depth(Profiler::Depth()++),
+        _begin(Profiler::Now())
+    {
+    }
+
+    ~ProfileZone()
+    {
+        unsigned long long end = Profiler::Now();
+        Profiler::Depth()--;
+        Profiler::Record(_name, _begin, end, _depth);
+    }
+
+private:
+    const char* _name;
+    unsigned _depth;
+    unsigned long long _begin;
+
+    ProfileZone(const ProfileZone&);
+    ProfileZone& operator=(const ProfileZone&);
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+#if PROFILER_ENABLED
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#else
+#define PROFILE_ZONE(name) do {} while (0)
+#endif
@@ -0,0 +1,168 @@
+#include "RingVertexAllocator.h"
+
+#include <string.h>
+
+RingVertexAllocator::RingVertexAllocator(DynamicBufferBackend* backend) :
+    _backend(backend),
+    _capacity(backend->Capacity()),
+    _head(0),
+    _used(0),
+    _frameBytes(0),
+    _frame(0),
+    _mapped(false),
+    _needsDiscard(true)
+{
+    ResetStats();
+}
+
+void RingVertexAllocator::ResetStats()
+{
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+void RingVertexAllocator::BeginFrame()
+{
+    _frame++;
+    _frameBytes = 0;
+    Retire();
+}
+
+void RingVertexAllocator::EndFrame()
+{
+    if (_frameBytes > 0)
+    {
+        FrameMark mark = { _frame, _frameBytes };
+        _frames.push_back(mark);
+        _frameBytes = 0;
+    }
+    _backend->SignalFrame(_frame);
+}
+
+void RingVertexAllocator::Retire()
+{
+    unsigned long long completed = _backend->CompletedFrame();
+    while (!_frames.empty() && _frames.front().frame <= completed)
+    {
+        _used -= _frames.front().bytes;
+        _frames.pop_front();
+    }
+}
+
+bool RingVertexAllocator::Fit(size_t bytes, size_t alignment, size_t* offset, size_t* consumed) const
+{
+    size_t aligned = (_head + alignment - 1) / alignment * alignment;
+    if (aligned + bytes <= _capacity)
+    {
+        *offset = aligned;
+        *consumed = aligned + bytes - _head;
+    }
+    else
+    {
+        // Skip the tail of the buffer and start over at the front
+        *offset = 0;
+        *consumed = _capacity - _head + bytes;
+    }
+    return _used + *consumed <= _capacity;
+}
+
+bool RingVertexAllocator::Allocate(size_t bytes, size_t alignment, RingAllocation* allocation)
+{
+    if (_mapped || bytes == 0 || bytes > _capacity)
+    {
+        _stats.failures++;
+        return false;
+    }
+    if (alignment == 0)
+    {
+        alignment = 1;
+    }
+
+    DynamicMapMode mode = DynamicMap_NoOverwrite;
+    size_t offset, consumed;
+
+    if (!Fit(bytes, alignment, &offset, &consumed))
+    {
+        Retire();
+    }
+    while (!Fit(bytes, alignment, &offset, &consumed))
+    {
+        if (_backend->SupportsDiscard())
+        {
+            // Give the old contents to the driver and start a fresh buffer.
+            // Frames still in flight keep reading the orphaned copy.
+            _frames.clear();
+            _used = 0;
+            _head = 0;
+            _frameBytes = 0;
+            mode = DynamicMap_Discard;
+        }
+        else if (!_frames.empty())
+        {
+            _stats.stalls++;
+            _backend->WaitForFrame(_frames.front().frame);
+            Retire();
+        }
+        else
+        {
+            // The current frame alone has filled the buffer
+            _stats.failures++;
+            return false;
+        }
+    }
+    if (_needsDiscard)
+    {
+        mode = DynamicMap_Discard;
+    }
+
+    unsigned char* base = _backend->Map(mode);
+    if (!base)
+    {
+        _stats.failures++;
+        return false;
+    }
+    _mapped = true;
+    _needsDiscard = false;
+
+    if (mode == DynamicMap_Discard)
+    {
+        _stats.discardMaps++;
+    }
+    else
+    {
+        _stats.noOverwriteMaps++;
+    }
+    _stats.allocations++;
+    _stats.bytesAllocated += bytes;
+    _stats.bytesWasted += consumed - bytes;
+
+    _head = offset + bytes;
+    _used += consumed;
+    _frameBytes += consumed;
+
+    allocation->data = base + offset;
+    allocation->offset = offset;
+    allocation->size = bytes;
+    return true;
+}
+
+void RingVertexAllocator::Commit()
+{
+    if (_mapped)
+    {
+        _backend->Unmap();
+        _mapped = false;
+    }
+}
+
+bool RingVertexAllocator::Upload(const void* data, size_t bytes, size_t alignment, size_t* offset)
+{
+    RingAllocation allocation;
+    if (!Allocate(bytes, alignment, &allocation))
+    {
+        return false;
+    }
+    memcpy(allocation.data, data, bytes);
+    Commit();
+    *offset = allocation.offset;
+    return true;
+}
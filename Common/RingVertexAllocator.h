@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stddef.h>
+#include <deque>
+
+#include "DynamicBuffer.h"
+
+// A block of the dynamic buffer handed out by the ring allocator.
+// data stays writable until RingVertexAllocator::Commit is called.
+struct RingAllocation
+{
+    unsigned char* data;
+    size_t offset;
+    size_t size;
+};
+
+struct RingAllocatorStats
+{
+    unsigned long long allocations;
+    unsigned long long bytesAllocated;
+    unsigned long long bytesWasted;     // alignment padding and skipped tails on wrap
+    unsigned long long noOverwriteMaps;
+    unsigned long long discardMaps;
+    unsigned long long stalls;          // times we had to wait on a frame fence
+    unsigned long long failures;
+};
+
+// Suballocates per-frame geometry out of one large dynamic buffer.
+// Writes go through NO_OVERWRITE maps while there is room ahead of the
+// oldest frame the GPU may still be reading. When the ring runs into that
+// frame we either DISCARD (the driver renames the buffer) or wait on the
+// frame's fence if the backend cannot rename.
+class RingVertexAllocator
+{
+public:
+    RingVertexAllocator(DynamicBufferBackend* backend);
+
+    // Open a new frame. Every allocation until EndFrame belongs to it.
+    void BeginFrame();
+
+    // Close the frame and signal its fence on the backend
+    void EndFrame();
+
+    // Reserve bytes aligned to alignment and map them for writing.
+    // Must be followed by Commit before the next allocation.
+    bool Allocate(size_t bytes, size_t alignment, RingAllocation* allocation);
+    void Commit();
+
+    // Allocate, copy and commit in one step
+    bool Upload(const void* data, size_t bytes, size_t alignment, size_t* offset);
+
+    // Bytes reserved by frames the GPU has not finished yet
+    size_t BytesInFlight() const { return _used; }
+    size_t FramesInFlight() const { return _frames.size(); }
+    unsigned long long CurrentFrame() const { return _frame; }
+
+    const RingAllocatorStats& Stats() const { return _stats; }
+    void ResetStats();
+
+private:
+    struct FrameMark
+    {
+        unsigned long long frame;
+        size_t bytes;
+    };
+
+    DynamicBufferBackend* _backend;
+    std::deque<FrameMark> _frames;
+    size_t _capacity;
+    size_t _head;
+    size_t _used;
+    size_t _frameBytes;
+    unsigned long long _frame;
+    bool _mapped;
+    bool _needsDiscard;
+    RingAllocatorStats _stats;
+
+    // Release the space of frames whose fences have passed
+    void Retire();
+
+    // Work out where an allocation goes. Returns false if it does not fit
+    // without touching memory that may still be in use.
+    bool Fit(size_t bytes, size_t alignment, size_t* offset, size_t* consumed) const;
+};
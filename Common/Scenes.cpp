@@ -0,0 +1,360 @@
+#include "Scenes.h"
+#include "CommandBuffer.h"
+#include "SoftwareRaster.h"
+#include "Telemetry.h"
+#include "ThreadPool.h"
+
+#include <math.h>
+
+// Colors of the D2D brushes the apps use
+static const unsigned White = PackRgba(255, 255, 255);
+static const unsigned DarkGreen = PackRgba(0, 100, 0);
+
+// Size of the window the D2D apps are written against
+static const float AppWidth = 640.0f;
+static const float AppHeight = 480.0f;
+
+void DefaultSierpinski(unsigned width, unsigned height, size_t iterations, unsigned long long rngSeed,
+                       SierpinskiParams* params)
+{
+    float inset = 0.05f * (width < height ? width : height);
+    params->corners[0] = Float2(width * 0.5f, inset);
+    params->corners[1] = Float2(inset, height - inset);
+    params->corners[2] = Float2(width - inset, height - inset);
+    params->seed = (params->corners[0] + params->corners[1] + params->corners[2]) * (1.0f / 3.0f);
+    params->iterations = iterations;
+    params->rngSeed = rngSeed;
+}
+
+static Float2 Midpoint(Float2 a, Float2 b)
+{
+    return Float2((a.x + b.x) / 2, (a.y + b.y) / 2);
+}
+
+// Calls visit(i, point, corner) for the points of one chunk, in order,
+// corner being the one the point moved halfway to. Chunk 0
+// starts at the seed like the app does. The others start at a corner,
+// which is already on the attractor, so no chunk adds stray points.
+template<typename Visit>
+static void WalkChaosChunk(const SierpinskiParams& params, size_t chunk, Visit visit)
+{
+    SceneRandom random(params.rngSeed * 0x100000001B3ULL + chunk);
+    Float2 point = chunk == 0 ? params.seed : params.corners[random.Below(3)];
+
+    size_t first = chunk * ChaosChunkSize;
+    size_t last = first + ChaosChunkSize < params.iterations ? first + ChaosChunkSize : params.iterations;
+    for (size_t i = first; i < last; i++)
+    {
+        unsigned corner = random.Below(3);
+        point = Midpoint(params.corners[corner], point);
+        visit(i, point, corner);
+    }
+}
+
+size_t ChaosChunkCount(const SierpinskiParams& params)
+{
+    return (params.iterations + ChaosChunkSize - 1) / ChaosChunkSize;
+}
+
+void GenerateChaosPoints(const SierpinskiParams& params, Float2* out, ThreadPool* pool)
+{
+    if (params.iterations == 0)
+    {
+        return;
+    }
+
+    size_t chunks = ChaosChunkCount(params);
+    std::function<void(size_t, size_t)> body = [&](size_t begin, size_t end) {
+        for (size_t chunk = begin; chunk < end; chunk++)
+        {
+            WalkChaosChunk(params, chunk, [out](size_t i, Float2 point, unsigned) { out[i] = point; });
+        }
+    };
+
+    if (pool)
+    {
+        pool->ParallelFor(chunks, 1, body);
+    }
+    else
+    {
+        body(0, chunks);
+    }
+    Telemetry::Add(Telemetry_ChaosIterations, params.iterations);
+}
+
+void GenerateChaosPoints(const SierpinskiParams& params, std::vector<Float2>* points, ThreadPool* pool)
+{
+    points->resize(params.iterations);
+    if (!points->empty())
+    {
+        GenerateChaosPoints(params, &(*points)[0], pool);
+    }
+}
+
+void GenerateChaosSamples(const SierpinskiParams& params, size_t firstChunk, size_t endChunk, float* x, float* y,
+                          unsigned char* corners, ThreadPool* pool)
+{
+    size_t chunks = ChaosChunkCount(params);
+    endChunk = endChunk < chunks ? endChunk : chunks;
+    if (firstChunk >= endChunk)
+    {
+        return;
+    }
+
+    size_t first = firstChunk * ChaosChunkSize;
+    std::function<void(size_t, size_t)> body = [&](size_t begin, size_t end) {
+        for (size_t chunk = firstChunk + begin; chunk < firstChunk + end; chunk++)
+        {
+            WalkChaosChunk(params, chunk, [=](size_t i, Float2 point, unsigned corner) {
+                x[i - first] = point.x;
+                y[i - first] = point.y;
+                corners[i - first] = (unsigned char)corner;
+            });
+        }
+    };
+
+    if (pool)
+    {
+        pool->ParallelFor(endChunk - firstChunk, 1, body);
+    }
+    else
+    {
+        body(0, endChunk - firstChunk);
+    }
+
+    size_t last = endChunk * ChaosChunkSize < params.iterations ? endChunk * ChaosChunkSize : params.iterations;
+    Telemetry::Add(Telemetry_ChaosIterations, last - first);
+}
+
+void AccumulateChaosDensity(const SierpinskiParams& params, size_t firstChunk, size_t endChunk, unsigned width,
+                            unsigned height, unsigned* density)
+{
+    size_t chunks = ChaosChunkCount(params);
+    endChunk = endChunk < chunks ? endChunk : chunks;
+    for (size_t chunk = firstChunk; chunk < endChunk; chunk++)
+    {
+        WalkChaosChunk(params, chunk, [=](size_t, Float2 point, unsigned) {
+            // Unsigned compares drop negative coordinates too
+            unsigned x = (unsigned)(int)floorf(point.x), y = (unsigned)(int)floorf(point.y);
+            if (x < width && y < height)
+            {
+                density[(size_t)y * width + x]++;
+            }
+        });
+    }
+
+    size_t first = firstChunk * ChaosChunkSize, last = endChunk * ChaosChunkSize;
+    last = last < params.iterations ? last : params.iterations;
+    Telemetry::Add(Telemetry_ChaosIterations, last > first ? last - first : 0);
+}
+
+void RenderDensity(const unsigned* density, unsigned width, unsigned height, Image* image)
+{
+    if (image->Width() != width || image->Height() != height)
+    {
+        image->Resize(width, height);
+    }
+
+    size_t count = (size_t)width * height;
+    unsigned peak = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        peak = density[i] > peak ? density[i] : peak;
+    }
+
+    // Log scaled so single hits still show next to the dense corners
+    float scale = peak > 0 ? 1.0f / logf(1.0f + peak) : 0.0f;
+    unsigned* pixels = image->Pixels();
+    for (size_t i = 0; i < count; i++)
+    {
+        float shade = logf(1.0f + density[i]) * scale;
+        unsigned char level = (unsigned char)(255.0f - 255.0f * shade + 0.5f);
+        pixels[i] = PackRgba(level, level, level);
+    }
+}
+
+void RecordSierpinski(const SierpinskiParams& params, const Float2* points, size_t count, CommandBuffer* commands)
+{
+    commands->SetTransform(Matrix3x2::Identity());
+    commands->Clear(White);
+    for (int i = 0; i < 3; i++)
+    {
+        commands->DrawCross(params.corners[i], 4.0f, DarkGreen);
+    }
+    commands->DrawCross(params.seed, 4.0f, DarkGreen);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        commands->DrawCross(points[i], 2.0f, DarkGreen);
+    }
+}
+
+void RecordSierpinski(const SierpinskiParams& params, const Float2* points, size_t count, const DirtyRegion& region,
+                      CommandBuffer* commands)
+{
+    commands->SetTransform(Matrix3x2::Identity());
+    for (size_t r = 0; r < region.Count(); r++)
+    {
+        const PixelRect& rect = region.Rect(r);
+        commands->SetClip(rect);
+        commands->Clear(White);
+        RecordCrosses(params.corners, 3, 4.0f, DarkGreen, rect, commands);
+        RecordCrosses(&params.seed, 1, 4.0f, DarkGreen, rect, commands);
+        RecordCrosses(points, count, 2.0f, DarkGreen, rect, commands);
+    }
+}
+
+void RecordCrosses(const Float2* centers, size_t count, float size, unsigned color, const PixelRect& rect,
+                   CommandBuffer* commands)
+{
+    // Grow the rect by the arms instead of bounding every cross, with a
+    // pixel to spare for rounding; the clip trims what this lets through
+    float loX = rect.left - size - 1.0f, hiX = rect.right + size + 1.0f;
+    float loY = rect.top - size - 1.0f, hiY = rect.bottom + size + 1.0f;
+    for (size_t i = 0; i < count; i++)
+    {
+        Float2 c = centers[i];
+        if (c.x >= loX && c.x <= hiX && c.y >= loY && c.y <= hiY)
+        {
+            commands->DrawCross(c, size, color);
+        }
+    }
+}
+
+void RenderSierpinski(const SierpinskiParams& params, const std::vector<Float2>& points, Image* image)
+{
+    CommandBuffer commands;
+    RecordSierpinski(params, points.empty() ? NULL : &points[0], points.size(), &commands);
+
+    SoftwareCommandBackend backend(image);
+    commands.Replay(&backend);
+}
+
+// Most a count read from a file reserves up front
+static const int MaxReservedCount = 1 << 16;
+
+bool ReadPolyline(std::istream& in, std::vector<Float2>* line)
+{
+    int numPoints;
+    if (!(in >> numPoints) || numPoints < 0)
+    {
+        return false;
+    }
+
+    // The count is only a hint: a corrupt one mustn't allocate more than
+    // the file can fill
+    line->clear();
+    line->reserve(numPoints < MaxReservedCount ? numPoints : MaxReservedCount);
+    for (int j = 0; j < numPoints; j++)
+    {
+        Float2 point;
+        if (!(in >> point.x >> point.y))
+        {
+            return false;
+        }
+        line->push_back(point);
+    }
+    return true;
+}
+
+bool ReadPolylines(std::istream& in, Polylines* lines)
+{
+    lines->clear();
+
+    int numLines;
+    if (!(in >> numLines) || numLines < 0)
+    {
+        return false;
+    }
+
+    lines->reserve(numLines < MaxReservedCount ? numLines : MaxReservedCount);
+    for (int i = 0; i < numLines; i++)
+    {
+        lines->push_back(std::vector<Float2>());
+        if (!ReadPolyline(in, &lines->back()))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+Float2 PolylineCenter(const Polylines& lines)
+{
+    double x = 0.0, y = 0.0;
+    size_t count = 0;
+    for (size_t i = 0; i < lines.size(); i++)
+    {
+        for (size_t j = 0; j < lines[i].size(); j++)
+        {
+            x += lines[i][j].x;
+            y += lines[i][j].y;
+        }
+        count += lines[i].size();
+    }
+    return count ? Float2((float)(x / count), (float)(y / count)) : Float2(0.0f, 0.0f);
+}
+
+Matrix3x2 TransformSceneMatrix(const Polylines& lines, const TransformParams& params, unsigned width, unsigned height)
+{
+    // The app draws (x, 440 - y)
+    Matrix3x2 flip = {1.0f, 0.0f, 0.0f, -1.0f, 0.0f, 440.0f};
+    Float2 center = flip.TransformPoint(PolylineCenter(lines));
+
+    return flip *
+           Matrix3x2::Scale(params.scale, params.scale, center) *
+           Matrix3x2::Rotation(params.rotation, center) *
+           Matrix3x2::Translation(params.translation.x, params.translation.y) *
+           Matrix3x2::Scale(width / AppWidth, height / AppHeight);
+}
+
+void RecordPolylines(const Polylines& lines, const Matrix3x2& m, CommandBuffer* commands)
+{
+    commands->SetTransform(Matrix3x2::Identity());
+    commands->Clear(White);
+    commands->SetTransform(m);
+    for (size_t i = 0; i < lines.size(); i++)
+    {
+        const std::vector<Float2>& line = lines[i];
+        for (size_t j = 0; j + 1 < line.size(); j++)
+        {
+            commands->DrawLine(line[j], line[j + 1], DarkGreen);
+        }
+    }
+}
+
+void RenderPolylines(const Polylines& lines, const Matrix3x2& m, Image* image)
+{
+    CommandBuffer commands;
+    RecordPolylines(lines, m, &commands);
+
+    SoftwareCommandBackend backend(image);
+    commands.Replay(&backend);
+}
+
+void TriangleVertices(Float2 positions[3], Float4 colors[3])
+{
+    positions[0] = Float2(0.0f, 0.5f);
+    positions[1] = Float2(0.45f, -0.5f);
+    positions[2] = Float2(-0.45f, -0.5f);
+    colors[0] = Float4(1.0f, 0.0f, 0.0f, 1.0f);
+    colors[1] = Float4(0.0f, 1.0f, 0.0f, 1.0f);
+    colors[2] = Float4(0.0f, 0.0f, 1.0f, 1.0f);
+}
+
+void RenderTriangle(Image* image)
+{
+    Float2 ndc[3];
+    Float4 colors[3];
+    TriangleVertices(ndc, colors);
+
+    // Viewport transform, NDC y is up
+    Float2 positions[3];
+    for (int i = 0; i < 3; i++)
+    {
+        positions[i] = Float2((ndc[i].x + 1.0f) * 0.5f * image->Width(), (1.0f - ndc[i].y) * 0.5f * image->Height());
+    }
+
+    image->Clear(PackColor(Float4(0.0f, 0.8f, 0.2f, 1.0f)));
+    FillTriangle(image, positions, colors);
+}
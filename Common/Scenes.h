@@ -0,0 +1,135 @@
+#pragma once
+
+#include <stddef.h>
+#include <istream>
+#include <vector>
+
+#include "DirtyRegion.h"
+#include "VecMath.h"
+
+class CommandBuffer;
+class Image;
+class ThreadPool;
+
+// The sample scenes without a window, shared by the apps and the headless
+// renderer. Coordinates are in pixels of the target, y down.
+
+// splitmix64, small and reproducible across platforms unlike rand()
+class SceneRandom
+{
+public:
+    explicit SceneRandom(unsigned long long seed) : _state(seed) {}
+
+    unsigned long long Next()
+    {
+        unsigned long long z = (_state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    // Uniform in [0, n)
+    unsigned Below(unsigned n) { return (unsigned)(((Next() >> 32) * n) >> 32); }
+
+private:
+    unsigned long long _state;
+};
+
+//
+// Sierpinski: the chaos game
+//
+
+struct SierpinskiParams
+{
+    Float2 corners[3];
+    Float2 seed;                // first point, the fourth click in the app
+    size_t iterations;
+    unsigned long long rngSeed;
+};
+
+// Points in chunks of this many; each chunk has its own random stream so
+// the result doesn't depend on how many threads generated it
+static const size_t ChaosChunkSize = 1 << 16;
+
+// Corners inset from the edges of a width x height target, seed at the
+// centroid
+void DefaultSierpinski(unsigned width, unsigned height, size_t iterations, unsigned long long rngSeed,
+                       SierpinskiParams* params);
+
+// The midpoints the app draws, in order, params.iterations of them. pool
+// may be NULL.
+void GenerateChaosPoints(const SierpinskiParams& params, Float2* points, ThreadPool* pool);
+void GenerateChaosPoints(const SierpinskiParams& params, std::vector<Float2>* points, ThreadPool* pool);
+
+// Chunks of params.iterations
+size_t ChaosChunkCount(const SierpinskiParams& params);
+
+// The points of chunks [firstChunk, endChunk) as arrays, point i of the
+// game at index i - firstChunk * ChaosChunkSize, with the corner (0 to 2)
+// each one moved halfway to. The same points GenerateChaosPoints gives.
+// pool may be NULL.
+void GenerateChaosSamples(const SierpinskiParams& params, size_t firstChunk, size_t endChunk, float* x, float* y,
+                          unsigned char* corners, ThreadPool* pool);
+
+// Adds one to density[y * width + x] for each point of chunks [firstChunk,
+// endChunk) that lands inside width x height. Every chunk has its own
+// random stream, so splitting the chunks over threads or processes and
+// adding the histograms up gives exactly the histogram of all of them.
+void AccumulateChaosDensity(const SierpinskiParams& params, size_t firstChunk, size_t endChunk, unsigned width,
+                            unsigned height, unsigned* density);
+
+// Black where points are densest, log scaled down to white where none landed
+void RenderDensity(const unsigned* density, unsigned width, unsigned height, Image* image);
+
+// White background, the corners and points as crosses, like the app
+void RecordSierpinski(const SierpinskiParams& params, const Float2* points, size_t count, CommandBuffer* commands);
+
+// Only the dirty part: each rectangle is clipped, cleared and given the
+// crosses that touch it. Replayed over the previous frame it leaves the
+// same pixels as recording everything.
+void RecordSierpinski(const SierpinskiParams& params, const Float2* points, size_t count, const DirtyRegion& region,
+                      CommandBuffer* commands);
+
+// The crosses of arm size around centers that touch rect
+void RecordCrosses(const Float2* centers, size_t count, float size, unsigned color, const PixelRect& rect,
+                   CommandBuffer* commands);
+void RenderSierpinski(const SierpinskiParams& params, const std::vector<Float2>& points, Image* image);
+
+//
+// Transform: polylines from dino.dat
+//
+
+typedef std::vector<std::vector<Float2> > Polylines;
+
+// The dino.dat format: the number of polylines, then for each one its
+// point count followed by x y pairs. False if the data is malformed.
+bool ReadPolylines(std::istream& in, Polylines* lines);
+
+// One polyline of that format, its point count and points
+bool ReadPolyline(std::istream& in, std::vector<Float2>* line);
+
+// Average of all points
+Float2 PolylineCenter(const Polylines& lines);
+
+struct TransformParams
+{
+    float rotation;             // degrees, about the center of the drawing
+    float scale;                // about the center of the drawing
+    Float2 translation;
+};
+
+// Where the Transform app puts dino.dat in its 640 x 480 window (y flipped
+// about 440), then params, then stretched to width x height
+Matrix3x2 TransformSceneMatrix(const Polylines& lines, const TransformParams& params, unsigned width, unsigned height);
+
+void RecordPolylines(const Polylines& lines, const Matrix3x2& m, CommandBuffer* commands);
+void RenderPolylines(const Polylines& lines, const Matrix3x2& m, Image* image);
+
+//
+// 2DTest: the colored triangle
+//
+
+// Vertices in normalized device coordinates with their colors
+void TriangleVertices(Float2 positions[3], Float4 colors[3]);
+
+void RenderTriangle(Image* image);
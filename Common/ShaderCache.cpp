@@ -0,0 +1,210 @@
+#include "ShaderCache.h"
+#include "Telemetry.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+
+#ifdef _WIN32
+#include <direct.h>
+#define MakeDirectory(path) _mkdir(path)
+#else
+#include <sys/stat.h>
+#define MakeDirectory(path) mkdir(path, 0755)
+#endif
+
+// Cache file layout: header followed by the bytecode
+struct ShaderCacheHeader
+{
+    unsigned magic;
+    unsigned version;
+    unsigned long long key;
+    unsigned long long checksum;
+    unsigned long long size;
+};
+
+static const unsigned ShaderCacheMagic = 0x43535844; // "DXSC"
+static const unsigned ShaderCacheVersion = 1;
+
+static const unsigned long long FnvOffset = 14695981039346656037ULL;
+static const unsigned long long FnvPrime = 1099511628211ULL;
+
+static unsigned long long Fnv1a(unsigned long long hash, const void* data, size_t size)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= FnvPrime;
+    }
+    return hash;
+}
+
+// Length prefixed so that ("ab", "c") and ("a", "bc") hash differently
+static unsigned long long HashString(unsigned long long hash, const std::string& s)
+{
+    unsigned long long length = s.size();
+    hash = Fnv1a(hash, &length, sizeof(length));
+    return Fnv1a(hash, s.data(), s.size());
+}
+
+static double MillisecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+ShaderCache::ShaderCache(const std::string& directory, const ShaderCompiler& compiler) :
+    _directory(directory),
+    _compiler(compiler)
+{
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+unsigned long long ShaderCache::Key(const ShaderSource& source) const
+{
+    unsigned long long hash = FnvOffset;
+    hash = HashString(hash, _compilerVersion);
+    hash = HashString(hash, source.text);
+    hash = HashString(hash, source.entryPoint);
+    hash = HashString(hash, source.profile);
+    hash = Fnv1a(hash, &source.flags, sizeof(source.flags));
+
+    unsigned long long defines = source.defines.size();
+    hash = Fnv1a(hash, &defines, sizeof(defines));
+    for (size_t i = 0; i < source.defines.size(); i++)
+    {
+        hash = HashString(hash, source.defines[i].name);
+        hash = HashString(hash, source.defines[i].value);
+    }
+    return hash;
+}
+
+std::string ShaderCache::PathFor(unsigned long long key) const
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.cso", key);
+    return _directory + "/" + name;
+}
+
+bool ShaderCache::ReadEntry(unsigned long long key, std::vector<unsigned char>* bytecode)
+{
+    FILE* file = fopen(PathFor(key).c_str(), "rb");
+    if (!file)
+    {
+        return false;
+    }
+
+    ShaderCacheHeader header;
+    bool ok = fread(&header, sizeof(header), 1, file) == 1 &&
+              header.magic == ShaderCacheMagic &&
+              header.version == ShaderCacheVersion &&
+              header.key == key &&
+              header.size > 0 && header.size < (1ULL << 30);
+    if (ok)
+    {
+        bytecode->resize((size_t)header.size);
+        ok = fread(&(*bytecode)[0], 1, bytecode->size(), file) == bytecode->size() &&
+             Fnv1a(FnvOffset, &(*bytecode)[0], bytecode->size()) == header.checksum;
+    }
+    fclose(file);
+
+    if (!ok)
+    {
+        _stats.rejected++;
+        bytecode->clear();
+    }
+    return ok;
+}
+
+bool ShaderCache::WriteEntry(unsigned long long key, const std::vector<unsigned char>& bytecode)
+{
+    MakeDirectory(_directory.c_str());
+
+    // Write to a temporary name and rename, so a crash never leaves a
+    // truncated entry under the real name
+    std::string path = PathFor(key);
+    std::string temp = path + ".tmp";
+    FILE* file = fopen(temp.c_str(), "wb");
+    if (!file)
+    {
+        return false;
+    }
+
+    ShaderCacheHeader header;
+    header.magic = ShaderCacheMagic;
+    header.version = ShaderCacheVersion;
+    header.key = key;
+    header.checksum = Fnv1a(FnvOffset, &bytecode[0], bytecode.size());
+    header.size = bytecode.size();
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+              fwrite(&bytecode[0], 1, bytecode.size(), file) == bytecode.size();
+    ok = fclose(file) == 0 && ok;
+
+    remove(path.c_str());
+    if (!ok || rename(temp.c_str(), path.c_str()) != 0)
+    {
+        remove(temp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool ShaderCache::Load(const ShaderSource& source, std::vector<unsigned char>* bytecode, std::string* errors)
+{
+    unsigned long long key = Key(source);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    bool hit = ReadEntry(key, bytecode);
+    _stats.loadMs += MillisecondsSince(start);
+
+    if (hit)
+    {
+        _stats.hits++;
+        Telemetry::Add(Telemetry_CacheHits);
+        return true;
+    }
+    _stats.misses++;
+    Telemetry::Add(Telemetry_CacheMisses);
+
+    start = std::chrono::steady_clock::now();
+    bool compiled = _compiler(source, bytecode, errors);
+    _stats.compileMs += MillisecondsSince(start);
+
+    if (!compiled || bytecode->empty())
+    {
+        _stats.failures++;
+        return false;
+    }
+
+    // A failed store only costs us a recompile next time
+    start = std::chrono::steady_clock::now();
+    WriteEntry(key, *bytecode);
+    _stats.storeMs += MillisecondsSince(start);
+    return true;
+}
+
+std::string ShaderCache::Report() const
+{
+    char line[256];
+    snprintf(line, sizeof(line),
+             "shader cache: %u hits, %u misses, %u failed, %u rejected, compile %.2f ms, load %.2f ms, store %.2f ms",
+             _stats.hits, _stats.misses, _stats.failures, _stats.rejected,
+             _stats.compileMs, _stats.loadMs, _stats.storeMs);
+    return line;
+}
+
+bool ReadTextFile(const std::string& path, std::string* text)
+{
+    std::ifstream file(path.c_str(), std::ios::in | std::ios::binary);
+    if (!file.good())
+    {
+        return false;
+    }
+    std::ostringstream contents;
+    contents << file.rdbuf();
+    *text = contents.str();
+    return true;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+
+struct ShaderDefine
+{
+    std::string name;
+    std::string value;
+};
+
+// Everything that determines the compiled bytecode of one shader.
+// The source is hashed as a whole; #includes are not followed.
+struct ShaderSource
+{
+    std::string fileName;       // only used for error messages
+    std::string text;
+    std::string entryPoint;
+    std::string profile;
+    std::vector<ShaderDefine> defines;
+    unsigned flags;             // passed to the compiler, e.g. D3D10_SHADER_DEBUG
+
+    ShaderSource() : flags(0) {}
+};
+
+// Compiles a shader. Returns false and fills errors on failure.
+typedef std::function<bool(const ShaderSource& source, std::vector<unsigned char>* bytecode, std::string* errors)> ShaderCompiler;
+
+struct ShaderCacheStats
+{
+    unsigned hits;
+    unsigned misses;
+    unsigned failures;
+    unsigned rejected;          // cache files that were stale or corrupt
+    double compileMs;           // time spent in the compiler
+    double loadMs;              // time spent reading cache files
+    double storeMs;             // time spent writing cache files
+};
+
+// Disk cache of compiled shader bytecode keyed by a hash of the source,
+// entry point, profile, defines, flags and compiler version. The compiler is
+// only invoked on a miss.
+class ShaderCache
+{
+public:
+    ShaderCache(const std::string& directory, const ShaderCompiler& compiler);
+
+    // Part of every key, so that bumping it invalidates the whole cache
+    void SetCompilerVersion(const std::string& version) { _compilerVersion = version; }
+
+    // Fetch bytecode from the cache or compile it
+    bool Load(const ShaderSource& source, std::vector<unsigned char>* bytecode, std::string* errors);
+
+    // Cache key of a shader
+    unsigned long long Key(const ShaderSource& source) const;
+
+    // Path of the cache file for a key
+    std::string PathFor(unsigned long long key) const;
+
+    const ShaderCacheStats& Stats() const { return _stats; }
+
+    // One line summary of the stats, for logging startup cost
+    std::string Report() const;
+
+private:
+    std::string _directory;
+    std::string _compilerVersion;
+    ShaderCompiler _compiler;
+    ShaderCacheStats _stats;
+
+    bool ReadEntry(unsigned long long key, std::vector<unsigned char>* bytecode);
+    bool WriteEntry(unsigned long long key, const std::vector<unsigned char>& bytecode);
+};
+
+// Read a whole file into a string. Returns false if it cannot be opened.
+bool ReadTextFile(const std::string& path, std::string* text);
@@ -0,0 +1,113 @@
+#include "SharedMemory.h"
+
+#include <stdio.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+SharedMemory::SharedMemory() :
+    _data(NULL),
+    _size(0),
+    _handle(NULL)
+{
+    _name[0] = '\0';
+}
+
+SharedMemory::~SharedMemory()
+{
+    Close();
+}
+
+bool SharedMemory::Create(const char* name, size_t size)
+{
+    return Map(name, size, true);
+}
+
+bool SharedMemory::Open(const char* name, size_t size)
+{
+    return Map(name, size, false);
+}
+
+bool SharedMemory::Map(const char* name, size_t size, bool create)
+{
+    Close();
+
+#ifdef _WIN32
+    unsigned long long bytes = size;
+    HANDLE mapping = create ? CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, (DWORD)(bytes >> 32),
+                                                 (DWORD)bytes, name)
+                            : OpenFileMappingA(FILE_MAP_READ | FILE_MAP_WRITE, FALSE, name);
+    if (!mapping)
+    {
+        return false;
+    }
+
+    // A view past the end of an existing mapping fails, which covers one
+    // that's too small
+    void* data = MapViewOfFile(mapping, FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, size);
+    if (!data)
+    {
+        CloseHandle(mapping);
+        return false;
+    }
+    _handle = mapping;
+#else
+    int fd = shm_open(name, create ? O_CREAT | O_RDWR : O_RDWR, 0644);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat info;
+    bool sized = create ? ftruncate(fd, (off_t)size) == 0
+                        : fstat(fd, &info) == 0 && (size_t)info.st_size >= size;
+    void* data = sized ? mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        if (create)
+        {
+            shm_unlink(name);
+        }
+        return false;
+    }
+    if (create)
+    {
+        snprintf(_name, sizeof(_name), "%s", name);
+    }
+#endif
+
+    _data = data;
+    _size = size;
+    return true;
+}
+
+void SharedMemory::Close()
+{
+    if (!_data)
+    {
+        return;
+    }
+
+#ifdef _WIN32
+    UnmapViewOfFile(_data);
+    CloseHandle((HANDLE)_handle);
+#else
+    munmap(_data, _size);
+    if (_name[0])
+    {
+        shm_unlink(_name);
+    }
+#endif
+
+    _data = NULL;
+    _size = 0;
+    _handle = NULL;
+    _name[0] = '\0';
+}
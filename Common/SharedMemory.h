@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stddef.h>
+
+// Named memory that several processes map at once: a paging file backed
+// mapping on Windows, shm_open under /dev/shm elsewhere. Names are passed
+// to the OS as they are, so "Local\..." on Windows and "/..." elsewhere.
+class SharedMemory
+{
+public:
+    SharedMemory();
+    ~SharedMemory();
+
+    // Creates the segment, or takes over one left by a process that
+    // crashed; the contents are then whatever it left. Closing unlinks it
+    // on Linux, Windows drops it with the last handle.
+    bool Create(const char* name, size_t size);
+
+    // Maps a segment another process created. False if it doesn't exist
+    // or is smaller than size.
+    bool Open(const char* name, size_t size);
+
+    void Close();
+
+    // Mapped read/write on both ends: on 32-bit x86 a 64-bit atomic load
+    // is a locked cmpxchg8b, which faults on a read-only page
+    void* Data() const { return _data; }
+    size_t Size() const { return _size; }
+
+private:
+    void* _data;
+    size_t _size;
+    void* _handle;
+    char _name[128];            // to unlink, Linux and creator only
+
+    bool Map(const char* name, size_t size, bool create);
+
+    SharedMemory(const SharedMemory&);
+    SharedMemory& operator=(const SharedMemory&);
+};
@@ -0,0 +1,350 @@
+#include "SoftwareRaster.h"
+
+#include <math.h>
+#include <stdio.h>
+
+static unsigned char ToByte(float f)
+{
+    if (f <= 0.0f)
+    {
+        return 0;
+    }
+    if (f >= 1.0f)
+    {
+        return 255;
+    }
+    return (unsigned char)(f * 255.0f + 0.5f);
+}
+
+unsigned PackColor(Float4 color)
+{
+    return PackRgba(ToByte(color.x), ToByte(color.y), ToByte(color.z), ToByte(color.w));
+}
+
+void Image::Resize(unsigned width, unsigned height)
+{
+    _width = width;
+    _height = height;
+    _pixels.assign((size_t)width * height, 0);
+    ResetClip();
+}
+
+void Image::SetClip(const PixelRect& rect)
+{
+    _clip = Intersect(rect, MakePixelRect(0, 0, (int)_width, (int)_height));
+    if (::IsEmpty(_clip))
+    {
+        _clip = MakePixelRect(0, 0, 0, 0);
+    }
+}
+
+void Image::Clear(unsigned color)
+{
+    if (_clip.left == 0 && _clip.top == 0 && _clip.right == (int)_width && _clip.bottom == (int)_height)
+    {
+        _pixels.assign(_pixels.size(), color);
+        return;
+    }
+
+    for (int y = _clip.top; y < _clip.bottom; y++)
+    {
+        unsigned* row = Row(y);
+        for (int x = _clip.left; x < _clip.right; x++)
+        {
+            row[x] = color;
+        }
+    }
+}
+
+bool Image::WritePpm(const char* path) const
+{
+    FILE* file = fopen(path, "wb");
+    if (!file)
+    {
+        return false;
+    }
+
+    fprintf(file, "P6\n%u %u\n255\n", _width, _height);
+
+    std::vector<unsigned char> row((size_t)_width * 3);
+    for (unsigned y = 0; y < _height; y++)
+    {
+        const unsigned* src = Row(y);
+        for (unsigned x = 0; x < _width; x++)
+        {
+            row[x * 3 + 0] = (unsigned char)(src[x]);
+            row[x * 3 + 1] = (unsigned char)(src[x] >> 8);
+            row[x * 3 + 2] = (unsigned char)(src[x] >> 16);
+        }
+        if (!row.empty())
+        {
+            fwrite(&row[0], 1, row.size(), file);
+        }
+    }
+
+    bool ok = ferror(file) == 0;
+    return fclose(file) == 0 && ok;
+}
+
+bool Image::ReadPpm(const char* path)
+{
+    FILE* file = fopen(path, "rb");
+    if (!file)
+    {
+        return false;
+    }
+
+    unsigned width, height, maxValue;
+    bool ok = fscanf(file, "P6 %u %u %u", &width, &height, &maxValue) == 3 && maxValue == 255 && fgetc(file) != EOF;
+    if (ok)
+    {
+        Resize(width, height);
+        std::vector<unsigned char> row((size_t)width * 3);
+        for (unsigned y = 0; ok && y < height; y++)
+        {
+            ok = row.empty() || fread(&row[0], 1, row.size(), file) == row.size();
+            unsigned* dst = Row(y);
+            for (unsigned x = 0; ok && x < width; x++)
+            {
+                dst[x] = PackRgba(row[x * 3 + 0], row[x * 3 + 1], row[x * 3 + 2]);
+            }
+        }
+    }
+
+    fclose(file);
+    return ok;
+}
+
+bool ClipSegment(Float2* a, Float2* b, float loX, float loY, float hiX, float hiY)
+{
+    float t0 = 0.0f, t1 = 1.0f;
+    float dx = b->x - a->x, dy = b->y - a->y;
+    float p[4] = {-dx, dx, -dy, dy};
+    float q[4] = {a->x - loX, hiX - a->x, a->y - loY, hiY - a->y};
+
+    for (int i = 0; i < 4; i++)
+    {
+        if (p[i] == 0.0f)
+        {
+            if (q[i] < 0.0f)
+            {
+                return false;
+            }
+            continue;
+        }
+
+        float t = q[i] / p[i];
+        if (p[i] < 0.0f)
+        {
+            if (t > t1)
+            {
+                return false;
+            }
+            if (t > t0)
+            {
+                t0 = t;
+            }
+        }
+        else
+        {
+            if (t < t0)
+            {
+                return false;
+            }
+            if (t < t1)
+            {
+                t1 = t;
+            }
+        }
+    }
+
+    Float2 start = *a;
+    *a = Float2(start.x + t0 * dx, start.y + t0 * dy);
+    *b = Float2(start.x + t1 * dx, start.y + t1 * dy);
+    return true;
+}
+
+void DrawLine(Image* image, Float2 a, Float2 b, unsigned color)
+{
+    if (image->Width() == 0 || image->Height() == 0)
+    {
+        return;
+    }
+
+    // Pixel (x, y) covers [x, x + 1), its center is x + 0.5
+    a = a - Float2(0.5f, 0.5f);
+    b = b - Float2(0.5f, 0.5f);
+
+    // Most lines are well inside and need no clipping
+    const PixelRect& clip = image->Clip();
+    float loX = clip.left - 0.5f, loY = clip.top - 0.5f, hiX = clip.right - 0.5f, hiY = clip.bottom - 0.5f;
+    bool inside = a.x >= loX && a.x < hiX && a.y >= loY && a.y < hiY &&
+                  b.x >= loX && b.x < hiX && b.y >= loY && b.y < hiY;
+    if (!inside)
+    {
+        // Entirely to one side of the clip
+        if ((a.x < loX && b.x < loX) || (a.x >= hiX && b.x >= hiX) || (a.y < loY && b.y < loY) ||
+            (a.y >= hiY && b.y >= hiY))
+        {
+            return;
+        }
+
+        // Cut to the image, not the clip: moving the ends would move the
+        // pixels Bresenham picks, and a line redrawn in pieces has to match
+        // the one drawn whole. SetPixel drops what is outside the clip.
+        if (!ClipSegment(&a, &b, -0.5f, -0.5f, image->Width() - 0.5f, image->Height() - 0.5f))
+        {
+            return;
+        }
+    }
+
+    // Both ends are at least -0.5 now, so truncating rounds down
+    int x0 = (int)(a.x + 0.5f), y0 = (int)(a.y + 0.5f);
+    int x1 = (int)(b.x + 0.5f), y1 = (int)(b.y + 0.5f);
+
+    // Horizontal and vertical spans, like the arms of DrawCross, without
+    // the stepping
+    if (inside && y0 == y1)
+    {
+        unsigned* row = image->Row(y0);
+        for (int x = x0 < x1 ? x0 : x1, end = x0 < x1 ? x1 : x0; x <= end; x++)
+        {
+            row[x] = color;
+        }
+        return;
+    }
+    if (inside && x0 == x1)
+    {
+        unsigned width = image->Width();
+        unsigned* p = image->Row(y0 < y1 ? y0 : y1) + x0;
+        for (int n = y0 < y1 ? y1 - y0 : y0 - y1; n >= 0; n--, p += width)
+        {
+            *p = color;
+        }
+        return;
+    }
+
+    // Bresenham
+    int dx = x1 > x0 ? x1 - x0 : x0 - x1;
+    int dy = y1 > y0 ? y0 - y1 : y1 - y0;
+    int sx = x0 < x1 ? 1 : -1;
+    int sy = y0 < y1 ? 1 : -1;
+    int err = dx + dy;
+    for (;;)
+    {
+        image->SetPixel(x0, y0, color);
+        if (x0 == x1 && y0 == y1)
+        {
+            break;
+        }
+        int e2 = 2 * err;
+        if (e2 >= dy)
+        {
+            err += dy;
+            x0 += sx;
+        }
+        if (e2 <= dx)
+        {
+            err += dx;
+            y0 += sy;
+        }
+    }
+}
+
+void DrawCross(Image* image, Float2 center, int size, unsigned color)
+{
+    int cx = (int)floorf(center.x);
+    int cy = (int)floorf(center.y);
+    for (int i = -size; i <= size; i++)
+    {
+        image->SetPixel(cx + i, cy, color);
+        image->SetPixel(cx, cy + i, color);
+    }
+}
+
+// Twice the signed area of (a, b, p), positive when p is left of a->b on a
+// y-down target
+static float Edge(Float2 a, Float2 b, float px, float py)
+{
+    return (b.x - a.x) * (py - a.y) - (b.y - a.y) * (px - a.x);
+}
+
+// Top-left rule: pixels exactly on a top or left edge belong to the triangle.
+// a->b follows the winding FillTriangle puts the vertices in.
+static bool IsTopLeft(Float2 a, Float2 b)
+{
+    return (a.y == b.y && b.x < a.x) || a.y < b.y;
+}
+
+void FillTriangle(Image* image, const Float2 positions[3], const Float4 colors[3])
+{
+    Float2 v[3] = {positions[0], positions[1], positions[2]};
+    Float4 c[3] = {colors[0], colors[1], colors[2]};
+
+    float area = Edge(v[0], v[1], v[2].x, v[2].y);
+    if (area == 0.0f)
+    {
+        return;
+    }
+    if (area > 0.0f)
+    {
+        // Make the winding clockwise on screen so inside is negative
+        Float2 tv = v[1]; v[1] = v[2]; v[2] = tv;
+        Float4 tc = c[1]; c[1] = c[2]; c[2] = tc;
+        area = -area;
+    }
+
+    float minX = v[0].x, maxX = v[0].x, minY = v[0].y, maxY = v[0].y;
+    for (int i = 1; i < 3; i++)
+    {
+        minX = v[i].x < minX ? v[i].x : minX;
+        maxX = v[i].x > maxX ? v[i].x : maxX;
+        minY = v[i].y < minY ? v[i].y : minY;
+        maxY = v[i].y > maxY ? v[i].y : maxY;
+    }
+
+    int x0 = (int)floorf(minX), x1 = (int)ceilf(maxX);
+    int y0 = (int)floorf(minY), y1 = (int)ceilf(maxY);
+    const PixelRect& clip = image->Clip();
+    x0 = x0 < clip.left ? clip.left : x0;
+    y0 = y0 < clip.top ? clip.top : y0;
+    x1 = x1 > clip.right ? clip.right : x1;
+    y1 = y1 > clip.bottom ? clip.bottom : y1;
+    if (x0 >= x1 || y0 >= y1)
+    {
+        return;
+    }
+
+    // Edge i is opposite vertex i
+    Float2 ea[3] = {v[1], v[2], v[0]};
+    Float2 eb[3] = {v[2], v[0], v[1]};
+    bool topLeft[3];
+    for (int i = 0; i < 3; i++)
+    {
+        topLeft[i] = IsTopLeft(ea[i], eb[i]);
+    }
+
+    float inv = 1.0f / area;
+    for (int y = y0; y < y1; y++)
+    {
+        unsigned* row = image->Row(y);
+        float py = y + 0.5f;
+        for (int x = x0; x < x1; x++)
+        {
+            float px = x + 0.5f;
+            float w0 = Edge(ea[0], eb[0], px, py);
+            float w1 = Edge(ea[1], eb[1], px, py);
+            float w2 = Edge(ea[2], eb[2], px, py);
+            // Inside is w < 0, and w == 0 counts only on top-left edges
+            if (w0 > 0.0f || w1 > 0.0f || w2 > 0.0f ||
+                (w0 == 0.0f && !topLeft[0]) || (w1 == 0.0f && !topLeft[1]) || (w2 == 0.0f && !topLeft[2]))
+            {
+                continue;
+            }
+
+            float b0 = w0 * inv, b1 = w1 * inv, b2 = w2 * inv;
+            Float4 color = c[0] * b0 + c[1] * b1 + c[2] * b2;
+            row[x] = PackColor(color);
+        }
+    }
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+#include "DirtyRegion.h"
+#include "VecMath.h"
+
+// 8-bit RGBA packed with red in the low byte, so the bytes in memory are
+// R, G, B, A like DXGI_FORMAT_R8G8B8A8_UNORM
+inline unsigned PackRgba(unsigned char r, unsigned char g, unsigned char b, unsigned char a = 255)
+{
+    return r | (g << 8) | (b << 16) | ((unsigned)a << 24);
+}
+
+unsigned PackColor(Float4 color);
+
+// CPU render target
+class Image
+{
+public:
+    Image() : _width(0), _height(0) { ResetClip(); }
+    Image(unsigned width, unsigned height) { Resize(width, height); }
+
+    void Resize(unsigned width, unsigned height);
+
+    unsigned Width() const { return _width; }
+    unsigned Height() const { return _height; }
+
+    unsigned* Row(unsigned y) { return &_pixels[(size_t)y * _width]; }
+    const unsigned* Row(unsigned y) const { return &_pixels[(size_t)y * _width]; }
+    unsigned* Pixels() { return _pixels.empty() ? NULL : &_pixels[0]; }
+    const unsigned* Pixels() const { return _pixels.empty() ? NULL : &_pixels[0]; }
+
+    // Clear, SetPixel and the drawing functions only touch pixels inside
+    // the clip, the whole image until SetClip. Resize resets it.
+    void SetClip(const PixelRect& rect);
+    void ResetClip() { _clip = MakePixelRect(0, 0, (int)_width, (int)_height); }
+    const PixelRect& Clip() const { return _clip; }
+
+    void Clear(unsigned color);
+
+    void SetPixel(int x, int y, unsigned color)
+    {
+        if (x >= _clip.left && x < _clip.right && y >= _clip.top && y < _clip.bottom)
+        {
+            _pixels[(size_t)y * _width + x] = color;
+        }
+    }
+
+    // Binary PPM (P6), alpha dropped
+    bool WritePpm(const char* path) const;
+
+    // Reads what WritePpm writes, alpha set to 255
+    bool ReadPpm(const char* path);
+
+private:
+    unsigned _width;
+    unsigned _height;
+    PixelRect _clip;
+    std::vector<unsigned> _pixels;
+};
+
+// Cuts a->b to [lo, hi] on both axes with Liang-Barsky, false if nothing
+// is left
+bool ClipSegment(Float2* a, Float2* b, float loX, float loY, float hiX, float hiY);
+
+// One pixel wide line between pixel centers, clipped to the image's clip.
+// The pixels set are the same ones an unclipped line sets inside the clip.
+void DrawLine(Image* image, Float2 a, Float2 b, unsigned color);
+
+// The plus sign Sierpinski draws for a point, arms of size pixels
+void DrawCross(Image* image, Float2 center, int size, unsigned color);
+
+// Gouraud shaded triangle with the top-left fill rule, either winding
+void FillTriangle(Image* image, const Float2 positions[3], const Float4 colors[3]);
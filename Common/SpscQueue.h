@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stddef.h>
+#include <atomic>
+#include <vector>
+
+// Bounded lock-free queue for exactly one producer thread and one consumer
+// thread. Capacity is rounded up to a power of two. Each side keeps a
+// cached copy of the other side's index so the shared cache lines are
+// only touched when the queue looks full or empty.
+template<typename T>
+class SpscQueue
+{
+public:
+    explicit SpscQueue(size_t capacity) :
+        _head(0),
+        _cachedTail(0),
+        _tail(0),
+        _cachedHead(0)
+    {
+        size_t size = 1;
+        while (size < capacity)
+        {
+            size <<= 1;
+        }
+        _slots.resize(size);
+        _mask = size - 1;
+    }
+
+    size_t Capacity() const { return _slots.size(); }
+
+    // Producer side. Returns false if the queue is full.
+    bool TryPush(const T& item)
+    {
+        size_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail - _cachedHead == _slots.size())
+        {
+            _cachedHead = _head.load(std::memory_order_acquire);
+            if (tail - _cachedHead == _slots.size())
+            {
+                return false;
+            }
+        }
+        _slots[tail & _mask] = item;
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side. Returns false if the queue is empty.
+    bool TryPop(T* item)
+    {
+        size_t head = _head.load(std::memory_order_relaxed);
+        if (head == _cachedTail)
+        {
+            _cachedTail = _tail.load(std::memory_order_acquire);
+            if (head == _cachedTail)
+            {
+                return false;
+            }
+        }
+        *item = _slots[head & _mask];
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Approximate when called while the other side is running
+    size_t Size() const
+    {
+        return _tail.load(std::memory_order_acquire) - _head.load(std::memory_order_acquire);
+    }
+
+private:
+    std::vector<T> _slots;
+    size_t _mask;
+
+    // Consumer owned
+    alignas(64) std::atomic<size_t> _head;
+    size_t _cachedTail;
+
+    // Producer owned
+    alignas(64) std::atomic<size_t> _tail;
+    size_t _cachedHead;
+
+    SpscQueue(const SpscQueue&);
+    SpscQueue& operator=(const SpscQueue&);
+};
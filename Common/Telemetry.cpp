@@ -0,0 +1,158 @@
+#include "Telemetry.h"
+
+#include <stdio.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+static const char* CounterNames[TelemetryCounterCount] =
+{
+    "frames",
+    "draw calls",
+    "primitives",
+    "vertices",
+    "upload bytes",
+    "allocations",
+    "chaos iterations",
+    "cache hits",
+    "cache misses",
+    "pixels redrawn"
+};
+
+// Where the counters live until Publish, and again after Unpublish.
+// Zeroed before any constructor runs, so counting works from the start.
+static TelemetryBlock s_localBlock;
+
+std::atomic<TelemetryBlock*> Telemetry::s_block(&s_localBlock);
+
+// The published segment, NULL while counting in process memory
+static SharedMemory* s_segment = NULL;
+
+static unsigned CurrentProcessId()
+{
+#ifdef _WIN32
+    return (unsigned)GetCurrentProcessId();
+#else
+    return (unsigned)getpid();
+#endif
+}
+
+bool Telemetry::Publish(const char* app)
+{
+    Unpublish();
+
+    char name[128];
+    SegmentName(app, name, sizeof(name));
+
+    SharedMemory* segment = new SharedMemory;
+    if (!segment->Create(name, sizeof(TelemetryBlock)))
+    {
+        delete segment;
+        return false;
+    }
+    TelemetryBlock* block = (TelemetryBlock*)segment->Data();
+
+    // The segment may be left over from a run that crashed, hide it from
+    // readers until it's filled in again
+    block->magic.store(0, std::memory_order_relaxed);
+    block->version = TelemetryVersion;
+    block->counterCount = TelemetryCounterCount;
+    block->processId = CurrentProcessId();
+    for (int i = 0; i < TelemetryCounterCount; i++)
+    {
+        block->counters[i].store(s_localBlock.counters[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+    block->magic.store(TelemetryMagic, std::memory_order_release);
+
+    s_segment = segment;
+    s_block.store(block, std::memory_order_release);
+    return true;
+}
+
+void Telemetry::Unpublish()
+{
+    if (!s_segment)
+    {
+        return;
+    }
+
+    TelemetryBlock* shared = (TelemetryBlock*)s_segment->Data();
+    for (int i = 0; i < TelemetryCounterCount; i++)
+    {
+        s_localBlock.counters[i].store(shared->counters[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+    s_block.store(&s_localBlock, std::memory_order_release);
+
+    // Readers still mapping it see it go stale
+    shared->magic.store(0, std::memory_order_release);
+    delete s_segment;
+    s_segment = NULL;
+}
+
+const char* Telemetry::Name(TelemetryCounter counter)
+{
+    return counter < TelemetryCounterCount ? CounterNames[counter] : "";
+}
+
+void Telemetry::SegmentName(const char* app, char* name, size_t size)
+{
+#ifdef _WIN32
+    snprintf(name, size, "Local\\DXPlayground.Telemetry.%s", app);
+#else
+    snprintf(name, size, "/dxplayground.telemetry.%s", app);
+#endif
+}
+
+TelemetryReader::TelemetryReader() :
+    _block(NULL)
+{
+}
+
+TelemetryReader::~TelemetryReader()
+{
+    Close();
+}
+
+bool TelemetryReader::Open(const char* app)
+{
+    Close();
+
+    char name[128];
+    Telemetry::SegmentName(app, name, sizeof(name));
+    if (!_segment.Open(name, sizeof(TelemetryBlock)))
+    {
+        return false;
+    }
+    _block = (const TelemetryBlock*)_segment.Data();
+
+    if (_block->magic.load(std::memory_order_acquire) != TelemetryMagic || _block->version != TelemetryVersion ||
+        _block->counterCount != TelemetryCounterCount)
+    {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+void TelemetryReader::Close()
+{
+    _segment.Close();
+    _block = NULL;
+}
+
+bool TelemetryReader::Read(unsigned long long* counters) const
+{
+    if (!_block || _block->magic.load(std::memory_order_acquire) != TelemetryMagic)
+    {
+        return false;
+    }
+
+    for (int i = 0; i < TelemetryCounterCount; i++)
+    {
+        counters[i] = _block->counters[i].load(std::memory_order_relaxed);
+    }
+    return true;
+}
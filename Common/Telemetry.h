@@ -0,0 +1,98 @@
+#pragma once
+
+#include <stddef.h>
+#include <atomic>
+
+#include "SharedMemory.h"
+
+// Counters the render paths bump as they work, published in shared memory
+// so another process can watch a running app without attaching to it.
+// Every counter only grows; a reader samples twice and divides the
+// difference by the time between the samples.
+
+enum TelemetryCounter
+{
+    Telemetry_Frames,
+    Telemetry_DrawCalls,            // D3D Draw and D2D DrawLine calls
+    Telemetry_Primitives,           // lines, triangles or points drawn, on any backend
+    Telemetry_Vertices,             // generated or packed on the CPU
+    Telemetry_UploadBytes,          // copied into vertex buffers
+    Telemetry_Allocations,          // heap blocks the render path took
+    Telemetry_ChaosIterations,
+    Telemetry_CacheHits,            // shader and texture caches
+    Telemetry_CacheMisses,
+    Telemetry_PixelsRedrawn,
+    TelemetryCounterCount
+};
+
+static const unsigned TelemetryMagic = 0x4D4C4554;     // "TELM" in memory
+static const unsigned TelemetryVersion = 1;
+
+// Layout of the shared segment. magic is written last, so a reader that
+// sees it sees the rest. The counters are lock-free 64-bit atomics, which
+// work across processes on the platforms this builds for.
+struct TelemetryBlock
+{
+    std::atomic<unsigned> magic;
+    unsigned version;
+    unsigned counterCount;
+    unsigned processId;
+    std::atomic<unsigned long long> counters[TelemetryCounterCount];
+};
+
+class Telemetry
+{
+public:
+    // Moves the counters into a segment named after app, see SegmentName,
+    // keeping what they counted so far. Until then, or if that fails, they
+    // count in process memory. Call before other threads start counting,
+    // adds racing with the move may be lost.
+    static bool Publish(const char* app);
+
+    // Back to process memory; on Linux the segment is unlinked too
+    static void Unpublish();
+
+    // One relaxed atomic add, safe from any thread
+    static void Add(TelemetryCounter counter, unsigned long long value = 1)
+    {
+        s_block.load(std::memory_order_relaxed)->counters[counter].fetch_add(value, std::memory_order_relaxed);
+    }
+
+    static unsigned long long Get(TelemetryCounter counter)
+    {
+        return s_block.load(std::memory_order_relaxed)->counters[counter].load(std::memory_order_relaxed);
+    }
+
+    static const char* Name(TelemetryCounter counter);
+
+    // "Local\DXPlayground.Telemetry.<app>" on Windows,
+    // "/dxplayground.telemetry.<app>" under /dev/shm elsewhere
+    static void SegmentName(const char* app, char* name, size_t size);
+
+private:
+    static std::atomic<TelemetryBlock*> s_block;
+};
+
+// Maps another process's counters read-only
+class TelemetryReader
+{
+public:
+    TelemetryReader();
+    ~TelemetryReader();
+
+    // False if app hasn't published or publishes another version
+    bool Open(const char* app);
+    void Close();
+
+    // False if the segment went stale, counters holds TelemetryCounterCount
+    bool Read(unsigned long long* counters) const;
+
+    unsigned ProcessId() const { return _block ? _block->processId : 0; }
+
+private:
+    SharedMemory _segment;
+    const TelemetryBlock* _block;
+
+    TelemetryReader(const TelemetryReader&);
+    TelemetryReader& operator=(const TelemetryReader&);
+};
@@ -0,0 +1,358 @@
+#include "TextureStreamer.h"
+#include "Telemetry.h"
+#include "ThreadPool.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <utility>
+
+static bool ReadBinaryFile(const std::string& path, std::vector<unsigned char>* data)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file)
+    {
+        return false;
+    }
+
+    bool ok = fseek(file, 0, SEEK_END) == 0;
+    long size = ok ? ftell(file) : -1;
+    ok = size >= 0 && fseek(file, 0, SEEK_SET) == 0;
+    if (ok)
+    {
+        data->resize((size_t)size);
+        ok = size == 0 || fread(&(*data)[0], 1, (size_t)size, file) == (size_t)size;
+    }
+
+    fclose(file);
+    return ok;
+}
+
+bool DecodePassThrough(const std::string&, std::vector<unsigned char>& fileData, DecodedTexture* texture)
+{
+    texture->width = 0;
+    texture->height = 0;
+    texture->encoded = true;
+    texture->data.swap(fileData);
+    return true;
+}
+
+// Next whitespace separated number in a PPM header, skipping # comments
+static bool ReadPpmNumber(const std::vector<unsigned char>& data, size_t* pos, unsigned* value)
+{
+    size_t i = *pos;
+    for (;;)
+    {
+        while (i < data.size() && (data[i] == ' ' || data[i] == '\t' || data[i] == '\r' || data[i] == '\n'))
+        {
+            i++;
+        }
+        if (i < data.size() && data[i] == '#')
+        {
+            while (i < data.size() && data[i] != '\n')
+            {
+                i++;
+            }
+            continue;
+        }
+        break;
+    }
+
+    if (i >= data.size() || data[i] < '0' || data[i] > '9')
+    {
+        return false;
+    }
+
+    unsigned long long n = 0;
+    while (i < data.size() && data[i] >= '0' && data[i] <= '9')
+    {
+        n = n * 10 + (data[i] - '0');
+        if (n > 0xffffffffULL)
+        {
+            return false;
+        }
+        i++;
+    }
+
+    *value = (unsigned)n;
+    *pos = i;
+    return true;
+}
+
+bool DecodePpm(const std::string&, std::vector<unsigned char>& fileData, DecodedTexture* texture)
+{
+    if (fileData.size() < 2 || fileData[0] != 'P' || fileData[1] != '6')
+    {
+        return false;
+    }
+
+    size_t pos = 2;
+    unsigned width, height, maxValue;
+    if (!ReadPpmNumber(fileData, &pos, &width) ||
+        !ReadPpmNumber(fileData, &pos, &height) ||
+        !ReadPpmNumber(fileData, &pos, &maxValue) ||
+        maxValue != 255 || width == 0 || height == 0)
+    {
+        return false;
+    }
+
+    // Exactly one whitespace byte before the pixels
+    pos++;
+    unsigned long long pixels = (unsigned long long)width * height;
+    if (pos > fileData.size() || (fileData.size() - pos) / 3 < pixels)
+    {
+        return false;
+    }
+
+    texture->width = width;
+    texture->height = height;
+    texture->encoded = false;
+    texture->data.resize((size_t)pixels * 4);
+
+    const unsigned char* src = &fileData[pos];
+    unsigned char* dst = &texture->data[0];
+    for (size_t i = 0; i < pixels; i++)
+    {
+        dst[0] = src[0];
+        dst[1] = src[1];
+        dst[2] = src[2];
+        dst[3] = 255;
+        src += 3;
+        dst += 4;
+    }
+    return true;
+}
+
+CpuTextureBackend::~CpuTextureBackend()
+{
+}
+
+void* CpuTextureBackend::Upload(const DecodedTexture& texture, size_t* gpuBytes)
+{
+    std::vector<unsigned char>* copy = new std::vector<unsigned char>(texture.data);
+    *gpuBytes = copy->size();
+    _liveBytes += copy->size();
+    _uploads++;
+    return copy;
+}
+
+void CpuTextureBackend::Release(void* gpuTexture)
+{
+    std::vector<unsigned char>* copy = (std::vector<unsigned char>*)gpuTexture;
+    _liveBytes -= copy->size();
+    _releases++;
+    delete copy;
+}
+
+TextureStreamer::TextureStreamer(ThreadPool* pool, TextureUploadBackend* backend, const TextureDecoder& decoder, size_t budgetBytes) :
+    _pool(pool),
+    _backend(backend),
+    _decoder(decoder),
+    _placeholder(NULL),
+    _frame(0),
+    _running(0)
+{
+    memset(&_stats, 0, sizeof(_stats));
+    _stats.budgetBytes = budgetBytes;
+}
+
+TextureStreamer::~TextureStreamer()
+{
+    // Workers hold this pointer, so let them finish first
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _drained.wait(lock, [this] { return _running == 0; });
+    }
+
+    for (size_t i = 0; i < _entries.size(); i++)
+    {
+        if (_entries[i].state == State_Resident)
+        {
+            _backend->Release(_entries[i].gpu);
+        }
+    }
+}
+
+TextureHandle TextureStreamer::Request(const std::string& path)
+{
+    std::map<std::string, TextureHandle>::iterator found = _handles.find(path);
+    if (found == _handles.end())
+    {
+        Entry entry;
+        entry.path = path;
+        entry.state = State_Evicted;
+        entry.gpu = NULL;
+        entry.bytes = 0;
+        entry.lastUsed = _frame;
+        entry.lru = _lru.end();
+        _entries.push_back(entry);
+
+        TextureHandle handle = (TextureHandle)_entries.size();
+        _handles[path] = handle;
+        _stats.misses++;
+        Telemetry::Add(Telemetry_CacheMisses);
+        StartLoad(handle);
+        return handle;
+    }
+
+    TextureHandle handle = found->second;
+    Entry& entry = _entries[handle - 1];
+    switch (entry.state)
+    {
+    case State_Resident:
+        _stats.hits++;
+        Telemetry::Add(Telemetry_CacheHits);
+        Touch(handle);
+        break;
+    case State_Loading:
+        _stats.deduplicated++;
+        break;
+    case State_Evicted:
+        _stats.misses++;
+        Telemetry::Add(Telemetry_CacheMisses);
+        StartLoad(handle);
+        break;
+    case State_Failed:
+        break;
+    }
+    return handle;
+}
+
+void* TextureStreamer::Resolve(TextureHandle handle)
+{
+    if (handle == 0 || handle > _entries.size())
+    {
+        return _placeholder;
+    }
+
+    Entry& entry = _entries[handle - 1];
+    if (entry.state == State_Resident)
+    {
+        Touch(handle);
+        return entry.gpu;
+    }
+
+    if (entry.state == State_Evicted)
+    {
+        _stats.misses++;
+        Telemetry::Add(Telemetry_CacheMisses);
+        StartLoad(handle);
+    }
+    return _placeholder;
+}
+
+bool TextureStreamer::IsResident(TextureHandle handle) const
+{
+    return handle != 0 && handle <= _entries.size() && _entries[handle - 1].state == State_Resident;
+}
+
+void TextureStreamer::StartLoad(TextureHandle handle)
+{
+    Entry& entry = _entries[handle - 1];
+    entry.state = State_Loading;
+    _stats.loadsInFlight++;
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _running++;
+    }
+
+    // Copy the path, _entries may grow while the load runs
+    std::string path = entry.path;
+    _pool->Submit([this, handle, path] { Load(handle, path); });
+}
+
+// Worker side: read and decode, then hand the result to Update
+void TextureStreamer::Load(TextureHandle handle, const std::string& path)
+{
+    Completed completed;
+    completed.handle = handle;
+    completed.texture.width = 0;
+    completed.texture.height = 0;
+    completed.texture.encoded = false;
+
+    std::vector<unsigned char> fileData;
+    completed.ok = ReadBinaryFile(path, &fileData);
+    completed.fileBytes = fileData.size();
+    if (completed.ok)
+    {
+        completed.ok = _decoder(path, fileData, &completed.texture);
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _completed.push_back(std::move(completed));
+    if (--_running == 0)
+    {
+        _drained.notify_all();
+    }
+}
+
+void TextureStreamer::Touch(TextureHandle handle)
+{
+    Entry& entry = _entries[handle - 1];
+    entry.lastUsed = _frame;
+    if (entry.lru != _lru.begin())
+    {
+        _lru.splice(_lru.begin(), _lru, entry.lru);
+    }
+}
+
+void TextureStreamer::Update()
+{
+    std::vector<Completed> completed;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        completed.swap(_completed);
+    }
+
+    for (size_t i = 0; i < completed.size(); i++)
+    {
+        Entry& entry = _entries[completed[i].handle - 1];
+        _stats.loadsInFlight--;
+        _stats.bytesLoaded += completed[i].fileBytes;
+
+        size_t bytes = 0;
+        void* gpu = completed[i].ok ? _backend->Upload(completed[i].texture, &bytes) : NULL;
+        if (!gpu)
+        {
+            entry.state = State_Failed;
+            _stats.failures++;
+            continue;
+        }
+
+        // Counts as used this frame so it gets drawn at least once
+        entry.state = State_Resident;
+        entry.gpu = gpu;
+        entry.bytes = bytes;
+        entry.lastUsed = _frame;
+        _lru.push_front(completed[i].handle);
+        entry.lru = _lru.begin();
+        _stats.residentBytes += bytes;
+    }
+
+    Evict();
+    _frame++;
+}
+
+void TextureStreamer::Evict()
+{
+    while (_stats.residentBytes > _stats.budgetBytes && !_lru.empty())
+    {
+        TextureHandle handle = _lru.back();
+        Entry& entry = _entries[handle - 1];
+        if (entry.lastUsed == _frame)
+        {
+            // Everything left was used this frame
+            break;
+        }
+
+        _backend->Release(entry.gpu);
+        _stats.residentBytes -= entry.bytes;
+        _stats.evictions++;
+
+        entry.state = State_Evicted;
+        entry.gpu = NULL;
+        entry.bytes = 0;
+        entry.lru = _lru.end();
+        _lru.pop_back();
+    }
+}
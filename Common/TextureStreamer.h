@@ -0,0 +1,168 @@
+#pragma once
+
+#include <stddef.h>
+#include <condition_variable>
+#include <functional>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class ThreadPool;
+
+// 0 is never a valid handle
+typedef unsigned TextureHandle;
+
+// Result of the decode stage. Either RGBA8 pixels, or the file bytes left
+// encoded for a backend that decodes during upload (D3DX does).
+struct DecodedTexture
+{
+    unsigned width;
+    unsigned height;
+    bool encoded;
+    std::vector<unsigned char> data;
+};
+
+// Turns the bytes of a file into a texture. Runs on a worker thread.
+typedef std::function<bool(const std::string& path, std::vector<unsigned char>& fileData, DecodedTexture* texture)> TextureDecoder;
+
+// Keeps the file bytes as they are
+bool DecodePassThrough(const std::string& path, std::vector<unsigned char>& fileData, DecodedTexture* texture);
+
+// Binary PPM (P6) to RGBA8
+bool DecodePpm(const std::string& path, std::vector<unsigned char>& fileData, DecodedTexture* texture);
+
+// Creates GPU textures. Called only from the thread that calls
+// TextureStreamer::Update.
+class TextureUploadBackend
+{
+public:
+    virtual ~TextureUploadBackend() {}
+
+    // Returns the GPU object (e.g. an ID3D11ShaderResourceView) or NULL,
+    // and how many bytes of video memory it takes
+    virtual void* Upload(const DecodedTexture& texture, size_t* gpuBytes) = 0;
+
+    virtual void Release(void* gpuTexture) = 0;
+};
+
+// Backend that keeps textures in system memory, for running the streaming
+// policy without a device
+class CpuTextureBackend : public TextureUploadBackend
+{
+public:
+    CpuTextureBackend() : _uploads(0), _releases(0), _liveBytes(0) {}
+    ~CpuTextureBackend();
+
+    void* Upload(const DecodedTexture& texture, size_t* gpuBytes);
+    void Release(void* gpuTexture);
+
+    unsigned long long Uploads() const { return _uploads; }
+    unsigned long long Releases() const { return _releases; }
+    size_t LiveBytes() const { return _liveBytes; }
+
+private:
+    unsigned long long _uploads;
+    unsigned long long _releases;
+    size_t _liveBytes;
+};
+
+struct TextureStreamerStats
+{
+    unsigned long long hits;            // requested and already resident
+    unsigned long long misses;          // requested and had to be loaded
+    unsigned long long deduplicated;    // requested while a load was already running
+    unsigned long long evictions;
+    unsigned long long failures;
+    unsigned long long bytesLoaded;     // from disk
+    size_t loadsInFlight;
+    size_t residentBytes;
+    size_t budgetBytes;
+};
+
+// Loads textures on a thread pool and keeps the most recently used ones
+// resident under a byte budget.
+//
+// Request never blocks. Until a texture is resident Resolve returns the
+// placeholder. Update, called once per frame on the render thread,
+// uploads what the workers have decoded and evicts least recently used
+// textures while over budget. Textures resolved in the current frame are
+// never evicted, so the budget can be exceeded by one frame's working set.
+class TextureStreamer
+{
+public:
+    TextureStreamer(ThreadPool* pool, TextureUploadBackend* backend, const TextureDecoder& decoder, size_t budgetBytes);
+    ~TextureStreamer();
+
+    // Shown while a texture is loading or failed to load
+    void SetPlaceholder(void* gpuTexture) { _placeholder = gpuTexture; }
+
+    void SetBudget(size_t budgetBytes) { _stats.budgetBytes = budgetBytes; }
+
+    // Start loading path if it isn't resident or already loading
+    TextureHandle Request(const std::string& path);
+
+    // GPU texture for drawing this frame, or the placeholder. Marks the
+    // texture as used and reloads it if it was evicted.
+    void* Resolve(TextureHandle handle);
+
+    bool IsResident(TextureHandle handle) const;
+
+    // Upload finished loads and enforce the budget
+    void Update();
+
+    const TextureStreamerStats& Stats() const { return _stats; }
+
+private:
+    enum State
+    {
+        State_Loading,
+        State_Resident,
+        State_Evicted,
+        State_Failed
+    };
+
+    struct Entry
+    {
+        std::string path;
+        State state;
+        void* gpu;
+        size_t bytes;
+        unsigned long long lastUsed;
+        std::list<TextureHandle>::iterator lru;
+    };
+
+    struct Completed
+    {
+        TextureHandle handle;
+        bool ok;
+        size_t fileBytes;
+        DecodedTexture texture;
+    };
+
+    ThreadPool* _pool;
+    TextureUploadBackend* _backend;
+    TextureDecoder _decoder;
+    void* _placeholder;
+    unsigned long long _frame;
+
+    std::map<std::string, TextureHandle> _handles;
+    std::vector<Entry> _entries;            // index is handle - 1
+    std::list<TextureHandle> _lru;          // most recently used at the front
+    TextureStreamerStats _stats;
+
+    // Shared with the workers
+    std::mutex _mutex;
+    std::condition_variable _drained;
+    std::vector<Completed> _completed;
+    size_t _running;
+
+    void StartLoad(TextureHandle handle);
+    void Load(TextureHandle handle, const std::string& path);
+    void Touch(TextureHandle handle);
+    void Evict();
+
+    TextureStreamer(const TextureStreamer&);
+    TextureStreamer& operator=(const TextureStreamer&);
+};
@@ -0,0 +1,229 @@
+#include "ThreadPool.h"
+
+#include <memory>
+
+// Which pool and queue the current thread works for, if any
+static thread_local ThreadPool* t_pool = NULL;
+static thread_local size_t t_queue = 0;
+
+ThreadPool::ThreadPool(unsigned threads) :
+    _queued(0),
+    _pending(0),
+    _sleepers(0),
+    _nextQueue(0),
+    _steals(0),
+    _stopping(false)
+{
+    if (threads == 0)
+    {
+        threads = std::thread::hardware_concurrency();
+        if (threads == 0)
+        {
+            threads = 1;
+        }
+    }
+    for (unsigned i = 1; i < threads; i++)
+    {
+        _queues.push_back(new WorkQueue);
+    }
+    for (size_t i = 0; i < _queues.size(); i++)
+    {
+        _workers.push_back(std::thread(&ThreadPool::WorkerLoop, this, i));
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _wake.notify_all();
+    for (size_t i = 0; i < _workers.size(); i++)
+    {
+        _workers[i].join();
+    }
+    for (size_t i = 0; i < _queues.size(); i++)
+    {
+        delete _queues[i];
+    }
+}
+
+// Newest task from our own queue, else the oldest from someone else's
+bool ThreadPool::TakeTask(size_t index, std::function<void()>* task)
+{
+    {
+        WorkQueue& own = *_queues[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty())
+        {
+            task->swap(own.tasks.back());
+            own.tasks.pop_back();
+            _queued--;
+            return true;
+        }
+    }
+
+    for (size_t i = 1; i < _queues.size(); i++)
+    {
+        WorkQueue& victim = *_queues[(index + i) % _queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty())
+        {
+            task->swap(victim.tasks.front());
+            victim.tasks.pop_front();
+            _queued--;
+            _steals++;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::WorkerLoop(size_t index)
+{
+    t_pool = this;
+    t_queue = index;
+
+    std::function<void()> task;
+    for (;;)
+    {
+        if (TakeTask(index, &task))
+        {
+            task();
+            task = NULL;
+
+            if (_pending.fetch_sub(1) == 1)
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _idle.notify_all();
+            }
+            continue;
+        }
+
+        // Announce that we're going to sleep before the last look at the
+        // queues. Submit bumps _queued before it checks _sleepers, so one
+        // of the two sides always sees the other.
+        std::unique_lock<std::mutex> lock(_mutex);
+        _sleepers++;
+        while (!_stopping && _queued.load() == 0)
+        {
+            _wake.wait(lock);
+        }
+        _sleepers--;
+        if (_stopping && _queued.load() == 0)
+        {
+            return;
+        }
+    }
+}
+
+void ThreadPool::Submit(const std::function<void()>& task)
+{
+    if (_workers.empty())
+    {
+        task();
+        return;
+    }
+
+    size_t index = t_pool == this ? t_queue : _nextQueue++ % _queues.size();
+    _pending++;
+    {
+        WorkQueue& queue = *_queues[index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(task);
+    }
+    _queued++;
+
+    if (_sleepers.load() > 0)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _wake.notify_one();
+    }
+}
+
+void ThreadPool::Wait()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (_pending.load() > 0)
+    {
+        _idle.wait(lock);
+    }
+}
+
+// Shared between the caller of ParallelFor and its helpers. Helpers can
+// start after the loop has finished, so it must outlive the call.
+struct ParallelForState
+{
+    std::atomic<size_t> next;
+    std::atomic<size_t> done;
+    size_t chunks;
+    size_t count;
+    size_t grain;
+    const std::function<void(size_t, size_t)>* body;
+    std::mutex mutex;
+    std::condition_variable finished;
+
+    // Claim and run chunks until none are left
+    void Run()
+    {
+        for (;;)
+        {
+            size_t chunk = next.fetch_add(1);
+            if (chunk >= chunks)
+            {
+                return;
+            }
+            size_t begin = chunk * grain;
+            size_t end = begin + grain < count ? begin + grain : count;
+            (*body)(begin, end);
+
+            if (done.fetch_add(1) + 1 == chunks)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                finished.notify_all();
+            }
+        }
+    }
+};
+
+void ThreadPool::ParallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& body)
+{
+    if (count == 0)
+    {
+        return;
+    }
+    if (grain == 0)
+    {
+        grain = 1;
+    }
+
+    size_t chunks = (count + grain - 1) / grain;
+    if (chunks == 1 || _workers.empty())
+    {
+        body(0, count);
+        return;
+    }
+
+    std::shared_ptr<ParallelForState> state = std::make_shared<ParallelForState>();
+    state->next = 0;
+    state->done = 0;
+    state->chunks = chunks;
+    state->count = count;
+    state->grain = grain;
+    state->body = &body;
+
+    size_t helpers = chunks - 1 < _workers.size() ? chunks - 1 : _workers.size();
+    for (size_t i = 0; i < helpers; i++)
+    {
+        Submit([state]() { state->Run(); });
+    }
+
+    state->Run();
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    while (state->done.load() < chunks)
+    {
+        state->finished.wait(lock);
+    }
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stddef.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads with work stealing.
+//
+// Every worker owns a task queue. Tasks submitted from a worker go to the
+// back of its own queue and it runs them newest first, so nested work
+// stays on the thread whose caches hold its data. Tasks submitted from
+// outside are spread over the queues round robin. A worker whose queue is
+// empty steals the oldest task from another worker before going to sleep.
+class ThreadPool
+{
+public:
+    // threads is the total parallelism including the calling thread, so
+    // ThreadPool(1) runs everything inline. 0 means one per hardware thread.
+    explicit ThreadPool(unsigned threads = 0);
+    ~ThreadPool();
+
+    // Workers plus the thread calling ParallelFor
+    unsigned ThreadCount() const { return (unsigned)_workers.size() + 1; }
+
+    // Run a task on a worker. With no workers the task runs inline.
+    void Submit(const std::function<void()>& task);
+
+    // Block until every submitted task has finished
+    void Wait();
+
+    // Split [0, count) into chunks of grain items and run body(begin, end)
+    // on each. The caller works on chunks too and returns once all are done,
+    // so it is safe to call from inside a task.
+    void ParallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& body);
+
+    // Tasks a worker took from another worker's queue
+    unsigned long long Steals() const { return _steals.load(); }
+
+private:
+    struct WorkQueue
+    {
+        std::mutex mutex;
+        std::deque<std::function<void()> > tasks;
+    };
+
+    std::vector<std::thread> _workers;
+    std::vector<WorkQueue*> _queues;
+    std::atomic<size_t> _queued;        // tasks sitting in queues
+    std::atomic<size_t> _pending;       // submitted and not finished
+    std::atomic<size_t> _sleepers;
+    std::atomic<size_t> _nextQueue;
+    std::atomic<unsigned long long> _steals;
+
+    // Only for sleeping and waking
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    std::condition_variable _idle;
+    bool _stopping;
+
+    void WorkerLoop(size_t index);
+    bool TakeTask(size_t index, std::function<void()>* task);
+
+    ThreadPool(const ThreadPool&);
+    ThreadPool& operator=(const ThreadPool&);
+};
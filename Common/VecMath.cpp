@@ -0,0 +1,428 @@
+#include "VecMath.h"
+
+#if VECMATH_AVX2 || VECMATH_SSE
+#include <immintrin.h>
+#elif VECMATH_NEON
+#include <arm_neon.h>
+#endif
+
+static const float DegreesToRadians = 3.1415926535f / 180.0f;
+
+Matrix3x2 Matrix3x2::Identity()
+{
+    Matrix3x2 r = {1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f};
+    return r;
+}
+
+Matrix3x2 Matrix3x2::Translation(float x, float y)
+{
+    Matrix3x2 r = {1.0f, 0.0f, 0.0f, 1.0f, x, y};
+    return r;
+}
+
+Matrix3x2 Matrix3x2::Scale(float x, float y, Float2 center)
+{
+    Matrix3x2 r = {x, 0.0f, 0.0f, y, center.x - x * center.x, center.y - y * center.y};
+    return r;
+}
+
+Matrix3x2 Matrix3x2::Rotation(float degrees, Float2 center)
+{
+    float s = sinf(degrees * DegreesToRadians);
+    float c = cosf(degrees * DegreesToRadians);
+    Matrix3x2 r = {c, s, -s, c,
+                   center.x - center.x * c + center.y * s,
+                   center.y - center.x * s - center.y * c};
+    return r;
+}
+
+bool Matrix3x2::Invert()
+{
+    float det = Determinant();
+    if (det == 0.0f)
+    {
+        return false;
+    }
+
+    float inv = 1.0f / det;
+    Matrix3x2 r;
+    r._11 = _22 * inv;
+    r._12 = -_12 * inv;
+    r._21 = -_21 * inv;
+    r._22 = _11 * inv;
+    r._31 = (_21 * _32 - _22 * _31) * inv;
+    r._32 = (_12 * _31 - _11 * _32) * inv;
+    *this = r;
+    return true;
+}
+
+Matrix3x2 operator*(const Matrix3x2& a, const Matrix3x2& b)
+{
+    Matrix3x2 r;
+    r._11 = a._11 * b._11 + a._12 * b._21;
+    r._12 = a._11 * b._12 + a._12 * b._22;
+    r._21 = a._21 * b._11 + a._22 * b._21;
+    r._22 = a._21 * b._12 + a._22 * b._22;
+    r._31 = a._31 * b._11 + a._32 * b._21 + b._31;
+    r._32 = a._31 * b._12 + a._32 * b._22 + b._32;
+    return r;
+}
+
+static Matrix4x4 MakeMatrix(float m00, float m01, float m02, float m03,
+                            float m10, float m11, float m12, float m13,
+                            float m20, float m21, float m22, float m23,
+                            float m30, float m31, float m32, float m33)
+{
+    Matrix4x4 r = {{{m00, m01, m02, m03}, {m10, m11, m12, m13}, {m20, m21, m22, m23}, {m30, m31, m32, m33}}};
+    return r;
+}
+
+Matrix4x4 Matrix4x4::Identity()
+{
+    return MakeMatrix(1, 0, 0, 0,
+                      0, 1, 0, 0,
+                      0, 0, 1, 0,
+                      0, 0, 0, 1);
+}
+
+Matrix4x4 Matrix4x4::Translation(float x, float y, float z)
+{
+    return MakeMatrix(1, 0, 0, 0,
+                      0, 1, 0, 0,
+                      0, 0, 1, 0,
+                      x, y, z, 1);
+}
+
+Matrix4x4 Matrix4x4::Scaling(float x, float y, float z)
+{
+    return MakeMatrix(x, 0, 0, 0,
+                      0, y, 0, 0,
+                      0, 0, z, 0,
+                      0, 0, 0, 1);
+}
+
+Matrix4x4 Matrix4x4::RotationX(float radians)
+{
+    float s = sinf(radians), c = cosf(radians);
+    return MakeMatrix(1, 0, 0, 0,
+                      0, c, s, 0,
+                      0, -s, c, 0,
+                      0, 0, 0, 1);
+}
+
+Matrix4x4 Matrix4x4::RotationY(float radians)
+{
+    float s = sinf(radians), c = cosf(radians);
+    return MakeMatrix(c, 0, -s, 0,
+                      0, 1, 0, 0,
+                      s, 0, c, 0,
+                      0, 0, 0, 1);
+}
+
+Matrix4x4 Matrix4x4::RotationZ(float radians)
+{
+    float s = sinf(radians), c = cosf(radians);
+    return MakeMatrix(c, s, 0, 0,
+                      -s, c, 0, 0,
+                      0, 0, 1, 0,
+                      0, 0, 0, 1);
+}
+
+Matrix4x4 Matrix4x4::PerspectiveFovLH(float fovY, float aspect, float zNear, float zFar)
+{
+    float yScale = 1.0f / tanf(fovY * 0.5f);
+    float xScale = yScale / aspect;
+    float q = zFar / (zFar - zNear);
+    return MakeMatrix(xScale, 0, 0, 0,
+                      0, yScale, 0, 0,
+                      0, 0, q, 1,
+                      0, 0, -q * zNear, 0);
+}
+
+Matrix4x4 Matrix4x4::LookAtLH(Float3 eye, Float3 target, Float3 up)
+{
+    Float3 z = Normalize(target - eye);
+    Float3 x = Normalize(Cross(up, z));
+    Float3 y = Cross(z, x);
+    return MakeMatrix(x.x, y.x, z.x, 0,
+                      x.y, y.y, z.y, 0,
+                      x.z, y.z, z.z, 0,
+                      -Dot(x, eye), -Dot(y, eye), -Dot(z, eye), 1);
+}
+
+Matrix4x4 Matrix4x4::Transposed() const
+{
+    Matrix4x4 r;
+    for (int i = 0; i < 4; i++)
+    {
+        for (int j = 0; j < 4; j++)
+        {
+            r.m[i][j] = m[j][i];
+        }
+    }
+    return r;
+}
+
+Float4 Matrix4x4::Transform(Float4 v) const
+{
+    return Float4(v.x * m[0][0] + v.y * m[1][0] + v.z * m[2][0] + v.w * m[3][0],
+                  v.x * m[0][1] + v.y * m[1][1] + v.z * m[2][1] + v.w * m[3][1],
+                  v.x * m[0][2] + v.y * m[1][2] + v.z * m[2][2] + v.w * m[3][2],
+                  v.x * m[0][3] + v.y * m[1][3] + v.z * m[2][3] + v.w * m[3][3]);
+}
+
+Float3 Matrix4x4::TransformCoord(Float3 p) const
+{
+    Float4 r = Transform(Float4(p.x, p.y, p.z, 1.0f));
+    float inv = r.w != 0.0f ? 1.0f / r.w : 0.0f;
+    return Float3(r.x * inv, r.y * inv, r.z * inv);
+}
+
+static void MultiplyRowsScalar(const Matrix4x4& a, const Matrix4x4& b, Matrix4x4* out)
+{
+    Matrix4x4 r;
+    for (int i = 0; i < 4; i++)
+    {
+        for (int j = 0; j < 4; j++)
+        {
+            r.m[i][j] = a.m[i][0] * b.m[0][j] + a.m[i][1] * b.m[1][j] + a.m[i][2] * b.m[2][j] + a.m[i][3] * b.m[3][j];
+        }
+    }
+    *out = r;
+}
+
+Matrix4x4 operator*(const Matrix4x4& a, const Matrix4x4& b)
+{
+    Matrix4x4 r;
+    MultiplyRowsScalar(a, b, &r);
+    return r;
+}
+
+//
+// One set of batch kernels, written against a small wrapper for each
+// backend's vector type.
+//
+
+#if VECMATH_AVX2
+
+typedef __m256 Lanes;
+static const size_t LaneCount = 8;
+static inline Lanes Load(const float* p) { return _mm256_loadu_ps(p); }
+static inline void Store(float* p, Lanes v) { _mm256_storeu_ps(p, v); }
+static inline Lanes Splat(float f) { return _mm256_set1_ps(f); }
+#ifdef __FMA__
+static inline Lanes MulAdd(Lanes a, Lanes b, Lanes c) { return _mm256_fmadd_ps(a, b, c); }
+#else
+static inline Lanes MulAdd(Lanes a, Lanes b, Lanes c) { return _mm256_add_ps(_mm256_mul_ps(a, b), c); }
+#endif
+
+#elif VECMATH_SSE
+
+typedef __m128 Lanes;
+static const size_t LaneCount = 4;
+static inline Lanes Load(const float* p) { return _mm_loadu_ps(p); }
+static inline void Store(float* p, Lanes v) { _mm_storeu_ps(p, v); }
+static inline Lanes Splat(float f) { return _mm_set1_ps(f); }
+static inline Lanes MulAdd(Lanes a, Lanes b, Lanes c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+
+#elif VECMATH_NEON
+
+typedef float32x4_t Lanes;
+static const size_t LaneCount = 4;
+static inline Lanes Load(const float* p) { return vld1q_f32(p); }
+static inline void Store(float* p, Lanes v) { vst1q_f32(p, v); }
+static inline Lanes Splat(float f) { return vdupq_n_f32(f); }
+static inline Lanes MulAdd(Lanes a, Lanes b, Lanes c) { return vmlaq_f32(c, a, b); }
+
+#else
+
+typedef float Lanes;
+static const size_t LaneCount = 1;
+static inline Lanes Load(const float* p) { return *p; }
+static inline void Store(float* p, Lanes v) { *p = v; }
+static inline Lanes Splat(float f) { return f; }
+static inline Lanes MulAdd(Lanes a, Lanes b, Lanes c) { return a * b + c; }
+
+#endif
+
+const char* VecMathBackend()
+{
+#if VECMATH_AVX2
+    return "AVX2";
+#elif VECMATH_SSE
+    return "SSE";
+#elif VECMATH_NEON
+    return "NEON";
+#else
+    return "scalar";
+#endif
+}
+
+void TransformPoints2Scalar(const Matrix3x2& m, const float* x, const float* y,
+                            float* outX, float* outY, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        Float2 p = m.TransformPoint(Float2(x[i], y[i]));
+        outX[i] = p.x;
+        outY[i] = p.y;
+    }
+}
+
+void TransformPoints2(const Matrix3x2& m, const float* x, const float* y,
+                      float* outX, float* outY, size_t count)
+{
+    Lanes m11 = Splat(m._11), m12 = Splat(m._12);
+    Lanes m21 = Splat(m._21), m22 = Splat(m._22);
+    Lanes m31 = Splat(m._31), m32 = Splat(m._32);
+
+    size_t i = 0;
+    for (; i + LaneCount <= count; i += LaneCount)
+    {
+        Lanes px = Load(x + i);
+        Lanes py = Load(y + i);
+        Lanes rx = MulAdd(px, m11, MulAdd(py, m21, m31));
+        Lanes ry = MulAdd(px, m12, MulAdd(py, m22, m32));
+        Store(outX + i, rx);
+        Store(outY + i, ry);
+    }
+
+    TransformPoints2Scalar(m, x + i, y + i, outX + i, outY + i, count - i);
+}
+
+void TransformPoints3Scalar(const Matrix4x4& m, const float* x, const float* y, const float* z,
+                            float* outX, float* outY, float* outZ, float* outW, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        Float4 p = m.Transform(Float4(x[i], y[i], z[i], 1.0f));
+        outX[i] = p.x;
+        outY[i] = p.y;
+        outZ[i] = p.z;
+        if (outW)
+        {
+            outW[i] = p.w;
+        }
+    }
+}
+
+void TransformPoints3(const Matrix4x4& m, const float* x, const float* y, const float* z,
+                      float* outX, float* outY, float* outZ, float* outW, size_t count)
+{
+    Lanes c[4][4];
+    for (int i = 0; i < 4; i++)
+    {
+        for (int j = 0; j < 4; j++)
+        {
+            c[i][j] = Splat(m.m[i][j]);
+        }
+    }
+
+    size_t i = 0;
+    for (; i + LaneCount <= count; i += LaneCount)
+    {
+        Lanes px = Load(x + i);
+        Lanes py = Load(y + i);
+        Lanes pz = Load(z + i);
+
+        // Translation row first, then accumulate z, y, x into it
+        Lanes rx = MulAdd(px, c[0][0], MulAdd(py, c[1][0], MulAdd(pz, c[2][0], c[3][0])));
+        Lanes ry = MulAdd(px, c[0][1], MulAdd(py, c[1][1], MulAdd(pz, c[2][1], c[3][1])));
+        Lanes rz = MulAdd(px, c[0][2], MulAdd(py, c[1][2], MulAdd(pz, c[2][2], c[3][2])));
+        if (outW)
+        {
+            Lanes rw = MulAdd(px, c[0][3], MulAdd(py, c[1][3], MulAdd(pz, c[2][3], c[3][3])));
+            Store(outW + i, rw);
+        }
+        Store(outX + i, rx);
+        Store(outY + i, ry);
+        Store(outZ + i, rz);
+    }
+
+    TransformPoints3Scalar(m, x + i, y + i, z + i, outX + i, outY + i, outZ + i, outW ? outW + i : NULL, count - i);
+}
+
+void MultiplyMatricesScalar(const Matrix4x4* a, const Matrix4x4& b, Matrix4x4* out, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        MultiplyRowsScalar(a[i], b, &out[i]);
+    }
+}
+
+void MultiplyMatrices(const Matrix4x4* a, const Matrix4x4& b, Matrix4x4* out, size_t count)
+{
+#if VECMATH_AVX2
+    // Two rows at a time, b's rows repeated in both halves. Row r of the
+    // product is the sum of a[r][k] times row k of b.
+    __m256 b0 = _mm256_broadcast_ps((const __m128*)b.m[0]);
+    __m256 b1 = _mm256_broadcast_ps((const __m128*)b.m[1]);
+    __m256 b2 = _mm256_broadcast_ps((const __m128*)b.m[2]);
+    __m256 b3 = _mm256_broadcast_ps((const __m128*)b.m[3]);
+    for (size_t i = 0; i < count; i++)
+    {
+        __m256 rows01 = _mm256_loadu_ps(a[i].m[0]);
+        __m256 rows23 = _mm256_loadu_ps(a[i].m[2]);
+
+        __m256 r01 = _mm256_mul_ps(_mm256_permute_ps(rows01, 0x00), b0);
+        r01 = MulAdd(_mm256_permute_ps(rows01, 0x55), b1, r01);
+        r01 = MulAdd(_mm256_permute_ps(rows01, 0xAA), b2, r01);
+        r01 = MulAdd(_mm256_permute_ps(rows01, 0xFF), b3, r01);
+
+        __m256 r23 = _mm256_mul_ps(_mm256_permute_ps(rows23, 0x00), b0);
+        r23 = MulAdd(_mm256_permute_ps(rows23, 0x55), b1, r23);
+        r23 = MulAdd(_mm256_permute_ps(rows23, 0xAA), b2, r23);
+        r23 = MulAdd(_mm256_permute_ps(rows23, 0xFF), b3, r23);
+
+        _mm256_storeu_ps(out[i].m[0], r01);
+        _mm256_storeu_ps(out[i].m[2], r23);
+    }
+#elif VECMATH_SSE
+    // Row r of the product is the sum of a[r][k] times row k of b
+    __m128 b0 = _mm_loadu_ps(b.m[0]);
+    __m128 b1 = _mm_loadu_ps(b.m[1]);
+    __m128 b2 = _mm_loadu_ps(b.m[2]);
+    __m128 b3 = _mm_loadu_ps(b.m[3]);
+    for (size_t i = 0; i < count; i++)
+    {
+        __m128 rows[4];
+        for (int r = 0; r < 4; r++)
+        {
+            __m128 ar = _mm_loadu_ps(a[i].m[r]);
+            __m128 row = _mm_mul_ps(_mm_shuffle_ps(ar, ar, 0x00), b0);
+            row = _mm_add_ps(row, _mm_mul_ps(_mm_shuffle_ps(ar, ar, 0x55), b1));
+            row = _mm_add_ps(row, _mm_mul_ps(_mm_shuffle_ps(ar, ar, 0xAA), b2));
+            row = _mm_add_ps(row, _mm_mul_ps(_mm_shuffle_ps(ar, ar, 0xFF), b3));
+            rows[r] = row;
+        }
+        for (int r = 0; r < 4; r++)
+        {
+            _mm_storeu_ps(out[i].m[r], rows[r]);
+        }
+    }
+#elif VECMATH_NEON
+    float32x4_t b0 = vld1q_f32(b.m[0]);
+    float32x4_t b1 = vld1q_f32(b.m[1]);
+    float32x4_t b2 = vld1q_f32(b.m[2]);
+    float32x4_t b3 = vld1q_f32(b.m[3]);
+    for (size_t i = 0; i < count; i++)
+    {
+        const Matrix4x4& m = a[i];
+        float32x4_t rows[4];
+        for (int r = 0; r < 4; r++)
+        {
+            float32x4_t row = vmulq_n_f32(b0, m.m[r][0]);
+            row = vmlaq_n_f32(row, b1, m.m[r][1]);
+            row = vmlaq_n_f32(row, b2, m.m[r][2]);
+            row = vmlaq_n_f32(row, b3, m.m[r][3]);
+            rows[r] = row;
+        }
+        for (int r = 0; r < 4; r++)
+        {
+            vst1q_f32(out[i].m[r], rows[r]);
+        }
+    }
+#else
+    MultiplyMatricesScalar(a, b, out, count);
+#endif
+}
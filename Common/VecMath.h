@@ -0,0 +1,147 @@
+#pragma once
+
+#include <stddef.h>
+#include <math.h>
+
+// Backend for the batch functions, picked from the compiler's target flags
+// unless one is defined on the command line (e.g. VECMATH_SCALAR=1)
+#if !defined(VECMATH_AVX2) && !defined(VECMATH_SSE) && !defined(VECMATH_NEON) && !defined(VECMATH_SCALAR)
+#if defined(__AVX2__)
+#define VECMATH_AVX2 1
+#elif defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VECMATH_SSE 1
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#define VECMATH_NEON 1
+#else
+#define VECMATH_SCALAR 1
+#endif
+#endif
+
+struct Float2
+{
+    float x, y;
+
+    Float2() {}
+    Float2(float x, float y) : x(x), y(y) {}
+};
+
+struct Float3
+{
+    float x, y, z;
+
+    Float3() {}
+    Float3(float x, float y, float z) : x(x), y(y), z(z) {}
+};
+
+struct Float4
+{
+    float x, y, z, w;
+
+    Float4() {}
+    Float4(float x, float y, float z, float w) : x(x), y(y), z(z), w(w) {}
+};
+
+inline Float2 operator+(Float2 a, Float2 b) { return Float2(a.x + b.x, a.y + b.y); }
+inline Float2 operator-(Float2 a, Float2 b) { return Float2(a.x - b.x, a.y - b.y); }
+inline Float2 operator*(Float2 a, float s) { return Float2(a.x * s, a.y * s); }
+inline float Dot(Float2 a, Float2 b) { return a.x * b.x + a.y * b.y; }
+inline float Length(Float2 a) { return sqrtf(Dot(a, a)); }
+inline Float2 Lerp(Float2 a, Float2 b, float t) { return a + (b - a) * t; }
+
+inline Float3 operator+(Float3 a, Float3 b) { return Float3(a.x + b.x, a.y + b.y, a.z + b.z); }
+inline Float3 operator-(Float3 a, Float3 b) { return Float3(a.x - b.x, a.y - b.y, a.z - b.z); }
+inline Float3 operator*(Float3 a, float s) { return Float3(a.x * s, a.y * s, a.z * s); }
+inline float Dot(Float3 a, Float3 b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+inline Float3 Cross(Float3 a, Float3 b) { return Float3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x); }
+inline float Length(Float3 a) { return sqrtf(Dot(a, a)); }
+inline Float3 Normalize(Float3 a) { float l = Length(a); return l > 0.0f ? a * (1.0f / l) : a; }
+inline Float3 Lerp(Float3 a, Float3 b, float t) { return a + (b - a) * t; }
+
+inline Float4 operator+(Float4 a, Float4 b) { return Float4(a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w); }
+inline Float4 operator-(Float4 a, Float4 b) { return Float4(a.x - b.x, a.y - b.y, a.z - b.z, a.w - b.w); }
+inline Float4 operator*(Float4 a, float s) { return Float4(a.x * s, a.y * s, a.z * s, a.w * s); }
+inline float Dot(Float4 a, Float4 b) { return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w; }
+inline Float4 Lerp(Float4 a, Float4 b, float t) { return a + (b - a) * t; }
+
+// 2D affine transform for row vectors, the same layout and conventions as
+// D2D1_MATRIX_3X2_F: p' = [x y 1] * M, and a * b applies a first.
+struct Matrix3x2
+{
+    float _11, _12;
+    float _21, _22;
+    float _31, _32;
+
+    static Matrix3x2 Identity();
+    static Matrix3x2 Translation(float x, float y);
+    static Matrix3x2 Scale(float x, float y, Float2 center = Float2(0.0f, 0.0f));
+
+    // Clockwise in degrees on a y-down target, like D2D1::Matrix3x2F::Rotation
+    static Matrix3x2 Rotation(float degrees, Float2 center = Float2(0.0f, 0.0f));
+
+    float Determinant() const { return _11 * _22 - _12 * _21; }
+
+    // False and unchanged if the matrix is singular
+    bool Invert();
+
+    Float2 TransformPoint(Float2 p) const
+    {
+        return Float2(p.x * _11 + p.y * _21 + _31, p.x * _12 + p.y * _22 + _32);
+    }
+};
+
+Matrix3x2 operator*(const Matrix3x2& a, const Matrix3x2& b);
+
+// 4x4 matrix for row vectors, row major, the same layout and conventions
+// as D3DXMATRIX and XMFLOAT4X4: p' = p * M, and a * b applies a first.
+struct Matrix4x4
+{
+    float m[4][4];
+
+    static Matrix4x4 Identity();
+    static Matrix4x4 Translation(float x, float y, float z);
+    static Matrix4x4 Scaling(float x, float y, float z);
+    static Matrix4x4 RotationX(float radians);
+    static Matrix4x4 RotationY(float radians);
+    static Matrix4x4 RotationZ(float radians);
+
+    // Left-handed, depth in [0, 1], like D3DXMatrixPerspectiveFovLH
+    static Matrix4x4 PerspectiveFovLH(float fovY, float aspect, float zNear, float zFar);
+    static Matrix4x4 LookAtLH(Float3 eye, Float3 target, Float3 up);
+
+    Matrix4x4 Transposed() const;
+
+    Float4 Transform(Float4 v) const;
+
+    // w = 1 in, divided by w out
+    Float3 TransformCoord(Float3 p) const;
+};
+
+Matrix4x4 operator*(const Matrix4x4& a, const Matrix4x4& b);
+
+// Name of the compiled-in backend: "AVX2", "SSE", "NEON" or "scalar"
+const char* VecMathBackend();
+
+//
+// Batch operations on structure-of-arrays data. Inputs and outputs may
+// alias element for element (in place is fine) but must not otherwise
+// overlap. No alignment is required.
+//
+
+// p' = p * m for count points
+void TransformPoints2(const Matrix3x2& m, const float* x, const float* y,
+                      float* outX, float* outY, size_t count);
+
+// p' = [p 1] * m for count points, w is written if outW isn't NULL
+void TransformPoints3(const Matrix4x4& m, const float* x, const float* y, const float* z,
+                      float* outX, float* outY, float* outZ, float* outW, size_t count);
+
+// out[i] = a[i] * b, e.g. world matrices times one view-projection
+void MultiplyMatrices(const Matrix4x4* a, const Matrix4x4& b, Matrix4x4* out, size_t count);
+
+// Plain loops over the inline functions, the reference the batch paths
+// are measured against
+void TransformPoints2Scalar(const Matrix3x2& m, const float* x, const float* y,
+                            float* outX, float* outY, size_t count);
+void TransformPoints3Scalar(const Matrix4x4& m, const float* x, const float* y, const float* z,
+                            float* outX, float* outY, float* outZ, float* outW, size_t count);
+void MultiplyMatricesScalar(const Matrix4x4* a, const Matrix4x4& b, Matrix4x4* out, size_t count);
@@ -0,0 +1,109 @@
+#pragma once
+
+// Conversions between VecMath and the Windows math types. Include this
+// after the D2D / D3DX / XNA math headers; each group of shims is only
+// compiled when its header has been seen. The layouts are identical, the
+// conversions are plain copies.
+
+#include "VecMath.h"
+
+#include <string.h>
+
+#ifdef _D2D1_H_
+
+inline D2D1_POINT_2F ToD2D(Float2 p)
+{
+    D2D1_POINT_2F r = {p.x, p.y};
+    return r;
+}
+
+inline Float2 FromD2D(D2D1_POINT_2F p)
+{
+    return Float2(p.x, p.y);
+}
+
+inline D2D1_MATRIX_3X2_F ToD2D(const Matrix3x2& m)
+{
+    D2D1_MATRIX_3X2_F r;
+    memcpy(&r, &m, sizeof(r));
+    return r;
+}
+
+inline Matrix3x2 FromD2D(const D2D1_MATRIX_3X2_F& m)
+{
+    Matrix3x2 r;
+    memcpy(&r, &m, sizeof(r));
+    return r;
+}
+
+inline D2D1_COLOR_F ToD2D(Float4 c)
+{
+    D2D1_COLOR_F r = {c.x, c.y, c.z, c.w};
+    return r;
+}
+
+#endif // _D2D1_H_
+
+#if defined(__D3DX10MATH_H__) || defined(__D3DX9MATH_H__)
+
+inline D3DXCOLOR ToD3DX(Float4 c)
+{
+    return D3DXCOLOR(c.x, c.y, c.z, c.w);
+}
+
+inline Float4 FromD3DX(const D3DXCOLOR& c)
+{
+    return Float4(c.r, c.g, c.b, c.a);
+}
+
+inline D3DXVECTOR3 ToD3DX(Float3 v)
+{
+    return D3DXVECTOR3(v.x, v.y, v.z);
+}
+
+inline Float3 FromD3DX(const D3DXVECTOR3& v)
+{
+    return Float3(v.x, v.y, v.z);
+}
+
+inline D3DXMATRIX ToD3DX(const Matrix4x4& m)
+{
+    return D3DXMATRIX(&m.m[0][0]);
+}
+
+inline Matrix4x4 FromD3DX(const D3DXMATRIX& m)
+{
+    Matrix4x4 r;
+    memcpy(&r, &m, sizeof(r));
+    return r;
+}
+
+#endif // D3DX math
+
+#ifdef __XNAMATH_H__
+
+inline XMFLOAT3 ToXna(Float3 v)
+{
+    return XMFLOAT3(v.x, v.y, v.z);
+}
+
+inline Float3 FromXna(const XMFLOAT3& v)
+{
+    return Float3(v.x, v.y, v.z);
+}
+
+inline XMFLOAT4X4 ToXna(const Matrix4x4& m)
+{
+    XMFLOAT4X4 r;
+    memcpy(&r, &m, sizeof(r));
+    return r;
+}
+
+inline Matrix4x4 FromXna(const XMFLOAT4X4& m)
+{
+    Matrix4x4 r;
+    memcpy(&r, &m, sizeof(r));
+    return r;
+}
+
+#endif // __XNAMATH_H__
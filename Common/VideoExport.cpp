@@ -0,0 +1,245 @@
+#include "VideoExport.h"
+#include "ColorConvert.h"
+#include "SoftwareRaster.h"
+#include "SpscQueue.h"
+#include "ThreadPool.h"
+
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+Y4mWriter::Y4mWriter() :
+    _file(NULL),
+    _frameBytes(0),
+    _raw(false),
+    _failed(false),
+    _bytes(0)
+{
+}
+
+Y4mWriter::~Y4mWriter()
+{
+    Close();
+}
+
+bool Y4mWriter::Open(const char* path, unsigned width, unsigned height, unsigned fps, bool raw)
+{
+    Close();
+
+    _file = fopen(path, "wb");
+    if (!_file)
+    {
+        return false;
+    }
+    _frameBytes = I420Size(width, height);
+    _raw = raw;
+    _failed = false;
+    _bytes = 0;
+
+    if (!raw)
+    {
+        // 420jpeg is the centered chroma RgbaToI420 makes
+        int written = fprintf(_file, "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C420jpeg XCOLORRANGE=LIMITED\n",
+                              width, height, fps);
+        _failed = written < 0;
+        _bytes += written > 0 ? written : 0;
+    }
+    return !_failed;
+}
+
+bool Y4mWriter::WriteFrame(unsigned char* frame)
+{
+    if (!_file || _failed)
+    {
+        return false;
+    }
+
+    const unsigned char* start = frame + FrameHeaderSize;
+    size_t bytes = _frameBytes;
+    if (!_raw)
+    {
+        memcpy(frame, "FRAME\n", FrameHeaderSize);
+        start = frame;
+        bytes += FrameHeaderSize;
+    }
+
+    _failed = fwrite(start, 1, bytes, _file) != bytes;
+    _bytes += _failed ? 0 : bytes;
+    return !_failed;
+}
+
+bool Y4mWriter::Close()
+{
+    if (!_file)
+    {
+        return !_failed;
+    }
+
+    _failed |= fclose(_file) != 0;
+    _file = NULL;
+    return !_failed;
+}
+
+//
+// ExportVideo
+//
+
+// Auto-reset, like the Win32 events 2DTest hands frames over with
+class StageEvent
+{
+public:
+    StageEvent() : _signaled(false) {}
+
+    void Set()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _signaled = true;
+        _wake.notify_one();
+    }
+
+    void Wait()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (!_signaled)
+        {
+            _wake.wait(lock);
+        }
+        _signaled = false;
+    }
+
+private:
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    bool _signaled;
+};
+
+struct ExportBuffer
+{
+    Image image;
+    std::vector<unsigned char> frame;   // room for the Y4M frame header, then I420
+};
+
+// One stage's input: a queue from the stage before and the event it sets
+// after pushing. A NULL buffer ends the stream.
+struct ExportQueue
+{
+    explicit ExportQueue(size_t capacity) : queue(capacity) {}
+
+    void Push(ExportBuffer* buffer)
+    {
+        // Never full, there are fewer buffers than slots
+        queue.TryPush(buffer);
+        pushed.Set();
+    }
+
+    ExportBuffer* Pop()
+    {
+        ExportBuffer* buffer;
+        while (!queue.TryPop(&buffer))
+        {
+            pushed.Wait();
+        }
+        return buffer;
+    }
+
+    SpscQueue<ExportBuffer*> queue;
+    StageEvent pushed;
+};
+
+static double MillisecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool ExportVideo(const char* path, const VideoExportSettings& settings, const ExportRenderFunction& render,
+                 ThreadPool* pool, VideoExportStats* stats)
+{
+    memset(stats, 0, sizeof(*stats));
+
+    Y4mWriter writer;
+    bool writing = path && path[0];
+    if (writing && !writer.Open(path, settings.width, settings.height, settings.fps, settings.raw))
+    {
+        return false;
+    }
+
+    // Everything is allocated here, the stages only pass pointers around.
+    // Each queue has room for every buffer and the end marker.
+    unsigned depth = settings.depth > 0 ? settings.depth : 1;
+    std::vector<ExportBuffer> buffers(depth);
+    ExportQueue recycled(depth + 1), rendered(depth + 1), converted(depth + 1);
+    for (unsigned i = 0; i < depth; i++)
+    {
+        buffers[i].image.Resize(settings.width, settings.height);
+        buffers[i].frame.resize(Y4mWriter::FrameHeaderSize + I420Size(settings.width, settings.height));
+        recycled.queue.TryPush(&buffers[i]);
+    }
+
+    std::atomic<bool> failed(false);
+    std::chrono::steady_clock::time_point wallStart = std::chrono::steady_clock::now();
+
+    std::thread convertThread([&]() {
+        unsigned width = settings.width, height = settings.height;
+        while (ExportBuffer* buffer = rendered.Pop())
+        {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            const unsigned* rgba = buffer->image.Pixels();
+            unsigned char* yuv = &buffer->frame[Y4mWriter::FrameHeaderSize];
+            if (pool && pool->ThreadCount() > 1)
+            {
+                // Bands of 32 row pairs
+                pool->ParallelFor((height + 1) / 2, 32, [=](size_t begin, size_t end) {
+                    unsigned rowEnd = (unsigned)end * 2;
+                    RgbaToI420Rows(rgba, width, height, (unsigned)begin * 2, rowEnd < height ? rowEnd : height, yuv);
+                });
+            }
+            else
+            {
+                RgbaToI420(rgba, width, height, yuv);
+            }
+            stats->convert += MillisecondsSince(start);
+            converted.Push(buffer);
+        }
+        converted.Push(NULL);
+    });
+
+    std::thread writeThread([&]() {
+        while (ExportBuffer* buffer = converted.Pop())
+        {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            if (writing && !failed && !writer.WriteFrame(&buffer->frame[0]))
+            {
+                failed = true;
+            }
+            stats->write += MillisecondsSince(start);
+            recycled.Push(buffer);
+        }
+    });
+
+    // A failed write stops rendering, the frames in flight drain through
+    for (unsigned f = 0; f < settings.frames && !failed; f++)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        ExportBuffer* buffer = recycled.Pop();
+        stats->renderWait += MillisecondsSince(start);
+
+        start = std::chrono::steady_clock::now();
+        render(f, &buffer->image);
+        stats->render += MillisecondsSince(start);
+        stats->frames++;
+        rendered.Push(buffer);
+    }
+    rendered.Push(NULL);
+
+    convertThread.join();
+    writeThread.join();
+
+    bool closed = writer.Close();
+    stats->wall = MillisecondsSince(wallStart);
+    stats->bytes = writer.BytesWritten();
+    return !failed && closed;
+}
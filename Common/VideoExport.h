@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdio.h>
+#include <functional>
+
+class Image;
+class ThreadPool;
+
+// Uncompressed video: a YUV4MPEG2 stream of I420 frames, or with raw set
+// the bare frames back to back (a .yuv file, the size and rate are up to
+// whoever reads it)
+class Y4mWriter
+{
+public:
+    // Every frame buffer starts with this much room for the frame header,
+    // so a frame goes out in one write
+    static const size_t FrameHeaderSize = 6;
+
+    Y4mWriter();
+    ~Y4mWriter();
+
+    bool Open(const char* path, unsigned width, unsigned height, unsigned fps, bool raw);
+
+    // frame is FrameHeaderSize bytes of room, then I420Size bytes of planes.
+    // The header is written into the room.
+    bool WriteFrame(unsigned char* frame);
+
+    // False if any write failed
+    bool Close();
+
+    unsigned long long BytesWritten() const { return _bytes; }
+
+private:
+    FILE* _file;
+    size_t _frameBytes;
+    bool _raw;
+    bool _failed;
+    unsigned long long _bytes;
+
+    Y4mWriter(const Y4mWriter&);
+    Y4mWriter& operator=(const Y4mWriter&);
+};
+
+struct VideoExportSettings
+{
+    unsigned width;
+    unsigned height;
+    unsigned frames;
+    unsigned fps;
+    unsigned depth;             // frames in flight, at least 1
+    bool raw;                   // see Y4mWriter
+};
+
+// Milliseconds summed over all frames unless noted
+struct VideoExportStats
+{
+    unsigned frames;
+    double wall;
+    double render;
+    double convert;
+    double write;
+    double renderWait;          // rendering waited for a buffer to come back
+    unsigned long long bytes;
+};
+
+// Draws frame into image. The image is width x height and holds an older
+// frame, buffers go round, so everything has to be drawn again.
+typedef std::function<void(unsigned frame, Image* image)> ExportRenderFunction;
+
+// Renders on the calling thread while the frame before is converted to
+// I420 on a second thread and the one before that written on a third.
+// settings.depth buffers go round through bounded queues between the
+// stages and are never copied; rendering waits when all of them are in
+// use. path NULL or empty converts and drops the frames. pool, if not
+// NULL, converts each frame in bands.
+bool ExportVideo(const char* path, const VideoExportSettings& settings, const ExportRenderFunction& render,
+                 ThreadPool* pool, VideoExportStats* stats);
@@ -0,0 +1,942 @@
+// Renders the sample scenes to image files on the CPU, without a window or
+// a graphics device, so they can run on machines with neither.
+//
+//   Headless --scene all --jobs 1000 --threads 0 --no-output
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "../Common/CommandBuffer.h"
+#include "../Common/DirtyRegion.h"
+#include "../Common/FrameArena.h"
+#include "../Common/FrameCapture.h"
+#include "../Common/LineRaster.h"
+#include "../Common/PointCloudWriter.h"
+#include "../Common/Scenes.h"
+#include "../Common/SoftwareRaster.h"
+#include "../Common/Telemetry.h"
+#include "../Common/ThreadPool.h"
+#include "../Common/VideoExport.h"
+
+// Counts every heap allocation in the process, so the reports can show
+// what a job or a replayed frame costs the allocator
+static std::atomic<unsigned long long> s_allocations(0);
+
+void* operator new(size_t bytes)
+{
+    s_allocations++;
+    void* p = malloc(bytes ? bytes : 1);
+    if (!p)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new[](size_t bytes)
+{
+    return operator new(bytes);
+}
+
+void operator delete(void* p) throw()
+{
+    free(p);
+}
+
+void operator delete[](void* p) throw()
+{
+    free(p);
+}
+
+// What C++14 and later call when the size is known, so every delete goes
+// through the ones above
+void operator delete(void* p, size_t) throw()
+{
+    operator delete(p);
+}
+
+void operator delete[](void* p, size_t) throw()
+{
+    operator delete[](p);
+}
+
+enum SceneKind
+{
+    Scene_Sierpinski,
+    Scene_Transform,
+    Scene_Triangle,
+    SceneCount
+};
+
+static const char* SceneNames[SceneCount] = {"sierpinski", "transform", "triangle"};
+
+struct Options
+{
+    std::vector<SceneKind> scenes;
+    unsigned width;
+    unsigned height;
+    size_t iterations;
+    unsigned long long seed;
+    TransformParams transform;
+    std::string input;
+    unsigned threads;
+    unsigned jobs;
+    std::string output;
+    bool write;
+    bool antialias;
+    std::string replay;
+    unsigned repeat;
+    unsigned edits;
+    std::string exportPath;
+    unsigned frames;
+    unsigned fps;
+    unsigned buffers;
+    std::string pointsPath;
+    bool direct;
+};
+
+// Milliseconds spent in each stage of one job
+struct JobResult
+{
+    SceneKind scene;
+    double generate;
+    double raster;
+    double write;
+    size_t primitives;          // points or line segments or triangles drawn
+    bool ok;
+
+    // Sierpinski with --edits: points added one at a time, each redrawing
+    // only what it dirtied, against one full redraw at the end
+    double edit;
+    unsigned long long editPixels;
+    double fullRedraw;
+    bool editsMatch;
+};
+
+// What a job draws with. Jobs hand it back when they finish so later jobs
+// reuse the memory instead of allocating their own.
+struct JobScratch
+{
+    FrameArena arena;
+    CommandBuffer commands;
+    Image image;
+    Image reference;            // --edits, the full redraw
+    LineRasterizer lines;       // --antialias
+};
+
+class ScratchPool
+{
+public:
+    ScratchPool() {}
+
+    ~ScratchPool()
+    {
+        for (size_t i = 0; i < _free.size(); i++)
+        {
+            delete _free[i];
+        }
+    }
+
+    JobScratch* Acquire()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_free.empty())
+        {
+            return new JobScratch;
+        }
+        JobScratch* scratch = _free.back();
+        _free.pop_back();
+        return scratch;
+    }
+
+    void Release(JobScratch* scratch)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _free.push_back(scratch);
+    }
+
+private:
+    std::mutex _mutex;
+    std::vector<JobScratch*> _free;
+
+    ScratchPool(const ScratchPool&);
+    ScratchPool& operator=(const ScratchPool&);
+};
+
+// Publishes the counters for as long as main runs
+class TelemetryScope
+{
+public:
+    TelemetryScope() { Telemetry::Publish("Headless"); }
+    ~TelemetryScope() { Telemetry::Unpublish(); }
+};
+
+static double MillisecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void PrintUsage()
+{
+    printf("usage: Headless [options]\n"
+           "  --scene NAME        sierpinski, transform, triangle or all (default all)\n"
+           "  --width N           image width (default 800)\n"
+           "  --height N          image height (default 600)\n"
+           "  --iterations N      chaos game points (default 65536)\n"
+           "  --seed N            random seed, job i uses seed + i (default 1)\n"
+           "  --rotate DEGREES    Transform rotation about the drawing's center\n"
+           "  --scale S           Transform scale about the drawing's center\n"
+           "  --translate X,Y     Transform offset in window units\n"
+           "  --input PATH        polyline file for Transform (default ../Transform/dino.dat)\n"
+           "  --threads N         total threads, 0 for one per core (default 0)\n"
+           "  --jobs N            number of renders, cycling through the scenes (default 1)\n"
+           "  --output PREFIX     files are PREFIX_<scene>_<job>.ppm (default headless)\n"
+           "  --no-output         render but don't write files\n"
+           "  --antialias         draw lines antialiased like Direct2D instead of aliased\n"
+           "  --replay PATH       replay a capture from an app's --capture instead\n"
+           "  --repeat N          passes over the capture (default 1)\n"
+           "  --edits N           Sierpinski adds N more points one at a time, redrawing only\n"
+           "                      what each dirtied, and compares that with a full redraw\n"
+           "  --export PATH       animate the first scene into a Y4M video, or raw I420 if\n"
+           "                      PATH ends in .yuv; with --no-output frames are dropped\n"
+           "  --frames N          frames to export (default 120)\n"
+           "  --fps N             frame rate of the export (default 30)\n"
+           "  --buffers N         frames in flight during the export, 1 runs the stages in turn\n"
+           "                      (default 3)\n"
+           "  --points PATH       write --iterations chaos game points with the corner each one\n"
+           "                      moved to, binary PLY if PATH ends in .ply, else SoA blocks; with\n"
+           "                      --no-output they are formatted and dropped\n"
+           "  --direct            write the points around the OS file cache\n");
+}
+
+static bool ParseOptions(int argc, char** argv, Options* options)
+{
+    options->width = 800;
+    options->height = 600;
+    options->iterations = 65536;
+    options->seed = 1;
+    options->transform.rotation = 0.0f;
+    options->transform.scale = 1.0f;
+    options->transform.translation = Float2(0.0f, 0.0f);
+    options->input = "../Transform/dino.dat";
+    options->threads = 0;
+    options->jobs = 1;
+    options->output = "headless";
+    options->write = true;
+    options->antialias = false;
+    options->repeat = 1;
+    options->edits = 0;
+    options->frames = 120;
+    options->fps = 30;
+    options->buffers = 3;
+    options->direct = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (strcmp(arg, "--no-output") == 0)
+        {
+            options->write = false;
+            continue;
+        }
+        if (strcmp(arg, "--antialias") == 0)
+        {
+            options->antialias = true;
+            continue;
+        }
+        if (strcmp(arg, "--direct") == 0)
+        {
+            options->direct = true;
+            continue;
+        }
+        if (strcmp(arg, "--help") == 0 || !value)
+        {
+            return false;
+        }
+
+        i++;
+        if (strcmp(arg, "--scene") == 0)
+        {
+            bool all = strcmp(value, "all") == 0;
+            bool found = all;
+            for (int s = 0; s < SceneCount; s++)
+            {
+                if (all || strcmp(value, SceneNames[s]) == 0)
+                {
+                    options->scenes.push_back((SceneKind)s);
+                    found = true;
+                }
+            }
+            if (!found)
+            {
+                fprintf(stderr, "unknown scene %s\n", value);
+                return false;
+            }
+        }
+        else if (strcmp(arg, "--width") == 0)
+        {
+            options->width = (unsigned)atoi(value);
+        }
+        else if (strcmp(arg, "--height") == 0)
+        {
+            options->height = (unsigned)atoi(value);
+        }
+        else if (strcmp(arg, "--iterations") == 0)
+        {
+            options->iterations = (size_t)strtoull(value, NULL, 10);
+        }
+        else if (strcmp(arg, "--seed") == 0)
+        {
+            options->seed = strtoull(value, NULL, 10);
+        }
+        else if (strcmp(arg, "--rotate") == 0)
+        {
+            options->transform.rotation = (float)atof(value);
+        }
+        else if (strcmp(arg, "--scale") == 0)
+        {
+            options->transform.scale = (float)atof(value);
+        }
+        else if (strcmp(arg, "--translate") == 0)
+        {
+            if (sscanf(value, "%f,%f", &options->transform.translation.x, &options->transform.translation.y) != 2)
+            {
+                return false;
+            }
+        }
+        else if (strcmp(arg, "--input") == 0)
+        {
+            options->input = value;
+        }
+        else if (strcmp(arg, "--threads") == 0)
+        {
+            options->threads = (unsigned)atoi(value);
+        }
+        else if (strcmp(arg, "--jobs") == 0)
+        {
+            options->jobs = (unsigned)atoi(value);
+        }
+        else if (strcmp(arg, "--output") == 0)
+        {
+            options->output = value;
+        }
+        else if (strcmp(arg, "--replay") == 0)
+        {
+            options->replay = value;
+        }
+        else if (strcmp(arg, "--repeat") == 0)
+        {
+            options->repeat = (unsigned)atoi(value);
+        }
+        else if (strcmp(arg, "--edits") == 0)
+        {
+            options->edits = (unsigned)atoi(value);
+        }
+        else if (strcmp(arg, "--export") == 0)
+        {
+            options->exportPath = value;
+        }
+        else if (strcmp(arg, "--frames") == 0)
+        {
+            options->frames = (unsigned)atoi(value);
+        }
+        else if (strcmp(arg, "--fps") == 0)
+        {
+            options->fps = (unsigned)atoi(value);
+        }
+        else if (strcmp(arg, "--buffers") == 0)
+        {
+            options->buffers = (unsigned)atoi(value);
+        }
+        else if (strcmp(arg, "--points") == 0)
+        {
+            options->pointsPath = value;
+        }
+        else
+        {
+            fprintf(stderr, "unknown option %s\n", arg);
+            return false;
+        }
+    }
+
+    if (options->scenes.empty())
+    {
+        for (int s = 0; s < SceneCount; s++)
+        {
+            options->scenes.push_back((SceneKind)s);
+        }
+    }
+    return options->width > 0 && options->height > 0 && options->jobs > 0 && options->repeat > 0 &&
+           options->frames > 0 && options->fps > 0 && options->buffers > 0;
+}
+
+// Adds the points after the first iterations one at a time, each frame
+// redrawing only the cross the new point adds, then checks the result
+// against drawing all of them at once
+static void RunEdits(const Options& options, const SierpinskiParams& params, const Float2* points,
+                     ThreadPool* pool, JobScratch* scratch, JobResult* result)
+{
+    DirtyRegion region;
+    region.SetSize((int)options.width, (int)options.height);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (unsigned e = 0; e < options.edits; e++)
+    {
+        size_t count = options.iterations + e + 1;
+        region.Clear();
+        region.Add(BoundsOf(points[count - 1], points[count - 1], 2.0f));
+        result->editPixels += region.Area();
+
+        scratch->commands.Reset();
+        RecordSierpinski(params, points, count, region, &scratch->commands);
+        SoftwareCommandBackend backend(&scratch->image);
+        backend.SetAntialiasing(options.antialias ? &scratch->lines : NULL, pool);
+        scratch->commands.Replay(&backend);
+    }
+    result->edit = MillisecondsSince(start) / options.edits;
+    result->editPixels /= options.edits;
+
+    Image& reference = scratch->reference;
+    if (reference.Width() != options.width || reference.Height() != options.height)
+    {
+        reference.Resize(options.width, options.height);
+    }
+
+    start = std::chrono::steady_clock::now();
+    scratch->commands.Reset();
+    RecordSierpinski(params, points, options.iterations + options.edits, &scratch->commands);
+    SoftwareCommandBackend backend(&reference, &scratch->arena);
+    backend.SetAntialiasing(options.antialias ? &scratch->lines : NULL, pool);
+    scratch->commands.Replay(&backend);
+    result->fullRedraw = MillisecondsSince(start);
+
+    result->editsMatch = memcmp(reference.Pixels(), scratch->image.Pixels(),
+                                (size_t)options.width * options.height * sizeof(unsigned)) == 0;
+    result->ok &= result->editsMatch;
+}
+
+static void RunJob(const Options& options, const Polylines& dino, ThreadPool* pool, ScratchPool* scratchPool,
+                   unsigned job, JobResult* result)
+{
+    result->scene = options.scenes[job % options.scenes.size()];
+    result->generate = 0.0;
+    result->raster = 0.0;
+    result->write = 0.0;
+    result->primitives = 0;
+    result->ok = true;
+    result->edit = 0.0;
+    result->editPixels = 0;
+    result->fullRedraw = 0.0;
+    result->editsMatch = true;
+
+    JobScratch* scratch = scratchPool->Acquire();
+    scratch->arena.Reset();
+    scratch->commands.Reset();
+    Image& image = scratch->image;
+    if (image.Width() != options.width || image.Height() != options.height)
+    {
+        image.Resize(options.width, options.height);
+    }
+    SoftwareCommandBackend backend(&image, &scratch->arena);
+    backend.SetAntialiasing(options.antialias ? &scratch->lines : NULL, pool);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    switch (result->scene)
+    {
+    case Scene_Sierpinski:
+        {
+            // The edits' points follow on from the first iterations, each
+            // chunk of the chaos game is the same however many there are
+            size_t total = options.iterations + options.edits;
+            SierpinskiParams params;
+            DefaultSierpinski(options.width, options.height, total, options.seed + job, &params);
+            Float2* points = scratch->arena.Allocate<Float2>(total);
+            if (!points)
+            {
+                result->ok = false;
+                break;
+            }
+            GenerateChaosPoints(params, points, pool);
+            result->generate = MillisecondsSince(start);
+
+            start = std::chrono::steady_clock::now();
+            RecordSierpinski(params, points, options.iterations, &scratch->commands);
+            scratch->commands.Replay(&backend);
+            result->raster = MillisecondsSince(start);
+            result->primitives = options.iterations;
+
+            if (options.edits > 0)
+            {
+                RunEdits(options, params, points, pool, scratch, result);
+            }
+        }
+        break;
+
+    case Scene_Transform:
+        {
+            Matrix3x2 m = TransformSceneMatrix(dino, options.transform, options.width, options.height);
+            result->generate = MillisecondsSince(start);
+
+            start = std::chrono::steady_clock::now();
+            RecordPolylines(dino, m, &scratch->commands);
+            scratch->commands.Replay(&backend);
+            result->raster = MillisecondsSince(start);
+            for (size_t i = 0; i < dino.size(); i++)
+            {
+                result->primitives += dino[i].size() > 1 ? dino[i].size() - 1 : 0;
+            }
+        }
+        break;
+
+    default:
+        RenderTriangle(&image);
+        result->raster = MillisecondsSince(start);
+        result->primitives = 1;
+        break;
+    }
+
+    if (options.write)
+    {
+        char path[512];
+        snprintf(path, sizeof(path), "%s_%s_%04u.ppm", options.output.c_str(), SceneNames[result->scene], job);
+
+        start = std::chrono::steady_clock::now();
+        bool written = image.WritePpm(path);
+        result->write = MillisecondsSince(start);
+        result->ok &= written;
+        if (!written)
+        {
+            fprintf(stderr, "could not write %s\n", path);
+        }
+    }
+
+    scratchPool->Release(scratch);
+    Telemetry::Add(Telemetry_Frames);
+}
+
+static double Percentile(std::vector<double> values, double p)
+{
+    if (values.empty())
+    {
+        return 0.0;
+    }
+    size_t i = (size_t)(p * (values.size() - 1) + 0.5);
+    std::nth_element(values.begin(), values.begin() + i, values.end());
+    return values[i];
+}
+
+// Replays every frame of a capture on the software backend as fast as it
+// can and reports how long each took
+static int ReplayCapture(const Options& options)
+{
+    FrameCaptureReader reader;
+    if (!reader.Open(options.replay.c_str()))
+    {
+        fprintf(stderr, "%s is not a capture\n", options.replay.c_str());
+        return 1;
+    }
+
+    // Read everything up front so disk time isn't counted
+    std::vector<CaptureRecord> frames;
+    std::vector<unsigned> eventsBefore;
+    unsigned events = 0;
+    CaptureRecord record;
+    while (reader.Next(&record))
+    {
+        if (record.type == CaptureRecord_Input)
+        {
+            events++;
+            continue;
+        }
+        frames.push_back(record);
+        eventsBefore.push_back(events);
+        events = 0;
+    }
+    if (reader.Failed())
+    {
+        fprintf(stderr, "%s is truncated or corrupt, replaying the %u frames before that\n",
+                options.replay.c_str(), (unsigned)frames.size());
+    }
+
+    CommandBuffer commands;
+    Image image;
+    std::vector<double> decode(frames.size()), raster(frames.size());
+    std::vector<unsigned> lines(frames.size());
+    std::vector<double> frameTimes;
+    bool ok = true;
+
+    FrameArena scratch;
+    LineRasterizer antialiased;
+    frameTimes.reserve(frames.size() * options.repeat);
+
+    // Allocations are counted over the last pass, after the first has
+    // grown the buffers to fit the biggest frame
+    unsigned long long allocations = 0;
+    std::chrono::steady_clock::time_point wallStart = std::chrono::steady_clock::now();
+    for (unsigned pass = 0; pass < options.repeat; pass++)
+    {
+        if (pass + 1 == options.repeat)
+        {
+            allocations = s_allocations;
+        }
+
+        for (size_t i = 0; i < frames.size(); i++)
+        {
+            const CaptureRecord& frame = frames[i];
+
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            if (!commands.Load(frame.commands.empty() ? NULL : &frame.commands[0], frame.commands.size()))
+            {
+                fprintf(stderr, "frame %u has malformed commands\n", frame.frame.index);
+                ok = false;
+            }
+            decode[i] = MillisecondsSince(start);
+            lines[i] = commands.Lines();
+
+            start = std::chrono::steady_clock::now();
+            if (image.Width() != frame.frame.width || image.Height() != frame.frame.height)
+            {
+                image.Resize(frame.frame.width, frame.frame.height);
+            }
+            scratch.Reset();
+            SoftwareCommandBackend backend(&image, &scratch);
+            backend.SetAntialiasing(options.antialias ? &antialiased : NULL, NULL);
+            commands.Replay(&backend);
+            raster[i] = MillisecondsSince(start);
+            frameTimes.push_back(decode[i] + raster[i]);
+            Telemetry::Add(Telemetry_Frames);
+
+            if (options.write && pass + 1 == options.repeat)
+            {
+                // Not counted, writing allocates
+                unsigned long long before = s_allocations;
+                char path[512];
+                snprintf(path, sizeof(path), "%s_replay_%04u.ppm", options.output.c_str(), frame.frame.index);
+                ok &= image.WritePpm(path);
+                allocations += s_allocations - before;
+            }
+        }
+    }
+    double wall = MillisecondsSince(wallStart);
+    allocations = s_allocations - allocations;
+
+    // Timings from the last pass, then the distribution over all of them
+    printf("%-8s %8s %8s %10s %12s %12s\n", "frame", "size", "events", "lines", "decode ms", "raster ms");
+    for (size_t i = 0; i < frames.size(); i++)
+    {
+        char size[32];
+        snprintf(size, sizeof(size), "%ux%u", frames[i].frame.width, frames[i].frame.height);
+        printf("%-8u %8s %8u %10u %12.3f %12.3f\n", frames[i].frame.index, size, eventsBefore[i], lines[i],
+               decode[i], raster[i]);
+    }
+
+    printf("%u frames x %u passes in %.1f ms, %.1f frames/s, frame ms p50 %.3f p95 %.3f p99 %.3f max %.3f\n",
+           (unsigned)frames.size(), options.repeat, wall, frameTimes.size() / (wall / 1000.0),
+           Percentile(frameTimes, 0.5), Percentile(frameTimes, 0.95), Percentile(frameTimes, 0.99),
+           Percentile(frameTimes, 1.0));
+    printf("last pass: %llu heap allocations, %.2f per frame\n", allocations,
+           frames.empty() ? 0.0 : (double)allocations / frames.size());
+
+    return ok && !reader.Failed() ? 0 : 1;
+}
+
+// Animates the first scene: Transform turns once and pulses in size, and
+// Sierpinski draws more of its points each frame until it has them all.
+// Rendering, conversion and writing overlap, see ExportVideo.
+static int ExportAnimation(const Options& options, const Polylines& dino, ThreadPool* pool)
+{
+    SceneKind scene = options.scenes[0];
+
+    VideoExportSettings settings;
+    settings.width = options.width;
+    settings.height = options.height;
+    settings.frames = options.frames;
+    settings.fps = options.fps;
+    settings.depth = options.buffers;
+    size_t length = options.exportPath.size();
+    settings.raw = length >= 4 && options.exportPath.compare(length - 4, 4, ".yuv") == 0;
+
+    SierpinskiParams params;
+    std::vector<Float2> points;
+    if (scene == Scene_Sierpinski)
+    {
+        DefaultSierpinski(options.width, options.height, options.iterations, options.seed, &params);
+        GenerateChaosPoints(params, &points, pool);
+    }
+
+    // Only the render stage draws, so one set of scratch does
+    CommandBuffer commands;
+    FrameArena arena;
+    LineRasterizer lines;
+    ExportRenderFunction render = [&](unsigned frame, Image* image) {
+        Telemetry::Add(Telemetry_Frames);
+        if (scene == Scene_Triangle)
+        {
+            RenderTriangle(image);
+            return;
+        }
+
+        commands.Reset();
+        if (scene == Scene_Sierpinski)
+        {
+            size_t count = (size_t)((unsigned long long)points.size() * (frame + 1) / options.frames);
+            RecordSierpinski(params, points.empty() ? NULL : &points[0], count, &commands);
+        }
+        else
+        {
+            float t = (float)frame / options.frames;
+            TransformParams transform = options.transform;
+            transform.rotation += 360.0f * t;
+            transform.scale *= 1.0f + 0.25f * sinf(6.2831853f * t);
+            RecordPolylines(dino, TransformSceneMatrix(dino, transform, image->Width(), image->Height()), &commands);
+        }
+
+        arena.Reset();
+        SoftwareCommandBackend backend(image, &arena);
+        backend.SetAntialiasing(options.antialias ? &lines : NULL, pool);
+        commands.Replay(&backend);
+    };
+
+    const char* path = options.write ? options.exportPath.c_str() : NULL;
+    VideoExportStats stats;
+    bool ok = ExportVideo(path, settings, render, pool, &stats);
+    if (!ok)
+    {
+        fprintf(stderr, "could not write %s\n", options.exportPath.c_str());
+    }
+
+    double frames = stats.frames > 0 ? stats.frames : 1;
+    double serial = (stats.render + stats.convert + stats.write) / frames;
+    printf("export %s: %u frames of %s, %ux%u, %u buffers, %u threads\n", path ? path : "(dropped)", stats.frames,
+           SceneNames[scene], options.width, options.height, settings.depth, pool->ThreadCount());
+    printf("%.1f frames/s, wall %.1f ms\n", stats.frames / (stats.wall / 1000.0), stats.wall);
+    printf("per frame: render %.3f ms, convert %.3f ms, write %.3f ms, render waited %.3f ms\n",
+           stats.render / frames, stats.convert / frames, stats.write / frames, stats.renderWait / frames);
+    printf("stage times added up: %.3f ms per frame, %.1f frames/s\n", serial, 1000.0 / serial);
+    if (path)
+    {
+        printf("%.1f MB written, %.1f MB/s\n", stats.bytes / 1e6, stats.bytes / 1e3 / stats.wall);
+    }
+    return ok ? 0 : 1;
+}
+
+// Streams the chaos game to a point cloud file. The pool generates a
+// million points at a time while the writer's thread writes the ones
+// before, see PointCloudWriter.
+static int ExportPoints(const Options& options, ThreadPool* pool)
+{
+    SierpinskiParams params;
+    DefaultSierpinski(options.width, options.height, options.iterations, options.seed, &params);
+
+    PointCloudSettings settings;
+    size_t length = options.pointsPath.size();
+    settings.format = length >= 4 && options.pointsPath.compare(length - 4, 4, ".ply") == 0 ? PointCloud_Ply
+                                                                                            : PointCloud_Blocks;
+    settings.bufferBytes = 8 << 20;
+    settings.buffers = 4;
+    settings.direct = options.direct;
+
+    const char* path = options.write ? options.pointsPath.c_str() : NULL;
+    PointCloudWriter writer;
+    if (!writer.Open(path, settings.format, params.iterations, params.corners, settings))
+    {
+        fprintf(stderr, "could not write %s\n", options.pointsPath.c_str());
+        return 1;
+    }
+
+    const size_t chunksPerBatch = 16;
+    std::vector<float> x(chunksPerBatch * ChaosChunkSize), y(x.size());
+    std::vector<unsigned char> corners(x.size());
+
+    double generate = 0.0, format = 0.0;
+    bool ok = true;
+    size_t chunks = ChaosChunkCount(params);
+    for (size_t chunk = 0; chunk < chunks && ok; chunk += chunksPerBatch)
+    {
+        size_t end = chunk + chunksPerBatch < chunks ? chunk + chunksPerBatch : chunks;
+        size_t last = end * ChaosChunkSize < params.iterations ? end * ChaosChunkSize : params.iterations;
+        size_t count = last - chunk * ChaosChunkSize;
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        GenerateChaosSamples(params, chunk, end, &x[0], &y[0], &corners[0], pool);
+        generate += MillisecondsSince(start);
+
+        start = std::chrono::steady_clock::now();
+        ok = writer.Write(&x[0], &y[0], &corners[0], count);
+        format += MillisecondsSince(start);
+    }
+    ok = writer.Close() && ok;
+    if (!ok)
+    {
+        fprintf(stderr, "could not write %s\n", options.pointsPath.c_str());
+    }
+
+    const PointCloudStats& stats = writer.Stats();
+    printf("points %s: %llu points as %s, %s, %u threads\n", path ? path : "(dropped)", stats.points,
+           settings.format == PointCloud_Ply ? "PLY" : "blocks",
+           !path ? "not written" : stats.direct ? "around the OS cache" : "through the OS cache", pool->ThreadCount());
+    printf("%.2f GB in %.1f ms, %.2f GB/s sustained\n", stats.bytes / 1e9, stats.wall, stats.bytes / 1e6 / stats.wall);
+    printf("generate %.1f ms, format %.1f ms, waited for the disk %.1f ms\n", generate, format - stats.wait,
+           stats.wait);
+    if (path)
+    {
+        printf("writer thread in write calls %.1f ms, %.2f GB/s while writing\n", stats.write,
+               stats.write > 0.0 ? stats.bytes / 1e6 / stats.write : 0.0);
+    }
+    return ok ? 0 : 1;
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!ParseOptions(argc, argv, &options))
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    // Watch a long run with TelemetryReader Headless
+    TelemetryScope telemetry;
+
+    if (!options.replay.empty())
+    {
+        return ReplayCapture(options);
+    }
+
+    // Only the chaos game, no need for dino.dat
+    if (!options.pointsPath.empty())
+    {
+        ThreadPool pool(options.threads);
+        return ExportPoints(options, &pool);
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    // Loaded once, every Transform job draws the same lines
+    Polylines dino;
+    bool needDino = false;
+    for (size_t i = 0; i < options.scenes.size(); i++)
+    {
+        needDino |= options.scenes[i] == Scene_Transform;
+    }
+    if (needDino)
+    {
+        std::ifstream file(options.input.c_str());
+        if (!file.good() || !ReadPolylines(file, &dino))
+        {
+            fprintf(stderr, "could not read %s\n", options.input.c_str());
+            return 1;
+        }
+    }
+    double load = MillisecondsSince(start);
+
+    ThreadPool pool(options.threads);
+    if (!options.exportPath.empty())
+    {
+        return ExportAnimation(options, dino, &pool);
+    }
+
+    ScratchPool scratchPool;
+    std::vector<JobResult> results(options.jobs);
+
+    // One task per job. The chaos game splits further with ParallelFor and
+    // idle workers steal those chunks.
+    unsigned long long allocations = s_allocations;
+    start = std::chrono::steady_clock::now();
+    for (unsigned job = 0; job < options.jobs; job++)
+    {
+        JobResult* result = &results[job];
+        pool.Submit([&options, &dino, &pool, &scratchPool, job, result]() {
+            RunJob(options, dino, &pool, &scratchPool, job, result);
+        });
+    }
+    pool.Wait();
+    double wall = MillisecondsSince(start);
+    allocations = s_allocations - allocations;
+
+    //
+    // Report
+    //
+
+    printf("%u jobs, %ux%u, %u threads, load %.2f ms\n", options.jobs, options.width, options.height,
+           pool.ThreadCount(), load);
+    printf("%-12s %6s %14s %14s %14s %16s\n", "scene", "jobs", "generate ms", "raster ms", "write ms", "primitives/s");
+
+    bool ok = true;
+    size_t totalPrimitives = 0;
+    for (int s = 0; s < SceneCount; s++)
+    {
+        unsigned count = 0;
+        double generate = 0.0, raster = 0.0, write = 0.0;
+        size_t primitives = 0;
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            if (results[i].scene != s)
+            {
+                continue;
+            }
+            count++;
+            generate += results[i].generate;
+            raster += results[i].raster;
+            write += results[i].write;
+            primitives += results[i].primitives;
+            ok &= results[i].ok;
+        }
+        if (count == 0)
+        {
+            continue;
+        }
+
+        // Means per job, throughput over the time spent generating and drawing
+        double busy = (generate + raster) / 1000.0;
+        printf("%-12s %6u %14.3f %14.3f %14.3f %16.0f\n", SceneNames[s], count,
+               generate / count, raster / count, write / count, busy > 0.0 ? primitives / busy : 0.0);
+        totalPrimitives += primitives;
+    }
+
+    double pixels = (double)options.width * options.height * options.jobs;
+    printf("wall %.1f ms, %.1f jobs/s, %.1f Mpixel/s, %.1f Mprimitive/s, %llu steals\n", wall,
+           options.jobs / (wall / 1000.0), pixels / (wall * 1000.0), totalPrimitives / (wall * 1000.0),
+           pool.Steals());
+    printf("%llu heap allocations, %.2f per job\n", allocations, (double)allocations / options.jobs);
+
+    if (options.edits > 0)
+    {
+        unsigned count = 0, matches = 0;
+        double edit = 0.0, fullRedraw = 0.0;
+        unsigned long long editPixels = 0;
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            if (results[i].scene == Scene_Sierpinski)
+            {
+                count++;
+                matches += results[i].editsMatch;
+                edit += results[i].edit;
+                editPixels += results[i].editPixels;
+                fullRedraw += results[i].fullRedraw;
+            }
+        }
+        if (count > 0)
+        {
+            printf("sierpinski edits: %.4f ms and %llu pixels touched each, full redraw %.3f ms and %u pixels, "
+                   "%u of %u jobs match the full redraw\n",
+                   edit / count, editPixels / count, fullRedraw / count, options.width * options.height, matches,
+                   count);
+        }
+    }
+
+    return ok ? 0 : 1;
+}
@@ -25,6 +25,7 @@
 #include <memory.h>
 #include <wchar.h>
 #include <math.h>
+#include <stdio.h>
 
 #include <d2d1.h>
 #include <d2d1helper.h>
@@ -32,8 +33,19 @@
 #include <wincodec.h>
 #include <vector>
 
+#include "../Common/D2DCommandBackend.h"
+#include "../Common/DirtyRegion.h"
+#include "../Common/FrameCapture.h"
+#include "../Common/FrameScheduler.h"
+#include "../Common/Profiler.h"
+#include "../Common/Telemetry.h"
+
 using std::vector;
 
+// Colors of the recorded commands
+static const unsigned White = PackRgba(255, 255, 255);
+static const unsigned DarkGreen = PackRgba(0, 100, 0);
+
 // define the screen resolution
 #define SCREEN_WIDTH  800
 #define SCREEN_HEIGHT 600
@@ -75,6 +87,9 @@ public:
     // Process and dispatch messages
     void RunMessageLoop();
 
+    // Log input and frames to path until the app exits
+    bool StartCapture(const char* path) { return _capture.Open(path); }
+
 private:
 	vector<D2D1_POINT_2F> _points;
 	HWND _hwnd;
@@ -83,6 +98,13 @@ private:
 	ID2D1SolidColorBrush* _pPointBrush;
 	ID2D1SolidColorBrush* _pLineBrush;
 	int _numChaoticPoints;
+	CommandBuffer _commands;
+	FrameCaptureWriter _capture;
+	FrameScheduler _scheduler;
+	DirtyRegion _dirty;
+	vector<D2D1_POINT_2F> _chaos;	// kept so a partial redraw matches what's around it
+	bool _chaosValid;
+	unsigned long long _pixelsTouched;
 
     // Initialize device-independent resources.
     HRESULT CreateDeviceIndependentResources();
@@ -96,6 +118,16 @@ private:
     // Draw content.
     HRESULT OnRender();
 
+    // Mark part of the window for redrawing and ask the scheduler for a frame.
+    void Invalidate(const PixelRect& rect);
+    void InvalidateAll();
+
+    // Where the chaos game and the points it starts from are drawn.
+    PixelRect ChaosBounds() const;
+
+    // Play the chaos game again if the points or the count changed.
+    void UpdateChaos();
+
     // Resize the render target.
     void OnResize(UINT width, UINT height);
 
@@ -103,7 +135,7 @@ private:
     static LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam);
 
 	// Convenience method for drawing points
-	void DrawPoint(D2D1_POINT_2F center, ID2D1SolidColorBrush* brush, int offset);
+	void DrawPoint(D2D1_POINT_2F center, unsigned color, int offset);
 
 	void OnLButtonUp(int pixelX, int pixelY, DWORD flags);
 
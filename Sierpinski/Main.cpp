@@ -11,7 +11,7 @@
 int WINAPI WinMain(
     HINSTANCE /* hInstance */,
     HINSTANCE /* hPrevInstance */,
-    LPSTR /* lpCmdLine */,
+    LPSTR lpCmdLine,
     int /* nCmdShow */
     )
 {
@@ -27,12 +27,29 @@ int WINAPI WinMain(
         {
             BasicApp app;
 
+            Profiler::SetThreadName("Main");
+
+            // Counters for an outside reader, see TelemetryReader
+            Telemetry::Publish("Sierpinski");
+
+            // --capture PATH records input and frames for Headless --replay
+            std::string capturePath;
+            if (FindCaptureArgument(lpCmdLine, &capturePath) && !app.StartCapture(capturePath.c_str()))
+            {
+                OutputDebugStringA("Could not open the capture file\n");
+            }
+
             if (SUCCEEDED(app.Initialize()))
             {
                 app.RunMessageLoop();
             }
         }
         CoUninitialize();
+
+        // Where the frame time went, open the trace in chrome://tracing
+        Profiler::WriteChromeTrace("Sierpinski.trace.json");
+        Telemetry::Unpublish();
+        OutputDebugStringA(Profiler::Report().c_str());
     }
 
     return 0;
@@ -45,8 +62,12 @@ BasicApp::BasicApp() :
     _pRenderTarget(NULL),
     _pPointBrush(NULL),
     _pLineBrush(NULL),
-	_numChaoticPoints(256)
+	_numChaoticPoints(256),
+	_chaosValid(false),
+	_pixelsTouched(0)
 {
+	// The three corners and the seed, so clicks never reallocate
+	_points.reserve(4);
 }
 
 // DemoApp destructor
@@ -64,6 +85,8 @@ BasicApp::~BasicApp()
 // resources.
 HRESULT BasicApp::Initialize()
 {
+    PROFILE_ZONE("Initialize");
+
     HRESULT hr;
 
     // Initialize device-indpendent resources, such
@@ -141,6 +164,8 @@ HRESULT BasicApp::CreateDeviceIndependentResources()
 // changes, the window is remoted, etc.
 HRESULT BasicApp::CreateDeviceResources()
 {
+    PROFILE_ZONE("CreateDeviceResources");
+
     HRESULT hr = S_OK;
 
     if (!_pRenderTarget)
@@ -154,11 +179,14 @@ HRESULT BasicApp::CreateDeviceResources()
             );
 
         // Create a Direct2D render target.
+        // Retain the contents between frames, only the dirty parts
+        // are redrawn.
         hr = _pDirect2dFactory->CreateHwndRenderTarget(
             D2D1::RenderTargetProperties(),
-            D2D1::HwndRenderTargetProperties(_hwnd, size),
+            D2D1::HwndRenderTargetProperties(_hwnd, size, D2D1_PRESENT_OPTIONS_RETAIN_CONTENTS),
             &_pRenderTarget
             );
+        _dirty.SetSize(size.width, size.height);
 
 
         if (SUCCEEDED(hr))
@@ -191,29 +219,132 @@ void BasicApp::DiscardDeviceResources()
     SafeRelease(&_pLineBrush);
 }
 
-// Runs the main window message loop.
+// Runs the main window message loop. Messages only mark the scene dirty;
+// the scheduler decides when to draw, so a burst of input costs one frame
+// and an idle window sleeps in MsgWaitForMultipleObjects.
 void BasicApp::RunMessageLoop()
 {
+    HANDLE timer = CreateWaitableTimer(NULL, TRUE, NULL);
     MSG msg;
+    bool running = true;
+
+    while (running)
+    {
+        unsigned long long now = FrameScheduler::Now();
+        unsigned long long wait = _scheduler.NextWait(now);
+        if (wait == 0)
+        {
+            _scheduler.BeginFrame(now);
+            OnRender();
+            _scheduler.EndFrame(FrameScheduler::Now());
+            continue;
+        }
+
+        // Sleep until input arrives or the next frame is due
+        DWORD handles = 0;
+        if (wait != FrameScheduler::WaitForever && timer)
+        {
+            LARGE_INTEGER due;
+            due.QuadPart = -(LONGLONG)(wait * 10);  // relative, in 100 ns units
+            SetWaitableTimer(timer, &due, 0, NULL, NULL, FALSE);
+            handles = 1;
+        }
+        MsgWaitForMultipleObjects(handles, &timer, FALSE, INFINITE, QS_ALLINPUT);
+
+        while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE))
+        {
+            if (msg.message == WM_QUIT)
+            {
+                running = false;
+                break;
+            }
+            TranslateMessage(&msg);
+            DispatchMessage(&msg);
+        }
+    }
+
+    if (timer)
+    {
+        CloseHandle(timer);
+    }
+
+    FrameLatencyStats stats = _scheduler.Stats();
+    char line[256];
+    snprintf(line, sizeof(line), "%llu frames for %llu invalidations (%llu coalesced), latency ms p50 %.2f p95 %.2f p99 %.2f max %.2f\n",
+             stats.frames, stats.invalidations, stats.coalesced, stats.p50, stats.p95, stats.p99, stats.max);
+    OutputDebugStringA(line);
+
+    snprintf(line, sizeof(line), "%llu pixels redrawn, %.0f per frame\n", _pixelsTouched,
+             stats.frames ? (double)_pixelsTouched / stats.frames : 0.0);
+    OutputDebugStringA(line);
+}
+
+void BasicApp::Invalidate(const PixelRect& rect)
+{
+    _dirty.Add(rect);
+    _scheduler.Invalidate(FrameScheduler::Now());
+}
+
+void BasicApp::InvalidateAll()
+{
+    _dirty.AddAll();
+    _scheduler.Invalidate(FrameScheduler::Now());
+}
 
-    while (GetMessage(&msg, NULL, 0, 0))
+PixelRect BasicApp::ChaosBounds() const
+{
+    // Every midpoint lies between the points it came from
+    if (_points.empty())
     {
-        TranslateMessage(&msg);
-        DispatchMessage(&msg);
+        return MakePixelRect(0, 0, 0, 0);
     }
+    Float2 lo = FromD2D(_points[0]), hi = lo;
+    for (size_t i = 1; i < _points.size(); i++)
+    {
+        lo.x = _points[i].x < lo.x ? _points[i].x : lo.x;
+        lo.y = _points[i].y < lo.y ? _points[i].y : lo.y;
+        hi.x = _points[i].x > hi.x ? _points[i].x : hi.x;
+        hi.y = _points[i].y > hi.y ? _points[i].y : hi.y;
+    }
+    return BoundsOf(lo, hi, 4.0f);
 }
 
-void BasicApp::DrawPoint(D2D1_POINT_2F center, ID2D1SolidColorBrush* brush, int offset){
-	_pRenderTarget->DrawLine(
-            D2D1::Point2F(center.x-offset, center.y),
-            D2D1::Point2F(center.x+offset, center.y),
-            brush,
-            1.0f);
-	_pRenderTarget->DrawLine(
-            D2D1::Point2F(center.x, center.y-offset),
-            D2D1::Point2F(center.x, center.y+offset),
-            brush,
-            1.0f);
+void BasicApp::UpdateChaos()
+{
+    if (_chaosValid)
+    {
+        return;
+    }
+
+    _chaos.clear();
+    if (_points.size() == 4)
+    {
+        PROFILE_ZONE("ChaosGame");
+        _chaos.reserve(_numChaoticPoints);
+        auto seedPoint = _points[3];
+        for (int i = 0; i < _numChaoticPoints; i++) {
+            // choose a random vertex of the triangle
+            auto chosenVertex = _points[rand() % 3];
+            // The midpoint of the random vertex and the seedpoint
+            // becomes the seedpoint for the next iteration
+            auto midpoint = CalculateMidpoint(chosenVertex, seedPoint);
+            _chaos.push_back(midpoint);
+            seedPoint = midpoint;
+        }
+        Telemetry::Add(Telemetry_ChaosIterations, _numChaoticPoints);
+    }
+    _chaosValid = true;
+}
+
+// True if the cross DrawPoint draws at center may touch rect
+static bool CrossTouches(const PixelRect& rect, D2D1_POINT_2F center, int offset)
+{
+    return center.x + offset + 1 >= rect.left && center.x - offset - 1 <= rect.right &&
+           center.y + offset + 1 >= rect.top && center.y - offset - 1 <= rect.bottom;
+}
+
+void BasicApp::DrawPoint(D2D1_POINT_2F center, unsigned color, int offset){
+	_commands.DrawCross(FromD2D(center), (float)offset, color);
 }
 
 D2D1_POINT_2F BasicApp::CalculateMidpoint(D2D1_POINT_2F first, D2D1_POINT_2F second){
@@ -225,42 +356,62 @@ D2D1_POINT_2F BasicApp::CalculateMidpoint(D2D1_POINT_2F first, D2D1_POINT_2F sec
 // recreates the resources the next time it's invoked.
 HRESULT BasicApp::OnRender()
 {
+    PROFILE_ZONE("OnRender");
+
     HRESULT hr = S_OK;
 
     hr = CreateDeviceResources();
 
-    if (SUCCEEDED(hr))
+    if (SUCCEEDED(hr) && !_dirty.IsEmpty())
     {
-        _pRenderTarget->BeginDraw();
-
-        _pRenderTarget->SetTransform(D2D1::Matrix3x2F::Identity());
-
-        _pRenderTarget->Clear(D2D1::ColorF(D2D1::ColorF::White));
-
-        D2D1_SIZE_F rtSize = _pRenderTarget->GetSize();
-
-		for(int i = 0; i < _points.size(); i++){
-			DrawPoint(_points[i], _pPointBrush, 4);
-		}
-		if(_points.size() == 4){
-			auto seedPoint = _points[3];
-			for (int i = 0; i < _numChaoticPoints; i++) {
-				// choose a random vertex of the triangle
-				auto chosenVertex = _points[rand() % 3];
-				// Draw the midpoint of the random vertex and the seedpoint
-				// Then make that midpoint the seedpoint for the next iteration
-				auto midpoint = CalculateMidpoint(chosenVertex, seedPoint);
-				DrawPoint(midpoint, _pPointBrush, 2);
-				seedPoint = midpoint;
+        UpdateChaos();
+
+        // Record the dirty parts of the frame, then replay them on the
+        // render target; the rest is still there from earlier frames
+        _commands.Reset();
+        _commands.SetTransform(Matrix3x2::Identity());
+
+		for (size_t r = 0; r < _dirty.Count(); r++) {
+			const PixelRect& rect = _dirty.Rect(r);
+			_commands.SetClip(rect);
+			_commands.Clear(White);
+
+			for(int i = 0; i < _points.size(); i++){
+				if (CrossTouches(rect, _points[i], 4)) {
+					DrawPoint(_points[i], DarkGreen, 4);
+				}
+			}
+			for(int i = 0; i < _chaos.size(); i++){
+				if (CrossTouches(rect, _chaos[i], 2)) {
+					DrawPoint(_chaos[i], DarkGreen, 2);
+				}
 			}
 		}
+        _pixelsTouched += _dirty.Area();
+        Telemetry::Add(Telemetry_Frames);
+        Telemetry::Add(Telemetry_Vertices, 2 * _commands.Lines());
+        Telemetry::Add(Telemetry_PixelsRedrawn, _dirty.Area());
+        _dirty.Clear();
+
+        D2D1_SIZE_U size = _pRenderTarget->GetPixelSize();
+        _capture.Frame(size.width, size.height, _commands);
+
+        _pRenderTarget->BeginDraw();
+        {
+            PROFILE_ZONE("Replay");
+            D2DCommandBackend backend(_pRenderTarget, _pPointBrush);
+            _commands.Replay(&backend);
+        }
+        PROFILE_ZONE("EndDraw");
         hr = _pRenderTarget->EndDraw();
     }
 
     if (hr == D2DERR_RECREATE_TARGET)
     {
+        // The new target starts empty
         hr = S_OK;
         DiscardDeviceResources();
+        InvalidateAll();
     }
 
     return hr;
@@ -277,21 +428,33 @@ void BasicApp::OnResize(UINT width, UINT height)
         // the next time EndDraw is called.
         _pRenderTarget->Resize(D2D1::SizeU(width, height));
     }
+    _dirty.SetSize(width, height);
 }
 
 void BasicApp::OnLButtonUp(int pixelX, int pixelY, DWORD flags)
 {
+    _capture.Input(InputEvent_LButtonUp, pixelX, pixelY, 0);
     //const float dipX = DPIScale::PixelsToDipsX(pixelX);
     //const float dipY = DPIScale::PixelsToDipsY(pixelY);
 	if (_points.size() < 4) {
 		_points.push_back(D2D1::Point2F(pixelX, pixelY));
+		_chaosValid = false;
+
+		// A corner only adds its cross, the seed starts the chaos game
+		if (_points.size() < 4) {
+			Invalidate(BoundsOf(FromD2D(_points.back()), FromD2D(_points.back()), 4.0f));
+		} else {
+			Invalidate(ChaosBounds());
+		}
 	}
-    InvalidateRect(_hwnd, NULL, FALSE);
 }
 
 void BasicApp::OnKeyDown(UINT vkey)
 {
-	bool needRedraw = false;
+    _capture.Input(InputEvent_KeyDown, 0, 0, vkey);
+	// What was drawn before the change has to go too
+	PixelRect before = ChaosBounds();
+	bool changed = true;
     switch (vkey)
     {
 	case 78: // n
@@ -312,9 +475,14 @@ void BasicApp::OnKeyDown(UINT vkey)
 		break;
 
 	default:
+		changed = false;
 		break;
 	}
-	InvalidateRect(_hwnd, NULL, FALSE);
+	if (changed) {
+		_chaosValid = false;
+		Invalidate(before);
+		Invalidate(ChaosBounds());
+	}
 }
 
 
@@ -366,7 +534,11 @@ LRESULT CALLBACK BasicApp::WndProc(HWND hwnd, UINT message, WPARAM wParam, LPARA
 
             case WM_PAINT:
                 {
-                    pDemoApp->OnRender();
+                    RECT update;
+                    if (GetUpdateRect(hwnd, &update, FALSE))
+                    {
+                        pDemoApp->Invalidate(MakePixelRect(update.left, update.top, update.right, update.bottom));
+                    }
                     ValidateRect(hwnd, NULL);
                 }
                 result = 0;
@@ -0,0 +1,119 @@
+// Prints the telemetry counters another app publishes, as rates per
+// second. Only maps the app's shared memory, so it doesn't slow it down.
+//
+// On Linux: g++ -std=c++11 -O2 -I../Common Main.cpp ../Common/Telemetry.cpp ../Common/SharedMemory.cpp -o TelemetryReader -lrt
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include "../Common/Telemetry.h"
+
+struct Options
+{
+    std::string app;
+    unsigned interval;          // ms
+    unsigned samples;           // 0 for until the app exits
+};
+
+static void PrintUsage()
+{
+    printf("usage: TelemetryReader APP [options]\n"
+           "  APP                 Sierpinski, Transform, 2DTest or Headless\n"
+           "  --interval MS       time between samples (default 1000)\n"
+           "  --samples N         stop after N samples, 0 to run until the app exits (default 0)\n");
+}
+
+static bool ParseOptions(int argc, char** argv, Options* options)
+{
+    options->interval = 1000;
+    options->samples = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        if (arg[0] != '-')
+        {
+            options->app = arg;
+            continue;
+        }
+
+        const char* value = i + 1 < argc ? argv[++i] : NULL;
+        if (!value)
+        {
+            return false;
+        }
+        if (strcmp(arg, "--interval") == 0)
+        {
+            options->interval = (unsigned)atoi(value);
+        }
+        else if (strcmp(arg, "--samples") == 0)
+        {
+            options->samples = (unsigned)atoi(value);
+        }
+        else
+        {
+            fprintf(stderr, "unknown option %s\n", arg);
+            return false;
+        }
+    }
+    return !options->app.empty() && options->interval > 0;
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!ParseOptions(argc, argv, &options))
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    TelemetryReader reader;
+    if (!reader.Open(options.app.c_str()))
+    {
+        char name[128];
+        Telemetry::SegmentName(options.app.c_str(), name, sizeof(name));
+        fprintf(stderr, "%s isn't publishing telemetry (no %s)\n", options.app.c_str(), name);
+        return 1;
+    }
+
+    unsigned long long previous[TelemetryCounterCount], current[TelemetryCounterCount];
+    if (!reader.Read(previous))
+    {
+        fprintf(stderr, "%s stopped publishing\n", options.app.c_str());
+        return 1;
+    }
+    printf("%s, process %u\n", options.app.c_str(), reader.ProcessId());
+
+    std::chrono::steady_clock::time_point last = std::chrono::steady_clock::now();
+    for (unsigned sample = 1; options.samples == 0 || sample <= options.samples; sample++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(options.interval));
+
+        // The app unpublishes when it exits
+        if (!reader.Read(current))
+        {
+            printf("%s exited\n", options.app.c_str());
+            break;
+        }
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(now - last).count();
+        last = now;
+
+        printf("\nsample %u, %.3f s\n", sample, seconds);
+        printf("  %-18s %16s %20s\n", "counter", "per second", "total");
+        for (int i = 0; i < TelemetryCounterCount; i++)
+        {
+            printf("  %-18s %16.1f %20llu\n", Telemetry::Name((TelemetryCounter)i),
+                   (current[i] - previous[i]) / seconds, current[i]);
+            previous[i] = current[i];
+        }
+        fflush(stdout);
+    }
+
+    return 0;
+}
@@ -25,18 +25,33 @@
 #include <memory.h>
 #include <wchar.h>
 #include <math.h>
+#include <stdio.h>
 
 #include <d2d1.h>
 #include <d2d1helper.h>
 #include <dwrite.h>
 #include <wincodec.h>
 #include <vector>
-#include <fstream>
 
-using std::ifstream;
-using std::istream;
+#include "../Common/D2DCommandBackend.h"
+#include "../Common/DirtyRegion.h"
+#include "../Common/FrameCapture.h"
+#include "../Common/FrameScheduler.h"
+#include "../Common/PolylineLoader.h"
+#include "../Common/Profiler.h"
+#include "../Common/Telemetry.h"
+#include "../Common/ThreadPool.h"
+#include "../Common/VecMathInterop.h"
+
 using std::vector;
 
+// Colors of the recorded commands
+static const unsigned White = PackRgba(255, 255, 255);
+static const unsigned DarkGreen = PackRgba(0, 100, 0);
+
+// Posted by the loader's worker when there are polylines to take
+static const UINT WM_POLYLINES_READY = WM_APP + 1;
+
 // define the screen resolution
 #define SCREEN_WIDTH  800
 #define SCREEN_HEIGHT 600
@@ -78,8 +93,21 @@ public:
     // Process and dispatch messages
     void RunMessageLoop();
 
+    // Log input and frames to path until the app exits
+    bool StartCapture(const char* path) { return _capture.Open(path); }
+
 private:
-	vector<vector<D2D1_POINT_2F>> _dino;
+	// Polylines [first, end) of _dino, loaded together, and the pixels
+	// they touch
+	struct DinoBatch
+	{
+		size_t first;
+		size_t end;
+		PixelRect bounds;
+	};
+
+	Polylines _dino;
+	vector<DinoBatch> _dinoBatches;
 	D2D1_POINT_2F _center;
 	HWND _hwnd;
 	ID2D1Factory* _pDirect2dFactory;
@@ -88,6 +116,20 @@ private:
 	double scale;
 	double rotation;
 	D2D1_POINT_2F offset;
+	CommandBuffer _commands;
+	FrameCaptureWriter _capture;
+	FrameScheduler _scheduler;
+	DirtyRegion _dirty;
+	unsigned long long _pixelsTouched;
+
+	// Reads dino.dat while the window already draws what has arrived.
+	// Declared after the pool, so it is destroyed, and its worker
+	// stopped, first.
+	ThreadPool _pool;
+	PolylineLoader _loader;
+	PolylineLoadState _loadState;       // as OnPolylinesReady last saw it
+	unsigned long long _startTime;
+	unsigned long long _firstFrameTime;
 
 
     // Initialize device-independent resources.
@@ -102,6 +144,10 @@ private:
     // Draw content.
     HRESULT OnRender();
 
+    // Mark part of the window for redrawing and ask the scheduler for a frame.
+    void Invalidate(const PixelRect& rect);
+    void InvalidateAll();
+
     // Resize the render target.
     void OnResize(UINT width, UINT height);
 
@@ -109,7 +155,7 @@ private:
     static LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam);
 
 	// Convenience method for drawing points
-	void DrawPolyline(vector<D2D1_POINT_2F> strip, ID2D1SolidColorBrush* brush);
+	void DrawPolyline(const vector<Float2>& strip, unsigned color);
 
 	void OnLButtonUp(int pixelX, int pixelY, DWORD flags);
 
@@ -117,5 +163,6 @@ private:
 
 	D2D1_POINT_2F CalculateMidpoint(D2D1_POINT_2F first, D2D1_POINT_2F second);
 
-	void ReadInputFile(istream &in);
+	// Take what the loader has read and mark where it goes for drawing
+	void OnPolylinesReady();
 };
\ No newline at end of file
@@ -11,7 +11,7 @@
 int WINAPI WinMain(
     HINSTANCE /* hInstance */,
     HINSTANCE /* hPrevInstance */,
-    LPSTR /* lpCmdLine */,
+    LPSTR lpCmdLine,
     int /* nCmdShow */
     )
 {
@@ -27,12 +27,29 @@ int WINAPI WinMain(
         {
             BasicApp app;
 
+            Profiler::SetThreadName("Main");
+
+            // Counters for an outside reader, see TelemetryReader
+            Telemetry::Publish("Transform");
+
+            // --capture PATH records input and frames for Headless --replay
+            std::string capturePath;
+            if (FindCaptureArgument(lpCmdLine, &capturePath) && !app.StartCapture(capturePath.c_str()))
+            {
+                OutputDebugStringA("Could not open the capture file\n");
+            }
+
             if (SUCCEEDED(app.Initialize()))
             {
                 app.RunMessageLoop();
             }
         }
         CoUninitialize();
+
+        // Where the frame time went, open the trace in chrome://tracing
+        Profiler::WriteChromeTrace("Transform.trace.json");
+        Telemetry::Unpublish();
+        OutputDebugStringA(Profiler::Report().c_str());
     }
 
     return 0;
@@ -40,11 +57,17 @@ int WINAPI WinMain(
 
 // DemoApp constructor
 BasicApp::BasicApp() :
+    _center(D2D1::Point2F(0.0f, 0.0f)),
     _hwnd(NULL),
     _pDirect2dFactory(NULL),
     _pRenderTarget(NULL),
     _pPointBrush(NULL),
-	_numChaoticPoints(256)
+	_numChaoticPoints(256),
+	_pixelsTouched(0),
+	_pool(2),
+	_loadState(PolylineLoad_Loading),
+	_startTime(FrameScheduler::Now()),
+	_firstFrameTime(0)
 {
 }
 
@@ -61,6 +84,8 @@ BasicApp::~BasicApp()
 // resources.
 HRESULT BasicApp::Initialize()
 {
+    PROFILE_ZONE("Initialize");
+
     HRESULT hr;
 
     // Initialize device-indpendent resources, such
@@ -114,40 +139,60 @@ HRESULT BasicApp::Initialize()
             UpdateWindow(_hwnd);
         }
     }
-	ifstream relfile("dino.dat");
-	if (relfile.good()) {
-		ReadInputFile(relfile);
-		relfile.close();
-		InvalidateRect(_hwnd, NULL, FALSE);
-	}
-	else {
-		exit(1);
-	}
+
+    // Read dino.dat on the pool and draw its polylines as they arrive,
+    // flipped like the file expects. The window is up already, so the
+    // worker can post to it.
+    if (SUCCEEDED(hr))
+    {
+        HWND hwnd = _hwnd;
+        Matrix3x2 flip = {1.0f, 0.0f, 0.0f, -1.0f, 0.0f, 440.0f};
+        _loader.Start("dino.dat", flip, &_pool, [hwnd]() {
+            PostMessage(hwnd, WM_POLYLINES_READY, 0, 0);
+        });
+    }
     return hr;
 }
 
-void BasicApp::ReadInputFile(istream &in) {
-	float x, y;
-	int xAvg = 0, yAvg = 0, pointTotal = 0;
-	//  Read the total number of polylines
-	int numLines,numPoints;
-	in >> numLines;
-	//  Read in the points for each polyline
-	for (int i = 0; i < numLines; i++) {
-		in >> numPoints;
-		vector<D2D1_POINT_2F> line;
-		for (int j = 0; j < numPoints; j++) {
-			in >> x >> y;
-			line.push_back(D2D1::Point2F(x, 440 - y));
-			pointTotal++;
-			xAvg += x;
-			yAvg += y;
+void BasicApp::OnPolylinesReady()
+{
+	PROFILE_ZONE("OnPolylinesReady");
+
+	// The state first: once it says loading ended, every batch is there
+	// to take
+	PolylineLoadState state = _loader.State();
+
+	vector<PolylineBatch> batches;
+	_loader.Take(&batches);
+	for (size_t i = 0; i < batches.size(); i++) {
+		DinoBatch batch = {_dino.size(), _dino.size() + batches[i].lines.size(), batches[i].bounds};
+		_dino.resize(batch.end);
+		for (size_t j = 0; j < batches[i].lines.size(); j++) {
+			_dino[batch.first + j].swap(batches[i].lines[j]);
 		}
-		_dino.push_back(line);
+		_dinoBatches.push_back(batch);
+		Invalidate(batch.bounds);
+	}
+
+	// Messages posted for batches taken already find nothing new
+	if (state == _loadState) {
+		return;
+	}
+	_loadState = state;
+
+	_center = ToD2D(PolylineCenter(_dino));
+
+	PolylineLoadStats stats = _loader.Stats();
+	char line[256];
+	snprintf(line, sizeof(line), "dino.dat: %llu polylines, %llu points in %u batches, first after %.1f ms, all after %.1f ms\n",
+	         (unsigned long long)stats.lines, (unsigned long long)stats.points, stats.batches, stats.firstBatch, stats.total);
+	OutputDebugStringA(line);
+
+	// Keep the window and whatever was read rather than quitting
+	if (state == PolylineLoad_Failed) {
+		OutputDebugStringA(_dino.empty() ? "Could not read dino.dat\n" : "dino.dat ends early or is damaged\n");
+		SetWindowText(_hwnd, _dino.empty() ? L"2D Transform - could not read dino.dat" : L"2D Transform - dino.dat is damaged");
 	}
-	xAvg /= pointTotal;
-	yAvg /= pointTotal;
-	_center = D2D1::Point2F(xAvg, yAvg);
 }
 
 // Creates resources that are not bound to a particular device.
@@ -169,6 +214,8 @@ HRESULT BasicApp::CreateDeviceIndependentResources()
 // changes, the window is remoted, etc.
 HRESULT BasicApp::CreateDeviceResources()
 {
+    PROFILE_ZONE("CreateDeviceResources");
+
     HRESULT hr = S_OK;
 
     if (!_pRenderTarget)
@@ -184,9 +231,10 @@ HRESULT BasicApp::CreateDeviceResources()
         // Create a Direct2D render target.
         hr = _pDirect2dFactory->CreateHwndRenderTarget(
             D2D1::RenderTargetProperties(),
-            D2D1::HwndRenderTargetProperties(_hwnd, size),
+            D2D1::HwndRenderTargetProperties(_hwnd, size, D2D1_PRESENT_OPTIONS_RETAIN_CONTENTS),
             &_pRenderTarget
             );
+        _dirty.SetSize(size.width, size.height);
 
 
         if (SUCCEEDED(hr))
@@ -210,25 +258,81 @@ void BasicApp::DiscardDeviceResources()
     SafeRelease(&_pPointBrush);
 }
 
-// Runs the main window message loop.
+// Runs the main window message loop. Messages only mark the scene dirty;
+// the scheduler decides when to draw, so a burst of input costs one frame
+// and an idle window sleeps in MsgWaitForMultipleObjects.
 void BasicApp::RunMessageLoop()
 {
+    HANDLE timer = CreateWaitableTimer(NULL, TRUE, NULL);
     MSG msg;
+    bool running = true;
+
+    while (running)
+    {
+        unsigned long long now = FrameScheduler::Now();
+        unsigned long long wait = _scheduler.NextWait(now);
+        if (wait == 0)
+        {
+            _scheduler.BeginFrame(now);
+            OnRender();
+            _scheduler.EndFrame(FrameScheduler::Now());
+            continue;
+        }
+
+        // Sleep until input arrives or the next frame is due
+        DWORD handles = 0;
+        if (wait != FrameScheduler::WaitForever && timer)
+        {
+            LARGE_INTEGER due;
+            due.QuadPart = -(LONGLONG)(wait * 10);  // relative, in 100 ns units
+            SetWaitableTimer(timer, &due, 0, NULL, NULL, FALSE);
+            handles = 1;
+        }
+        MsgWaitForMultipleObjects(handles, &timer, FALSE, INFINITE, QS_ALLINPUT);
+
+        while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE))
+        {
+            if (msg.message == WM_QUIT)
+            {
+                running = false;
+                break;
+            }
+            TranslateMessage(&msg);
+            DispatchMessage(&msg);
+        }
+    }
 
-    while (GetMessage(&msg, NULL, 0, 0))
+    if (timer)
     {
-        TranslateMessage(&msg);
-        DispatchMessage(&msg);
+        CloseHandle(timer);
     }
+
+    FrameLatencyStats stats = _scheduler.Stats();
+    char line[256];
+    snprintf(line, sizeof(line), "%llu frames for %llu invalidations (%llu coalesced), latency ms p50 %.2f p95 %.2f p99 %.2f max %.2f\n",
+             stats.frames, stats.invalidations, stats.coalesced, stats.p50, stats.p95, stats.p99, stats.max);
+    OutputDebugStringA(line);
+
+    snprintf(line, sizeof(line), "%llu pixels redrawn, %.0f per frame\n", _pixelsTouched,
+             stats.frames ? (double)_pixelsTouched / stats.frames : 0.0);
+    OutputDebugStringA(line);
 }
 
-void BasicApp::DrawPolyline(vector<D2D1_POINT_2F> strip, ID2D1SolidColorBrush* brush){
+void BasicApp::Invalidate(const PixelRect& rect)
+{
+    _dirty.Add(rect);
+    _scheduler.Invalidate(FrameScheduler::Now());
+}
+
+void BasicApp::InvalidateAll()
+{
+    _dirty.AddAll();
+    _scheduler.Invalidate(FrameScheduler::Now());
+}
+
+void BasicApp::DrawPolyline(const vector<Float2>& strip, unsigned color){
 	for(int i = 0; i + 1 < strip.size(); i++){
-		_pRenderTarget->DrawLine(
-				strip[i],
-				strip[i+1],
-				brush,
-				1.0f);
+		_commands.DrawLine(strip[i], strip[i+1], color);
 	}
 }
 
@@ -241,32 +345,70 @@ D2D1_POINT_2F BasicApp::CalculateMidpoint(D2D1_POINT_2F first, D2D1_POINT_2F sec
 // recreates the resources the next time it's invoked.
 HRESULT BasicApp::OnRender()
 {
+    PROFILE_ZONE("OnRender");
+
     HRESULT hr = S_OK;
 
     hr = CreateDeviceResources();
 
-    if (SUCCEEDED(hr))
+    if (SUCCEEDED(hr) && !_dirty.IsEmpty())
     {
-        _pRenderTarget->BeginDraw();
-		auto identity = D2D1::Matrix3x2F::Identity();
-		auto flip = D2D1::Matrix3x2F::Rotation(180, _center);
-        _pRenderTarget->SetTransform(identity);
-
-
-        _pRenderTarget->Clear(D2D1::ColorF(D2D1::ColorF::White));
+		auto identity = Matrix3x2::Identity();
+		auto flip = Matrix3x2::Rotation(180, FromD2D(_center));
+
+        // Record the dirty parts of the frame, then replay them on the
+        // render target; the rest is still there from earlier frames
+        _commands.Reset();
+        _commands.SetTransform(identity);
+
+		for (size_t r = 0; r < _dirty.Count(); r++) {
+			PROFILE_ZONE("DrawPolylines");
+			_commands.SetClip(_dirty.Rect(r));
+			_commands.Clear(White);
+			for (size_t b = 0; b < _dinoBatches.size(); b++) {
+				const DinoBatch& batch = _dinoBatches[b];
+				if (!Intersects(batch.bounds, _dirty.Rect(r))) {
+					continue;
+				}
+				for (size_t i = batch.first; i < batch.end; i++) {
+					DrawPolyline(_dino[i], DarkGreen);
+				}
+			}
+		}
+        _pixelsTouched += _dirty.Area();
+        Telemetry::Add(Telemetry_Frames);
+        Telemetry::Add(Telemetry_Vertices, 2 * _commands.Lines());
+        Telemetry::Add(Telemetry_PixelsRedrawn, _dirty.Area());
+        _dirty.Clear();
 
-        D2D1_SIZE_F rtSize = _pRenderTarget->GetSize();
+        D2D1_SIZE_U size = _pRenderTarget->GetPixelSize();
+        _capture.Frame(size.width, size.height, _commands);
 
-		for (auto i = 0; i < _dino.size(); i++) {
-			DrawPolyline(_dino[i], _pPointBrush);
-		}
+        _pRenderTarget->BeginDraw();
+        {
+            PROFILE_ZONE("Replay");
+            D2DCommandBackend backend(_pRenderTarget, _pPointBrush);
+            _commands.Replay(&backend);
+        }
+        PROFILE_ZONE("EndDraw");
         hr = _pRenderTarget->EndDraw();
+
+        if (SUCCEEDED(hr) && _firstFrameTime == 0 && !_dino.empty())
+        {
+            _firstFrameTime = FrameScheduler::Now();
+            char line[128];
+            snprintf(line, sizeof(line), "First polylines on screen %.1f ms after start\n",
+                     (_firstFrameTime - _startTime) / 1000.0);
+            OutputDebugStringA(line);
+        }
     }
 
     if (hr == D2DERR_RECREATE_TARGET)
     {
+        // The new target starts empty
         hr = S_OK;
         DiscardDeviceResources();
+        InvalidateAll();
     }
 
     return hr;
@@ -283,17 +425,19 @@ void BasicApp::OnResize(UINT width, UINT height)
         // the next time EndDraw is called.
         _pRenderTarget->Resize(D2D1::SizeU(width, height));
     }
+    _dirty.SetSize(width, height);
 }
 
 void BasicApp::OnLButtonUp(int pixelX, int pixelY, DWORD flags)
 {
+    _capture.Input(InputEvent_LButtonUp, pixelX, pixelY, 0);
     //const float dipX = DPIScale::PixelsToDipsX(pixelX);
     //const float dipY = DPIScale::PixelsToDipsY(pixelY);
-    InvalidateRect(_hwnd, NULL, FALSE);
 }
 
 void BasicApp::OnKeyDown(UINT vkey)
 {
+    _capture.Input(InputEvent_KeyDown, 0, 0, vkey);
 	bool needRedraw = false;
     switch (vkey)
     {
@@ -310,7 +454,7 @@ void BasicApp::OnKeyDown(UINT vkey)
 	default:
 		break;
 	}
-	InvalidateRect(_hwnd, NULL, FALSE);
+	// Nothing on screen depends on the keys yet, so nothing to redraw
 }
 
 // Handles window messages.
@@ -351,6 +495,12 @@ LRESULT CALLBACK BasicApp::WndProc(HWND hwnd, UINT message, WPARAM wParam, LPARA
                 wasHandled = true;
                 break;
 
+            case WM_POLYLINES_READY:
+                pDemoApp->OnPolylinesReady();
+                result = 0;
+                wasHandled = true;
+                break;
+
             case WM_DISPLAYCHANGE:
                 {
                     InvalidateRect(hwnd, NULL, FALSE);
@@ -361,7 +511,11 @@ LRESULT CALLBACK BasicApp::WndProc(HWND hwnd, UINT message, WPARAM wParam, LPARA
 
             case WM_PAINT:
                 {
-                    pDemoApp->OnRender();
+                    RECT update;
+                    if (GetUpdateRect(hwnd, &update, FALSE))
+                    {
+                        pDemoApp->Invalidate(MakePixelRect(update.left, update.top, update.right, update.bottom));
+                    }
                     ValidateRect(hwnd, NULL);
                 }
                 result = 0;